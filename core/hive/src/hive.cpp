@@ -250,12 +250,22 @@ void hive_app::run(int rtype) {
 		return m_schedulor.startup(name, entry, incl);
 		});
 	hive.set_function("worker_call", [&](lua_State* L, vstring name) {
-		return m_schedulor.call(L, name);
+		return m_schedulor.call(L, name, "master");
 		});
+	hive.set_function("worker_recv", [&](lua_State* L) { return m_schedulor.recv(L); });
+	hive.set_function("worker_stats", [&](lua_State* L) { return m_schedulor.stats(L); });
+	hive.set_function("worker_budget", [&](uint32_t budget_ms, uint32_t batch_num) { m_schedulor.set_budget(budget_ms, batch_num); });
 	hive.set_function("worker_names", [&]() { return m_schedulor.workers(); });
 	//end worker接口
+
+	//帧耗时统计
+	hive.set_function("perf_begin", [&]() { m_perf.begin(); });
+	hive.set_function("perf_mark", [&](uint32_t phase) { m_perf.mark(phase); });
+	hive.set_function("perf_finish", [&]() { m_perf.finish(); });
+	hive.set_function("perf_stats", [&](lua_State* L, bool reset) { return m_perf.stats(L, reset); });
 	
 	init_default_log(rtype);
+	lworker::setup_placement("hive", true);
 	LOG_INFO(fmt::format("hive engine run.build in[{}] time:{} {}", compiler_info(), __DATE__, __TIME__));
 
 	lua.run_script(g_sandbox, [&](vstring err) {
@@ -35,6 +35,7 @@ private:
 	MAP_ENV m_environs;
 	MAP_ENV m_cmd_environs;
 	lworker::scheduler m_schedulor;
+	lworker::frame_perf m_perf;
 };
 
 extern hive_app* g_app;
@@ -12,18 +12,27 @@
 #include <iostream>
 #include <filesystem>
 #include <map>
+#include <algorithm>
 #include <condition_variable>
 #include <assert.h>
+#include <string.h>
+#include <fcntl.h>
+#include <limits.h>
 
 #include "fmt/core.h"
+#include "fmt/args.h"
 #include "thread_name.hpp"
 #include "lua_kit.h"
+#include "lcrypt/lz4.h"
 
 #ifdef WIN32
+#include <io.h>
 #include <process.h>
+#include <sys/stat.h>
 #define getpid _getpid
 #else
 #include <unistd.h>
+#include <sys/uio.h>
 #endif
 
 using namespace std::chrono;
@@ -52,8 +61,11 @@ namespace logger {
         DAYLY = 1,
     }; //rolling_type
 
-    const size_t QUEUE_MINI      = 10;
-    const size_t QUEUE_SIZE      = 300;
+    const size_t RING_SIZE       = 1024;    //单线程日志队列容量
+    const size_t RECORD_SIZE     = 512;     //单条日志记录大小
+    const size_t NOTIFY_SIZE     = 10;      //积压超过该值时唤醒写线程
+    const size_t BLOCK_SIZE      = 64*1024; //文件写缓冲块大小
+    const size_t MAX_BATCH_SIZE  = 4*1024*1024;//单文件缓冲超过该值立即写入
     const size_t MAX_LOG_SIZE    = 50*1024*1024;//50M
     const size_t CLEAN_TIME      = 7 * 24 * 3600;
 
@@ -91,121 +103,175 @@ namespace logger {
     class log_time : public ::tm {
     public:
         int tm_usec = 0;
+        time_t tm_epoch = 0;
 
         log_time() { }
-        log_time(const ::tm& tm, int usec) : ::tm(tm), tm_usec(usec) { }
+        log_time(const ::tm& tm, int usec, time_t epoch) : ::tm(tm), tm_usec(usec), tm_epoch(epoch) { }
         static log_time now() {
             system_clock::duration dur = system_clock::now().time_since_epoch();
             time_t time = duration_cast<seconds>(dur).count();
             auto time_ms = duration_cast<milliseconds>(dur).count();
-            return log_time(*std::localtime(&time), time_ms % 1000);
+            return log_time(*std::localtime(&time), time_ms % 1000, time);
         }
     }; // class log_time
 
+    //按秒缓存localtime及其格式化文本, 仅由写线程使用
+    class log_clock {
+    public:
+        const log_time& update(uint64_t time_us) {
+            time_t sec = (time_t)(time_us / 1000000);
+            if (sec != last_sec_) {
+                last_sec_ = sec;
+                time_ = log_time(*std::localtime(&sec), 0, sec);
+                text_ = fmt::format("{:4d}-{:02d}-{:02d} {:02d}:{:02d}:{:02d}", time_.tm_year + 1900,
+                    time_.tm_mon + 1, time_.tm_mday, time_.tm_hour, time_.tm_min, time_.tm_sec);
+            }
+            time_.tm_usec = (int)(time_us / 1000 % 1000);
+            return time_;
+        }
+        vstring text() const { return text_; }
+
+    private:
+        time_t      last_sec_ = -1;
+        log_time    time_;
+        sstring     text_;
+    }; // class log_clock
+
+    inline uint64_t log_now_us() {
+        return duration_cast<microseconds>(system_clock::now().time_since_epoch()).count();
+    }
+
     class log_message {
     public:
         int line() const { return line_; }
-        bool is_grow() const { return grow_; }
-        void set_grow(bool grow) { grow_ = grow; }
         log_level level() const { return level_; }
         vstring tag() const { return tag_; }
         vstring msg() const { return msg_; }
         vstring source() const { return source_; }
         vstring feature() const { return feature_; }
+        vstring time_text() const { return time_text_; }
         const log_time& get_log_time()const { return log_time_; }
-        void option(log_level level, sstring&& msg, cstring& tag, cstring& feature, cstring& source, int line) {
-            log_time_ = log_time::now();
-            msg_ = std::move(msg);
-            tag_ = std::move(tag);
-            feature_ = std::move(feature);
-            source_ = std::move(source);
+        sstring& buffer() { return msg_; }
+        void option(log_level level, vstring tag, vstring feature, vstring source, int line) {
+            tag_.assign(tag);
+            feature_.assign(feature);
+            source_.assign(source);
             level_ = level;
             line_ = line;
         }
+        void set_time(const log_time& time, vstring text) {
+            log_time_ = time;
+            time_text_ = text;
+        }
 
     private:
         int                 line_ = 0;
-        bool                grow_ = false;
         log_time            log_time_;
+        vstring             time_text_;
         sstring             source_, msg_, feature_, tag_;
         log_level           level_ = log_level::LOG_LEVEL_DEBUG;
     }; // class log_message
-    typedef std::list<sptr<log_message>> log_message_list;
 
-    class log_message_pool {
-    public:
-        log_message_pool(size_t msg_size) {
-            for (size_t i = 0; i < msg_size; ++i) {
-                alloc_messages_->push_back(std::make_shared<log_message>());
-            }
-            pool_size_ = msg_size;
-        }
-        ~log_message_pool() {
-            alloc_messages_->clear();
-            free_messages_->clear();
+    //定长日志记录
+    //data依次存放tag,feature,source,fmt及各参数, 格式为[uint32 len][bytes]
+    //nargs为0时fmt即为已格式化的消息, 超出定长部分转存到overflow
+    struct log_record {
+        uint64_t        time_us = 0;
+        sstring*        overflow = nullptr;
+        int             line = 0;
+        uint32_t        size = 0;
+        uint16_t        nargs = 0;
+        log_level       level = log_level::LOG_LEVEL_DEBUG;
+        char            data[RECORD_SIZE - 32];
+
+        void reset(log_level lvl, int ln) {
+            time_us = log_now_us();
+            level = lvl;
+            line = ln;
+            size = 0;
+            nargs = 0;
         }
-        sptr<log_message> allocate() {
-            std::unique_lock<spin_mutex> lock(mutex_);
-            if (alloc_messages_->empty()) {                
-                alloc_messages_.swap(free_messages_);
-            }
-            if (alloc_messages_->empty()) {
-                auto logmsg = std::make_shared<log_message>();                
-                if (pool_size_ < QUEUE_SIZE) {
-                    pool_size_++;
-                }else{
-                    logmsg->set_grow(true);
-                }
-                return logmsg;
+
+        void append(const char* buf, size_t len) {
+            uint32_t ulen = (uint32_t)len;
+            if (!overflow && size + sizeof(uint32_t) + len > sizeof(data)) {
+                overflow = new sstring(data, size);
             }
-            auto logmsg = alloc_messages_->front();
-            alloc_messages_->pop_front();
-            return logmsg;
-        }
-        void release(sptr<log_message> logmsg) {
-            if (!logmsg->is_grow()) {
-                std::unique_lock<spin_mutex> lock(mutex_);
-                free_messages_->push_back(logmsg);
+            if (overflow) {
+                overflow->append((const char*)&ulen, sizeof(uint32_t)).append(buf, len);
+                return;
             }
+            memcpy(data + size, &ulen, sizeof(uint32_t));
+            memcpy(data + size + sizeof(uint32_t), buf, len);
+            size += sizeof(uint32_t) + ulen;
         }
+        void append(vstring str) { append(str.data(), str.size()); }
 
-    private:
-        size_t pool_size_ = 0;
-        spin_mutex mutex_;
-        sptr<log_message_list> free_messages_ = std::make_shared<log_message_list>();
-        sptr<log_message_list> alloc_messages_ = std::make_shared<log_message_list>();
-    }; // class log_message_pool
+        //读取下一个字段
+        vstring read(size_t& pos) const {
+            const char* buf = overflow ? overflow->data() : data;
+            size_t len = overflow ? overflow->size() : size;
+            if (pos + sizeof(uint32_t) > len) return "";
+            uint32_t ulen;
+            memcpy(&ulen, buf + pos, sizeof(uint32_t));
+            vstring str(buf + pos + sizeof(uint32_t), ulen);
+            pos += sizeof(uint32_t) + ulen;
+            return str;
+        }
 
-    class log_message_queue {
-    public:
-        void put(sptr<log_message> logmsg, bool notify) {
-            std::unique_lock<spin_mutex> lock(spin_);
-            write_messages_->push_back(logmsg);
-            if (notify || write_messages_->size() > 10) {
-                condv_.notify_all();
+        void release() {
+            if (overflow) {
+                delete overflow;
+                overflow = nullptr;
             }
         }
+    }; // struct log_record
 
-        sptr<log_message_list> timed_getv() {
-            {
-                read_messages_->clear();
-                std::unique_lock<spin_mutex> lock(spin_);
-                read_messages_.swap(write_messages_);
-            }
-            if (read_messages_->empty()) {
-                std::unique_lock<std::mutex> lock(mutex_);
-                condv_.wait_for(lock, milliseconds(5));
-            }
-            return read_messages_;
+    //单生产者单消费者无锁环形队列, 每个写日志的线程独占一个
+    class log_ring {
+    public:
+        log_ring() : records_(RING_SIZE) {}
+        ~log_ring() { for (auto& record : records_) record.release(); }
+
+        //生产者: 队列满时返回nullptr
+        log_record* acquire() {
+            size_t tail = tail_.load(std::memory_order_relaxed);
+            if (tail - head_.load(std::memory_order_acquire) >= RING_SIZE) return nullptr;
+            return &records_[tail % RING_SIZE];
         }
+        size_t commit() {
+            size_t tail = tail_.load(std::memory_order_relaxed) + 1;
+            tail_.store(tail, std::memory_order_release);
+            return tail - head_.load(std::memory_order_relaxed);
+        }
+
+        //消费者
+        log_record* front() {
+            size_t head = head_.load(std::memory_order_relaxed);
+            if (head == tail_.load(std::memory_order_acquire)) return nullptr;
+            return &records_[head % RING_SIZE];
+        }
+        void pop() {
+            size_t head = head_.load(std::memory_order_relaxed);
+            records_[head % RING_SIZE].release();
+            head_.store(head + 1, std::memory_order_release);
+        }
+        bool empty() const { return head_.load(std::memory_order_acquire) == tail_.load(std::memory_order_acquire); }
+
+        std::atomic<bool> closed = false;   //所属线程已退出
 
     private:
-        spin_mutex                  spin_;
-        std::mutex                  mutex_;
-        std::condition_variable     condv_;
-        sptr<log_message_list> read_messages_   = std::make_shared<log_message_list>();
-        sptr<log_message_list> write_messages_  = std::make_shared<log_message_list>();
-    }; // class log_message_queue
+        alignas(64) std::atomic<size_t> head_ = 0;
+        alignas(64) std::atomic<size_t> tail_ = 0;
+        std::vector<log_record> records_;
+    }; // class log_ring
+    typedef std::vector<sptr<log_ring>> log_ring_list;
+
+    //线程退出时标记队列关闭, 由写线程取完后回收
+    struct log_ring_holder {
+        sptr<log_ring> ring = nullptr;
+        ~log_ring_holder() { if (ring) ring->closed = true; }
+    }; // struct log_ring_holder
 
     class log_service;
     class log_dest {
@@ -216,11 +282,12 @@ namespace logger {
         virtual void ignore_prefix(bool prefix) { ignore_prefix_ = prefix; }
         virtual void ignore_suffix(bool suffix) { ignore_suffix_ = suffix; }
         virtual void ignore_def(bool def) { ignore_def_ = def; }
-        virtual cstring build_prefix(sptr<log_message> logmsg);
-        virtual cstring build_suffix(sptr<log_message> logmsg);
+        virtual void build_prefix(sptr<log_message> logmsg, sstring& out);
+        virtual void build_suffix(sptr<log_message> logmsg, sstring& out);
         virtual bool log_def() { return !ignore_def_; }
 
     protected:
+        sstring line_;
         bool ignore_suffix_ = true;
         bool ignore_prefix_ = false;
         bool ignore_def_ = false;
@@ -237,60 +304,206 @@ namespace logger {
         }
     }; // class stdio_dest
 
+    //文件写入配置与统计, 所有日志文件共享
+    struct log_file_status {
+        std::atomic<uint32_t> fsync_ms = 0;         //fsync周期, 0表示交给系统
+        std::atomic<bool> compress = false;         //滚动后压缩为lz4
+        std::atomic<uint64_t> write_bytes = 0;
+        std::atomic<uint64_t> write_calls = 0;
+        std::atomic<uint64_t> write_us = 0;
+        std::atomic<uint64_t> fsync_calls = 0;
+        std::atomic<uint64_t> compress_files = 0;
+        std::atomic<uint64_t> compress_in = 0;
+        std::atomic<uint64_t> compress_out = 0;
+        std::atomic<uint64_t> compress_us = 0;
+    }; // struct log_file_status
+
+    inline log_file_status& file_status() {
+        static log_file_status status;
+        return status;
+    }
+
+    //定长对齐的写缓冲块, 批量提交时一块对应一个iovec
+    struct alignas(4096) log_block {
+        size_t size = 0;
+        char data[BLOCK_SIZE - sizeof(size_t)];
+    }; // struct log_block
+
     class log_file_base : public log_dest {
     public:
         log_file_base(size_t max_logsize) : logsize_(0), max_logsize_(max_logsize) {}
         virtual ~log_file_base() {
-            if (file_) {
-                file_->flush();
-                file_->close();
-            }
+            close();
         }
         virtual void raw_write(vstring msg, log_level lvl) {
             logsize_ += msg.size();
-            if (file_) file_->write(msg.data(), msg.size());
+            buffered_ += msg.size();
+            while (!msg.empty()) {
+                if (blocks_.empty() || blocks_.back()->size == sizeof(log_block::data)) {
+                    blocks_.push_back(alloc_block());
+                }
+                auto block = blocks_.back().get();
+                size_t len = std::min(msg.size(), sizeof(log_block::data) - block->size);
+                memcpy(block->data + block->size, msg.data(), len);
+                block->size += len;
+                msg.remove_prefix(len);
+            }
+            if (buffered_ >= MAX_BATCH_SIZE) {
+                flush();
+            }
         }
+        //整批缓冲一次writev写入
+        //空闲时也会被定时调用, 保证最后一批数据按节奏落盘
         virtual void flush() {
-            if (file_) file_->flush();
+            if (fd_ >= 0 && (!blocks_.empty() || unsynced_)) {
+                auto& status = file_status();
+                uint64_t now_us = log_now_us();
+                if (!blocks_.empty()) {
+                    write_blocks();
+                    uint64_t end_us = log_now_us();
+                    status.write_us += end_us - now_us;
+                    status.write_bytes += buffered_;
+                    now_us = end_us;
+                    unsynced_ = true;
+                }
+                uint32_t fsync_ms = status.fsync_ms;
+                if (fsync_ms > 0 && now_us >= fsync_us_ + fsync_ms * 1000) {
+                    sync();
+                    fsync_us_ = now_us;
+                }
+            }
+            if (blocks_.empty()) return;
+            for (auto& block : blocks_) {
+                block->size = 0;
+                frees_.push_back(std::move(block));
+            }
+            blocks_.clear();
+            buffered_ = 0;
         }
         const log_time& file_time() const { return file_time_; }
 
     protected:
         virtual void create(path file_path, vstring file_name, const log_time& file_time) {
-            if (file_) {
-                file_->flush();
-                file_->close();
-            }
+            close();
             file_time_ = file_time;
             file_path.append(file_name);
-            file_ = std::make_unique<std::ofstream>(file_path, std::ios::binary | std::ios::out | std::ios::app);
+            file_path_ = file_path;
+#ifdef WIN32
+            fd_ = _wopen(file_path.c_str(), _O_WRONLY | _O_CREAT | _O_APPEND | _O_BINARY, _S_IREAD | _S_IWRITE);
+#else
+            fd_ = ::open(file_path.c_str(), O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+#endif
+        }
+
+        void close() {
+            if (fd_ >= 0) {
+                flush();
+                if (file_status().fsync_ms > 0) sync();
+#ifdef WIN32
+                _close(fd_);
+#else
+                ::close(fd_);
+#endif
+                fd_ = -1;
+            }
+        }
+
+        void sync() {
+            unsynced_ = false;
+            file_status().fsync_calls++;
+#ifdef WIN32
+            _commit(fd_);
+#elif defined(__linux)
+            fdatasync(fd_);
+#else
+            fsync(fd_);
+#endif
         }
 
+        void write_blocks() {
+            auto& status = file_status();
+#ifdef WIN32
+            for (auto& block : blocks_) {
+                status.write_calls++;
+                _write(fd_, block->data, (unsigned)block->size);
+            }
+#else
+            iovs_.clear();
+            for (auto& block : blocks_) {
+                iovs_.push_back({ block->data, block->size });
+            }
+            size_t index = 0;
+            while (index < iovs_.size()) {
+                int count = (int)std::min(iovs_.size() - index, (size_t)IOV_MAX);
+                status.write_calls++;
+                ssize_t len = ::writev(fd_, &iovs_[index], count);
+                if (len < 0) {
+                    if (errno == EINTR) continue;
+                    break;
+                }
+                //处理部分写入
+                while (len > 0 && index < iovs_.size()) {
+                    auto& iov = iovs_[index];
+                    if ((size_t)len >= iov.iov_len) {
+                        len -= iov.iov_len;
+                        index++;
+                        continue;
+                    }
+                    iov.iov_base = (char*)iov.iov_base + len;
+                    iov.iov_len -= len;
+                    len = 0;
+                }
+            }
+#endif
+        }
+
+        std::unique_ptr<log_block> alloc_block() {
+            if (frees_.empty()) {
+                return std::make_unique<log_block>();
+            }
+            auto block = std::move(frees_.back());
+            frees_.pop_back();
+            return block;
+        }
+
+        int             fd_ = -1;
+        path            file_path_;
         log_time        file_time_;
         size_t          logsize_, max_logsize_;
-        std::unique_ptr<std::ofstream> file_ = nullptr;
+        size_t          buffered_ = 0;
+        uint64_t        fsync_us_ = 0;
+        bool            unsynced_ = false;
+        std::vector<std::unique_ptr<log_block>> blocks_, frees_;
+#ifndef WIN32
+        std::vector<iovec> iovs_;
+#endif
     }; // class log_file
 
+    //滚动时间点在建文件时算好, 逐条日志只比较时间戳
     class rolling_hourly {
     public:
-        bool eval(const log_file_base* log_file, const sptr<log_message> logmsg) const {
-            const log_time& ftime = log_file->file_time();
-            const log_time& ltime = logmsg->get_log_time();
-            return ltime.tm_year != ftime.tm_year || ltime.tm_mon != ftime.tm_mon ||
-                ltime.tm_mday != ftime.tm_mday || ltime.tm_hour != ftime.tm_hour;
+        time_t next(const log_time& ftime) const {
+            ::tm t = ftime;
+            t.tm_min = t.tm_sec = 0;
+            t.tm_hour += 1;
+            t.tm_isdst = -1;
+            return mktime(&t);
         }
-
     }; // class rolling_hourly
 
     class rolling_daily {
     public:
-        bool eval(const log_file_base* log_file, const sptr<log_message> logmsg) const {
-            const log_time& ftime = log_file->file_time();
-            const log_time& ltime = logmsg->get_log_time();
-            return ltime.tm_year != ftime.tm_year || ltime.tm_mon != ftime.tm_mon || ltime.tm_mday != ftime.tm_mday;
+        time_t next(const log_time& ftime) const {
+            ::tm t = ftime;
+            t.tm_hour = t.tm_min = t.tm_sec = 0;
+            t.tm_mday += 1;
+            t.tm_isdst = -1;
+            return mktime(&t);
         }
     }; // class rolling_daily
 
+    inline void compress_log_file(const path& file_path);
+
     template<class rolling_evaler>
     class log_rollingfile : public log_file_base {
     public:
@@ -302,11 +515,13 @@ namespace logger {
         }
 
         virtual void write(sptr<log_message> logmsg) {
-            if (file_ == nullptr || rolling_evaler_.eval(this, logmsg) || logsize_ >= max_logsize_) {
+            const log_time& ltime = logmsg->get_log_time();
+            if (fd_ < 0 || ltime.tm_epoch >= roll_time_ || logsize_ >= max_logsize_) {
                 create_directories(log_path_);
                 try {
                     for (auto entry : recursive_directory_iterator(log_path_)) {
-                        if (!entry.is_directory() && entry.path().extension().string() == ".log") {
+                        auto ext = entry.path().extension().string();
+                        if (!entry.is_directory() && (ext == ".log" || ext == ".lz4")) {
                             auto ftime = last_write_time(entry.path());
                             if ((size_t)duration_cast<seconds>(file_time_type::clock::now() - ftime).count() > clean_time_) {
                                 remove(entry.path());
@@ -315,8 +530,12 @@ namespace logger {
                     }
                 }
                 catch (...) {}
-                create(log_path_, new_log_file_path(logmsg), logmsg->get_log_time());
-                assert(file_);
+                path old_path = fd_ >= 0 ? file_path_ : path();
+                create(log_path_, new_log_file_path(logmsg), ltime);
+                if (!old_path.empty() && file_status().compress) {
+                    compress_log_file(old_path);
+                }
+                roll_time_ = rolling_evaler_.next(ltime);
                 logsize_ = 0;
             }
             log_file_base::write(logmsg);
@@ -325,11 +544,21 @@ namespace logger {
     protected:
         cstring new_log_file_path(const sptr<log_message> logmsg) {
             const log_time& t = logmsg->get_log_time();
-            return fmt::format("{}-{:4d}{:02d}{:02d}-{:02d}{:02d}{:02d}.{:03d}.p{}.log", feature_, t.tm_year + 1900, t.tm_mon + 1, t.tm_mday, t.tm_hour, t.tm_min, t.tm_sec, t.tm_usec, ::getpid());
+            auto name = fmt::format("{}-{:4d}{:02d}{:02d}-{:02d}{:02d}{:02d}.{:03d}.p{}", feature_, t.tm_year + 1900, t.tm_mon + 1, t.tm_mday, t.tm_hour, t.tm_min, t.tm_sec, t.tm_usec, ::getpid());
+            //同一毫秒内多次滚动时追加序号, 避免与正在压缩的旧文件重名
+            if (name == last_name_) {
+                return fmt::format("{}.{}.log", name, ++roll_seq_);
+            }
+            last_name_ = name;
+            roll_seq_ = 0;
+            return name + ".log";
         }
 
         path                    log_path_;
         sstring                 feature_;
+        time_t                  roll_time_ = 0;
+        sstring                 last_name_;
+        size_t                  roll_seq_ = 0;
         rolling_evaler          rolling_evaler_;
         size_t                  clean_time_ = CLEAN_TIME;
     }; // class log_rollingfile
@@ -337,6 +566,120 @@ namespace logger {
     typedef log_rollingfile<rolling_hourly> log_hourlyrollingfile;
     typedef log_rollingfile<rolling_daily> log_dailyrollingfile;
 
+    //后台压缩滚动出的日志文件, 输出标准lz4 frame格式(.log.lz4)
+    class log_compressor {
+    public:
+        ~log_compressor() { stop(); }
+
+        void push(const path& file_path) {
+            std::unique_lock<std::mutex> lock(mutex_);
+            if (!running_) {
+                running_ = true;
+                std::thread(&log_compressor::run, this).swap(thread_);
+                utility::set_thread_name(thread_, "logzip");
+            }
+            files_.push_back(file_path);
+            condv_.notify_one();
+        }
+
+        void stop() {
+            {
+                std::unique_lock<std::mutex> lock(mutex_);
+                running_ = false;
+                condv_.notify_one();
+            }
+            if (thread_.joinable()) {
+                thread_.join();
+            }
+        }
+
+    private:
+        void run() {
+            while (true) {
+                path file_path;
+                {
+                    std::unique_lock<std::mutex> lock(mutex_);
+                    condv_.wait(lock, [&] { return !files_.empty() || !running_; });
+                    if (files_.empty()) break;
+                    file_path = files_.front();
+                    files_.pop_front();
+                }
+                compress(file_path);
+            }
+        }
+
+        //lz4 frame头校验: xxh32(FLG,BD)的第二个字节
+        static uint8_t header_checksum(uint8_t flg, uint8_t bd) {
+            const uint32_t P1 = 2654435761U, P2 = 2246822519U, P3 = 3266489917U, P5 = 374761393U;
+            auto rotl = [](uint32_t x, int r) { return (x << r) | (x >> (32 - r)); };
+            uint32_t h32 = P5 + 2;
+            for (uint8_t b : { flg, bd }) {
+                h32 += b * P5;
+                h32 = rotl(h32, 11) * P1;
+            }
+            h32 ^= h32 >> 15; h32 *= P2;
+            h32 ^= h32 >> 13; h32 *= P3;
+            h32 ^= h32 >> 16;
+            return (uint8_t)(h32 >> 8);
+        }
+
+        void compress(const path& file_path) {
+            const uint8_t FLG = 0x60;   //version 01, block独立
+            const uint8_t BD = 0x70;    //block最大4M
+            const size_t LZ4_BLOCK = 4 * 1024 * 1024;
+            uint64_t start_us = log_now_us();
+            path zip_path = file_path;
+            zip_path += ".lz4";
+            std::ifstream ifs(file_path, std::ios::binary);
+            std::ofstream ofs(zip_path, std::ios::binary | std::ios::trunc);
+            if (!ifs || !ofs) return;
+            const uint8_t header[7] = { 0x04, 0x22, 0x4D, 0x18, FLG, BD, header_checksum(FLG, BD) };
+            ofs.write((const char*)header, sizeof(header));
+            std::vector<char> src(LZ4_BLOCK), dst(LZ4_compressBound((int)LZ4_BLOCK));
+            size_t in_size = 0, out_size = sizeof(header) + 4;
+            while (ifs) {
+                ifs.read(src.data(), src.size());
+                int len = (int)ifs.gcount();
+                if (len <= 0) break;
+                int zlen = LZ4_compress_default(src.data(), dst.data(), len, (int)dst.size());
+                //不可压缩的块原样存放, 最高位标记
+                uint32_t bsize = (zlen > 0 && zlen < len) ? (uint32_t)zlen : ((uint32_t)len | 0x80000000U);
+                const char* bdata = (zlen > 0 && zlen < len) ? dst.data() : src.data();
+                size_t blen = bsize & 0x7FFFFFFFU;
+                write_le32(ofs, bsize);
+                ofs.write(bdata, blen);
+                in_size += len;
+                out_size += blen + 4;
+            }
+            write_le32(ofs, 0);
+            ofs.close();
+            if (!ofs) {
+                std::error_code ec;
+                remove(zip_path, ec);
+                return;
+            }
+            std::error_code ec;
+            remove(file_path, ec);
+            auto& status = file_status();
+            status.compress_files++;
+            status.compress_in += in_size;
+            status.compress_out += out_size;
+            status.compress_us += log_now_us() - start_us;
+        }
+
+        static void write_le32(std::ofstream& ofs, uint32_t v) {
+            const char buf[4] = { (char)(v & 0xFF), (char)((v >> 8) & 0xFF), (char)((v >> 16) & 0xFF), (char)((v >> 24) & 0xFF) };
+            ofs.write(buf, 4);
+        }
+
+        bool                        running_ = false;
+        std::mutex                  mutex_;
+        std::thread                 thread_;
+        std::condition_variable     condv_;
+        std::list<path>             files_;
+    }; // class log_compressor
+
+
     class log_service {
     public:
         ~log_service() { stop(); }
@@ -358,9 +701,11 @@ namespace logger {
         }
 
         log_filter* get_filter() { return &log_filter_; }
-        log_message_pool* message_pool() { return message_pool_.get(); }
 
         void set_max_logsize(size_t max_logsize) { max_logsize_ = max_logsize; }
+        void set_fsync_time(uint32_t fsync_ms) { file_status().fsync_ms = fsync_ms; }
+        void set_compress(bool compress) { file_status().compress = compress; }
+        void compress(const path& file_path) { compressor_.push(file_path); }
         void set_clean_time(size_t clean_time) { clean_time_ = clean_time; }
         bool need_hook(log_level lvl) { return lvl >= hook_lv_; }
 
@@ -454,11 +799,10 @@ namespace logger {
         }
 
         void start() {
-            if (!stop_msg_ && !std_dest_) {
-                logmsgque_ = std::make_shared<log_message_queue>();
-                message_pool_ = std::make_shared<log_message_pool>(QUEUE_MINI);
+            if (!running_ && !std_dest_) {
+                running_ = true;
+                logmsg_ = std::make_shared<log_message>();
                 std_dest_ = std::make_shared<stdio_dest>();
-                stop_msg_ = message_pool_->allocate();
                 std::thread(&log_service::run, this).swap(thread_);
                 utility::set_thread_name(thread_, "log");
             }
@@ -467,27 +811,18 @@ namespace logger {
         void terminal() {
             if (!std_dest_) {
                 std_dest_ = std::make_shared<stdio_dest>();
-                message_pool_ = std::make_shared<log_message_pool>(QUEUE_MINI);
             }
         }
 
         void stop() {
-            if (stop_msg_) {
-                logmsgque_->put(stop_msg_,true);
+            if (running_) {
+                running_ = false;
+                condv_.notify_all();
             }
             if (thread_.joinable()) {
                 thread_.join();
             }
-        }
-
-        void submit(sptr<log_message> logmsg) {
-            if (stop_msg_) {
-                logmsgque_->put(logmsg,false);
-                return;
-            }
-            if (std_dest_) {
-                std_dest_->write(logmsg);
-            }
+            compressor_.stop();
         }
 
         void flush() {
@@ -514,47 +849,157 @@ namespace logger {
             return &service;
         }
 
-        void output(log_level level, sstring&& msg, cstring& tag, cstring& feature, cstring& source = "", int line = 0) {
+        void output(log_level level, vstring msg, vstring tag, vstring feature, vstring source = "", int line = 0) {
             if (!log_filter_.is_filter(level)) {
-                auto logmsg_ = message_pool_->allocate();
-                logmsg_->option(level, std::move(msg), tag, feature, source, line);
-                submit(logmsg_);
+                if (auto record = acquire(level, tag, feature, source, line)) {
+                    record->append(msg);
+                    commit(record);
+                    return;
+                }
+                if (std_dest_) {
+                    log_clock clock;
+                    auto logmsg = std::make_shared<log_message>();
+                    logmsg->option(level, tag, feature, source, line);
+                    auto& time = clock.update(log_now_us());
+                    logmsg->set_time(time, clock.text());
+                    logmsg->buffer().assign(msg);
+                    std_dest_->write(logmsg);
+                }
+            }
+        }
+
+        //从本线程队列中申请记录并写入tag/feature/source, 调用方继续写入fmt和参数后commit
+        //写线程未启动时返回nullptr
+        log_record* acquire(log_level level, vstring tag, vstring feature, vstring source, int line) {
+            if (!running_) return nullptr;
+            auto ring = thread_ring();
+            log_record* record = ring->acquire();
+            while (!record) {
+                wakeup();
+                std::this_thread::yield();
+                if (!running_) return nullptr;
+                record = ring->acquire();
+            }
+            record->release();
+            record->reset(level, line);
+            record->append(tag);
+            record->append(feature);
+            record->append(source);
+            return record;
+        }
+
+        void commit(log_record* record) {
+            if (thread_ring()->commit() > NOTIFY_SIZE) {
+                wakeup();
             }
         }
 
     private:
+        log_ring* thread_ring() {
+            thread_local log_ring_holder holder;
+            if (!holder.ring) {
+                holder.ring = std::make_shared<log_ring>();
+                std::unique_lock<spin_mutex> lock(ring_mutex_);
+                rings_.push_back(holder.ring);
+                ring_version_++;
+            }
+            return holder.ring.get();
+        }
+
+        void wakeup() {
+            if (sleeping_) condv_.notify_one();
+        }
+
         void run() {
-            bool loop = true;
-            while (loop) {
-                auto logmsgs = logmsgque_->timed_getv().get();
-                for (auto logmsg : *logmsgs) {
-                    if (logmsg == stop_msg_) {
-                        loop = false;
-                        continue;
-                    }
-                    if (!log_daemon_) {
-                        std_dest_->write(logmsg);
-                    }
-                    auto itLvl = dest_lvls_.find(logmsg->level());
-                    if (itLvl != dest_lvls_.end()) {
-                        itLvl->second->write(logmsg);
+            size_t version = 0;
+            log_ring_list rings;
+            while (true) {
+                bool running = running_;
+                if (version != ring_version_) {
+                    std::unique_lock<spin_mutex> lock(ring_mutex_);
+                    rings = rings_;
+                    version = ring_version_;
+                }
+                size_t count = 0;
+                bool closed = false;
+                for (auto& ring : rings) {
+                    //单个队列每轮最多处理RING_SIZE条, 避免饿死其他线程
+                    for (size_t i = 0; i < RING_SIZE; ++i) {
+                        auto record = ring->front();
+                        if (!record) break;
+                        dispatch(record);
+                        ring->pop();
+                        ++count;
                     }
-                    auto itFea = dest_features_.find(logmsg->feature());
-                    if (itFea != dest_features_.end()) {
-                        itFea->second->write(logmsg);
-                        if (itFea->second->log_def()) {
-                            if (def_dest_) {
-                                def_dest_->write(logmsg);
-                            }
-                        }
-                    } else {
-                        if (def_dest_) {
-                            def_dest_->write(logmsg);
-                        }
+                    if (ring->closed && ring->empty()) closed = true;
+                }
+                //空闲时也刷新, 让fsync节奏覆盖最后一批日志
+                if (count > 0 || file_status().fsync_ms > 0) {
+                    flush();
+                }
+                if (closed) {
+                    std::unique_lock<spin_mutex> lock(ring_mutex_);
+                    rings_.erase(std::remove_if(rings_.begin(), rings_.end(), [](auto& ring) { return ring->closed && ring->empty(); }), rings_.end());
+                    ring_version_++;
+                }
+                if (!running) break;
+                if (count == 0) {
+                    std::unique_lock<std::mutex> lock(wait_mutex_);
+                    sleeping_ = true;
+                    condv_.wait_for(lock, milliseconds(5));
+                    sleeping_ = false;
+                }
+            }
+        }
+
+        //在写线程完成格式化
+        void dispatch(log_record* record) {
+            size_t pos = 0;
+            auto tag = record->read(pos);
+            auto feature = record->read(pos);
+            auto source = record->read(pos);
+            auto vfmt = record->read(pos);
+            logmsg_->option(record->level, tag, feature, source, record->line);
+            auto& time = clock_.update(record->time_us);
+            logmsg_->set_time(time, clock_.text());
+            auto& buffer = logmsg_->buffer();
+            buffer.clear();
+            if (record->nargs == 0) {
+                buffer.assign(vfmt);
+            } else {
+                args_.clear();
+                for (uint16_t i = 0; i < record->nargs; ++i) {
+                    args_.push_back(record->read(pos));
+                }
+                try {
+                    fmt::vformat_to(std::back_inserter(buffer), vfmt, args_);
+                } catch (const std::exception& e) {
+                    buffer.assign(fmt::format("[logger] format failed: {} => {}", e.what(), vfmt));
+                }
+            }
+            write(logmsg_);
+        }
+
+        void write(sptr<log_message> logmsg) {
+            if (!log_daemon_) {
+                std_dest_->write(logmsg);
+            }
+            auto itLvl = dest_lvls_.find(logmsg->level());
+            if (itLvl != dest_lvls_.end()) {
+                itLvl->second->write(logmsg);
+            }
+            auto itFea = dest_features_.find(logmsg->feature());
+            if (itFea != dest_features_.end()) {
+                itFea->second->write(logmsg);
+                if (itFea->second->log_def()) {
+                    if (def_dest_) {
+                        def_dest_->write(logmsg);
                     }
-                    message_pool_->release(logmsg);
                 }
-                flush();
+            } else {
+                if (def_dest_) {
+                    def_dest_->write(logmsg);
+                }
             }
         }
 
@@ -567,9 +1012,17 @@ namespace logger {
         sstring         service_;
         sptr<log_dest>  std_dest_ = nullptr;
         sptr<log_dest>  def_dest_ = nullptr;
-        sptr<log_message> stop_msg_ = nullptr;
-        sptr<log_message_queue> logmsgque_ = nullptr;
-        sptr<log_message_pool> message_pool_ = nullptr;
+        sptr<log_message> logmsg_ = nullptr;
+        log_clock       clock_;
+        fmt::dynamic_format_arg_store<fmt::format_context> args_;
+        spin_mutex      ring_mutex_;
+        log_ring_list   rings_;
+        std::atomic<size_t> ring_version_ = 0;
+        std::atomic<bool> running_ = false;
+        std::atomic<bool> sleeping_ = false;
+        std::mutex      wait_mutex_;
+        std::condition_variable condv_;
+        log_compressor  compressor_;
         std::map<log_level, sptr<log_dest>> dest_lvls_;
         std::map<sstring, sptr<log_dest>,std::less<>> dest_features_;
         size_t max_logsize_ = MAX_LOG_SIZE, clean_time_ = CLEAN_TIME;
@@ -579,25 +1032,29 @@ namespace logger {
     // class log_dest
     // --------------------------------------------------------------------------------
     inline void log_dest::write(sptr<log_message> logmsg) {
-        auto logtxt = fmt::format("{}{}{}\n", build_prefix(logmsg), logmsg->msg(), build_suffix(logmsg));
-        raw_write(logtxt, logmsg->level());
+        line_.clear();
+        build_prefix(logmsg, line_);
+        line_.append(logmsg->msg());
+        build_suffix(logmsg, line_);
+        line_.push_back('\n');
+        raw_write(line_, logmsg->level());
     }
 
-    inline cstring log_dest::build_prefix(sptr<log_message> logmsg) {
+    inline void log_dest::build_prefix(sptr<log_message> logmsg, sstring& out) {
         if (!ignore_prefix_) {
             auto names = level_names<log_level>()();
-            const log_time& t = logmsg->get_log_time();
-            return fmt::format("[{:4d}-{:02d}-{:02d} {:02d}:{:02d}:{:02d}.{:03d}][{}][{}]",
-                t.tm_year + 1900, t.tm_mon + 1, t.tm_mday, t.tm_hour, t.tm_min, t.tm_sec, t.tm_usec, logmsg->tag(), names[(int)logmsg->level()]);
+            fmt::format_to(std::back_inserter(out), "[{}.{:03d}][{}][{}]", logmsg->time_text(), logmsg->get_log_time().tm_usec, logmsg->tag(), names[(int)logmsg->level()]);
         }
-        return "";
     }
 
-    inline cstring log_dest::build_suffix(sptr<log_message> logmsg) {
+    inline void log_dest::build_suffix(sptr<log_message> logmsg, sstring& out) {
         if (!ignore_suffix_) {
-            return fmt::format("[{}:{}]", logmsg->source().data(), logmsg->line());
+            fmt::format_to(std::back_inserter(out), "[{}:{}]", logmsg->source(), logmsg->line());
         }
-        return "";
+    }
+
+    inline void compress_log_file(const path& file_path) {
+        log_service::instance()->compress(file_path);
     }
 }
 
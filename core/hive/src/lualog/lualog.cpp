@@ -37,6 +37,38 @@ namespace logger {
         return "unsuppert data type";
     }
 
+    //参数转为文本直接写入日志记录, 由写线程完成格式化
+    void write_args(lua_State* L, log_record* record, int flag, int index, size_t max_len) {
+        size_t len;
+        char buf[64];
+        switch (lua_type(L, index)) {
+        case LUA_TSTRING: {
+            const char* str = lua_tolstring(L, index, &len);
+            record->append(str, len);
+            break;
+        }
+        case LUA_TNUMBER: {
+            auto res = lua_isinteger(L, index) ? fmt::format_to_n(buf, sizeof(buf), "{}", lua_tointeger(L, index))
+                : fmt::format_to_n(buf, sizeof(buf), "{}", lua_tonumber(L, index));
+            record->append(buf, res.size);
+            break;
+        }
+        case LUA_TTABLE:
+            if ((flag & LOG_FLAG_FORMAT) == LOG_FLAG_FORMAT) {
+                thread_buff.clean();
+                serialize_one(L, &thread_buff, index, 1, (flag & LOG_FLAG_PRETTY) == LOG_FLAG_PRETTY, max_len);
+                record->append((const char*)thread_buff.head(), thread_buff.size());
+                break;
+            }
+            record->append(luaL_tolstring(L, index, &len), len);
+            lua_pop(L, 1);
+            break;
+        default:
+            record->append(read_args(L, flag, index, max_len));
+            break;
+        }
+    }
+
     int zformat(lua_State* L, log_level lvl, cstring& tag, cstring& feature, int flag, sstring&& msg) {
         if (log_service::instance()->need_hook(lvl) || (flag & LOG_FLAG_MONITOR) == LOG_FLAG_MONITOR) {
             lua_pushlstring(L, msg.c_str(), msg.size());
@@ -115,6 +147,18 @@ namespace logger {
             replace_fmt(vfmt);          
             int arg_num = lua_gettop(L) - 5;
             auto max_len = log_limit_len(lvl);
+            //需要回传消息给lua层的日志在本线程格式化, 其他日志延迟到写线程格式化
+            if (arg_num > 0 && arg_num <= 12 && !log_service::instance()->need_hook(lvl) && (flag & LOG_FLAG_MONITOR) == 0) {
+                if (auto record = log_service::instance()->acquire(lvl, tag, feature, "", 0)) {
+                    record->append(vfmt);
+                    for (int i = 0; i < arg_num; ++i) {
+                        write_args(L, record, flag, i + 6, max_len);
+                    }
+                    record->nargs = arg_num;
+                    log_service::instance()->commit(record);
+                    return 0;
+                }
+            }
             switch (arg_num) {
             case 0: return zformat(L, lvl, tag, feature, flag, string(vfmt.data(), vfmt.size()));
             case 1: return tformat(L, lvl, tag, feature, flag, vfmt, max_len, make_index_sequence<1>{});
@@ -159,6 +203,22 @@ namespace logger {
         lualog.set_function("daemon", [](bool status) { log_service::instance()->daemon(status); });
         lualog.set_function("set_max_logsize", [](size_t logsize) { log_service::instance()->set_max_logsize(logsize); });
         lualog.set_function("set_clean_time", [](size_t time) { log_service::instance()->set_clean_time(time); });
+        lualog.set_function("set_fsync_time", [](uint32_t time) { log_service::instance()->set_fsync_time(time); });
+        lualog.set_function("set_compress", [](bool compress) { log_service::instance()->set_compress(compress); });
+        lualog.set_function("file_stats", [](lua_State* L) {
+            auto& status = file_status();
+            luakit::kit_state kit_state(L);
+            auto stats = kit_state.new_table();
+            stats.set("write_bytes", status.write_bytes.load());
+            stats.set("write_calls", status.write_calls.load());
+            stats.set("write_us", status.write_us.load());
+            stats.set("fsync_calls", status.fsync_calls.load());
+            stats.set("compress_files", status.compress_files.load());
+            stats.set("compress_in", status.compress_in.load());
+            stats.set("compress_out", status.compress_out.load());
+            stats.set("compress_us", status.compress_us.load());
+            return stats.push_stack();
+        });
         lualog.set_function("filter", [](int lv, bool on) { log_service::instance()->filter((log_level)lv, on); });
         lualog.set_function("is_filter", [](int lv) { return log_service::instance()->is_filter((log_level)lv); });
         lualog.set_function("del_dest", [](vstring feature) { log_service::instance()->del_dest(feature); });
@@ -0,0 +1,144 @@
+#ifndef __FRAME_PERF_H__
+#define __FRAME_PERF_H__
+#include <array>
+#include "lua_kit.h"
+
+using namespace luakit;
+
+namespace lworker {
+
+    //帧阶段, 对应lua层FramePhase
+    enum frame_phase : uint32_t {
+        PHASE_SCHEDULER = 0,    //线程消息调度
+        PHASE_IO        = 1,    //luabus.wait网络IO
+        PHASE_TIMER     = 2,    //定时器派发
+        PHASE_UPDATE    = 3,    //lua逻辑更新
+        PHASE_FRAME     = 4,    //整帧
+        PHASE_COUNT     = 5,
+    };
+    const char* const PHASE_NAMES[PHASE_COUNT] = { "scheduler", "io", "timer", "update", "frame" };
+
+    //HDR直方图(微秒)
+    //每个2的幂区间划分SUB_COUNT个子桶, 相对误差不超过1/SUB_COUNT
+    class hdr_histogram {
+    public:
+        static const uint32_t SUB_BITS = 6;
+        static const uint32_t SUB_COUNT = 1 << SUB_BITS;
+        static const uint32_t MAX_BITS = 36;    //最大记录约19小时
+        static const uint32_t BUCKET_COUNT = (MAX_BITS - SUB_BITS + 1) * SUB_COUNT;
+
+        void record(uint64_t value) {
+            uint64_t max_value = (1ull << MAX_BITS) - 1;
+            if (value > max_value) value = max_value;
+            m_counts[index_of(value)]++;
+            if (m_count == 0 || value < m_min) m_min = value;
+            if (value > m_max) m_max = value;
+            m_total += value;
+            m_count++;
+        }
+
+        void reset() {
+            m_counts.fill(0);
+            m_count = m_total = m_min = m_max = 0;
+        }
+
+        uint64_t count() const { return m_count; }
+
+        //百分位对应的值(所在子桶上界)
+        uint64_t percentile(double pct) const {
+            if (m_count == 0) return 0;
+            uint64_t target = (uint64_t)(pct / 100.0 * m_count + 0.5);
+            if (target == 0) target = 1;
+            uint64_t acc = 0;
+            for (uint32_t i = 0; i < BUCKET_COUNT; ++i) {
+                acc += m_counts[i];
+                if (acc >= target) {
+                    uint64_t value = highest_of(i);
+                    return value < m_max ? value : m_max;
+                }
+            }
+            return m_max;
+        }
+
+        void push(kit_state& kit, lua_table& table, const char* name) const {
+            auto stat = kit.new_table();
+            stat.set("count", m_count);
+            stat.set("min", m_min);
+            stat.set("max", m_max);
+            stat.set("mean", m_count ? m_total / m_count : 0);
+            stat.set("p50", percentile(50));
+            stat.set("p90", percentile(90));
+            stat.set("p99", percentile(99));
+            stat.set("p999", percentile(99.9));
+            table.set(name, stat);
+        }
+
+    protected:
+        static uint32_t index_of(uint64_t value) {
+            if (value < SUB_COUNT) return (uint32_t)value;
+            uint32_t shift = 0;
+            while ((value >> shift) >= SUB_COUNT * 2) ++shift;
+            return (shift + 1) * SUB_COUNT + (uint32_t)((value >> shift) - SUB_COUNT);
+        }
+
+        static uint64_t highest_of(uint32_t index) {
+            if (index < SUB_COUNT) return index;
+            uint32_t shift = index / SUB_COUNT - 1;
+            uint64_t sub = index % SUB_COUNT + SUB_COUNT;
+            return ((sub + 1) << shift) - 1;
+        }
+
+    private:
+        uint64_t m_count = 0;
+        uint64_t m_total = 0;
+        uint64_t m_min = 0;
+        uint64_t m_max = 0;
+        std::array<uint64_t, BUCKET_COUNT> m_counts = {};
+    };
+
+    //单线程帧耗时统计, 仅由所属线程读写
+    //begin开始一帧, mark把距上次打点的耗时累加到指定阶段, finish提交整帧
+    class frame_perf {
+    public:
+        void begin() {
+            m_start = m_last = steady_us();
+            m_phases.fill(0);
+        }
+
+        void mark(uint32_t phase) {
+            uint64_t now = steady_us();
+            if (phase < PHASE_FRAME) {
+                m_phases[phase] += now - m_last;
+            }
+            m_last = now;
+        }
+
+        void finish() {
+            if (m_start == 0) return;
+            uint64_t now = steady_us();
+            for (uint32_t i = 0; i < PHASE_FRAME; ++i) {
+                m_histograms[i].record(m_phases[i]);
+            }
+            m_histograms[PHASE_FRAME].record(now - m_start);
+            m_start = 0;
+        }
+
+        int stats(lua_State* L, bool reset) {
+            kit_state kit(L);
+            auto result = kit.new_table();
+            for (uint32_t i = 0; i < PHASE_COUNT; ++i) {
+                m_histograms[i].push(kit, result, PHASE_NAMES[i]);
+                if (reset) m_histograms[i].reset();
+            }
+            return result.push_stack();
+        }
+
+    private:
+        uint64_t m_start = 0;
+        uint64_t m_last = 0;
+        std::array<uint64_t, PHASE_COUNT> m_phases = {};
+        std::array<hdr_histogram, PHASE_COUNT> m_histograms;
+    };
+}
+
+#endif
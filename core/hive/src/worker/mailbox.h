@@ -0,0 +1,284 @@
+#ifndef __MAILBOX_H__
+#define __MAILBOX_H__
+#include <map>
+#include <atomic>
+#include <vector>
+#include <memory>
+#include "fmt/core.h"
+#include "lua_kit.h"
+#include "../lualog/logger.h"
+
+using namespace luakit;
+using vstring = std::string_view;
+using spin_mutex = luakit::spin_mutex;
+
+namespace lworker {
+
+    const int64_t FLAG_REQ = 0x01;          //对应lua层FlagMask.REQ
+    const uint32_t BUDGET_MS = 100;         //单帧默认处理时间预算
+    const uint32_t BATCH_NUM = 64;          //单个来源每轮默认处理条数
+    const char* const RESPONSE = "response";
+
+    //消息头
+    struct mail_head {
+        uint32_t len;       //消息长度
+        uint64_t push_us;   //入队时间
+    };
+
+    //耗时统计(微秒)
+    struct mail_stat {
+        uint64_t count = 0;
+        uint64_t wait_us = 0;
+        uint64_t max_wait_us = 0;
+        uint64_t cost_us = 0;
+        uint64_t max_cost_us = 0;
+
+        void record(uint64_t wait, uint64_t cost) {
+            ++count;
+            wait_us += wait;
+            cost_us += cost;
+            if (wait > max_wait_us) max_wait_us = wait;
+            if (cost > max_cost_us) max_cost_us = cost;
+        }
+
+        lua_table push(kit_state& kit, lua_table& table, const std::string& name) {
+            auto stat = kit.new_table();
+            stat.set("count", count);
+            stat.set("wait_avg", count ? wait_us / count : 0);
+            stat.set("wait_max", max_wait_us);
+            stat.set("cost_avg", count ? cost_us / count : 0);
+            stat.set("cost_max", max_cost_us);
+            table.set(name, stat);
+            return stat;
+        }
+    };
+
+    //单个来源的消息通道
+    struct mail_channel {
+        mail_channel(vstring source) : name(source) {}
+        std::string name;
+        size_t max_depth = 0;               //最大积压数量
+        std::atomic<uint64_t> drop = 0;     //丢弃数量
+        std::atomic<uint64_t> push = 0;     //入队数量
+        std::atomic<uint64_t> pop = 0;      //出队数量
+        mail_stat stat;
+        std::shared_ptr<luabuf> read_buf = std::make_shared<luabuf>(64, 32);
+        std::shared_ptr<luabuf> write_buf = std::make_shared<luabuf>(64, 32);
+    };
+
+    //线程消息邮箱
+    //每个来源独立排队, 轮询分批投递, 单帧处理受时间预算限制
+    class mailbox {
+    public:
+        mailbox(vstring owner) : m_owner(owner) {}
+
+        void set_budget(uint32_t budget_ms, uint32_t batch_num) {
+            m_budget_ms = budget_ms > 0 ? budget_ms : BUDGET_MS;
+            m_batch_num = batch_num > 0 ? batch_num : BATCH_NUM;
+        }
+
+        //参数从栈上index=2开始编码, 调用方已确保codec线程安全
+        bool push(lua_State* L, codec_base* codec, vstring source) {
+            size_t data_len;
+            std::unique_lock<spin_mutex> lock(m_mutex);
+            uint8_t* data = codec->encode(L, 2, &data_len);
+            auto channel = find_channel(source);
+            auto buff = channel->write_buf;
+            if (buff->peek_space(data_len + sizeof(mail_head))) {
+                buff->write<mail_head>({ (uint32_t)data_len, steady_us() });
+                buff->push_data(data, data_len);
+                size_t depth = ++channel->push - channel->pop;
+                if (depth > channel->max_depth) channel->max_depth = depth;
+                return true;
+            }
+            channel->drop++;
+            LOG_ERROR(fmt::format("[{}] thread call buffer is full!,source:{},size:{}", m_owner, source, buff->size()));
+            return false;
+        }
+
+        //lua层在handler中循环调用recv, 直至返回false
+        void dispatch(kit_state* lua, const char* service, const char* handler, uint64_t clock_ms) {
+            collect();
+            size_t count = m_actives.size();
+            if (count == 0) return;
+            uint64_t pcount = 0;
+            size_t start = m_cursor++ % count;
+            m_deadline = clock_ms + m_budget_ms;
+            bool pending = true;
+            while (pending) {
+                pending = false;
+                for (size_t i = 0; i < count; ++i) {
+                    m_channel = m_actives[(start + i) % count].get();
+                    if (m_channel->read_buf->empty()) continue;
+                    uint64_t pop = m_channel->pop;
+                    m_quota = m_batch_num;
+                    if (!lua->table_call(service, handler, nullptr, std::tie(), m_channel->name)) {
+                        LOG_ERROR(fmt::format("[{}] {} dispatch failed,source:{}", m_owner, handler, m_channel->name));
+                        discard(m_channel);
+                    }
+                    finish(steady_us());
+                    pcount += m_channel->pop - pop;
+                    if (!m_channel->read_buf->empty()) pending = true;
+                    if (m_busy) break;
+                }
+                if (m_busy) {
+                    LOG_ERROR(fmt::format("{} [{}] is busy,cost:{},pcount:{},remain:{}", handler, m_owner, steady_ms() - clock_ms, pcount, remain()));
+                    break;
+                }
+            }
+            m_busy = false;
+            m_channel = nullptr;
+        }
+
+        //读取当前批次的下一条消息: 成功返回true和消息参数, 否则返回false
+        int recv(lua_State* L, codec_base* codec) {
+            uint64_t now = steady_us();
+            finish(now);
+            if (!m_channel || m_quota == 0) {
+                lua_pushboolean(L, false);
+                return 1;
+            }
+            if (now / 1000 >= m_deadline) {
+                m_busy = true;
+                lua_pushboolean(L, false);
+                return 1;
+            }
+            auto buff = m_channel->read_buf;
+            mail_head* head = (mail_head*)buff->peek_data(sizeof(mail_head));
+            if (!head || !buff->peek_data(head->len + sizeof(mail_head))) {
+                lua_pushboolean(L, false);
+                return 1;
+            }
+            int top = lua_gettop(L);
+            lua_pushboolean(L, true);
+            uint64_t wait = now - head->push_us;
+            size_t plen = sizeof(mail_head) + head->len;
+            codec->set_slice(buff->get_slice(head->len, sizeof(mail_head)));
+            try {
+                codec->decode(L);
+            } catch (const std::exception& e) {
+                LOG_ERROR(fmt::format("[{}] thread recv decode failed,source:{},err:{}", m_owner, m_channel->name, e.what()));
+                discard(m_channel);
+                lua_settop(L, top);
+                lua_pushboolean(L, false);
+                return 1;
+            }
+            buff->pop_size(plen);
+            m_channel->pop++;
+            m_quota--;
+            //REQ消息: session_id, flag, title, rpc, ...
+            const char* method = RESPONSE;
+            if (lua_gettop(L) - top >= 5 && lua_tointeger(L, top + 3) == FLAG_REQ && lua_type(L, top + 5) == LUA_TSTRING) {
+                method = lua_tostring(L, top + 5);
+            }
+            auto it = m_methods.find(method);
+            if (it == m_methods.end()) {
+                it = m_methods.emplace(method, mail_stat()).first;
+            }
+            m_reading = { &it->second, now, wait };
+            return lua_gettop(L) - top;
+        }
+
+        int stats(lua_State* L) {
+            kit_state kit(L);
+            auto sources = kit.new_table();
+            std::unique_lock<spin_mutex> lock(m_mutex);
+            for (auto& channel : m_channels) {
+                auto stat = channel->stat.push(kit, sources, channel->name);
+                stat.set("depth", channel->push - channel->pop);
+                stat.set("max_depth", channel->max_depth);
+                stat.set("push", channel->push.load());
+                stat.set("drop", channel->drop.load());
+            }
+            lock.unlock();
+            auto methods = kit.new_table();
+            for (auto& [name, stat] : m_methods) {
+                stat.push(kit, methods, name);
+            }
+            auto result = kit.new_table();
+            result.set("sources", sources);
+            result.set("methods", methods);
+            result.set("budget", m_budget_ms);
+            result.set("batch", m_batch_num);
+            return result.push_stack();
+        }
+
+    protected:
+        mail_channel* find_channel(vstring source) {
+            auto it = m_channel_map.find(source);
+            if (it != m_channel_map.end()) {
+                return it->second;
+            }
+            auto channel = std::make_shared<mail_channel>(source);
+            m_channel_map.emplace(channel->name, channel.get());
+            m_channels.push_back(channel);
+            return channel.get();
+        }
+
+        //交换读写缓冲, 收集待处理的通道
+        void collect() {
+            m_actives.clear();
+            std::unique_lock<spin_mutex> lock(m_mutex);
+            for (auto& channel : m_channels) {
+                if (channel->read_buf->empty()) {
+                    if (channel->write_buf->empty()) continue;
+                    channel->read_buf.swap(channel->write_buf);
+                }
+                m_actives.push_back(channel);
+            }
+        }
+
+        //结算上一条消息的处理耗时
+        void finish(uint64_t now) {
+            if (m_reading.stat) {
+                uint64_t cost = now - m_reading.start_us;
+                m_reading.stat->record(m_reading.wait_us, cost);
+                m_channel->stat.record(m_reading.wait_us, cost);
+                m_reading.stat = nullptr;
+            }
+        }
+
+        //丢弃读缓冲中剩余的消息
+        void discard(mail_channel* channel) {
+            auto buff = channel->read_buf;
+            while (mail_head* head = (mail_head*)buff->peek_data(sizeof(mail_head))) {
+                if (!buff->peek_data(head->len + sizeof(mail_head))) break;
+                buff->pop_size(head->len + sizeof(mail_head));
+                channel->pop++;
+                channel->drop++;
+            }
+            buff->clean();
+        }
+
+        size_t remain() {
+            size_t size = 0;
+            for (auto& channel : m_actives) {
+                size += channel->push - channel->pop;
+            }
+            return size;
+        }
+
+    private:
+        struct reading {
+            mail_stat* stat = nullptr;
+            uint64_t start_us = 0;
+            uint64_t wait_us = 0;
+        };
+        spin_mutex m_mutex;
+        std::string m_owner;
+        bool m_busy = false;
+        reading m_reading;
+        size_t m_cursor = 0;
+        uint32_t m_quota = 0;
+        uint64_t m_deadline = 0;
+        uint32_t m_budget_ms = BUDGET_MS;
+        uint32_t m_batch_num = BATCH_NUM;
+        mail_channel* m_channel = nullptr;
+        std::vector<std::shared_ptr<mail_channel>> m_channels;
+        std::vector<std::shared_ptr<mail_channel>> m_actives;
+        std::map<std::string, mail_channel*, std::less<>> m_channel_map;
+        std::map<std::string, mail_stat, std::less<>> m_methods;
+    };
+}
+
+#endif
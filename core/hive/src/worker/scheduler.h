@@ -43,19 +43,19 @@ namespace lworker {
         int broadcast(lua_State* L) {
             std::unique_lock<spin_mutex> lock(m_mutex);
             for (auto it : m_worker_map) {
-                it.second->call(L);
+                it.second->call(L, "master");
             }
             return 0;
         }
         
-        int call(lua_State* L, vstring name) {
+        int call(lua_State* L, vstring name, vstring source) {
             if (name == "master") {
-                lua_pushboolean(L, call(L));
+                lua_pushboolean(L, m_mailbox.push(L, m_codec, source));
                 return 1;
             }
             auto workor = find_worker(name);
             if (workor) {
-                lua_pushboolean(L, workor->call(L));
+                lua_pushboolean(L, workor->call(L, source));
                 return 1;
             }
             LOG_ERROR(fmt::format("thread call [{}] work is not exist", name));
@@ -63,47 +63,20 @@ namespace lworker {
             return 1;
         }
 
-        bool call(lua_State* L) {
-            size_t data_len;
-            std::unique_lock<spin_mutex> lock(m_mutex);
-            uint8_t* data = m_codec->encode(L, 2, &data_len);
-            uint8_t* target = m_write_buf->peek_space(data_len + sizeof(uint32_t));
-            if (target) {
-                m_write_buf->write<uint32_t>(data_len);
-                m_write_buf->push_data(data, data_len);
-                return true;
-            }
-            LOG_ERROR(fmt::format("master thread call buffer is full!,size:{}",m_write_buf->size()));
-            return false;
+        void update(uint64_t clock_ms) {
+            m_mailbox.dispatch(m_lua.get(), m_service.c_str(), "on_scheduler", clock_ms);
         }
 
-        void update(uint64_t clock_ms) {
-            if (m_read_buf->empty()) {
-                if (m_write_buf->empty()) {
-                    return;
-                }
-                std::unique_lock<spin_mutex> lock(m_mutex);
-                m_read_buf.swap(m_write_buf);
-            }
-            size_t plen = 0,pcount = 0;
-            const char* service = m_service.c_str();
-            slice* slice = read_slice(m_read_buf, &plen);
-            while (slice) {
-                m_codec->set_slice(slice);
-                m_lua->table_call(service, "on_scheduler", nullptr, m_codec, std::tie());
-                if (m_codec->failed()) {
-                    m_read_buf->clean();
-                    break;
-                }
-                m_read_buf->pop_size(plen);
-                ++pcount;
-                auto cost_time = steady_ms() - clock_ms;
-                if (cost_time > 100) {
-                    LOG_ERROR(fmt::format("on_scheduler is busy,cost:{},pcount:{},remain:{}", cost_time, pcount, m_read_buf->size()));
-                    break;
-                }
-                slice = read_slice(m_read_buf, &plen);
-            }
+        int recv(lua_State* L) {
+            return m_mailbox.recv(L, m_codec);
+        }
+
+        int stats(lua_State* L) {
+            return m_mailbox.stats(L);
+        }
+
+        void set_budget(uint32_t budget_ms, uint32_t batch_num) {
+            m_mailbox.set_budget(budget_ms, batch_num);
         }
 
         void destory(vstring name) {
@@ -135,8 +108,7 @@ namespace lworker {
         std::string m_service;
         codec_base* m_codec = nullptr;
         std::unique_ptr<kit_state> m_lua = nullptr;
-        std::shared_ptr<luabuf> m_read_buf = std::make_shared<luabuf>(32,32);
-        std::shared_ptr<luabuf> m_write_buf = std::make_shared<luabuf>(32,32);
+        mailbox m_mailbox{ "master" };
         std::map<std::string, std::shared_ptr<worker>, std::less<>> m_worker_map;
     };
 }
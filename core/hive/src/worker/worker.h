@@ -3,11 +3,15 @@
 #include <mutex>
 #include <atomic>
 #include <thread>
+#include <algorithm>
 #include "../sandbox.h"
 #include "fmt/core.h"
 #include "thread_name.hpp"
+#include "thread_affinity.hpp"
 #include "lua_kit.h"
 #include "../lualog/logger.h"
+#include "mailbox.h"
+#include "frame_perf.h"
 
 using namespace luakit;
 using vstring = std::string_view;
@@ -17,24 +21,43 @@ extern "C" void open_custom_libs(lua_State * L);
 
 namespace lworker {
 
-    static slice* read_slice(std::shared_ptr<luabuf> buff, size_t* pack_len) {
-        uint8_t* plen = buff->peek_data(sizeof(uint32_t));
-        if (plen) {
-            uint32_t len = *(uint32_t*)plen;
-            uint8_t* pdata = buff->peek_data(len);
-            if (pdata) {
-                *pack_len = sizeof(uint32_t) + len;
-                return buff->get_slice(len, sizeof(uint32_t));
+    //线程绑核/优先级/numa设置
+    //主线程读取HIVE_XXX, 工作线程优先读取HIVE_{NAME}_XXX, 其次读取HIVE_WORKER_XXX
+    static void setup_placement(vstring name, bool master) {
+        auto get_conf = [&](vstring key) -> const char* {
+            if (master) {
+                return getenv(fmt::format("HIVE_{}", key).c_str());
             }
+            auto ekey = fmt::format("HIVE_{}_{}", name, key);
+            std::transform(ekey.begin(), ekey.end(), ekey.begin(), [](auto c) { return std::toupper(c); });
+            auto value = getenv(ekey.c_str());
+            return value ? value : getenv(fmt::format("HIVE_WORKER_{}", key).c_str());
+        };
+        auto affinity = get_conf("CPU_AFFINITY");
+        if (affinity && !utility::set_thread_affinity(affinity)) {
+            LOG_WARN(fmt::format("[{}] thread set cpu affinity {} failed!", name, affinity));
+        }
+        auto priority = get_conf("CPU_PRIORITY");
+        if (priority && !utility::set_thread_priority(priority)) {
+            LOG_WARN(fmt::format("[{}] thread set cpu priority {} failed!", name, priority));
+        }
+        auto numa = get_conf("NUMA_NODE");
+        if (numa && !utility::set_thread_numa(numa)) {
+            LOG_WARN(fmt::format("[{}] thread set numa node {} failed!", name, numa));
+        }
+        if (affinity || priority || numa) {
+            int prio = 0;
+            auto policy = utility::get_thread_priority(prio);
+            LOG_INFO(fmt::format("[{}] thread placement tid:{} cpus:{} policy:{} priority:{} numa:{}", name, utility::thread_id(),
+                utility::format_cpu_list(utility::get_thread_affinity()), policy, prio, utility::format_cpu_list(utility::get_thread_numa())));
         }
-        return nullptr;
     }
 
     class worker;
     class ischeduler {
     public:
         virtual int broadcast(lua_State* L) = 0;
-        virtual int call(lua_State* L, vstring name) = 0;
+        virtual int call(lua_State* L, vstring name, vstring source) = 0;
         virtual void destory(vstring name) = 0;
     };
 
@@ -42,7 +65,7 @@ namespace lworker {
     {
     public:
         worker(ischeduler* schedulor, vstring name, vstring entry, vstring incl, vstring service)
-            : m_schedulor(schedulor), m_name(name), m_entry(entry), m_service(service), m_include(incl) { 
+            : m_schedulor(schedulor), m_name(name), m_entry(entry), m_service(service), m_include(incl), m_mailbox(name) { 
             m_codec = m_lua->create_codec();
         }
 
@@ -58,47 +81,12 @@ namespace lworker {
             return getenv(key);
         }
 
-        bool call(lua_State* L) {
-            size_t data_len;
-            std::unique_lock<spin_mutex> lock(m_mutex);
-            uint8_t* data = m_codec->encode(L, 2, &data_len);
-            uint8_t* target = m_write_buf->peek_space(data_len + sizeof(uint32_t));
-            if (target) {
-                m_write_buf->write<uint32_t>(data_len);
-                m_write_buf->push_data(data, data_len);
-                return true;
-            }
-            LOG_ERROR(fmt::format("[{}] thread call buffer is full!,size:{}", m_name, m_write_buf->size()));
-            return false;
+        bool call(lua_State* L, vstring source) {
+            return m_mailbox.push(L, m_codec, source);
         }
 
         void update(uint64_t clock_ms) {
-            if (m_read_buf->empty()) {
-                if (m_write_buf->empty()) {
-                    return;
-                }
-                std::unique_lock<spin_mutex> lock(m_mutex);
-                m_read_buf.swap(m_write_buf);
-            }
-            size_t plen = 0, pcount = 0;
-            const char* service = m_service.c_str();
-            slice* slice = read_slice(m_read_buf, &plen);
-            while (slice) {
-                m_codec->set_slice(slice);
-                m_lua->table_call(service, "on_worker", nullptr, m_codec, std::tie());
-                if (m_codec->failed()) {
-                    m_read_buf->clean();
-                    break;
-                }
-                m_read_buf->pop_size(plen);
-                ++pcount;
-                auto cost_time = steady_ms() - clock_ms;
-                if (steady_ms() - clock_ms > 100) {
-                    LOG_ERROR(fmt::format("on_worker [{}]  is busy,cost:{},pcount:{},remain:{}", m_name, cost_time, pcount, m_read_buf->size()));
-                    break;
-                }
-                slice = read_slice(m_read_buf, &plen);
-            }
+            m_mailbox.dispatch(m_lua.get(), m_service.c_str(), "on_worker", clock_ms);
         }
 
         void startup(){            
@@ -108,13 +96,21 @@ namespace lworker {
         }
 
         void run(){
+            setup_placement(m_name, false);
             auto hive = m_lua->new_table(m_service.c_str());
             hive.set("pid", ::getpid());
             hive.set("title", m_name);
             hive.set_function("stop", [&]() { m_running = false; });
             hive.set_function("update", [&](uint64_t clock_ms) { update(clock_ms); });
             hive.set_function("getenv", [&](const char* key) { return get_env(key); });
-            hive.set_function("call", [&](lua_State* L, vstring name) { return m_schedulor->call(L, name); });
+            hive.set_function("call", [&](lua_State* L, vstring name) { return m_schedulor->call(L, name, m_name); });
+            hive.set_function("recv", [&](lua_State* L) { return m_mailbox.recv(L, m_codec); });
+            hive.set_function("stats", [&](lua_State* L) { return m_mailbox.stats(L); });
+            hive.set_function("set_budget", [&](uint32_t budget_ms, uint32_t batch_num) { m_mailbox.set_budget(budget_ms, batch_num); });
+            hive.set_function("perf_begin", [&]() { m_perf.begin(); });
+            hive.set_function("perf_mark", [&](uint32_t phase) { m_perf.mark(phase); });
+            hive.set_function("perf_finish", [&]() { m_perf.finish(); });
+            hive.set_function("perf_stats", [&](lua_State* L, bool reset) { return m_perf.stats(L, reset); });
             m_lua->run_script(g_sandbox, [&](vstring err) {
                 LOG_ERROR(fmt::format("worker load sandbox failed, because: {}", err.data()));
                 m_schedulor->destory(m_name);
@@ -150,7 +146,6 @@ namespace lworker {
         }
 
     private:
-        spin_mutex m_mutex;
         std::thread m_thread;
         bool m_stop = false;
         bool m_running = false;
@@ -158,8 +153,8 @@ namespace lworker {
         ischeduler* m_schedulor = nullptr;
         std::string m_name, m_entry, m_service, m_include;
         std::unique_ptr<kit_state> m_lua = std::make_unique<kit_state>();
-        std::shared_ptr<luabuf> m_read_buf = std::make_shared<luabuf>(64,32);
-        std::shared_ptr<luabuf> m_write_buf = std::make_shared<luabuf>(64,32);
+        mailbox m_mailbox;
+        frame_perf m_perf;
     };
 }
 
@@ -107,6 +107,38 @@ int lua_socket_node::call(lua_State* L, uint32_t session_id, uint8_t flag, uint3
 	return 1;
 }
 
+//最后一个参数是已经编码好的数据块(lua_blob或字符串), 作为字符串参数原样发送, 不解码也不复制
+int lua_socket_node::call_blob(lua_State* L, uint32_t session_id, uint8_t flag, uint32_t source_id) {
+	int top = lua_gettop(L);
+	std::string_view blob;
+	if (!m_codec || top < 5 || !lua_blob_view(L, top, blob)) {
+		lua_pushinteger(L, 0);
+		return 1;
+	}
+	//数据块移到前面留在栈上, 只编码rpc和其余参数
+	lua_rotate(L, 4, 1);
+	size_t data_len = 0;
+	uint8_t* data = m_codec->encode(L, 5, &data_len);
+	uint8_t blob_head[8];
+	size_t head_len = string_head_encode(blob_head, blob.size());
+	if (data_len == 0 || data[0] == UCHAR_MAX || data_len + head_len + blob.size() > SOCKET_PACKET_MAX) {
+		lua_pushinteger(L, 0);
+		return 1;
+	}
+	//参数个数加上数据块
+	data[0]++;
+	router_header header;
+	header.session_id = session_id;
+	header.rpc_flag = flag;
+	header.source_id = source_id;
+	header.msg_id = (uint8_t)rpc_type::remote_call;
+	header.len = data_len + head_len + blob.size() + ROUTER_HEAD_SIZE;
+	sendv_item items[] = { {&header, ROUTER_HEAD_SIZE}, {data, data_len}, {blob_head, head_len}, {blob.data(), blob.size()} };
+	auto send_len = m_mgr->sendv(m_token, items, _countof(items));
+	lua_pushinteger(L, send_len);
+	return 1;
+}
+
 int lua_socket_node::forward_target(lua_State* L, uint32_t session_id, uint8_t flag, uint32_t source_id, uint32_t target) {
 	if (m_codec) {
 		size_t data_len = 0;
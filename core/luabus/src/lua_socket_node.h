@@ -16,6 +16,7 @@ struct lua_socket_node final
 	int call_pb(lua_State* L);
 	int call_text(lua_State* L);
 	int call_data(lua_State* L);
+	int call_blob(lua_State* L, uint32_t session_id, uint8_t flag, uint32_t source_id);
 
 	void close();
 	void set_timeout(int ms) { m_mgr->set_timeout(m_token, ms); }
@@ -100,6 +100,7 @@ namespace luabus {
             "call_pb",&lua_socket_node::call_pb,
             "call_text",&lua_socket_node::call_text,
             "call_data", &lua_socket_node::call_data,
+            "call_blob", &lua_socket_node::call_blob,
             "forward_hash", &lua_socket_node::forward_hash,
             "forward_player",&lua_socket_node::forward_player,
             "forward_group_player",&lua_socket_node::forward_group_player,
@@ -547,10 +547,12 @@ void socket_stream::dispatch_package(bool reset) {
 		case eproto_type::proto_pb:
 		case eproto_type::proto_text: {
 			if (m_codec) {
+				//回调中可能切换codec, 本包使用切换前的codec收尾
+				codec_base* codec = m_codec;
 				//解析数据包头长度
 				slice* slice = m_recv_buffer.get_slice();
-				m_codec->set_slice(slice);
-				package_size = m_codec->load_packet(data_len);
+				codec->set_slice(slice);
+				package_size = codec->load_packet(data_len);
 				//当前包头长度解析失败, 关闭连接
 				if (package_size < 0) {
 					on_error(fmt::format("text package-length-err,ip:{}", m_ip).c_str());
@@ -566,11 +568,11 @@ void socket_stream::dispatch_package(bool reset) {
 					return;
 				}
 				// 数据包解析失败
-				if (m_codec->failed()) {
-					on_error(fmt::format("codec decode failed:{}", m_codec->err()).c_str());
+				if (codec->failed()) {
+					on_error(fmt::format("codec decode failed:{}", codec->err()).c_str());
 					return;
 				}
-				size_t read_size = m_codec->get_packet_len();
+				size_t read_size = codec->get_packet_len();
 				// 数据包还没有收完整
 				if (read_size == 0) {
 					std::cout << "read_size:" << package_size << std::endl;
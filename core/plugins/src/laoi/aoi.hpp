@@ -1,12 +1,18 @@
 ﻿#pragma once
 #include <unordered_map>
-#include <forward_list>
-#include <unordered_set>
+#include <vector>
+#include <memory>
 #include <cassert>
 #include <functional>
 #include <iostream>
 #include <algorithm>
 #include "math.hpp"
+#include "aoi_worker.hpp"
+
+#if defined(__SSE2__) && !defined(_MSC_VER)
+#include <immintrin.h>
+#define AOI_SIMD
+#endif
 
 template<class AoiObject>
 class aoi
@@ -21,6 +27,7 @@ public:
 	{
 		event_enter = 1,
 		event_leave = 2,
+		event_move = 3,
 	};
 
 	using object_type = AoiObject;//对象类型
@@ -39,11 +46,32 @@ public:
 		{
 		}
 	};
+
+	//批量模式下单个观察者一帧的合并增量
+	struct aoi_delta
+	{
+		object_handle_type watcher = object_handle_type{};
+		std::vector<std::pair<object_handle_type, int>> events; //原始进出事件(marker, eventid)
+		std::vector<object_handle_type> enters;
+		std::vector<object_handle_type> leaves;
+		std::vector<object_handle_type> moves;
+	};
 private:
+	//格子内对象数量很少, 连续数组遍历比链表/哈希集合快, 删除时与末尾交换
 	struct tile
 	{
-		std::forward_list<object_type*> markers;    //观察者(玩家)
-		std::unordered_set<object_type*> watchers;  //被观察者(被看的东西,玩家)
+		std::vector<object_type*> markers;    //被观察者(被看的东西,玩家)
+		std::vector<int32_t> xs;              //markers的坐标和层, 与markers下标一致, 距离查询按列连续比较
+		std::vector<int32_t> ys;
+		std::vector<int32_t> layers;
+		std::vector<object_type*> watchers;   //观察者(玩家)
+	};
+
+	//批量模式下缓存的目标位置
+	struct aoi_move
+	{
+		object_type* obj;
+		int x, y, w, h, layer;
 	};
 public:
 	//x,y为地图偏移,为了对齐前端坐标,一般0,0即可
@@ -141,7 +169,7 @@ public:
 						std::cout << res.first->first << " watch (" << x << "," << y << ")" << std::endl;
 					}
 					//触发事件
-					update_watcher(t, rect<int>{-1, -1, 0, 0}, rc, & res.first->second);
+					update_watcher(t, rect<int>{-1, -1, 0, 0}, rc, & res.first->second, event_queue_);
 					});
 			}
 			return true;
@@ -177,7 +205,266 @@ public:
 		}
 
 		object_type* obj = &iter->second;
+		//批量模式只记录本帧最终位置, flush时统一处理
+		if (batch_)
+		{
+			if (obj->pending < 0)
+			{
+				obj->pending = static_cast<int>(moves_.size());
+				moves_.push_back(aoi_move{ obj, x, y, w, h, layer });
+			}
+			else
+			{
+				moves_[obj->pending] = aoi_move{ obj, x, y, w, h, layer };
+			}
+			return true;
+		}
+		move_object(obj, x, y, w, h, layer, event_queue_);
+		return true;
+	}
 
+	//批量模式: 应用本帧积累的移动, 按观察者合并为enter/leave/move增量
+	//同一对(watcher, marker)的进出相互抵消, 进入视野的不再重复下发move
+	void flush()
+	{
+		event_queue_.clear();
+		moved_.clear();
+		++stamp_;
+		delta_count_ = 0;
+		parallel_count_ = 0;
+		for (auto& mv : moves_)
+		{
+			object_type* obj = mv.obj;
+			if (obj == nullptr)
+			{
+				continue;
+			}
+			obj->pending = -1;
+			if ((obj->mode & marker) && (obj->x != mv.x || obj->y != mv.y))
+			{
+				moved_.push_back(obj);
+			}
+		}
+		if (worker_ && moves_.size() >= parallel_min)
+		{
+			apply_parallel();
+		}
+		else
+		{
+			for (auto& mv : moves_)
+			{
+				if (mv.obj)
+				{
+					move_object(mv.obj, mv.x, mv.y, mv.w, mv.h, mv.layer, event_queue_);
+				}
+			}
+		}
+		moves_.clear();
+		//原始事件按观察者分桶
+		for (const auto& evt : event_queue_)
+		{
+			auto iter = objects_.find(evt.watcher);
+			if (iter != objects_.end())
+			{
+				get_delta(&iter->second).events.emplace_back(evt.marker, evt.eventid);
+			}
+		}
+		event_queue_.clear();
+		//进出计数抵消, 结果按marker有序
+		for (size_t i = 0; i < delta_count_; ++i)
+		{
+			auto& d = deltas_[i];
+			std::sort(d.events.begin(), d.events.end());
+			for (size_t j = 0; j < d.events.size();)
+			{
+				auto m = d.events[j].first;
+				int net = 0;
+				for (; j < d.events.size() && d.events[j].first == m; ++j)
+				{
+					net += (d.events[j].second == event_enter) ? 1 : -1;
+				}
+				if (net > 0)
+				{
+					d.enters.push_back(m);
+				}
+				else if (net < 0)
+				{
+					d.leaves.push_back(m);
+				}
+			}
+		}
+		//视野内移动过的marker, 并行时分段收集再按原顺序合并
+		if (worker_ && moved_.size() >= parallel_min)
+		{
+			size_t chunks = region_pairs_.size();
+			size_t step = (moved_.size() + chunks - 1) / chunks;
+			worker_->execute(chunks, [this, step](size_t r) {
+				auto& pairs = region_pairs_[r];
+				pairs.clear();
+				visit_moves(r * step, std::min(moved_.size(), (r + 1) * step), [&pairs](object_type* w, object_type* m) {
+					pairs.emplace_back(w, m);
+					});
+				});
+			for (const auto& pairs : region_pairs_)
+			{
+				for (const auto& pair : pairs)
+				{
+					add_move(pair.first, pair.second);
+				}
+			}
+		}
+		else
+		{
+			visit_moves(0, moved_.size(), [this](object_type* w, object_type* m) {
+				add_move(w, m);
+				});
+		}
+		//输出按watcher排序, 与是否并行无关
+		std::sort(deltas_.begin(), deltas_.begin() + delta_count_, [](const aoi_delta& a, const aoi_delta& b) {
+			return a.watcher < b.watcher;
+			});
+	}
+
+	//并行处理批量移动, threads为参与计算的线程数(含调用线程), 小于2关闭
+	void enable_parallel(int threads)
+	{
+		if (threads < 2)
+		{
+			worker_.reset();
+			return;
+		}
+		worker_ = std::make_unique<aoi_worker>(threads - 1);
+		region_moves_.resize(threads + 1);
+		region_events_.resize(threads + 1);
+		region_pairs_.resize(threads);
+	}
+
+	//上一次flush并行处理的移动数
+	size_t parallel_count() const
+	{
+		return parallel_count_;
+	}
+
+	template<typename Handler>
+	void for_each_delta(const Handler& handler) const
+	{
+		for (size_t i = 0; i < delta_count_; ++i)
+		{
+			const auto& d = deltas_[i];
+			if (!d.enters.empty() || !d.leaves.empty() || !d.moves.empty())
+			{
+				handler(d);
+			}
+		}
+	}
+
+	void enable_batch(bool v)
+	{
+		batch_ = v;
+	}
+
+	size_t pending_size() const
+	{
+		return moves_.size();
+	}
+private:
+	//按格子列把地图切成条带, 移动涉及的格子(新旧视野和所在格)完全落在同一条带内的由各线程并行处理
+	//不同条带的移动不共享格子, 也不会读到对方正在修改的对象; 跨条带的用错开半个条带的划分再并行一次, 剩下的顺序处理
+	//视野关系只取决于首尾状态, 处理顺序不影响合并后的结果
+	void apply_parallel()
+	{
+		int slots = static_cast<int>(worker_->size());
+		int width = std::max(1, (count_ + slots - 1) / slots);
+		rest_.clear();
+		for (auto& mv : moves_)
+		{
+			if (mv.obj)
+			{
+				rest_.push_back(&mv);
+			}
+		}
+		for (int pass = 0; pass < 2 && !rest_.empty(); ++pass)
+		{
+			int shift = pass * (width / 2);
+			size_t strips = static_cast<size_t>((count_ - 1 + shift) / width + 1);
+			for (size_t r = 0; r < strips; ++r)
+			{
+				region_moves_[r].clear();
+				region_events_[r].clear();
+			}
+			border_.clear();
+			for (auto mv : rest_)
+			{
+				int lo, hi;
+				move_footprint(*mv, lo, hi);
+				int r = (lo + shift) / width;
+				if (r == (hi + shift) / width)
+				{
+					region_moves_[r].push_back(mv);
+				}
+				else
+				{
+					border_.push_back(mv);
+				}
+			}
+			worker_->execute(strips, [this](size_t r) {
+				for (auto mv : region_moves_[r])
+				{
+					move_object(mv->obj, mv->x, mv->y, mv->w, mv->h, mv->layer, region_events_[r]);
+				}
+				});
+			for (size_t r = 0; r < strips; ++r)
+			{
+				parallel_count_ += region_moves_[r].size();
+				event_queue_.insert(event_queue_.end(), region_events_[r].begin(), region_events_[r].end());
+			}
+			rest_.swap(border_);
+		}
+		for (auto mv : rest_)
+		{
+			move_object(mv->obj, mv->x, mv->y, mv->w, mv->h, mv->layer, event_queue_);
+		}
+	}
+
+	//移动会读写的格子列范围
+	void move_footprint(const aoi_move& mv, int& lo, int& hi) const
+	{
+		const object_type* obj = mv.obj;
+		auto old_rc = make_tile_rect(obj->x, obj->y, obj->w, obj->h);
+		auto new_rc = make_tile_rect(mv.x, mv.y, mv.w, mv.h);
+		lo = std::min({ old_rc.left(), new_rc.left(), get_tile_x(obj->x), get_tile_x(mv.x) });
+		hi = std::max({ old_rc.right(), new_rc.right(), get_tile_x(obj->x), get_tile_x(mv.x) });
+	}
+
+	//moved_[first, last)中的marker与看得到它的watcher
+	template<typename Handler>
+	void visit_moves(size_t first, size_t last, const Handler& handler) const
+	{
+		for (size_t i = first; i < last; ++i)
+		{
+			object_type* m = moved_[i];
+			const tile& t = data_[get_tile_y(m->y) * count_ + get_tile_x(m->x)];
+			for (auto w : t.watchers)
+			{
+				if (w != m && in_view(w, m->x, m->y))
+				{
+					handler(w, m);
+				}
+			}
+		}
+	}
+
+	void add_move(object_type* w, object_type* m)
+	{
+		auto& d = get_delta(w);
+		if (d.enters.empty() || !std::binary_search(d.enters.begin(), d.enters.end(), m->handle))
+		{
+			d.moves.push_back(m->handle);
+		}
+	}
+
+	void move_object(object_type* obj, int x, int y, int w, int h, int layer, std::vector<aoi_event>& events)
+	{
 		auto old_rect = make_rect(obj->x, obj->y, obj->w, obj->h);
 		auto old_tile_rect = make_tile_rect(obj->x, obj->y, obj->w, obj->h);
 
@@ -189,20 +476,20 @@ public:
 		obj->w = w;
 		obj->layer = layer;
 
-		if (iter->second.mode & marker)
+		if (obj->mode & marker)
 		{
-			update_marker(obj, old_x, old_y);
+			update_marker(obj, old_x, old_y, events);
 		}
 
-		while (iter->second.mode & watcher)
+		while (obj->mode & watcher)
 		{
 			auto new_rect = make_rect(x, y, w, h);
 			auto new_tile_rect = make_tile_rect(x, y, w, h);
 
 			if (old_rect.contains(new_rect))
 			{
-				for_each_rect(old_tile_rect, [this, &new_rect, &new_tile_rect, &old_rect, &obj](int x, int y) {
-					auto rc = rect<int>{ x * tile_size_, y * tile_size_, tile_size_, tile_size_ };
+				for_each_rect(old_tile_rect, [this, &new_rect, &new_tile_rect, &old_rect, &obj, &events](int x, int y) {
+					auto rc = rect<int>{ rect_.x + x * tile_size_, rect_.y + y * tile_size_, tile_size_, tile_size_ };
 					if (new_rect.contains(rc))
 					{
 						return;
@@ -218,15 +505,15 @@ public:
 						}
 					}
 
-					update_watcher(t, old_rect, new_rect, obj);
+					update_watcher(t, old_rect, new_rect, obj, events);
 					});
 				break;
 			}
 
 			if (old_rect.contains(new_rect))
 			{
-				for_each_rect(new_tile_rect, [this, &new_rect, &old_tile_rect, &old_rect, &obj](int x, int y) {
-					auto rc = rect<int>{ x * tile_size_, y * tile_size_, tile_size_, tile_size_ };
+				for_each_rect(new_tile_rect, [this, &new_rect, &old_tile_rect, &old_rect, &obj, &events](int x, int y) {
+					auto rc = rect<int>{ rect_.x + x * tile_size_, rect_.y + y * tile_size_, tile_size_, tile_size_ };
 					if (old_rect.contains(rc))
 					{
 						return;
@@ -242,13 +529,13 @@ public:
 						}
 					}
 
-					update_watcher(t, old_rect, new_rect, obj);
+					update_watcher(t, old_rect, new_rect, obj, events);
 					});
 				break;
 			}
 
-			for_each_rect(old_tile_rect, [this, &new_rect, &new_tile_rect, &old_rect, &obj](int x, int y) {
-				auto rc = rect<int>{ x * tile_size_, y * tile_size_, tile_size_, tile_size_ };
+			for_each_rect(old_tile_rect, [this, &new_rect, &new_tile_rect, &old_rect, &obj, &events](int x, int y) {
+				auto rc = rect<int>{ rect_.x + x * tile_size_, rect_.y + y * tile_size_, tile_size_, tile_size_ };
 				if (new_rect.contains(rc))
 				{
 					return;
@@ -265,11 +552,11 @@ public:
 					}
 				}
 				//std::cout << " update_watcher1 (" << x << "," << y << ")" << std::endl;
-				update_watcher(t, old_rect, new_rect, obj, false, true);
+				update_watcher(t, old_rect, new_rect, obj, events, false, true);
 				});
 
-			for_each_rect(new_tile_rect, [this, &new_rect, &old_tile_rect, &old_rect, &obj](int x, int y) {
-				auto rc = rect<int>{ x * tile_size_, y * tile_size_, tile_size_, tile_size_ };
+			for_each_rect(new_tile_rect, [this, &new_rect, &old_tile_rect, &old_rect, &obj, &events](int x, int y) {
+				auto rc = rect<int>{ rect_.x + x * tile_size_, rect_.y + y * tile_size_, tile_size_, tile_size_ };
 				if (old_rect.contains(rc))
 				{
 					return;
@@ -286,13 +573,12 @@ public:
 					}
 				}
 				//std::cout << " update_watcher2 (" << x << "," << y << ")" << std::endl;
-				update_watcher(t, old_rect, new_rect, obj, true, false);
+				update_watcher(t, old_rect, new_rect, obj, events, true, false);
 				});
 			break;
 		}
-
-		return true;
 	}
+public:
 
 	template<typename... Args>
 	void query(int x, int y, int w, int h, std::vector<int64_t>& out, Args&&...args)
@@ -337,6 +623,127 @@ public:
 		}
 	}
 
+	//圆形范围内的marker, mask按位过滤层(1 << layer), 0不过滤
+	//整格在圆内的直接收集, 压线的格子按坐标列4个一组比较距离
+	void query_circle(int x, int y, int radius, uint32_t mask, std::vector<object_handle_type>& out)
+	{
+		out.clear();
+		float cx = static_cast<float>(x), cy = static_cast<float>(y);
+		float r2 = static_cast<float>(radius) * static_cast<float>(radius);
+		auto tile_rc = make_tile_rect(x, y, radius * 2, radius * 2);
+		for (int j = tile_rc.bottom(); j <= tile_rc.top(); ++j)
+		{
+			for (int i = tile_rc.left(); i <= tile_rc.right(); ++i)
+			{
+				const tile& node = data_[j * count_ + i];
+				if (node.markers.empty())
+				{
+					continue;
+				}
+				float near2, far2;
+				tile_distance(i, j, cx, cy, near2, far2);
+				if (near2 > r2)
+				{
+					continue;
+				}
+				if (far2 <= r2)
+				{
+					for (size_t k = 0; k < node.markers.size(); ++k)
+					{
+						push_marker(node, k, mask, out);
+					}
+					continue;
+				}
+				match_circle(node, cx, cy, r2, mask, out);
+			}
+		}
+	}
+
+	//扇形范围内的marker, dir为朝向角度, half为半张角(度)
+	void query_sector(int x, int y, int radius, float dir, float half, uint32_t mask, std::vector<object_handle_type>& out)
+	{
+		out.clear();
+		const float rad = 3.14159265358979f / 180.0f;
+		float cx = static_cast<float>(x), cy = static_cast<float>(y);
+		float r2 = static_cast<float>(radius) * static_cast<float>(radius);
+		float ux = std::cos(dir * rad), uy = std::sin(dir * rad);
+		float cosh = std::cos(std::clamp(half, 0.0f, 180.0f) * rad);
+		auto tile_rc = make_tile_rect(x, y, radius * 2, radius * 2);
+		for (int j = tile_rc.bottom(); j <= tile_rc.top(); ++j)
+		{
+			for (int i = tile_rc.left(); i <= tile_rc.right(); ++i)
+			{
+				const tile& node = data_[j * count_ + i];
+				if (node.markers.empty())
+				{
+					continue;
+				}
+				float near2, far2;
+				tile_distance(i, j, cx, cy, near2, far2);
+				if (near2 <= r2)
+				{
+					match_sector(node, cx, cy, r2, ux, uy, cosh, mask, out);
+				}
+			}
+		}
+	}
+
+	//半径内最近的k个marker, 按距离从近到远
+	//从所在格子一圈圈向外找, 第k近的距离不超过下一圈的最近距离就停止
+	void query_nearest(int x, int y, int radius, size_t k, uint32_t mask, std::vector<object_handle_type>& out)
+	{
+		out.clear();
+		nearest_.clear();
+		if (k == 0)
+		{
+			return;
+		}
+		float cx = static_cast<float>(x), cy = static_cast<float>(y);
+		float r2 = static_cast<float>(radius) * static_cast<float>(radius);
+		int tx = get_tile_x(std::clamp(x, rect_.left(), rect_.right()));
+		int ty = get_tile_y(std::clamp(y, rect_.bottom(), rect_.top()));
+		int max_ring = std::max({ tx, ty, count_ - 1 - tx, count_ - 1 - ty });
+		for (int ring = 0; ring <= max_ring; ++ring)
+		{
+			for (int j = ty - ring; j <= ty + ring; ++j)
+			{
+				if (j < 0 || j >= count_)
+				{
+					continue;
+				}
+				//上下两行整行, 中间只取左右两格
+				int step = (j == ty - ring || j == ty + ring) ? 1 : std::max(1, ring * 2);
+				for (int i = tx - ring; i <= tx + ring; i += step)
+				{
+					if (i >= 0 && i < count_)
+					{
+						match_nearest(data_[j * count_ + i], cx, cy, r2, mask);
+					}
+				}
+			}
+			//下一圈的点距离都大于ring个格子
+			float bound = static_cast<float>(ring) * static_cast<float>(tile_size_);
+			if (bound * bound > r2)
+			{
+				break;
+			}
+			if (nearest_.size() >= k)
+			{
+				std::nth_element(nearest_.begin(), nearest_.begin() + (k - 1), nearest_.end());
+				if (nearest_[k - 1].first < bound * bound)
+				{
+					break;
+				}
+			}
+		}
+		size_t n = std::min(k, nearest_.size());
+		std::partial_sort(nearest_.begin(), nearest_.begin() + n, nearest_.end());
+		for (size_t i = 0; i < n; ++i)
+		{
+			out.push_back(nearest_[i].second);
+		}
+	}
+
 	void clear()
 	{
 		for (int i = 0; i < count_; ++i)
@@ -345,10 +752,14 @@ public:
 			{
 				tile& n = data_[i * count_ + j];
 				n.markers.clear();
+				n.xs.clear();
+				n.ys.clear();
+				n.layers.clear();
 				n.watchers.clear();
 			}
 		}
 		objects_.clear();
+		moves_.clear();
 	}
 
 	void erase(object_handle_type handle)
@@ -356,6 +767,10 @@ public:
 		auto iter = objects_.find(handle);
 		if (iter != objects_.end())
 		{
+			if (iter->second.pending >= 0)
+			{
+				moves_[iter->second.pending].obj = nullptr;
+			}
 			if (iter->second.mode & marker)
 			{
 				if (iter->second.w > 0 && iter->second.h > 0)
@@ -383,7 +798,7 @@ public:
 					{
 						std::cout << iter->first << " unwatch (" << x << "," << y << ")" << std::endl;
 					}
-					node.watchers.erase(&iter->second);
+					remove_watcher(node, &iter->second);
 					});
 			}
 
@@ -456,14 +871,13 @@ private:
 	void insert_marker(object_type* obj, int tile_x, int tile_y)
 	{
 		tile& node = data_[tile_y * count_ + tile_x];
-		node.markers.emplace_front(obj);
+		add_marker(node, obj);
 
 		for (const auto& w : node.watchers)
 		{
 			if (w->handle == obj->handle) continue;
 
-			auto rc = make_rect(w->x, w->y, w->w, w->h);
-			if (!rc.contains(obj->x, obj->y))
+			if (!in_view(w, obj->x, obj->y))
 			{
 				continue;
 			}
@@ -475,14 +889,13 @@ private:
 	void remove_marker(object_type* obj, int tile_x, int tile_y)
 	{
 		tile& node = data_[tile_y * count_ + tile_x];
-		node.markers.remove(obj);
+		erase_marker(node, obj);
 
 		for (const auto& w : node.watchers)
 		{
 			if (w->handle == obj->handle) continue;
 
-			auto rc = make_rect(w->x, w->y, w->w, w->h);
-			if (!rc.contains(obj->x, obj->y))
+			if (!in_view(w, obj->x, obj->y))
 			{
 				continue;
 			}
@@ -491,7 +904,7 @@ private:
 		}
 	}
 
-	void update_marker(object_type* obj, int old_x, int old_y)
+	void update_marker(object_type* obj, int old_x, int old_y, std::vector<aoi_event>& events)
 	{
 		int old_tile_x = get_tile_x(old_x);
 		int old_tile_y = get_tile_y(old_y);
@@ -504,25 +917,48 @@ private:
 
 		if (&old_node != &node)
 		{
-			old_node.markers.remove(obj);
-			node.markers.emplace_front(obj);
+			erase_marker(old_node, obj);
+			add_marker(node, obj);
 			if (debug_)
 			{
 				std::cout << obj->handle << " insert (" << new_tile_x << "," << new_tile_y << ")" << std::endl;
 			}
 		}
+		else
+		{
+			set_marker(node, obj);
+		}
+
+		//格子没变时进出在同一遍里检查
+		if (&old_node == &node)
+		{
+			for (const auto& w : node.watchers)
+			{
+				if (w->handle == obj->handle) continue;
+				bool in_old_view = in_view(w, old_x, old_y);
+				bool in_new_view = in_view(w, obj->x, obj->y);
+				if (in_new_view && !in_old_view)
+				{
+					events.emplace_back(static_cast<int>(event_enter), w->handle, obj->handle);
+				}
+				else if (in_old_view && !in_new_view && enable_leave_event_)
+				{
+					events.emplace_back(static_cast<int>(event_leave), w->handle, obj->handle);
+				}
+			}
+			return;
+		}
 
 		if (enable_leave_event_)
 		{
 			for (const auto& w : old_node.watchers)
 			{
 				if (w->handle == obj->handle) continue;
-				auto rc = make_rect(w->x, w->y, w->w, w->h);
-				if (!rc.contains(old_x, old_y) || rc.contains(obj->x, obj->y))
+				if (!in_view(w, old_x, old_y) || in_view(w, obj->x, obj->y))
 				{
 					continue;
 				}
-				event_queue_.emplace_back(static_cast<int>(event_leave), w->handle, obj->handle);
+				events.emplace_back(static_cast<int>(event_leave), w->handle, obj->handle);
 			}
 		}
 
@@ -530,13 +966,12 @@ private:
 		{
 			if (w->handle == obj->handle) continue;
 
-			auto rc = make_rect(w->x, w->y, w->w, w->h);
-			if (!rc.contains(obj->x, obj->y) || rc.contains(old_x, old_y))
+			if (!in_view(w, obj->x, obj->y) || in_view(w, old_x, old_y))
 			{
 				continue;
 			}
 
-			event_queue_.emplace_back(static_cast<int>(event_enter), w->handle, obj->handle);
+			events.emplace_back(static_cast<int>(event_enter), w->handle, obj->handle);
 		}
 	}
 
@@ -547,8 +982,7 @@ private:
 		{
 			//if (w->handle == obj->handle) continue;
 
-			auto rc = make_rect(w->x, w->y, w->w, w->h);
-			if (!rc.contains(obj->x, obj->y))
+			if (!in_view(w, obj->x, obj->y))
 			{
 				continue;
 			}
@@ -559,20 +993,226 @@ private:
 
 	void insert_watcher(tile& node, object_type* obj)
 	{
-		[[maybe_unused]] bool ok = node.watchers.emplace(obj).second;
-		assert(ok);
+		node.watchers.push_back(obj);
 	}
 
 	void remove_watcher(tile& node, object_type* obj)
 	{
-		[[maybe_unused]] size_t count = node.watchers.erase(obj);
-		assert(1 == count);
+		[[maybe_unused]] bool ok = erase_object(node.watchers, obj);
+		assert(ok);
+	}
+
+	//点是否在观察者视野内, 地图内的点不受make_rect边界裁剪影响, 省去构建矩形
+	static bool in_view(const object_type* w, int px, int py)
+	{
+		return std::abs(px - w->x) <= w->w / 2 && std::abs(py - w->y) <= w->h / 2;
+	}
+
+	//点到格子的最近/最远距离平方
+	void tile_distance(int i, int j, float cx, float cy, float& near2, float& far2) const
+	{
+		float left = static_cast<float>(rect_.x + i * tile_size_);
+		float bottom = static_cast<float>(rect_.y + j * tile_size_);
+		float right = left + tile_size_, top = bottom + tile_size_;
+		float nx = std::clamp(cx, left, right) - cx, ny = std::clamp(cy, bottom, top) - cy;
+		float fx = std::max(cx - left, right - cx), fy = std::max(cy - bottom, top - cy);
+		near2 = nx * nx + ny * ny;
+		far2 = fx * fx + fy * fy;
+	}
+
+	static void push_marker(const tile& node, size_t idx, uint32_t mask, std::vector<object_handle_type>& out)
+	{
+		if (mask == 0 || (mask & (1u << (node.layers[idx] & 31))))
+		{
+			out.push_back(node.markers[idx]->handle);
+		}
+	}
+
+	static void match_circle(const tile& node, float cx, float cy, float r2, uint32_t mask, std::vector<object_handle_type>& out)
+	{
+		size_t n = node.xs.size(), i = 0;
+#ifdef AOI_SIMD
+		__m128 vx = _mm_set1_ps(cx), vy = _mm_set1_ps(cy), vr = _mm_set1_ps(r2);
+		for (; i + 4 <= n; i += 4)
+		{
+			__m128 dx = _mm_sub_ps(_mm_cvtepi32_ps(_mm_loadu_si128((const __m128i*)(node.xs.data() + i))), vx);
+			__m128 dy = _mm_sub_ps(_mm_cvtepi32_ps(_mm_loadu_si128((const __m128i*)(node.ys.data() + i))), vy);
+			__m128 d2 = _mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy));
+			for (int bits = _mm_movemask_ps(_mm_cmple_ps(d2, vr)); bits; bits &= bits - 1)
+			{
+				push_marker(node, i + __builtin_ctz(bits), mask, out);
+			}
+		}
+#endif
+		for (; i < n; ++i)
+		{
+			float dx = static_cast<float>(node.xs[i]) - cx, dy = static_cast<float>(node.ys[i]) - cy;
+			if (dx * dx + dy * dy <= r2)
+			{
+				push_marker(node, i, mask, out);
+			}
+		}
+	}
+
+	//夹角判断不开方: 半张角不超过90度时要求点积非负且点积平方不小于cos²·距离², 超过90度时取补集
+	static void match_sector(const tile& node, float cx, float cy, float r2, float ux, float uy, float cosh, uint32_t mask, std::vector<object_handle_type>& out)
+	{
+		size_t n = node.xs.size(), i = 0;
+		float cos2 = cosh * cosh;
+#ifdef AOI_SIMD
+		__m128 vx = _mm_set1_ps(cx), vy = _mm_set1_ps(cy), vr = _mm_set1_ps(r2);
+		__m128 vux = _mm_set1_ps(ux), vuy = _mm_set1_ps(uy), vc2 = _mm_set1_ps(cos2), zero = _mm_setzero_ps();
+		for (; i + 4 <= n; i += 4)
+		{
+			__m128 dx = _mm_sub_ps(_mm_cvtepi32_ps(_mm_loadu_si128((const __m128i*)(node.xs.data() + i))), vx);
+			__m128 dy = _mm_sub_ps(_mm_cvtepi32_ps(_mm_loadu_si128((const __m128i*)(node.ys.data() + i))), vy);
+			__m128 d2 = _mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy));
+			__m128 dot = _mm_add_ps(_mm_mul_ps(dx, vux), _mm_mul_ps(dy, vuy));
+			__m128 dot2 = _mm_mul_ps(dot, dot), lim = _mm_mul_ps(vc2, d2);
+			__m128 front = _mm_cmpge_ps(dot, zero);
+			__m128 angle = (cosh >= 0) ? _mm_and_ps(front, _mm_cmpge_ps(dot2, lim)) : _mm_or_ps(front, _mm_cmple_ps(dot2, lim));
+			for (int bits = _mm_movemask_ps(_mm_and_ps(_mm_cmple_ps(d2, vr), angle)); bits; bits &= bits - 1)
+			{
+				push_marker(node, i + __builtin_ctz(bits), mask, out);
+			}
+		}
+#endif
+		for (; i < n; ++i)
+		{
+			float dx = static_cast<float>(node.xs[i]) - cx, dy = static_cast<float>(node.ys[i]) - cy;
+			float d2 = dx * dx + dy * dy;
+			if (d2 > r2)
+			{
+				continue;
+			}
+			float dot = dx * ux + dy * uy;
+			bool angle = (cosh >= 0) ? (dot >= 0 && dot * dot >= cos2 * d2) : (dot >= 0 || dot * dot <= cos2 * d2);
+			if (angle)
+			{
+				push_marker(node, i, mask, out);
+			}
+		}
+	}
+
+	void match_nearest(const tile& node, float cx, float cy, float r2, uint32_t mask)
+	{
+		size_t n = node.xs.size(), i = 0;
+#ifdef AOI_SIMD
+		__m128 vx = _mm_set1_ps(cx), vy = _mm_set1_ps(cy), vr = _mm_set1_ps(r2);
+		alignas(16) float d2s[4];
+		for (; i + 4 <= n; i += 4)
+		{
+			__m128 dx = _mm_sub_ps(_mm_cvtepi32_ps(_mm_loadu_si128((const __m128i*)(node.xs.data() + i))), vx);
+			__m128 dy = _mm_sub_ps(_mm_cvtepi32_ps(_mm_loadu_si128((const __m128i*)(node.ys.data() + i))), vy);
+			__m128 d2 = _mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy));
+			_mm_store_ps(d2s, d2);
+			for (int bits = _mm_movemask_ps(_mm_cmple_ps(d2, vr)); bits; bits &= bits - 1)
+			{
+				int k = __builtin_ctz(bits);
+				if (mask == 0 || (mask & (1u << (node.layers[i + k] & 31))))
+				{
+					nearest_.emplace_back(d2s[k], node.markers[i + k]->handle);
+				}
+			}
+		}
+#endif
+		for (; i < n; ++i)
+		{
+			float dx = static_cast<float>(node.xs[i]) - cx, dy = static_cast<float>(node.ys[i]) - cy;
+			float d2 = dx * dx + dy * dy;
+			if (d2 <= r2 && (mask == 0 || (mask & (1u << (node.layers[i] & 31)))))
+			{
+				nearest_.emplace_back(d2, node.markers[i]->handle);
+			}
+		}
+	}
+
+	//index记录在格子数组中的位置, 范围建筑在多个格子中, 以所在格子为准, 对不上时再查找
+	static size_t marker_index(const tile& node, const object_type* obj)
+	{
+		size_t idx = static_cast<size_t>(obj->index);
+		if (idx < node.markers.size() && node.markers[idx] == obj)
+		{
+			return idx;
+		}
+		return std::find(node.markers.begin(), node.markers.end(), obj) - node.markers.begin();
+	}
+
+	static void add_marker(tile& node, object_type* obj)
+	{
+		obj->index = static_cast<int32_t>(node.markers.size());
+		node.markers.push_back(obj);
+		node.xs.push_back(obj->x);
+		node.ys.push_back(obj->y);
+		node.layers.push_back(obj->layer);
+	}
+
+	static void erase_marker(tile& node, object_type* obj)
+	{
+		size_t idx = marker_index(node, obj);
+		if (idx == node.markers.size())
+		{
+			return;
+		}
+		node.markers[idx] = node.markers.back();
+		node.markers[idx]->index = static_cast<int32_t>(idx);
+		node.xs[idx] = node.xs.back();
+		node.ys[idx] = node.ys.back();
+		node.layers[idx] = node.layers.back();
+		node.markers.pop_back();
+		node.xs.pop_back();
+		node.ys.pop_back();
+		node.layers.pop_back();
+	}
+
+	static void set_marker(tile& node, object_type* obj)
+	{
+		size_t idx = marker_index(node, obj);
+		if (idx < node.markers.size())
+		{
+			node.xs[idx] = obj->x;
+			node.ys[idx] = obj->y;
+			node.layers[idx] = obj->layer;
+		}
+	}
+
+	static bool erase_object(std::vector<object_type*>& objs, object_type* obj)
+	{
+		auto iter = std::find(objs.begin(), objs.end(), obj);
+		if (iter == objs.end())
+		{
+			return false;
+		}
+		*iter = objs.back();
+		objs.pop_back();
+		return true;
+	}
+
+	aoi_delta& get_delta(object_type* w)
+	{
+		if (w->stamp != stamp_)
+		{
+			w->stamp = stamp_;
+			w->slot = static_cast<int>(delta_count_++);
+			if (deltas_.size() < delta_count_)
+			{
+				deltas_.emplace_back();
+			}
+			auto& d = deltas_[w->slot];
+			d.watcher = w->handle;
+			d.events.clear();
+			d.enters.clear();
+			d.leaves.clear();
+			d.moves.clear();
+		}
+		return deltas_[w->slot];
 	}
 
 	void update_watcher(const tile& t,
 		const rect<int>& old_rect,
 		const rect<int>& new_rect,
 		object_type* obj,
+		std::vector<aoi_event>& events,
 		bool check_enter = true,
 		bool check_leave = true)
 	{
@@ -587,7 +1227,7 @@ private:
 				{
 					if (!in_new_view && check_leave)
 					{
-						event_queue_.emplace_back(static_cast<int>(event_leave), obj->handle, m->handle);
+						events.emplace_back(static_cast<int>(event_leave), obj->handle, m->handle);
 					}
 				}
 			}
@@ -595,7 +1235,7 @@ private:
 			{
 				if (in_new_view && check_enter)
 				{
-					event_queue_.emplace_back(static_cast<int>(event_enter), obj->handle, m->handle);
+					events.emplace_back(static_cast<int>(event_enter), obj->handle, m->handle);
 				}
 			}
 		}
@@ -622,4 +1262,22 @@ private:
 	tile* data_;//count * count
 	std::unordered_map<object_handle_type, object_type> objects_;
 	std::vector<aoi_event> event_queue_;
+	//批量模式
+	bool batch_ = false;
+	uint32_t stamp_ = 0;
+	size_t delta_count_ = 0;
+	std::vector<aoi_move> moves_;
+	std::vector<object_type*> moved_;
+	std::vector<aoi_delta> deltas_;
+	//最近邻查询的候选(距离平方, handle)
+	std::vector<std::pair<float, object_handle_type>> nearest_;
+	//并行模式
+	static constexpr size_t parallel_min = 256;
+	size_t parallel_count_ = 0;
+	std::unique_ptr<aoi_worker> worker_;
+	std::vector<aoi_move*> rest_;
+	std::vector<aoi_move*> border_;
+	std::vector<std::vector<aoi_move*>> region_moves_;
+	std::vector<std::vector<aoi_event>> region_events_;
+	std::vector<std::vector<std::pair<object_type*, object_type*>>> region_pairs_;
 };
@@ -0,0 +1,117 @@
+#pragma once
+#include <mutex>
+#include <thread>
+#include <atomic>
+#include <vector>
+#include <functional>
+#include <condition_variable>
+
+//aoi并行计算的常驻线程池, 调用线程也参与执行
+class aoi_worker
+{
+public:
+	explicit aoi_worker(size_t threads)
+	{
+		for (size_t i = 0; i < threads; ++i)
+		{
+			threads_.emplace_back(&aoi_worker::run, this);
+		}
+	}
+
+	~aoi_worker()
+	{
+		{
+			std::unique_lock<std::mutex> lock(mutex_);
+			stop_ = true;
+		}
+		cond_.notify_all();
+		for (auto& t : threads_)
+		{
+			t.join();
+		}
+	}
+
+	//参与计算的线程数, 包括调用线程
+	size_t size() const
+	{
+		return threads_.size() + 1;
+	}
+
+	//执行count个任务, 全部完成后返回
+	void execute(size_t count, const std::function<void(size_t)>& task)
+	{
+		if (count == 0)
+		{
+			return;
+		}
+		std::unique_lock<std::mutex> lock(mutex_);
+		//等上一轮的线程全部退出再重置, 不会有线程拿着旧任务取到本轮序号
+		finish_.wait(lock, [this] { return active_ == 0; });
+		task_ = &task;
+		count_ = count;
+		done_ = 0;
+		next_ = 0;
+		++round_;
+		lock.unlock();
+		cond_.notify_all();
+		work();
+		lock.lock();
+		finish_.wait(lock, [this] { return done_ == count_; });
+	}
+
+private:
+	void work()
+	{
+		while (true)
+		{
+			size_t idx = next_.fetch_add(1);
+			if (idx >= count_)
+			{
+				break;
+			}
+			(*task_)(idx);
+			if (done_.fetch_add(1) + 1 == count_)
+			{
+				std::unique_lock<std::mutex> lock(mutex_);
+				finish_.notify_all();
+			}
+		}
+	}
+
+	void run()
+	{
+		uint64_t round = 0;
+		while (true)
+		{
+			{
+				std::unique_lock<std::mutex> lock(mutex_);
+				cond_.wait(lock, [&] { return stop_ || round_ != round; });
+				if (stop_)
+				{
+					return;
+				}
+				round = round_;
+				++active_;
+			}
+			work();
+			std::unique_lock<std::mutex> lock(mutex_);
+			if (--active_ == 0)
+			{
+				finish_.notify_all();
+			}
+		}
+	}
+
+private:
+	bool stop_ = false;
+	uint64_t round_ = 0;
+	size_t active_ = 0;
+	std::atomic<size_t> count_ = 0;
+	std::atomic<size_t> next_ = 0;
+	std::atomic<size_t> done_ = 0;
+	const std::function<void(size_t)>* task_ = nullptr;
+	std::mutex mutex_;
+	std::condition_variable cond_;
+	std::condition_variable finish_;
+	std::vector<std::thread> threads_;
+};
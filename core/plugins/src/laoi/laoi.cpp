@@ -21,6 +21,12 @@ struct aoi_object
 	int32_t layer;
 	int32_t mode;
 	handle_type handle;
+	//批量模式: 待处理移动的序号, 本帧增量的序号和帧戳
+	int32_t pending = -1;
+	int32_t slot = -1;
+	uint32_t stamp = 0;
+	//在所在格子marker数组中的下标
+	int32_t index = -1;
 
 	aoi_object(int32_t x_, int32_t y_, int32_t w_, int32_t h_, int32_t layer_, int32_t mode_, handle_type handle_)
 		:x(x_)
@@ -129,6 +135,69 @@ static int laoi_query(lua_State* L)
 	return 1;
 }
 
+//查询结果复用的缓冲区, 写入lua表的1..n, 返回n
+static thread_local std::vector<aoi_object::handle_type> query_buf;
+
+static int push_result(lua_State* L, int idx)
+{
+	lua_Integer n = 0;
+	for (const auto& id : query_buf)
+	{
+		lua_pushinteger(L, id);
+		lua_rawseti(L, idx, ++n);
+	}
+	lua_pushinteger(L, n);
+	return 1;
+}
+
+//mask按位过滤层(1 << layer), 0不过滤
+static int laoi_query_circle(lua_State* L)
+{
+	aoi_space_box* ab = (aoi_space_box*)lua_touserdata(L, 1);
+	if (ab == NULL || ab->space == NULL)
+		return luaL_error(L, "Invalid aoi_space pointer");
+	int32_t x = (int32_t)luaL_checknumber(L, 2);
+	int32_t y = (int32_t)luaL_checknumber(L, 3);
+	int32_t radius = (int32_t)luaL_checkinteger(L, 4);
+	uint32_t mask = (uint32_t)luaL_optinteger(L, 5, 0);
+	luaL_checktype(L, 6, LUA_TTABLE);
+	ab->space->query_circle(x, y, radius, mask, query_buf);
+	return push_result(L, 6);
+}
+
+//dir为朝向角度, half为半张角, 单位度
+static int laoi_query_sector(lua_State* L)
+{
+	aoi_space_box* ab = (aoi_space_box*)lua_touserdata(L, 1);
+	if (ab == NULL || ab->space == NULL)
+		return luaL_error(L, "Invalid aoi_space pointer");
+	int32_t x = (int32_t)luaL_checknumber(L, 2);
+	int32_t y = (int32_t)luaL_checknumber(L, 3);
+	int32_t radius = (int32_t)luaL_checkinteger(L, 4);
+	float dir = (float)luaL_checknumber(L, 5);
+	float half = (float)luaL_checknumber(L, 6);
+	uint32_t mask = (uint32_t)luaL_optinteger(L, 7, 0);
+	luaL_checktype(L, 8, LUA_TTABLE);
+	ab->space->query_sector(x, y, radius, dir, half, mask, query_buf);
+	return push_result(L, 8);
+}
+
+//半径内最近的k个, 按距离从近到远
+static int laoi_query_nearest(lua_State* L)
+{
+	aoi_space_box* ab = (aoi_space_box*)lua_touserdata(L, 1);
+	if (ab == NULL || ab->space == NULL)
+		return luaL_error(L, "Invalid aoi_space pointer");
+	int32_t x = (int32_t)luaL_checknumber(L, 2);
+	int32_t y = (int32_t)luaL_checknumber(L, 3);
+	int32_t radius = (int32_t)luaL_checkinteger(L, 4);
+	lua_Integer k = luaL_checkinteger(L, 5);
+	uint32_t mask = (uint32_t)luaL_optinteger(L, 6, 0);
+	luaL_checktype(L, 7, LUA_TTABLE);
+	ab->space->query_nearest(x, y, radius, k > 0 ? (size_t)k : 0, mask, query_buf);
+	return push_result(L, 7);
+}
+
 static int laoi_erase(lua_State* L)
 {
 	aoi_space_box* ab = (aoi_space_box*)lua_touserdata(L, 1);
@@ -193,6 +262,77 @@ static int laoi_update_event(lua_State* L)
 	return 1;
 }
 
+static int laoi_enable_batch(lua_State* L)
+{
+	aoi_space_box* ab = (aoi_space_box*)lua_touserdata(L, 1);
+	if (ab == NULL || ab->space == NULL)
+		return luaL_error(L, "Invalid aoi_space pointer");
+	bool v = (bool)lua_toboolean(L, 2);
+	ab->space->enable_batch(v);
+	return 0;
+}
+
+//批量移动按地图条带多线程处理, threads为参与线程数(含主线程), 小于2关闭
+static int laoi_enable_parallel(lua_State* L)
+{
+	aoi_space_box* ab = (aoi_space_box*)lua_touserdata(L, 1);
+	if (ab == NULL || ab->space == NULL)
+		return luaL_error(L, "Invalid aoi_space pointer");
+	int threads = (int)luaL_optinteger(L, 2, 0);
+	ab->space->enable_parallel(threads);
+	return 0;
+}
+
+static int laoi_parallel_count(lua_State* L)
+{
+	aoi_space_box* ab = (aoi_space_box*)lua_touserdata(L, 1);
+	if (ab == NULL || ab->space == NULL)
+		return luaL_error(L, "Invalid aoi_space pointer");
+	lua_pushinteger(L, static_cast<lua_Integer>(ab->space->parallel_count()));
+	return 1;
+}
+
+//输出格式: watcher, nenter, nleave, nmove, enters..., leaves..., moves...
+static int laoi_flush(lua_State* L)
+{
+	aoi_space_box* ab = (aoi_space_box*)lua_touserdata(L, 1);
+	if (ab == NULL || ab->space == NULL)
+		return luaL_error(L, "Invalid aoi_space pointer");
+
+	luaL_checktype(L, 2, LUA_TTABLE);
+	ab->space->flush();
+
+	lua_Integer idx = 1;
+	ab->space->for_each_delta([L, &idx](const aoi_space_box::aoi_type::aoi_delta& d) {
+		lua_pushinteger(L, d.watcher);
+		lua_rawseti(L, 2, idx++);
+		lua_pushinteger(L, static_cast<lua_Integer>(d.enters.size()));
+		lua_rawseti(L, 2, idx++);
+		lua_pushinteger(L, static_cast<lua_Integer>(d.leaves.size()));
+		lua_rawseti(L, 2, idx++);
+		lua_pushinteger(L, static_cast<lua_Integer>(d.moves.size()));
+		lua_rawseti(L, 2, idx++);
+		for (auto id : d.enters)
+		{
+			lua_pushinteger(L, id);
+			lua_rawseti(L, 2, idx++);
+		}
+		for (auto id : d.leaves)
+		{
+			lua_pushinteger(L, id);
+			lua_rawseti(L, 2, idx++);
+		}
+		for (auto id : d.moves)
+		{
+			lua_pushinteger(L, id);
+			lua_rawseti(L, 2, idx++);
+		}
+		});
+
+	lua_pushinteger(L, idx - 1);
+	return 1;
+}
+
 static int laoi_enable_debug(lua_State* L)
 {
 	aoi_space_box* ab = (aoi_space_box*)lua_touserdata(L, 1);
@@ -233,12 +373,19 @@ static int laoi_create(lua_State* L)
 			{ "insert",laoi_insert },
 			{ "update",laoi_update },
 			{ "query", laoi_query},
+			{ "query_circle", laoi_query_circle},
+			{ "query_sector", laoi_query_sector},
+			{ "query_nearest", laoi_query_nearest},
 			{ "fire_event",laoi_fire_event },
 			{ "erase",laoi_erase },
 			{ "has",laoi_hasobject },
 			{ "update_event", laoi_update_event},
 			{ "enable_debug", laoi_enable_debug},
 			{ "enable_leave_event", laoi_enable_leave_event},
+			{ "enable_batch", laoi_enable_batch},
+			{ "flush", laoi_flush},
+			{ "enable_parallel", laoi_enable_parallel},
+			{ "parallel_count", laoi_parallel_count},
 			{ NULL,NULL }
 		};
 		luaL_newlib(L, l); //{}
@@ -1,6 +1,10 @@
 #pragma once
 
+#include <memory>
+#include <unordered_set>
+#include <unordered_map>
 #include "lua_kit.h"
+#include "snappy.h"
 
 using namespace std;
 using namespace luakit;
@@ -13,10 +17,27 @@ namespace lbson {
     const uint32_t max_bson_index   = 1024;
 
     const uint32_t OP_MSG_CODE      = 2013;
+    const uint32_t OP_COMPRESSED    = 2012;
     const uint32_t OP_MSG_HLEN      = 4 * 5 + 1;
     const uint32_t OP_CHECKSUM      = 1 << 0;
     const uint32_t OP_MORE_COME     = 1 << 1;
 
+    //OP_MSG section类型
+    const uint8_t OP_KIND_BODY      = 0;
+    const uint8_t OP_KIND_SEQUENCE  = 1;
+
+    //压缩算法, 只实现了snappy
+    const uint8_t COMPRESSOR_NOOP   = 0;
+    const uint8_t COMPRESSOR_SNAPPY = 1;
+    const uint8_t COMPRESSOR_ZLIB   = 2;
+    const uint8_t COMPRESSOR_ZSTD   = 3;
+    //小于该长度的消息不压缩
+    const uint32_t OP_COMPRESS_MIN  = 512;
+
+    //惰性文档元表, 字段数超过该值时建立哈希索引
+    const char* const LAZY_BSON_META = "_bson_lazy";
+    const uint32_t lazy_hash_min    = 16;
+
     static char bson_numstrs[max_bson_index][4];
     static int bson_numstr_len[max_bson_index];
 
@@ -45,6 +66,24 @@ namespace lbson {
         BSON_MAXKEY     = 127,
     };
 
+    struct bson_field {
+        string_view key;
+        bson_type type;
+        uint32_t offset;    //值在数据中的偏移
+    };
+
+    //惰性文档: 共享整个回复数据, 首次访问时建立字段索引
+    struct bson_doc {
+        bson_doc(shared_ptr<string> d, uint32_t o, uint32_t l, bool a) : data(d), offset(o), length(l), array(a) {}
+        shared_ptr<string> data;
+        uint32_t offset;
+        uint32_t length;
+        bool array;
+        bool indexed = false;
+        vector<bson_field> fields;
+        unordered_map<string_view, uint32_t> keys;
+    };
+
     class mgocodec;
     class bson {
     public:
@@ -81,12 +120,15 @@ namespace lbson {
             return lua_gettop(L);
         }
 
-        uint8_t* encode_pairs(lua_State* L, size_t* data_len) {
+        //sequence: 批量写入的文档数组(documents/updates/deletes)以OP_MSG kind-1 section写在body之后
+        uint8_t* encode_pairs(lua_State* L, size_t* data_len, bool sequence = false) {
             int n = lua_gettop(L);
             if (n < 2 || n % 2 != 0) {
                 luaL_error(L, "Invalid ordered dict");
             }
             size_t sz;
+            int sequences[4];
+            int nsequence = 0;
             size_t offset = m_buffer.size();
             m_buffer.write<uint32_t>(0);
             for (int i = 0; i < n; i += 2) {
@@ -96,6 +138,10 @@ namespace lbson {
                     if (key == nullptr) {
                         luaL_error(L, "Argument %d need a string", i + 1);
                     }
+                    if (sequence && nsequence < 4 && vt == LUA_TTABLE && is_sequence_key(key, sz) && lua_rawlen(L, i + 2) > 0) {
+                        sequences[nsequence++] = i + 1;
+                        continue;
+                    }
                     lua_pushvalue(L, i + 2);
                     pack_one(L, key, sz, 0);
                     lua_pop(L, 1);
@@ -104,6 +150,9 @@ namespace lbson {
             m_buffer.write<uint8_t>(0);
             uint32_t size = m_buffer.size() - offset;
             m_buffer.copy(offset, (uint8_t*)&size, sizeof(uint32_t));
+            for (int i = 0; i < nsequence; ++i) {
+                pack_sequence(L, sequences[i]);
+            }
             //返回结果
             return m_buffer.data(data_len);
         }
@@ -167,7 +216,282 @@ namespace lbson {
             return 1;
         }
 
+        //惰性解码: 只拷贝一次数据, 字段在访问时才解码
+        int lazy_decode(lua_State* L) {
+            size_t data_len = 0;
+            const char* buf = luaL_checklstring(L, 1, &data_len);
+            if (data_len < 5 || *(uint32_t*)buf > data_len) {
+                return luaL_error(L, "invalid bson document");
+            }
+            return push_lazy(L, make_shared<string>(buf, data_len), 0, false);
+        }
+
+        int push_lazy(lua_State* L, shared_ptr<string> data, uint32_t offset, bool array) {
+            //嵌套文档的长度来自数据本身, 先校验不越过整个缓冲区
+            size_t remain = data->size() > offset ? data->size() - offset : 0;
+            if (remain < 5) throw lua_exception("invalid bson document");
+            uint32_t length = *(uint32_t*)(data->data() + offset);
+            if (length < 5 || length > remain) {
+                throw lua_exception("invalid bson document, length = %u", length);
+            }
+            void* ud = lua_newuserdatauv(L, sizeof(bson_doc), 1);
+            new (ud) bson_doc(data, offset, length, array);
+            luaL_setmetatable(L, LAZY_BSON_META);
+            return 1;
+        }
+
+        int lazy_index(lua_State* L) {
+            bson_doc* doc = (bson_doc*)luaL_checkudata(L, 1, LAZY_BSON_META);
+            try {
+                int index = find_field(L, doc, 2);
+                if (index < 0) return 0;
+                return push_field(L, doc, index);
+            } catch (const exception& e) {
+                luaL_error(L, e.what());
+            }
+            return 0;
+        }
+
+        int lazy_len(lua_State* L) {
+            bson_doc* doc = (bson_doc*)luaL_checkudata(L, 1, LAZY_BSON_META);
+            try {
+                index_fields(doc);
+            } catch (const exception& e) {
+                luaL_error(L, e.what());
+            }
+            lua_pushinteger(L, doc->array ? doc->fields.size() : 0);
+            return 1;
+        }
+
+        //按字段在文档中的位置遍历, 不按键回查, 重复键和数字形式的键都能完整遍历
+        int lazy_next(lua_State* L, int index) {
+            bson_doc* doc = (bson_doc*)luaL_checkudata(L, 1, LAZY_BSON_META);
+            try {
+                index_fields(doc);
+                if (index >= (int)doc->fields.size()) return 0;
+                push_field_key(L, doc, index);
+                push_field(L, doc, index);
+                return 2;
+            } catch (const exception& e) {
+                luaL_error(L, e.what());
+            }
+            return 0;
+        }
+
+        //转换为普通table, keys为需要的字段列表时只解码这些字段
+        int lazy_totable(lua_State* L) {
+            bson_doc* doc = (bson_doc*)luaL_checkudata(L, 1, LAZY_BSON_META);
+            try {
+                if (lua_istable(L, 2)) {
+                    lua_createtable(L, 0, (int)lua_rawlen(L, 2));
+                    for (lua_Integer i = 1; lua_rawgeti(L, 2, i) != LUA_TNIL; ++i) {
+                        int index = find_field(L, doc, -1);
+                        if (index >= 0) {
+                            push_field(L, doc, index);
+                            lua_rawset(L, -3);
+                        } else {
+                            lua_pop(L, 1);
+                        }
+                    }
+                    lua_pop(L, 1);
+                    return 1;
+                }
+                slice slice((uint8_t*)doc->data->data() + doc->offset, doc->length);
+                unpack_dict(L, &slice, doc->array);
+            } catch (const exception& e) {
+                luaL_error(L, e.what());
+            }
+            return 1;
+        }
+
+        int lazy_gc(lua_State* L) {
+            bson_doc* doc = (bson_doc*)luaL_checkudata(L, 1, LAZY_BSON_META);
+            doc->~bson_doc();
+            return 0;
+        }
+
     protected:
+        bool is_sequence_key(const char* key, size_t len) {
+            string_view skey(key, len);
+            return skey == "documents" || skey == "updates" || skey == "deletes";
+        }
+
+        //kind-1: size + identifier + 连续的文档
+        void pack_sequence(lua_State* L, int kidx) {
+            size_t klen;
+            const char* key = lua_tolstring(L, kidx, &klen);
+            m_buffer.write<uint8_t>(OP_KIND_SEQUENCE);
+            size_t offset = m_buffer.size();
+            m_buffer.write<uint32_t>(0);
+            write_cstring(key, klen);
+            size_t count = lua_rawlen(L, kidx + 1);
+            for (size_t i = 1; i <= count; ++i) {
+                if (lua_rawgeti(L, kidx + 1, i) != LUA_TTABLE) {
+                    luaL_error(L, "%s[%d] need a table", key, (int)i);
+                }
+                pack_dict(L, 1);
+                lua_pop(L, 1);
+            }
+            uint32_t size = m_buffer.size() - offset;
+            m_buffer.copy(offset, (uint8_t*)&size, sizeof(uint32_t));
+        }
+
+        //建立字段索引, 只扫描类型和键, 跳过值
+        //扫描失败时文档保持未索引状态, 下次访问重新报错
+        void index_fields(bson_doc* doc) {
+            if (doc->indexed) return;
+            vector<bson_field> fields;
+            slice slice((uint8_t*)doc->data->data() + doc->offset + 4, doc->length - 4);
+            while (!slice.empty()) {
+                uint8_t* bt = slice.read<uint8_t>();
+                if (!bt || *bt == (uint8_t)bson_type::BSON_EOO) break;
+                size_t klen = 0;
+                const char* key = read_cstring(&slice, klen);
+                uint32_t offset = (uint32_t)(slice.head() - (uint8_t*)doc->data->data());
+                fields.push_back(bson_field{ string_view(key, klen), (bson_type)*bt, offset });
+                skip_value(&slice, (bson_type)*bt);
+            }
+            if (!doc->array && fields.size() > lazy_hash_min) {
+                doc->keys.reserve(fields.size());
+                for (uint32_t i = 0; i < fields.size(); ++i) {
+                    doc->keys.emplace(fields[i].key, i);
+                }
+            }
+            doc->fields = std::move(fields);
+            doc->indexed = true;
+        }
+
+        void skip_value(slice* slice, bson_type bt) {
+            size_t len = 0;
+            switch (bt) {
+            case bson_type::BSON_REAL:
+            case bson_type::BSON_DATE:
+            case bson_type::BSON_INT64:
+            case bson_type::BSON_TIMESTAMP:
+                len = 8;
+                break;
+            case bson_type::BSON_INT32:
+                len = 4;
+                break;
+            case bson_type::BSON_BOOLEAN:
+                len = 1;
+                break;
+            case bson_type::BSON_OBJECTID:
+                len = 12;
+                break;
+            case bson_type::BSON_INT128:
+                len = 16;
+                break;
+            case bson_type::BSON_UNDEFINED:
+            case bson_type::BSON_MINKEY:
+            case bson_type::BSON_MAXKEY:
+            case bson_type::BSON_NULL:
+                break;
+            case bson_type::BSON_JSCODE:
+            case bson_type::BSON_SYMBOL:
+            case bson_type::BSON_STRING:
+                len = 4 + peek_length(slice);
+                break;
+            case bson_type::BSON_DBPOINTER:
+                len = 4 + peek_length(slice) + 12;
+                break;
+            case bson_type::BSON_BINARY:
+                len = 5 + peek_length(slice);
+                break;
+            case bson_type::BSON_CODEWS:
+            case bson_type::BSON_DOCUMENT:
+            case bson_type::BSON_ARRAY:
+                len = peek_length(slice);
+                break;
+            case bson_type::BSON_REGEX: {
+                    size_t klen = 0;
+                    read_cstring(slice, klen);
+                    read_cstring(slice, klen);
+                }
+                break;
+            default:
+                throw lua_exception("invalid bson type: %d", (int)bt);
+            }
+            if (len > 0 && !slice->erase(len)) {
+                throw lua_exception("invalid bson value, length = %lu", len);
+            }
+        }
+
+        uint32_t peek_length(slice* slice) {
+            uint32_t* len = (uint32_t*)slice->peek(sizeof(uint32_t));
+            if (!len) throw lua_exception("invalid bson value length");
+            return *len;
+        }
+
+        //数组按位置查找, 文档按键查找(数字键按字符串匹配)
+        int find_field(lua_State* L, bson_doc* doc, int kidx) {
+            index_fields(doc);
+            if (doc->array) {
+                if (!lua_isinteger(L, kidx)) return -1;
+                lua_Integer index = lua_tointeger(L, kidx);
+                return (index >= 1 && index <= (lua_Integer)doc->fields.size()) ? (int)index - 1 : -1;
+            }
+            size_t klen = 0;
+            const char* key = nullptr;
+            char numkey[32];
+            int type = lua_type(L, kidx);
+            if (type == LUA_TSTRING) {
+                key = lua_tolstring(L, kidx, &klen);
+            } else if (type == LUA_TNUMBER && lua_isinteger(L, kidx)) {
+                klen = snprintf(numkey, sizeof(numkey), "%lld", (long long)lua_tointeger(L, kidx));
+                key = numkey;
+            } else {
+                return -1;
+            }
+            string_view skey(key, klen);
+            if (!doc->keys.empty()) {
+                auto it = doc->keys.find(skey);
+                return it == doc->keys.end() ? -1 : (int)it->second;
+            }
+            for (uint32_t i = 0; i < doc->fields.size(); ++i) {
+                if (doc->fields[i].key == skey) return (int)i;
+            }
+            return -1;
+        }
+
+        void push_field_key(lua_State* L, bson_doc* doc, int index) {
+            if (doc->array) {
+                lua_pushinteger(L, index + 1);
+                return;
+            }
+            //文档的键保持字符串
+            const bson_field& field = doc->fields[index];
+            lua_pushlstring(L, field.key.data(), field.key.size());
+        }
+
+        //子文档缓存在uservalue中, 保证多次访问得到同一个对象
+        int push_field(lua_State* L, bson_doc* doc, int index) {
+            const bson_field& field = doc->fields[index];
+            if (field.type == bson_type::BSON_DOCUMENT || field.type == bson_type::BSON_ARRAY) {
+                int udx = lua_absindex(L, 1);
+                if (lua_getiuservalue(L, udx, 1) != LUA_TTABLE) {
+                    lua_pop(L, 1);
+                    lua_createtable(L, 0, 4);
+                    lua_pushvalue(L, -1);
+                    lua_setiuservalue(L, udx, 1);
+                }
+                if (lua_rawgeti(L, -1, index + 1) != LUA_TNIL) {
+                    lua_remove(L, -2);
+                    return 1;
+                }
+                lua_pop(L, 1);
+                push_lazy(L, doc->data, field.offset, field.type == bson_type::BSON_ARRAY);
+                lua_pushvalue(L, -1);
+                lua_rawseti(L, -3, index + 1);
+                lua_remove(L, -2);
+                return 1;
+            }
+            uint8_t* head = (uint8_t*)doc->data->data() + field.offset;
+            slice slice(head, doc->offset + doc->length - field.offset);
+            unpack_value(L, &slice, field.type);
+            return 1;
+        }
+
         int make_bson_value(lua_State *L, bson_type type, uint8_t* value, size_t len) {
             m_buffer.clean();
             m_buffer.write<uint8_t>(0);
@@ -515,84 +839,91 @@ namespace lbson {
             }
             lua_createtable(L, 0, 8);
             while (!slice->empty()) {
-                size_t klen = 0;
                 bson_type bt = (bson_type)read_val<uint8_t>(L, slice);
                 if (bt == bson_type::BSON_EOO) break;
                 unpack_key(L, slice, isarray);
-                switch (bt) {
-                case bson_type::BSON_REAL:
-                    lua_pushnumber(L, read_val<double>(L, slice));
-                    break;
-                case bson_type::BSON_BOOLEAN:
-                    lua_pushboolean(L, read_val<bool>(L, slice));
-                    break;
-                case bson_type::BSON_INT32:
-                    lua_pushinteger(L, read_val<int32_t>(L, slice));
-                    break;
-                case bson_type::BSON_DATE:
-                    lua_pushinteger(L, read_val<int64_t>(L, slice) / 1000);
-                    break;
-                case bson_type::BSON_INT64:
-                case bson_type::BSON_TIMESTAMP:
-                    lua_pushinteger(L, read_val<int64_t>(L, slice));
-                    break;
-                case bson_type::BSON_OBJECTID:
-                    read_objectid(L, slice);
-                    break;
-                case bson_type::BSON_JSCODE:
-                case bson_type::BSON_STRING:{
-                        const char* s = read_string(L, slice, klen);
-                        lua_pushlstring(L, s, klen);
-                    }
-                    break;
-                case bson_type::BSON_BINARY: {
-                        lua_createtable(L, 0, 4);
-                        int32_t len = read_val<int32_t>(L, slice);
-                        lua_pushinteger(L, (uint32_t)bt);
-                        lua_setfield(L, -2, "__type");
-                        lua_pushinteger(L, read_val<uint8_t>(L, slice));
-                        lua_setfield(L, -2, "subtype");
-                        const char* s = read_bytes(L, slice, len);
-                        lua_pushlstring(L, s, len);
-                        lua_setfield(L, -2, "binray");
-                    }
-                    break;
-                case bson_type::BSON_REGEX: {
-                        lua_createtable(L, 0, 4);
-                        lua_pushinteger(L, (uint32_t)bt);
-                        lua_setfield(L, -2, "__type");
-                        lua_pushstring(L, read_cstring(slice, klen));
-                        lua_setfield(L, -2, "pattern");
-                        lua_pushstring(L, read_cstring(slice, klen));
-                        lua_setfield(L, -2, "option");
-                    }
-                    break;
-                case bson_type::BSON_DOCUMENT:
-                    unpack_dict(L, slice, false);
-                    break;
-                case bson_type::BSON_ARRAY:
-                    unpack_dict(L, slice, true);
-                    break;
-                case bson_type::BSON_MINKEY:
-                case bson_type::BSON_MAXKEY:
-                case bson_type::BSON_NULL: {
-                        lua_createtable(L, 0, 2);
-                        lua_pushinteger(L, (uint32_t)bt);
-                        lua_setfield(L, -2, "__type");
-                    }
-                    break;
-                default:
-                    throw lua_exception("invalid bson type: %d", (int)bt);
-                }
+                unpack_value(L, slice, bt);
                 lua_rawset(L, -3);
             }
         }
+
+        void unpack_value(lua_State* L, slice* slice, bson_type bt) {
+            switch (bt) {
+            case bson_type::BSON_REAL:
+                lua_pushnumber(L, read_val<double>(L, slice));
+                break;
+            case bson_type::BSON_BOOLEAN:
+                lua_pushboolean(L, read_val<bool>(L, slice));
+                break;
+            case bson_type::BSON_INT32:
+                lua_pushinteger(L, read_val<int32_t>(L, slice));
+                break;
+            case bson_type::BSON_DATE:
+                lua_pushinteger(L, read_val<int64_t>(L, slice) / 1000);
+                break;
+            case bson_type::BSON_INT64:
+            case bson_type::BSON_TIMESTAMP:
+                lua_pushinteger(L, read_val<int64_t>(L, slice));
+                break;
+            case bson_type::BSON_OBJECTID:
+                read_objectid(L, slice);
+                break;
+            case bson_type::BSON_JSCODE:
+            case bson_type::BSON_STRING:{
+                    size_t klen = 0;
+                    const char* s = read_string(L, slice, klen);
+                    lua_pushlstring(L, s, klen);
+                }
+                break;
+            case bson_type::BSON_BINARY: {
+                    lua_createtable(L, 0, 4);
+                    int32_t len = read_val<int32_t>(L, slice);
+                    lua_pushinteger(L, (uint32_t)bt);
+                    lua_setfield(L, -2, "__type");
+                    lua_pushinteger(L, read_val<uint8_t>(L, slice));
+                    lua_setfield(L, -2, "subtype");
+                    const char* s = read_bytes(L, slice, len);
+                    lua_pushlstring(L, s, len);
+                    lua_setfield(L, -2, "binray");
+                }
+                break;
+            case bson_type::BSON_REGEX: {
+                    size_t klen = 0;
+                    lua_createtable(L, 0, 4);
+                    lua_pushinteger(L, (uint32_t)bt);
+                    lua_setfield(L, -2, "__type");
+                    lua_pushstring(L, read_cstring(slice, klen));
+                    lua_setfield(L, -2, "pattern");
+                    lua_pushstring(L, read_cstring(slice, klen));
+                    lua_setfield(L, -2, "option");
+                }
+                break;
+            case bson_type::BSON_DOCUMENT:
+                unpack_dict(L, slice, false);
+                break;
+            case bson_type::BSON_ARRAY:
+                unpack_dict(L, slice, true);
+                break;
+            case bson_type::BSON_MINKEY:
+            case bson_type::BSON_MAXKEY:
+            case bson_type::BSON_NULL: {
+                    lua_createtable(L, 0, 2);
+                    lua_pushinteger(L, (uint32_t)bt);
+                    lua_setfield(L, -2, "__type");
+                }
+                break;
+            default:
+                throw lua_exception("invalid bson type: %d", (int)bt);
+            }
+        }
     private:
         luabuf m_buffer;
     };
 
     class mgocodec : public codec_base {
     public:
+        mgocodec(uint8_t compressor = COMPRESSOR_NOOP) : m_compressor(compressor) {}
+
         virtual int load_packet(size_t data_len) {
             if (!m_slice) return 0;
             uint32_t* packet_len = (uint32_t*)m_slice->peek(sizeof(uint32_t));
@@ -604,18 +935,30 @@ namespace lbson {
             return m_packet_len;
         }
 
+        //参数: session_id, [lazy], cmd, cmd_v, ...
         virtual uint8_t* encode(lua_State* L, int index, size_t* len) {
             luabuf* buf = m_bson->get_buffer();
             buf->clean();
             buf->write<uint32_t>(0);
-            buf->write<uint32_t>(lua_tointeger(L, 1));
+            uint32_t session_id = lua_tointeger(L, 1);
+            buf->write<uint32_t>(session_id);
             buf->write<uint32_t>(0);
             buf->write<uint32_t>(OP_MSG_CODE);
             buf->write<uint32_t>(0);
-            buf->write<uint8_t>(0);
+            buf->write<uint8_t>(OP_KIND_BODY);
             lua_remove(L, 1);
-            uint8_t* data = m_bson->encode_pairs(L, len);
+            if (lua_type(L, 1) == LUA_TBOOLEAN) {
+                //回复以惰性文档返回
+                if (lua_toboolean(L, 1) && session_id > 0) {
+                    m_lazys.insert(session_id);
+                }
+                lua_remove(L, 1);
+            }
+            uint8_t* data = m_bson->encode_pairs(L, len, true);
             buf->copy(0, (uint8_t*)len, sizeof(uint32_t));
+            if (m_compressor == COMPRESSOR_SNAPPY && *len >= OP_COMPRESS_MIN) {
+                return compress(data, len);
+            }
             return data;
         }
 
@@ -625,21 +968,105 @@ namespace lbson {
             m_slice->erase(8);
             uint32_t session_id = m_bson->read_val<uint32_t>(L, m_slice);
             uint32_t opcode = m_bson->read_val<uint32_t>(L, m_slice);
+            if (opcode == OP_COMPRESSED) {
+                slice msg = uncompress(L);
+                return decode_msg(L, &msg, session_id);
+            }
             if (opcode != OP_MSG_CODE) {
                 throw lua_exception("unsupported opcode: %d", opcode);
             }
-            uint32_t flags = m_bson->read_val<uint32_t>(L, m_slice);
-            if (flags > 0 && ((flags & OP_CHECKSUM) != 0 || ((flags ^ OP_MORE_COME) != 0))) {
+            return decode_msg(L, m_slice, session_id);
+        }
+
+        void set_bson(bson* bson) {
+            m_bson = bson;
+        }
+
+        //会话结束(超时或连接断开)时清除惰性标记
+        void cancel(uint32_t session_id) {
+            m_lazys.erase(session_id);
+        }
+
+    protected:
+        //OP_COMPRESSED: 原始header之后的内容整体压缩
+        uint8_t* compress(uint8_t* data, size_t* len) {
+            snappy::compress(data + 16, *len - 16, m_zdata);
+            m_zbuf.clean();
+            m_zbuf.write<uint32_t>(16 + 9 + m_zdata.size());
+            m_zbuf.push_data(data + 4, 8);
+            m_zbuf.write<uint32_t>(OP_COMPRESSED);
+            m_zbuf.write<uint32_t>(OP_MSG_CODE);
+            m_zbuf.write<uint32_t>(*len - 16);
+            m_zbuf.write<uint8_t>(m_compressor);
+            m_zbuf.push_data((uint8_t*)m_zdata.data(), m_zdata.size());
+            return m_zbuf.data(len);
+        }
+
+        slice uncompress(lua_State* L) {
+            uint32_t opcode = m_bson->read_val<uint32_t>(L, m_slice);
+            uint32_t size = m_bson->read_val<uint32_t>(L, m_slice);
+            uint8_t compressor = m_bson->read_val<uint8_t>(L, m_slice);
+            if (opcode != OP_MSG_CODE) {
+                throw lua_exception("unsupported opcode: %d", opcode);
+            }
+            size_t data_len;
+            uint8_t* data = m_slice->data(&data_len);
+            m_slice->erase(data_len);
+            switch (compressor) {
+            case COMPRESSOR_NOOP:
+                m_zdata.assign((const char*)data, data_len);
+                break;
+            case COMPRESSOR_SNAPPY:
+                if (!snappy::uncompress(data, data_len, m_zdata)) {
+                    throw lua_exception("snappy uncompress failed");
+                }
+                break;
+            default:
+                throw lua_exception("unsupported compressor: %d", compressor);
+            }
+            if (m_zdata.size() != size) {
+                throw lua_exception("invalid uncompressed size: %d", size);
+            }
+            return slice((uint8_t*)m_zdata.data(), m_zdata.size());
+        }
+
+        size_t decode_msg(lua_State* L, slice* slice, uint32_t session_id) {
+            uint32_t flags = m_bson->read_val<uint32_t>(L, slice);
+            if ((flags & ~(OP_CHECKSUM | OP_MORE_COME)) != 0) {
                 throw lua_exception("unsupported flags: %d", flags);
             }
-            uint32_t payload = m_bson->read_val<uint8_t>(L, m_slice);
-            if (payload != 0) {
-                throw lua_exception("unsupported flags: %d", payload);
+            //忽略末尾的crc32c校验
+            if ((flags & OP_CHECKSUM) != 0) {
+                if (slice->size() < 4) throw lua_exception("invalid checksum");
+                slice->attach(slice->head(), slice->size() - 4);
+            }
+            uint32_t payload = m_bson->read_val<uint8_t>(L, slice);
+            if (payload != OP_KIND_BODY) {
+                throw lua_exception("unsupported payload: %d", payload);
             }
             int otop = lua_gettop(L);
             lua_pushinteger(L, session_id);
+            if (m_lazys.erase(session_id) > 0) {
+                uint32_t* doc_len = (uint32_t*)slice->peek(sizeof(uint32_t));
+                if (!doc_len || *doc_len < 5 || *doc_len > slice->size()) {
+                    throw lua_exception("invalid bson document");
+                }
+                //带kind-1 section的回复需要合并, 不以惰性文档返回
+                if (slice->size() - *doc_len <= 5) {
+                    m_bson->push_lazy(L, make_shared<string>((const char*)slice->head(), *doc_len), 0, false);
+                    return lua_gettop(L) - otop;
+                }
+            }
             try {
-                m_bson->unpack_dict(L, m_slice, false);
+                m_bson->unpack_dict(L, slice, false);
+                //kind-1 section合并到body中
+                while (slice->size() > 5) {
+                    uint8_t kind = m_bson->read_val<uint8_t>(L, slice);
+                    if (kind != OP_KIND_SEQUENCE) {
+                        throw lua_exception("unsupported payload: %d", kind);
+                    }
+                    decode_sequence(L, slice);
+                }
             } catch (const exception& e){
                 lua_settop(L, otop);
                 throw lua_exception(e.what());
@@ -647,11 +1074,29 @@ namespace lbson {
             return lua_gettop(L) - otop;
         }
 
-        void set_bson(bson* bson) {
-            m_bson = bson;
+        void decode_sequence(lua_State* L, slice* slice) {
+            uint32_t size = m_bson->read_val<uint32_t>(L, slice);
+            if (size < 5 || slice->size() < size - 4) {
+                throw lua_exception("invalid document sequence");
+            }
+            luakit::slice docs(slice->head(), size - 4);
+            slice->erase(size - 4);
+            size_t klen = 0;
+            const char* key = m_bson->read_cstring(&docs, klen);
+            lua_pushlstring(L, key, klen);
+            lua_createtable(L, 8, 0);
+            for (int i = 1; !docs.empty(); ++i) {
+                m_bson->unpack_dict(L, &docs, false);
+                lua_rawseti(L, -2, i);
+            }
+            lua_rawset(L, -3);
         }
 
     protected:
         bson* m_bson;
+        uint8_t m_compressor;
+        luabuf m_zbuf;
+        string m_zdata;
+        unordered_set<uint32_t> m_lazys;
     };
-}
\ No newline at end of file
+}
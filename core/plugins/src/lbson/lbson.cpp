@@ -29,6 +29,76 @@ namespace lbson {
     static int date(lua_State* L, int64_t value) {
         return thread_bson.date(L, value * 1000);
     }
+    static int snappy_encode(lua_State* L) {
+        size_t data_len = 0;
+        const char* data = luaL_checklstring(L, 1, &data_len);
+        string out;
+        snappy::compress((const uint8_t*)data, data_len, out);
+        lua_pushlstring(L, out.data(), out.size());
+        return 1;
+    }
+    static int snappy_decode(lua_State* L) {
+        size_t data_len = 0;
+        const char* data = luaL_checklstring(L, 1, &data_len);
+        bool ok = false;
+        {
+            string out;
+            ok = snappy::uncompress((const uint8_t*)data, data_len, out);
+            if (ok) lua_pushlstring(L, out.data(), out.size());
+        }
+        if (!ok) {
+            return luaL_error(L, "snappy decompress failed!");
+        }
+        return 1;
+    }
+    static int lazy(lua_State* L) {
+        return thread_bson.lazy_decode(L);
+    }
+    static int totable(lua_State* L) {
+        return thread_bson.lazy_totable(L);
+    }
+    static int lazy_index(lua_State* L) {
+        return thread_bson.lazy_index(L);
+    }
+    static int lazy_len(lua_State* L) {
+        return thread_bson.lazy_len(L);
+    }
+    //遍历位置保存在upvalue中, 不依赖上一次返回的键
+    static int lazy_next(lua_State* L) {
+        lua_Integer index = lua_tointeger(L, lua_upvalueindex(1));
+        lua_pushinteger(L, index + 1);
+        lua_replace(L, lua_upvalueindex(1));
+        return thread_bson.lazy_next(L, (int)index);
+    }
+    static int lazy_pairs(lua_State* L) {
+        luaL_checkudata(L, 1, LAZY_BSON_META);
+        lua_pushinteger(L, 0);
+        lua_pushcclosure(L, lazy_next, 1);
+        lua_pushvalue(L, 1);
+        lua_pushnil(L);
+        return 3;
+    }
+    static int lazy_newindex(lua_State* L) {
+        return luaL_error(L, "bson lazy document is readonly");
+    }
+    static int lazy_gc(lua_State* L) {
+        return thread_bson.lazy_gc(L);
+    }
+
+    static void init_lazy_meta(lua_State* L) {
+        if (luaL_newmetatable(L, LAZY_BSON_META)) {
+            luaL_Reg l[] = {
+                { "__index", lazy_index },
+                { "__len", lazy_len },
+                { "__pairs", lazy_pairs },
+                { "__newindex", lazy_newindex },
+                { "__gc", lazy_gc },
+                { NULL, NULL }
+            };
+            luaL_setfuncs(L, l, 0);
+        }
+        lua_pop(L, 1);
+    }
 
     static void init_static_bson() {
         for (uint32_t i = 0; i < max_bson_index; ++i) {
@@ -38,8 +108,8 @@ namespace lbson {
         }
     }
 
-    static codec_base* mongo_codec() {
-        mgocodec* codec = new mgocodec();
+    static mgocodec* mongo_codec(uint8_t compressor) {
+        mgocodec* codec = new mgocodec(compressor);
         codec->set_bson(&thread_bson);
         return codec;
     }
@@ -56,6 +126,13 @@ namespace lbson {
         llbson.set_function("pairs", pairs);
         llbson.set_function("regex", regex);
         llbson.set_function("date", date);
+        llbson.set_function("lazy", lazy);
+        llbson.set_function("snappy_encode", snappy_encode);
+        llbson.set_function("snappy_decode", snappy_decode);
+        llbson.set_function("totable", totable);
+        kit_state.new_class<mgocodec>(
+            "cancel", &mgocodec::cancel
+        );
         llbson.new_enum("BSON_TYPE",
             "BSON_EOO", bson_type::BSON_EOO,
             "BSON_REAL", bson_type::BSON_REAL,
@@ -82,6 +159,7 @@ namespace lbson {
 extern "C" {
     LUALIB_API int luaopen_lbson(lua_State* L) {
         lbson::init_static_bson();
+        lbson::init_lazy_meta(L);
         auto lluabus = lbson::open_lbson(L);
         return lluabus.push_stack();
     }
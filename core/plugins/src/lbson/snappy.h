@@ -0,0 +1,184 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <cstring>
+#include <cstdint>
+
+//snappy原始格式压缩/解压
+//https://github.com/google/snappy/blob/main/format_description.txt
+namespace lbson {
+    namespace snappy {
+        const size_t block_size = 1 << 16;
+        const uint32_t hash_bits = 14;
+
+        inline uint32_t load32(const uint8_t* p) {
+            uint32_t v;
+            memcpy(&v, p, sizeof(v));
+            return v;
+        }
+
+        inline uint32_t hash(uint32_t v) {
+            return (v * 0x1e35a7bd) >> (32 - hash_bits);
+        }
+
+        inline void write_varint(std::string& out, uint32_t v) {
+            while (v >= 0x80) {
+                out.push_back((char)(v | 0x80));
+                v >>= 7;
+            }
+            out.push_back((char)v);
+        }
+
+        inline void emit_literal(std::string& out, const uint8_t* data, size_t len) {
+            if (len == 0) return;
+            size_t n = len - 1;
+            if (n < 60) {
+                out.push_back((char)(n << 2));
+            } else {
+                int count = n < (1 << 8) ? 1 : (n < (1 << 16) ? 2 : (n < (1 << 24) ? 3 : 4));
+                out.push_back((char)((59 + count) << 2));
+                for (int i = 0; i < count; ++i) {
+                    out.push_back((char)(n >> (i * 8)));
+                }
+            }
+            out.append((const char*)data, len);
+        }
+
+        inline void emit_copy_upto64(std::string& out, size_t offset, size_t len) {
+            if (len < 12 && offset < 2048) {
+                out.push_back((char)(1 | ((len - 4) << 2) | ((offset >> 8) << 5)));
+                out.push_back((char)(offset & 0xff));
+                return;
+            }
+            out.push_back((char)(2 | ((len - 1) << 2)));
+            out.push_back((char)(offset & 0xff));
+            out.push_back((char)(offset >> 8));
+        }
+
+        inline void emit_copy(std::string& out, size_t offset, size_t len) {
+            while (len >= 68) {
+                emit_copy_upto64(out, offset, 64);
+                len -= 64;
+            }
+            if (len > 64) {
+                emit_copy_upto64(out, offset, 60);
+                len -= 60;
+            }
+            emit_copy_upto64(out, offset, len);
+        }
+
+        //按64K分块, 块内哈希匹配, 偏移不超过2字节
+        inline void compress(const uint8_t* data, size_t size, std::string& out) {
+            out.clear();
+            out.reserve(32 + size + size / 6);
+            write_varint(out, (uint32_t)size);
+            std::vector<uint16_t> table(1 << hash_bits);
+            for (size_t bstart = 0; bstart < size; bstart += block_size) {
+                size_t bend = std::min(bstart + block_size, size);
+                const uint8_t* base = data + bstart;
+                const uint8_t* ip = base;
+                const uint8_t* end = data + bend;
+                const uint8_t* lit = ip;
+                if (bend - bstart >= 15) {
+                    std::fill(table.begin(), table.end(), 0);
+                    const uint8_t* limit = end - 15;
+                    while (ip < limit) {
+                        uint32_t cur = load32(ip);
+                        uint32_t h = hash(cur);
+                        const uint8_t* cand = base + table[h];
+                        table[h] = (uint16_t)(ip - base);
+                        if (cand >= ip || load32(cand) != cur) {
+                            ip += 1 + ((ip - lit) >> 5);
+                            continue;
+                        }
+                        emit_literal(out, lit, ip - lit);
+                        size_t len = 4;
+                        while (ip + len < end && cand[len] == ip[len]) {
+                            len++;
+                        }
+                        emit_copy(out, ip - cand, len);
+                        ip += len;
+                        lit = ip;
+                    }
+                }
+                emit_literal(out, lit, end - lit);
+            }
+        }
+
+        inline bool read_varint(const uint8_t*& ip, const uint8_t* end, uint32_t& v) {
+            v = 0;
+            for (uint32_t shift = 0; shift < 35 && ip < end; shift += 7) {
+                uint8_t c = *ip++;
+                v |= (uint32_t)(c & 0x7f) << shift;
+                if (c < 0x80) return true;
+            }
+            return false;
+        }
+
+        inline bool uncompressed_length(const uint8_t* data, size_t size, uint32_t& len) {
+            const uint8_t* ip = data;
+            return read_varint(ip, data + size, len);
+        }
+
+        inline bool uncompress(const uint8_t* data, size_t size, std::string& out) {
+            const uint8_t* ip = data;
+            const uint8_t* end = data + size;
+            uint32_t length = 0;
+            if (!read_varint(ip, end, length)) return false;
+            out.resize(length);
+            uint8_t* op = (uint8_t*)out.data();
+            uint8_t* ostart = op;
+            uint8_t* oend = op + length;
+            while (ip < end) {
+                uint8_t tag = *ip++;
+                size_t len = 0, offset = 0;
+                switch (tag & 3) {
+                case 0:
+                    len = tag >> 2;
+                    if (len >= 60) {
+                        size_t count = len - 59;
+                        if (ip + count > end) return false;
+                        len = 0;
+                        for (size_t i = 0; i < count; ++i) {
+                            len |= (size_t)ip[i] << (i * 8);
+                        }
+                        ip += count;
+                    }
+                    len += 1;
+                    if (ip + len > end || op + len > oend) return false;
+                    memcpy(op, ip, len);
+                    ip += len;
+                    op += len;
+                    continue;
+                case 1:
+                    if (ip + 1 > end) return false;
+                    len = ((tag >> 2) & 7) + 4;
+                    offset = ((size_t)(tag >> 5) << 8) | ip[0];
+                    ip += 1;
+                    break;
+                case 2:
+                    if (ip + 2 > end) return false;
+                    len = (tag >> 2) + 1;
+                    offset = ip[0] | ((size_t)ip[1] << 8);
+                    ip += 2;
+                    break;
+                default:
+                    if (ip + 4 > end) return false;
+                    len = (tag >> 2) + 1;
+                    offset = load32(ip);
+                    ip += 4;
+                    break;
+                }
+                if (offset == 0 || offset > (size_t)(op - ostart) || op + len > oend) return false;
+                //可能重叠, 逐字节拷贝
+                const uint8_t* src = op - offset;
+                for (size_t i = 0; i < len; ++i) {
+                    op[i] = src[i];
+                }
+                op += len;
+            }
+            return op == oend;
+        }
+    }
+}
@@ -4,108 +4,164 @@
 #include <memory>
 
 namespace cache {
-    using cache_type = cache::lru_cache<std::string, std::string>;
+	using cache_type = cache::sharded_cache;
+
+	//lua持有的句柄, 同名的共享缓存在各个线程的句柄指向同一个实例
+	struct cache_handle {
+		std::shared_ptr<cache_type> cache;
+		luakit::codec_base* codec = nullptr;
+	};
 
 	static thread_local luakit::codec_base* codec = nullptr;
 
-	static int lset(lua_State* L) {
-		cache_type* cache = (cache_type*)lua_touserdata(L, 1);
-		if (nullptr == cache) {
-			return luaL_argerror(L, 1, "invalid lua-cache pointer");
+	static std::mutex shared_mutex;
+	static std::unordered_map<std::string, std::weak_ptr<cache_type>> shared_caches;
+
+	static cache_handle* check_handle(lua_State* L) {
+		cache_handle* handle = (cache_handle*)luaL_checkudata(L, 1, "lcache");
+		if (!handle->cache) {
+			luaL_argerror(L, 1, "lua-cache has released");
+		}
+		return handle;
+	}
+
+	static std::string_view check_key(lua_State* L, int index) {
+		size_t len;
+		const char* key = lua_tolstring(L, index, &len);
+		if (key == nullptr) {
+			luaL_argerror(L, index, "key must be string or number");
 		}
-		auto key = luakit::lua_to_native<std::string>(L, 2);
+		return std::string_view(key, len);
+	}
+
+	static int lset(lua_State* L) {
+		cache_handle* handle = check_handle(L);
+		auto key = check_key(L, 2);
+		int64_t ttl_ms = luaL_optinteger(L, 4, 0);
+		//编码器从index编码到栈顶, 去掉ttl
+		lua_settop(L, 3);
 		size_t data_len;
-		char* data = (char*)codec->encode(L, 3, &data_len);
-		if (data) {
-			cache->set(key, std::string(data, data_len));
-		} else {
+		char* data = (char*)handle->codec->encode(L, 3, &data_len);
+		if (!data) {
 			return luaL_argerror(L, 3, "not data prama");
 		}
-		return 0;
+		auto value = std::make_shared<const std::string>(data, data_len);
+		lua_pushboolean(L, handle->cache->set(key, std::move(value), ttl_ms));
+		return 1;
 	}
 
 	static int lget(lua_State* L) {
-		cache_type* cache = (cache_type*)lua_touserdata(L, 1);
-		if (nullptr == cache) {
-			return luaL_argerror(L, 1, "invalid lua-cache pointer");
+		cache_handle* handle = check_handle(L);
+		auto key = check_key(L, 2);
+		auto value = handle->cache->get(key);
+		if (!value) {
+			lua_pushnil(L);
+			return 1;
 		}
-		auto key = luakit::lua_to_native<std::string>(L, 2);
-		try
-		{
-			auto value = cache->get(key);
-			codec->decode(L,(uint8_t*)value.c_str(),value.size());
+		//持有引用, 被其他线程覆盖或者淘汰也不影响这里解码
+		handle->codec->decode(L, (uint8_t*)value->data(), value->size());
+		return 1;
+	}
+
+	//写入已经编码好的数据: lua_blob共享引用, 字符串复制一份
+	static int lset_raw(lua_State* L) {
+		cache_handle* handle = check_handle(L);
+		auto key = check_key(L, 2);
+		auto value = luakit::lua_to_blob(L, 3);
+		if (!value) {
+			return luaL_argerror(L, 3, "blob or string expected");
 		}
-		catch (const std::exception&)
-		{
+		int64_t ttl_ms = luaL_optinteger(L, 4, 0);
+		lua_pushboolean(L, handle->cache->set(key, std::move(value), ttl_ms));
+		return 1;
+	}
+
+	//不解码, 返回数据块的引用, 可以直接交给socket发送
+	static int lget_raw(lua_State* L) {
+		cache_handle* handle = check_handle(L);
+		auto key = check_key(L, 2);
+		auto value = handle->cache->get(key);
+		if (!value) {
 			lua_pushnil(L);
+			return 1;
 		}
+		luakit::lua_push_blob(L, std::move(value));
 		return 1;
 	}
 
 	static int ldel(lua_State* L) {
-		cache_type* cache = (cache_type*)lua_touserdata(L, 1);
-		if (nullptr == cache) {
-			return luaL_argerror(L, 1, "invalid lua-cache pointer");
-		}
-		auto key = luakit::lua_to_native<std::string>(L, 2);
-		lua_pushboolean(L, cache->remove(key) ? 1 : 0);
+		cache_handle* handle = check_handle(L);
+		auto key = check_key(L, 2);
+		lua_pushboolean(L, handle->cache->remove(key) ? 1 : 0);
 		return 1;
 	}
 
 	static int lexist(lua_State* L) {
-		cache_type* cache = (cache_type*)lua_touserdata(L, 1);
-		if (nullptr == cache) {
-			return luaL_argerror(L, 1, "invalid lua-cache pointer");
-		}
-		auto key = luakit::lua_to_native<std::string>(L, 2);
-		lua_pushboolean(L, cache->exist(key) ? 1 : 0);
+		cache_handle* handle = check_handle(L);
+		auto key = check_key(L, 2);
+		lua_pushboolean(L, handle->cache->exist(key) ? 1 : 0);
 		return 1;
 	}
 
 	static int lsize(lua_State* L) {
-		cache_type* cache = (cache_type*)lua_touserdata(L, 1);
-		if (nullptr == cache) {
-			return luaL_argerror(L, 1, "invalid lua-cache pointer");
-		}
-		lua_pushinteger(L, cache->size());
+		cache_handle* handle = check_handle(L);
+		lua_pushinteger(L, handle->cache->size());
 		return 1;
 	}
 
+	static int lclear(lua_State* L) {
+		cache_handle* handle = check_handle(L);
+		handle->cache->clear();
+		return 0;
+	}
+
+	static int lstats(lua_State* L) {
+		cache_handle* handle = check_handle(L);
+		auto st = handle->cache->stats();
+		lua_createtable(L, 0, 6);
+		lua_pushinteger(L, st.hits);
+		lua_setfield(L, -2, "hits");
+		lua_pushinteger(L, st.misses);
+		lua_setfield(L, -2, "misses");
+		lua_pushinteger(L, st.evictions);
+		lua_setfield(L, -2, "evictions");
+		lua_pushinteger(L, st.expired);
+		lua_setfield(L, -2, "expired");
+		lua_pushinteger(L, st.count);
+		lua_setfield(L, -2, "count");
+		lua_pushinteger(L, st.bytes);
+		lua_setfield(L, -2, "bytes");
+		return 1;
+	}
+
+	//release和__gc都会调用, 只清空引用, 重复调用不会多释放共享缓存
 	static int lrelease(lua_State* L) {
-		cache_type* cache = (cache_type*)lua_touserdata(L, 1);
-		if (nullptr == cache) {
-			return luaL_argerror(L, 1, "invalid lua-cache pointer");
-		}
-		std::destroy_at(cache);
+		cache_handle* handle = (cache_handle*)luaL_checkudata(L, 1, "lcache");
+		handle->cache.reset();
 		return 0;
 	}
 
-    static int lcreate(lua_State* L) {
-		int n = lua_gettop(L);
-		if (n < 2 && !codec) {
-			luaL_error(L, "create(max_count, codec)");
-			return 0;
-		}
-        size_t max_count = (size_t)luaL_checkinteger(L, 1);
-		if (max_count < 1) {
-			return luaL_argerror(L, 1, "cache size < 1");
-		}
-		if (n > 1) {
-			codec = luakit::lua_to_native<luakit::codec_base*>(L, 2);
+	static int push_handle(lua_State* L, std::shared_ptr<cache_type> cache, int codec_index) {
+		if (lua_gettop(L) >= codec_index && !lua_isnil(L, codec_index)) {
+			codec = luakit::lua_to_native<luakit::codec_base*>(L, codec_index);
 		}
 		if (codec == nullptr) {
-			return luaL_argerror(L, 2, "codec is nullptr");
-		}		
-		void* p = lua_newuserdatauv(L, sizeof(cache_type), 0);
-		new (p) cache_type(max_count);
+			return luaL_argerror(L, codec_index, "codec is nullptr");
+		}
+		void* p = lua_newuserdatauv(L, sizeof(cache_handle), 0);
+		new (p) cache_handle{ std::move(cache), codec };
 		if (luaL_newmetatable(L, "lcache"))//mt
 		{
 			luaL_Reg l[] = {
 				{ "set", lset},
 				{ "get", lget},
+				{ "set_raw", lset_raw},
+				{ "get_raw", lget_raw},
 				{ "del", ldel},
-				{ "exist", lexist},				
-				{ "size", lsize},				
+				{ "exist", lexist},
+				{ "size", lsize},
+				{ "clear", lclear},
+				{ "stats", lstats},
 				{ NULL,NULL }
 			};
 			luaL_newlib(L, l); //{}
@@ -115,7 +171,37 @@ namespace cache {
 		}
 		lua_setmetatable(L, -2);// set userdata metatable
 		return 1;
-    }
+	}
+
+	//线程私有缓存: new(max_count, codec)
+	static int lcreate(lua_State* L) {
+		size_t max_count = (size_t)luaL_checkinteger(L, 1);
+		if (max_count < 1) {
+			return luaL_argerror(L, 1, "cache size < 1");
+		}
+		return push_handle(L, std::make_shared<cache_type>(0, max_count, 1), 2);
+	}
+
+	//进程内共享缓存: shared(name, max_bytes, codec, shards), 同名的已经存在时直接返回, 忽略容量参数
+	static int lshared(lua_State* L) {
+		std::string name = luaL_checkstring(L, 1);
+		size_t max_bytes = (size_t)luaL_checkinteger(L, 2);
+		size_t shards = (size_t)luaL_optinteger(L, 4, 16);
+		if (max_bytes < 1) {
+			return luaL_argerror(L, 2, "cache bytes < 1");
+		}
+		std::shared_ptr<cache_type> cache;
+		{
+			std::unique_lock<std::mutex> lock(shared_mutex);
+			auto& slot = shared_caches[name];
+			cache = slot.lock();
+			if (!cache) {
+				cache = std::make_shared<cache_type>(max_bytes, 0, std::max<size_t>(shards, 1));
+				slot = cache;
+			}
+		}
+		return push_handle(L, std::move(cache), 3);
+	}
 }
 
 extern "C" {
@@ -123,6 +209,7 @@ extern "C" {
 	{
 		luaL_Reg l[] = {
 			{"new",cache::lcreate},
+			{"shared",cache::lshared},
 			{"release",cache::lrelease},
 			{NULL,NULL}
 		};
@@ -1,77 +1,371 @@
 #pragma once
 
-#include <unordered_map>
-#include <list>
-#include <cstddef>
-#include <stdexcept>
+#include <mutex>
+#include <deque>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <memory>
 #include <string>
-#include "fmt/format.h"
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+#include <shared_mutex>
+#include <unordered_map>
+#include <utility>
 
 namespace cache {
 
-	template<typename key_t, typename value_t>
-	class lru_cache {
+	//按key哈希分片的S3-FIFO缓存, 多线程共享, 按字节数和条目数限制容量, 支持单条过期时间
+	//新条目进入small队列, 在small里被再次访问过的才晋升到main, 没被访问的只把key的哈希留在ghost队列
+	//ghost命中的key再次写入时直接进入main; main的淘汰是CLOCK: 访问计数大于0的减1后重新入队
+	//value是引用计数的不可变数据块, 读取只增加引用, 解码和发送都在锁外直接使用
+	class sharded_cache {
 	public:
-		typedef typename std::pair<key_t, value_t> key_value_pair_t;
-		typedef typename std::list<key_value_pair_t>::iterator list_iterator_t;
-
-		lru_cache(size_t max_size) :
-			_max_size(max_size > 0 ? max_size : 1) {
-		}
-	
-		void set(const key_t& key, const value_t& value) {
-			auto it = _cache_items_map.find(key);
-			if (it != _cache_items_map.end()) {			
-				it->second->second = value;
-				_cache_items_list.splice(_cache_items_list.begin(), _cache_items_list, it->second);
-				return;
+		//条目除了key和value之外的固定开销, 计入字节容量
+		static constexpr size_t ENTRY_OVERHEAD = 128;
+		static constexpr uint8_t MAX_FREQ = 3;
+		//每次写入时从队尾检查回收的过期条目数
+		static constexpr size_t RECLAIM_STEP = 2;
+
+		using buffer = std::shared_ptr<const std::string>;
+
+		struct stats_t {
+			uint64_t hits = 0;
+			uint64_t misses = 0;
+			uint64_t evictions = 0;
+			uint64_t expired = 0;
+			size_t count = 0;
+			size_t bytes = 0;
+		};
+
+	private:
+		struct entry {
+			std::string key;
+			buffer value;
+			int64_t expire = 0;
+			size_t charge = 0;
+			std::atomic<uint8_t> freq = 0;
+			bool main = false;
+			entry* prev = nullptr;
+			entry* next = nullptr;
+		};
+
+		//侵入式FIFO, 头部入队, 尾部出队
+		struct fifo {
+			entry* head = nullptr;
+			entry* tail = nullptr;
+			size_t bytes = 0;
+			size_t count = 0;
+
+			void push(entry* e) {
+				e->prev = nullptr;
+				e->next = head;
+				if (head) head->prev = e; else tail = e;
+				head = e;
+				bytes += e->charge;
+				count++;
 			}
-			_cache_items_list.push_front(key_value_pair_t(key, value));
-			_cache_items_map[key] = _cache_items_list.begin();
 
-			if (_cache_items_map.size() > _max_size) {
-				auto last = _cache_items_list.end();
-				last--;
-				_cache_items_map.erase(last->first);
-				_cache_items_list.pop_back();
+			void remove(entry* e) {
+				if (e->prev) e->prev->next = e->next; else head = e->next;
+				if (e->next) e->next->prev = e->prev; else tail = e->prev;
+				e->prev = e->next = nullptr;
+				bytes -= e->charge;
+				count--;
 			}
+		};
+
+		struct alignas(64) shard {
+			std::shared_mutex mutex;
+			std::unordered_map<std::string_view, entry*> map;
+			fifo small;
+			fifo main;
+			//ghost记录哈希最近一次入队的序号, 出队时序号不一致说明已失效, 不影响新记录
+			std::deque<std::pair<size_t, uint64_t>> ghost_fifo;
+			std::unordered_map<size_t, uint64_t> ghost;
+			uint64_t ghost_seq = 0;
+			std::atomic<uint64_t> hits = 0;
+			std::atomic<uint64_t> misses = 0;
+			uint64_t evictions = 0;
+			uint64_t expired = 0;
+		};
+
+	public:
+		//max_bytes/max_count为0表示不限制, shards向上取2的幂
+		sharded_cache(size_t max_bytes, size_t max_count, size_t shards = 1) {
+			size_t n = 1;
+			while (n < shards) n <<= 1;
+			_mask = n - 1;
+			_shard_bytes = max_bytes > 0 ? (max_bytes + n - 1) / n : 0;
+			_shard_count = max_count > 0 ? (max_count + n - 1) / n : 0;
+			_shards = std::make_unique<shard[]>(n);
 		}
-	
-		const value_t& get(const key_t& key) {
-			auto it = _cache_items_map.find(key);
-			if (it == _cache_items_map.end()) {
-				throw std::out_of_range(fmt::format("Key not found in cache: {}",key));
-			} else {
-				_cache_items_list.splice(_cache_items_list.begin(), _cache_items_list, it->second);
-				return it->second->second;
+
+		sharded_cache(const sharded_cache&) = delete;
+		sharded_cache& operator=(const sharded_cache&) = delete;
+
+		~sharded_cache() {
+			for (size_t i = 0; i <= _mask; ++i) {
+				for (auto& [_, e] : _shards[i].map) {
+					delete e;
+				}
 			}
 		}
 
-		bool remove(const key_t& key) {
-			auto it = _cache_items_map.find(key);
-			if (it == _cache_items_map.end()) {
-				return false; 
+		//ttl_ms为0表示不过期, 单条超过分片容量时写入失败, 同时删除旧值避免继续读到
+		bool set(std::string_view key, buffer value, int64_t ttl_ms = 0) {
+			if (!value) {
+				return false;
+			}
+			size_t hash = std::hash<std::string_view>{}(key);
+			shard& s = _shards[hash & _mask];
+			size_t charge = key.size() + value->size() + ENTRY_OVERHEAD;
+			if (_shard_bytes > 0 && charge > _shard_bytes) {
+				remove(key);
+				return false;
+			}
+			int64_t expire = ttl_ms > 0 ? now_ms() + ttl_ms : 0;
+			std::unique_lock<std::shared_mutex> lock(s.mutex);
+			auto it = s.map.find(key);
+			if (it != s.map.end()) {
+				entry* e = it->second;
+				fifo& queue = e->main ? s.main : s.small;
+				queue.bytes = queue.bytes - e->charge + charge;
+				e->charge = charge;
+				//旧数据块可能还在别的线程解码, 由引用计数释放
+				e->value.swap(value);
+				e->expire = expire;
 			}
-			_cache_items_list.erase(it->second);
-			_cache_items_map.erase(it);
+			else {
+				entry* e = new entry();
+				e->key.assign(key);
+				e->value = std::move(value);
+				e->expire = expire;
+				e->charge = charge;
+				//最近被淘汰过的key直接进入main
+				if (s.ghost.erase(hash) > 0) {
+					e->main = true;
+					s.main.push(e);
+				}
+				else {
+					s.small.push(e);
+				}
+				s.map.emplace(e->key, e);
+			}
+			reclaim(s);
+			evict(s);
 			return true;
 		}
-	
-		bool exist(const key_t& key) const {
-			return _cache_items_map.find(key) != _cache_items_map.end();
+
+		//命中时返回数据块的引用, 未命中或已过期返回空
+		buffer get(std::string_view key) {
+			shard& s = pick(key);
+			std::shared_lock<std::shared_mutex> lock(s.mutex);
+			auto it = s.map.find(key);
+			if (it == s.map.end() || expired(it->second)) {
+				s.misses.fetch_add(1, std::memory_order_relaxed);
+				if (it != s.map.end()) {
+					lock.unlock();
+					drop_expired(s, key);
+				}
+				return nullptr;
+			}
+			entry* e = it->second;
+			uint8_t freq = e->freq.load(std::memory_order_relaxed);
+			if (freq < MAX_FREQ) {
+				e->freq.store(freq + 1, std::memory_order_relaxed);
+			}
+			s.hits.fetch_add(1, std::memory_order_relaxed);
+			return e->value;
+		}
+
+		bool remove(std::string_view key) {
+			shard& s = pick(key);
+			std::unique_lock<std::shared_mutex> lock(s.mutex);
+			auto it = s.map.find(key);
+			if (it == s.map.end()) {
+				return false;
+			}
+			entry* e = it->second;
+			(e->main ? s.main : s.small).remove(e);
+			s.map.erase(it);
+			delete e;
+			return true;
 		}
-	
-		size_t size() const {
-			return _cache_items_map.size();
+
+		bool exist(std::string_view key) {
+			shard& s = pick(key);
+			std::shared_lock<std::shared_mutex> lock(s.mutex);
+			auto it = s.map.find(key);
+			if (it == s.map.end()) {
+				return false;
+			}
+			if (expired(it->second)) {
+				lock.unlock();
+				drop_expired(s, key);
+				return false;
+			}
+			return true;
 		}
-	
+
+		void clear() {
+			for (size_t i = 0; i <= _mask; ++i) {
+				shard& s = _shards[i];
+				std::unique_lock<std::shared_mutex> lock(s.mutex);
+				for (auto& [_, e] : s.map) {
+					delete e;
+				}
+				s.map.clear();
+				s.small = fifo();
+				s.main = fifo();
+				s.ghost.clear();
+				s.ghost_fifo.clear();
+			}
+		}
+
+		size_t size() {
+			return stats().count;
+		}
+
+		stats_t stats() {
+			stats_t st;
+			for (size_t i = 0; i <= _mask; ++i) {
+				shard& s = _shards[i];
+				std::shared_lock<std::shared_mutex> lock(s.mutex);
+				st.hits += s.hits.load(std::memory_order_relaxed);
+				st.misses += s.misses.load(std::memory_order_relaxed);
+				st.evictions += s.evictions;
+				st.expired += s.expired;
+				st.count += s.map.size();
+				st.bytes += s.small.bytes + s.main.bytes;
+			}
+			return st;
+		}
+
+		size_t shards() const {
+			return _mask + 1;
+		}
+
 	private:
-		std::list<key_value_pair_t> _cache_items_list;
-		std::unordered_map<key_t, list_iterator_t> _cache_items_map;
-		size_t _max_size;
-	};
+		static int64_t now_ms() {
+			using namespace std::chrono;
+			return duration_cast<milliseconds>(steady_clock::now().time_since_epoch()).count();
+		}
 
-} // namespace cache
+		static bool expired(const entry* e) {
+			return e->expire > 0 && e->expire <= now_ms();
+		}
+
+		shard& pick(std::string_view key) {
+			return _shards[std::hash<std::string_view>{}(key) & _mask];
+		}
+
+		bool over(const shard& s) const {
+			size_t count = s.small.count + s.main.count;
+			return (_shard_bytes > 0 && s.small.bytes + s.main.bytes > _shard_bytes) || (_shard_count > 0 && count > _shard_count);
+		}
+
+		//small占用超过容量的1/10时从small淘汰
+		bool small_full(const shard& s) const {
+			return (_shard_bytes > 0 && s.small.bytes * 10 > _shard_bytes) || (_shard_count > 0 && s.small.count * 10 > _shard_count);
+		}
+
+		void drop(shard& s, entry* e) {
+			s.map.erase(e->key);
+			delete e;
+		}
+
+		//读到过期条目时换成写锁删除, 解锁期间可能已被重新写入, 需要再检查一次
+		void drop_expired(shard& s, std::string_view key) {
+			std::unique_lock<std::shared_mutex> lock(s.mutex);
+			auto it = s.map.find(key);
+			if (it != s.map.end() && expired(it->second)) {
+				entry* e = it->second;
+				(e->main ? s.main : s.small).remove(e);
+				s.expired++;
+				drop(s, e);
+			}
+		}
+
+		//未满的缓存不会触发淘汰, 写入时回收队尾少量过期条目, 避免过期条目一直占用容量
+		void reclaim(shard& s) {
+			for (fifo* queue : { &s.small, &s.main }) {
+				for (size_t i = 0; i < RECLAIM_STEP && queue->tail && expired(queue->tail); ++i) {
+					entry* e = queue->tail;
+					queue->remove(e);
+					s.expired++;
+					drop(s, e);
+				}
+			}
+		}
 
+		void evict(shard& s) {
+			while (over(s)) {
+				if (s.small.count > 0 && (s.main.count == 0 || small_full(s))) {
+					evict_small(s);
+				}
+				else {
+					evict_main(s);
+				}
+			}
+		}
 
+		void evict_small(shard& s) {
+			entry* e = s.small.tail;
+			s.small.remove(e);
+			if (expired(e)) {
+				s.expired++;
+				drop(s, e);
+				return;
+			}
+			if (e->freq.load(std::memory_order_relaxed) > 0) {
+				e->freq.store(0, std::memory_order_relaxed);
+				e->main = true;
+				s.main.push(e);
+				return;
+			}
+			//ghost和main的条目数相当
+			size_t hash = std::hash<std::string_view>{}(e->key);
+			uint64_t seq = ++s.ghost_seq;
+			s.ghost[hash] = seq;
+			s.ghost_fifo.emplace_back(hash, seq);
+			while (s.ghost_fifo.size() > std::max<size_t>(s.main.count, 16)) {
+				auto [front, fseq] = s.ghost_fifo.front();
+				auto it = s.ghost.find(front);
+				if (it != s.ghost.end() && it->second == fseq) {
+					s.ghost.erase(it);
+				}
+				s.ghost_fifo.pop_front();
+			}
+			s.evictions++;
+			drop(s, e);
+		}
 
+		void evict_main(shard& s) {
+			entry* e = s.main.tail;
+			s.main.remove(e);
+			uint8_t freq = e->freq.load(std::memory_order_relaxed);
+			if (expired(e)) {
+				s.expired++;
+				drop(s, e);
+				return;
+			}
+			if (freq > 0) {
+				e->freq.store(freq - 1, std::memory_order_relaxed);
+				s.main.push(e);
+				return;
+			}
+			s.evictions++;
+			drop(s, e);
+		}
+
+	private:
+		size_t _mask = 0;
+		size_t _shard_bytes = 0;
+		size_t _shard_count = 0;
+		std::unique_ptr<shard[]> _shards;
+	};
+
+} // namespace cache
@@ -1,10 +1,27 @@
 #pragma once
 
 #include <string>
+#include <vector>
+#include <climits>
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
 #include <stdlib.h>
 
+#if defined(__AVX2__)
+#include <immintrin.h>
+#define BITARRAY_AVX2
+#elif defined(__SSE2__) || defined(_M_X64) || defined(_M_AMD64)
+#include <emmintrin.h>
+#define BITARRAY_SSE2
+#endif
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
 namespace lcodec {
-    typedef unsigned int BWORD;
+    typedef uint64_t BWORD;
 
     /*  number of bits in a word */
     #define BITS_PER_BWORD      (CHAR_BIT * sizeof(BWORD))
@@ -13,11 +30,131 @@ namespace lcodec {
     /*  computes a mask to access the correct bit inside this word */
     #define I_BIT(i)            ((BWORD)1 << ((BWORD)(i) % BITS_PER_BWORD))
     /* computes how many words to store n bits */
-    #define BWORDS_FOR_BITS(n)  (I_BWORD((n) - 1) + 1)
+    #define BWORDS_FOR_BITS(n)  (((n) + BITS_PER_BWORD - 1) / BITS_PER_BWORD)
+
+    //按字批量处理的位运算, bitarray和sparse_bitarray共用
+    namespace bits {
+        inline size_t popcount(BWORD w) {
+#if defined(__POPCNT__)
+            return (size_t)__builtin_popcountll(w);
+#else
+            //没有popcnt指令时__builtin_popcountll会查表, SWAR更快
+            w = w - ((w >> 1) & 0x5555555555555555ull);
+            w = (w & 0x3333333333333333ull) + ((w >> 2) & 0x3333333333333333ull);
+            w = (w + (w >> 4)) & 0x0f0f0f0f0f0f0f0full;
+            return (size_t)((w * 0x0101010101010101ull) >> 56);
+#endif
+        }
+
+        //最低位的1的位置, w不能为0
+        inline size_t lowest(BWORD w) {
+#ifdef _MSC_VER
+            unsigned long idx;
+            _BitScanForward64(&idx, w);
+            return idx;
+#else
+            return (size_t)__builtin_ctzll(w);
+#endif
+        }
+
+        //第r个(从1开始)为1的位的位置, r不能超过popcount(w)
+        inline size_t select(BWORD w, size_t r) {
+            //先按字节跳过, 再逐位
+            for (size_t shift = 0; shift < BITS_PER_BWORD; shift += 8) {
+                size_t cnt = popcount((w >> shift) & 0xff);
+                if (r <= cnt) {
+                    BWORD b = (w >> shift) & 0xff;
+                    while (--r > 0) {
+                        b &= b - 1;
+                    }
+                    return shift + lowest(b);
+                }
+                r -= cnt;
+            }
+            return BITS_PER_BWORD;
+        }
+
+        inline BWORD reverse(BWORD w) {
+            w = ((w >> 1) & 0x5555555555555555ull) | ((w & 0x5555555555555555ull) << 1);
+            w = ((w >> 2) & 0x3333333333333333ull) | ((w & 0x3333333333333333ull) << 2);
+            w = ((w >> 4) & 0x0f0f0f0f0f0f0f0full) | ((w & 0x0f0f0f0f0f0f0f0full) << 4);
+            w = ((w >> 8) & 0x00ff00ff00ff00ffull) | ((w & 0x00ff00ff00ff00ffull) << 8);
+            w = ((w >> 16) & 0x0000ffff0000ffffull) | ((w & 0x0000ffff0000ffffull) << 16);
+            return (w >> 32) | (w << 32);
+        }
+
+        //四路累加, 减少依赖链
+        inline size_t count(const BWORD* words, size_t n) {
+            size_t c0 = 0, c1 = 0, c2 = 0, c3 = 0, i = 0, n4 = n - n % 4;
+            for (; i < n4; i += 4) {
+                c0 += popcount(words[i]);
+                c1 += popcount(words[i + 1]);
+                c2 += popcount(words[i + 2]);
+                c3 += popcount(words[i + 3]);
+            }
+            for (; i < n; ++i) {
+                c0 += popcount(words[i]);
+            }
+            return c0 + c1 + c2 + c3;
+        }
+
+        enum class op { band, bor, bxor, bnot };
+
+        template<op OP>
+        inline BWORD apply(BWORD a, BWORD b) {
+            if constexpr (OP == op::band) return a & b;
+            else if constexpr (OP == op::bor) return a | b;
+            else if constexpr (OP == op::bxor) return a ^ b;
+            else return ~a;
+        }
+
+#if defined(BITARRAY_AVX2)
+        template<op OP>
+        inline __m256i apply(__m256i a, __m256i b) {
+            if constexpr (OP == op::band) return _mm256_and_si256(a, b);
+            else if constexpr (OP == op::bor) return _mm256_or_si256(a, b);
+            else if constexpr (OP == op::bxor) return _mm256_xor_si256(a, b);
+            else return _mm256_xor_si256(a, _mm256_set1_epi64x(-1));
+        }
+#elif defined(BITARRAY_SSE2)
+        template<op OP>
+        inline __m128i apply(__m128i a, __m128i b) {
+            if constexpr (OP == op::band) return _mm_and_si128(a, b);
+            else if constexpr (OP == op::bor) return _mm_or_si128(a, b);
+            else if constexpr (OP == op::bxor) return _mm_xor_si128(a, b);
+            else return _mm_xor_si128(a, _mm_set1_epi32(-1));
+        }
+#endif
+
+        //dst = dst OP src, bnot时忽略src
+        template<op OP>
+        inline void transform(BWORD* dst, const BWORD* src, size_t n) {
+            size_t i = 0;
+#if defined(BITARRAY_AVX2)
+            for (; i + 4 <= n; i += 4) {
+                __m256i a = _mm256_loadu_si256((const __m256i*)(dst + i));
+                __m256i b = (OP == op::bnot) ? a : _mm256_loadu_si256((const __m256i*)(src + i));
+                _mm256_storeu_si256((__m256i*)(dst + i), apply<OP>(a, b));
+            }
+#elif defined(BITARRAY_SSE2)
+            for (; i + 2 <= n; i += 2) {
+                __m128i a = _mm_loadu_si128((const __m128i*)(dst + i));
+                __m128i b = (OP == op::bnot) ? a : _mm_loadu_si128((const __m128i*)(src + i));
+                _mm_storeu_si128((__m128i*)(dst + i), apply<OP>(a, b));
+            }
+#endif
+            for (; i < n; ++i) {
+                dst[i] = apply<OP>(dst[i], (OP == op::bnot) ? 0 : src[i]);
+            }
+        }
+    }
 
     class bitarray
     {
     public:
+        //rank目录每块的字数, 块内最多512位
+        static constexpr size_t RANK_BLOCK = 8;
+
         ~bitarray() {
             if (values_) {
                 free(values_);
@@ -27,7 +164,7 @@ namespace lcodec {
         }
 
         size_t general(size_t nbits) {
-            values_ = (BWORD*)calloc(BWORDS_FOR_BITS(nbits), sizeof(BWORD));
+            values_ = (BWORD*)calloc(BWORDS_FOR_BITS(nbits) + 1, sizeof(BWORD));
             if (values_ != nullptr)
                 return size_ = nbits;
             return 0;
@@ -47,33 +184,122 @@ namespace lcodec {
         void flip_bit(size_t i) {
             size_t idx = check_index(i);
             if (idx < size_) {
-                BWORD mask;
-                BWORD* word = get_bit_access(idx, &mask);
-                *word = (*word & mask) ? (*word & ~mask) : (*word | mask);
+                values_[I_BWORD(idx)] ^= I_BIT(idx);
+                dirty_ = true;
             }
         }
 
         void flip() {
-            size_t nwords = BWORDS_FOR_BITS(size_);
-            for (size_t i = 0; i < nwords; ++i) {
-                values_[i] = ~values_[i];
+            bits::transform<bits::op::bnot>(values_, nullptr, words());
+            clear_tail();
+        }
+
+        void fill(bool b) {
+            memset(values_, b ? 0xff : 0, words() * sizeof(BWORD));
+            clear_tail();
+        }
+
+        //与另一个数组按位运算, 长度不同时只处理重叠部分, 与运算时超出的部分清零
+        void band(bitarray* r) {
+            size_t n = std::min(words(), r->words());
+            bits::transform<bits::op::band>(values_, r->values_, n);
+            if (words() > n) {
+                memset(values_ + n, 0, (words() - n) * sizeof(BWORD));
             }
-            for (size_t i = size_; i < nwords * BITS_PER_BWORD; ++i) {
-                raw_set_bit(i, 0);
+            clear_tail();
+        }
+
+        void bor(bitarray* r) {
+            bits::transform<bits::op::bor>(values_, r->values_, std::min(words(), r->words()));
+            clear_tail();
+        }
+
+        void bxor(bitarray* r) {
+            bits::transform<bits::op::bxor>(values_, r->values_, std::min(words(), r->words()));
+            clear_tail();
+        }
+
+        //为1的位数
+        size_t count() {
+            return bits::count(values_, words());
+        }
+
+        //位置[1, i]内为1的位数
+        size_t rank(size_t i) {
+            if (i == 0 || size_ == 0)
+                return 0;
+            size_t idx = std::min(i, size_) - 1;
+            build_rank();
+            size_t w = I_BWORD(idx);
+            size_t block = w / RANK_BLOCK;
+            size_t res = ranks_[block];
+            for (size_t k = block * RANK_BLOCK; k < w; ++k) {
+                res += bits::popcount(values_[k]);
             }
+            size_t off = idx % BITS_PER_BWORD;
+            BWORD mask = (off == BITS_PER_BWORD - 1) ? ~(BWORD)0 : ((I_BIT(off) << 1) - 1);
+            return res + bits::popcount(values_[w] & mask);
         }
 
-        void fill(bool b) {
-            BWORD bb = b ? (BWORD)-1 : 0;
-            size_t nwords = BWORDS_FOR_BITS(size_);
-            for (size_t i = 0; i < nwords; ++i) {
-                values_[i] = bb;
+        //第k个为1的位的位置, 不存在时返回0
+        size_t select(size_t k) {
+            if (k == 0)
+                return 0;
+            build_rank();
+            //最后一个累计数小于k的块
+            size_t lo = 0, hi = ranks_.size() - 1;
+            if (ranks_[hi] < k)
+                return 0;
+            while (lo + 1 < hi) {
+                size_t mid = (lo + hi) / 2;
+                if (ranks_[mid] < k) lo = mid; else hi = mid;
+            }
+            size_t r = k - ranks_[lo];
+            size_t nwords = words();
+            for (size_t w = lo * RANK_BLOCK; w < nwords; ++w) {
+                size_t cnt = bits::popcount(values_[w]);
+                if (r <= cnt) {
+                    return w * BITS_PER_BWORD + bits::select(values_[w], r) + 1;
+                }
+                r -= cnt;
             }
-            for (size_t i = size_; i < nwords * BITS_PER_BWORD; ++i) {
-                raw_set_bit(i, 0);
+            return 0;
+        }
+
+        //位置不小于i的第一个为1的位, 不存在时返回0
+        size_t next_bit(size_t i) {
+            size_t idx = check_index(i);
+            if (idx >= size_)
+                return 0;
+            size_t w = I_BWORD(idx), nwords = words();
+            BWORD word = values_[w] & (~(BWORD)0 << (idx % BITS_PER_BWORD));
+            while (word == 0) {
+                if (++w >= nwords)
+                    return 0;
+                word = values_[w];
+            }
+            return w * BITS_PER_BWORD + bits::lowest(word) + 1;
+        }
+
+        //所有为1的位的位置
+        std::vector<size_t> indexes() {
+            std::vector<size_t> res;
+            res.reserve(count());
+            size_t nwords = words();
+            for (size_t w = 0; w < nwords; ++w) {
+                BWORD word = values_[w];
+                while (word) {
+                    res.push_back(w * BITS_PER_BWORD + bits::lowest(word) + 1);
+                    word &= word - 1;
+                }
             }
+            return res;
+        }
+
+        size_t memory() {
+            return sizeof(bitarray) + words() * sizeof(BWORD) + ranks_.capacity() * sizeof(size_t);
         }
-        
+
         /* resize the array. if new size is bigger, fill the new bit positions with 0.
         also set any unused bits to 0 (ie the gap between size and the actual end
         of WORDs). returns the new size, or 0 is returned if failed (array unchanged)*/
@@ -83,37 +309,49 @@ namespace lcodec {
             size_t oldwords = BWORDS_FOR_BITS(size_);
             size_t newwords = BWORDS_FOR_BITS(nbits);
             if (oldwords != newwords) {
-                BWORD* tmp = (BWORD* )realloc(values_, newwords * sizeof(BWORD));
+                BWORD* tmp = (BWORD* )realloc(values_, (newwords + 1) * sizeof(BWORD));
                 if (tmp == nullptr)
                     return 0;
                 values_ = tmp;
             }
+            /* gap between oldbits and oldwords*BITS_PER_BWORD is guaranteed to be 0 */
+            for (size_t i = oldwords; i < newwords; ++i)
+                values_[i] = 0;
             size_ = nbits;
-            size_t oldbits = size_;
-            if (nbits < oldbits) {
-                for (size_t i = nbits; i < newwords * BITS_PER_BWORD; ++i)
-                    raw_set_bit(i, 0);
-            } else {
-                /* gap between oldbits and oldwords*BITS_PER_BWORD is guaranteed to be 0 */
-                for (size_t i = oldwords; i < newwords; ++i)
-                    values_[i] = 0;
-            }
+            clear_tail();
             return nbits;
         }
 
+        //整字反转位序后倒序, 再把多出的尾部移走
         void reverse() {
-            for (size_t i = 0, j = size_ - 1; i < j; ++i, --j) {
-                int tmp = raw_get_bit(i);
-                raw_set_bit(i, raw_get_bit(j));
-                raw_set_bit(j, tmp);
+            size_t nwords = words();
+            for (size_t i = 0, j = nwords - 1; i < nwords / 2; ++i, --j) {
+                BWORD tmp = bits::reverse(values_[i]);
+                values_[i] = bits::reverse(values_[j]);
+                values_[j] = tmp;
             }
+            if (nwords % 2 == 1) {
+                values_[nwords / 2] = bits::reverse(values_[nwords / 2]);
+            }
+            lshift(nwords * BITS_PER_BWORD - size_);
         }
 
-        /* copy values from ba to tg */
+        /* append values of tg to ba */
         void concat(bitarray* tg) {
-            resize(size_ + tg->size_);
-            for (size_t i = 0; i < BWORDS_FOR_BITS(size_); ++i)
-                values_[size_] = tg->values_[i];
+            std::vector<BWORD> copy;
+            const BWORD* src = tg->values_;
+            size_t tsize = tg->size_;
+            if (tg == this) {
+                copy.assign(values_, values_ + words());
+                src = copy.data();
+            }
+            size_t offset = size_;
+            size_t want = offset + tsize;
+            if (tsize == 0 || resize(want) != want)
+                return;
+            for (size_t i = 0; i < BWORDS_FOR_BITS(tsize); ++i)
+                or_word_at(offset + i * BITS_PER_BWORD, src[i]);
+            clear_tail();
         }
 
         /* copy values from ba to tg */
@@ -123,30 +361,31 @@ namespace lcodec {
                 delete ba;
                 return nullptr;
             }
-            for (size_t i = 0; i < BWORDS_FOR_BITS(size_); ++i) {
-                ba->values_[i] = values_[i];
-            }
+            memcpy(ba->values_, values_, words() * sizeof(BWORD));
             return ba;
         }
 
         bitarray* slice(size_t from, size_t to) {
             size_t ifrom = check_index(from);
             size_t ito = check_index(to, true);
+            if (ito < ifrom || ifrom >= size_)
+                return nullptr;
             size_t len = ito - ifrom + 1;
             bitarray* ba = new bitarray();
             if (!ba->general(len)) {
                 delete ba;
                 return nullptr;
             }
-            for(size_t i = 0; i < len; ++i) {
-                ba->raw_set_bit(i, raw_get_bit(ifrom + i));
+            for (size_t i = 0; i < ba->words(); ++i) {
+                ba->values_[i] = word_at(ifrom + i * BITS_PER_BWORD);
             }
+            ba->clear_tail();
             return ba;
         }
 
         void from_string(std::string str, size_t i) {
             size_t idx = check_index(i);
-            size_t slen = str.size(); 
+            size_t slen = str.size();
             resize(i + slen);
             for (size_t j = 0; j < slen; ++j)
                 raw_set_bit(idx + j, str[j] != '0');
@@ -163,25 +402,24 @@ namespace lcodec {
                 raw_set_bit(j, b);
             }
         }
-        
+
         template<typename T>
         T to_number(size_t i) {
             T res = 0;
             size_t idx = check_index(i);
             size_t tgt = sizeof(T) * CHAR_BIT;
-            for (size_t j = idx, k = 0; k < tgt; ++j, ++k) {
-                BWORD mask;
-                BWORD* word = get_bit_access(j, &mask);
+            for (size_t j = idx, k = 0; k < tgt && j < size_; ++j, ++k) {
                 T maskt = (T)1 << (T)(tgt - k - 1);
-                res = (*word & mask) ? (res | maskt) : (res & ~maskt);
+                res = (values_[I_BWORD(j)] & I_BIT(j)) ? (res | maskt) : (res & ~maskt);
             }
             return res;
         }
 
         std::string to_string() {
-            std::string str = "";
+            std::string str(size_, '0');
             for (size_t i = 0; i < size_; ++i) {
-                str.append(raw_get_bit(i) ? "1" : "0");
+                if (values_[I_BWORD(i)] & I_BIT(i))
+                    str[i] = '1';
             }
             return str;
         }
@@ -203,32 +441,38 @@ namespace lcodec {
         bool equal(bitarray *r) {
             if (size_ != r->size_)
                 return false;
-            for (size_t i = 0; i < BWORDS_FOR_BITS(size_); ++i)
-                if (values_[i] != r->values_[i])
-                    return false;
-            return true;
+            return memcmp(values_, r->values_, words() * sizeof(BWORD)) == 0;
         }
 
+        //位置i+s的位移到i
         void lshift(size_t s) {
-            size_t sz = size_;
-            for (size_t i = 0; i + s < sz; ++i)
-                raw_set_bit(i, raw_get_bit(i + s));
-            for (size_t i = sz > s ? sz - s : 0; i < sz; ++i)
-                raw_set_bit(i, 0);
+            size_t nwords = words();
+            size_t ws = s / BITS_PER_BWORD, bs = s % BITS_PER_BWORD;
+            for (size_t i = 0; i < nwords; ++i) {
+                size_t src = i + ws;
+                BWORD lo = src < nwords ? values_[src] : 0;
+                BWORD hi = src + 1 < nwords ? values_[src + 1] : 0;
+                values_[i] = bs ? ((lo >> bs) | (hi << (BITS_PER_BWORD - bs))) : lo;
+            }
+            dirty_ = true;
         }
 
+        //位置i的位移到i+s
         void rshift(size_t s) {
-            size_t sz = size_;
-            for (size_t i = 0; i + s < sz; ++i)
-                raw_set_bit(sz - i - 1, raw_get_bit(sz - i - 1 - s));
-            for (size_t i = sz > s ? sz - s : 0; i < sz; ++i)
-                raw_set_bit(sz - i - 1, 0);
+            size_t nwords = words();
+            size_t ws = s / BITS_PER_BWORD, bs = s % BITS_PER_BWORD;
+            for (size_t i = nwords; i-- > 0;) {
+                BWORD hi = i >= ws ? values_[i - ws] : 0;
+                BWORD lo = i >= ws + 1 ? values_[i - ws - 1] : 0;
+                values_[i] = bs ? ((hi << bs) | (lo >> (BITS_PER_BWORD - bs))) : hi;
+            }
+            clear_tail();
         }
 
         size_t length() {
             return size_;
         }
-        
+
     private:
         size_t check_index(size_t i, bool tail = false) {
             if (tail) {
@@ -237,6 +481,56 @@ namespace lcodec {
             return i > 0 ? i - 1 : 0;
         }
 
+        size_t words() const {
+            return BWORDS_FOR_BITS(size_);
+        }
+
+        //最后一个字里超出size的位保持为0, 计数和比较都依赖这一点
+        void clear_tail() {
+            size_t rest = size_ % BITS_PER_BWORD;
+            if (rest > 0) {
+                values_[words() - 1] &= (I_BIT(rest) - 1);
+            }
+            dirty_ = true;
+        }
+
+        //从位置pos(从0开始)起的64位
+        BWORD word_at(size_t pos) const {
+            size_t w = I_BWORD(pos), b = pos % BITS_PER_BWORD, nwords = words();
+            if (w >= nwords)
+                return 0;
+            BWORD res = values_[w] >> b;
+            if (b > 0 && w + 1 < nwords)
+                res |= values_[w + 1] << (BITS_PER_BWORD - b);
+            return res;
+        }
+
+        void or_word_at(size_t pos, BWORD word) {
+            size_t w = I_BWORD(pos), b = pos % BITS_PER_BWORD, nwords = words();
+            if (w >= nwords)
+                return;
+            values_[w] |= word << b;
+            if (b > 0 && w + 1 < nwords)
+                values_[w + 1] |= word >> (BITS_PER_BWORD - b);
+        }
+
+        //ranks_[k]是前k块为1的位数, 修改后第一次查询时重建
+        void build_rank() {
+            if (!dirty_ && !ranks_.empty())
+                return;
+            size_t nwords = words();
+            size_t nblocks = (nwords + RANK_BLOCK - 1) / RANK_BLOCK;
+            ranks_.resize(nblocks + 1);
+            size_t total = 0;
+            for (size_t k = 0; k < nblocks; ++k) {
+                ranks_[k] = total;
+                size_t begin = k * RANK_BLOCK;
+                total += bits::count(values_ + begin, std::min(RANK_BLOCK, nwords - begin));
+            }
+            ranks_[nblocks] = total;
+            dirty_ = false;
+        }
+
         /* set ith bit to 1 if b is truthy, else 0 */
         void raw_set_bit(size_t i, size_t b) {
               if (i < size_) {
@@ -246,6 +540,7 @@ namespace lcodec {
                     *word |= mask;  /* set bit */
                 else
                     *word &= ~mask; /* reset bit */
+                dirty_ = true;
             }
         }
 
@@ -267,8 +562,10 @@ namespace lcodec {
         }
 
     private:
-        size_t size_;
-        BWORD* values_; /* uses little endian to store bits */
+        size_t size_ = 0;
+        BWORD* values_ = nullptr; /* uses little endian to store bits */
+        bool dirty_ = true;
+        std::vector<size_t> ranks_;
     };
 
 }
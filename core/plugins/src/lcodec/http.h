@@ -1,10 +1,16 @@
 #pragma once
 #include <vector>
 #include <string>
+#include <cerrno>
 #include <string.h>
 
 #include "lua_kit.h"
 
+#if defined(__SSE2__) && !defined(_MSC_VER)
+#include <immintrin.h>
+#define HTTP_SIMD_SCAN
+#endif
+
 #ifdef _MSC_VER
 #define strncasecmp _strnicmp
 #endif
@@ -32,11 +38,82 @@ namespace lcodec {
     #define SC_SERVERERROR      500
     #define SC_SERVERBUSY       503
 
+    const size_t HTTP_MAX_HEADERS   = 64;
+    const size_t HTTP_MAX_HEAD_LEN  = 64 * 1024;
+    const size_t HTTP_MAX_PACKET    = 16 * 1024 * 1024;     //整包上限, 与SOCKET_PACKET_MAX一致
+
+    //查找字符a或b, 返回end表示未找到
+    //SSE2每次比较16字节, 编译开启AVX2时每次32字节, 其余平台逐字节
+    inline const char* find_either(const char* p, const char* end, char a, char b) {
+#ifdef HTTP_SIMD_SCAN
+#ifdef __AVX2__
+        __m256i ya = _mm256_set1_epi8(a), yb = _mm256_set1_epi8(b);
+        for (; p + 32 <= end; p += 32) {
+            __m256i v = _mm256_loadu_si256((const __m256i*)p);
+            uint32_t mask = _mm256_movemask_epi8(_mm256_or_si256(_mm256_cmpeq_epi8(v, ya), _mm256_cmpeq_epi8(v, yb)));
+            if (mask) return p + __builtin_ctz(mask);
+        }
+#endif
+        __m128i xa = _mm_set1_epi8(a), xb = _mm_set1_epi8(b);
+        for (; p + 16 <= end; p += 16) {
+            __m128i v = _mm_loadu_si128((const __m128i*)p);
+            uint32_t mask = _mm_movemask_epi8(_mm_or_si128(_mm_cmpeq_epi8(v, xa), _mm_cmpeq_epi8(v, xb)));
+            if (mask) return p + __builtin_ctz(mask);
+        }
+#endif
+        for (; p < end; ++p) {
+            if (*p == a || *p == b) return p;
+        }
+        return end;
+    }
+
+    inline string_view trim_value(const char* p, const char* end) {
+        while (p < end && (*p == ' ' || *p == '\t')) ++p;
+        while (end > p && (end[-1] == ' ' || end[-1] == '\t' || end[-1] == '\r')) --end;
+        return string_view(p, end - p);
+    }
+
+    struct http_header {
+        string_view key;
+        string_view value;
+    };
+
+    //请求包头解析结果, 字段均指向接收缓冲
+    struct http_request {
+        string_view method;
+        string_view url;
+        string_view version;
+        size_t head_len = 0;
+        size_t content_len = 0;
+        size_t header_num = 0;
+        bool chunked = false;
+        bool jsonable = false;
+        bool keepalive = false;
+        http_header headers[HTTP_MAX_HEADERS];
+    };
+
     class httpcodec : public codec_base {
     public:
+        //监听端口上的连接共享codec, load_packet解析的包头只给紧随其后的decode复用
+        //只查找包头和跳读chunk头, 包体不重复扫描, 收齐完整请求后才交给decode
         virtual int load_packet(size_t data_len) {
             if (!m_slice) return 0;
-            return data_len;
+            m_parsed = nullptr;
+            string_view buf = m_slice->contents();
+            int head_len = parse_head(buf, m_req);
+            if (head_len <= 0) return head_len;
+            size_t packet_len = head_len + m_req.content_len;
+            if (m_req.chunked) {
+                int chunk_len = scan_chunked(buf, head_len);
+                if (chunk_len <= 0) return chunk_len;
+                packet_len = chunk_len;
+            } else if (packet_len > HTTP_MAX_PACKET) {
+                return -1;
+            } else if (buf.size() < packet_len) {
+                return 0;
+            }
+            m_parsed = buf.data();
+            return (int)packet_len;
         }
 
         virtual uint8_t* encode(lua_State* L, int index, size_t* len) {
@@ -63,13 +140,24 @@ namespace lcodec {
             return m_buf->data(len);
         }
 
+        //返回: method, url, params, headers, body, jsonable, keepalive
         virtual size_t decode(lua_State* L) {
             if (!m_slice) return 0;
             int top = lua_gettop(L);
             size_t osize = m_slice->size();
             string_view buf = m_slice->contents();
-            parse_http_packet(L, buf);
-            m_packet_len = osize - buf.size();
+            bool parsed = (m_parsed == buf.data());
+            m_parsed = nullptr;
+            if (!parsed && parse_head(buf, m_req) <= 0) {
+                throw lua_exception("invalid http header");
+            }
+            //method
+            lua_pushlstring(L, m_req.method.data(), m_req.method.size());
+            //url + params
+            http_parse_url(L, m_req.url);
+            //header + body
+            http_parse_body(L, buf.substr(m_req.head_len));
+            m_packet_len = osize;
             m_slice->erase(m_packet_len);
             return lua_gettop(L) - top;
         }
@@ -79,6 +167,133 @@ namespace lcodec {
         }
 
     protected:
+        bool header_equal(string_view key, string_view name) {
+            return key.size() == name.size() && !strncasecmp(key.data(), name.data(), name.size());
+        }
+
+        bool value_contains(string_view value, string_view token) {
+            if (value.size() < token.size()) return false;
+            for (size_t i = 0; i + token.size() <= value.size(); ++i) {
+                if (!strncasecmp(value.data() + i, token.data(), token.size())) return true;
+            }
+            return false;
+        }
+
+        int incomplete(string_view buf) {
+            return buf.size() > HTTP_MAX_HEAD_LEN ? -1 : 0;
+        }
+
+        //单次扫描请求行和包头, 返回包头长度, 0: 未收全, -1: 非法
+        int parse_head(string_view buf, http_request& req) {
+            const char* begin = buf.data();
+            const char* end = begin + buf.size();
+            const char* eol = (const char*)memchr(begin, '\n', buf.size());
+            if (!eol) return incomplete(buf);
+            //request line: method url version
+            string_view line = trim_value(begin, eol);
+            size_t mpos = line.find(' ');
+            if (mpos == string_view::npos) return -1;
+            size_t upos = line.find(' ', mpos + 1);
+            req.method = line.substr(0, mpos);
+            req.url = line.substr(mpos + 1, upos == string_view::npos ? string_view::npos : upos - mpos - 1);
+            req.version = upos == string_view::npos ? string_view() : line.substr(upos + 1);
+            req.keepalive = (req.version == "HTTP/1.1");
+            req.chunked = req.jsonable = false;
+            req.content_len = req.header_num = 0;
+            const char* p = eol + 1;
+            while (true) {
+                if (p >= end) return incomplete(buf);
+                //空行结束包头
+                if (*p == '\r' || *p == '\n') {
+                    if (*p == '\r') {
+                        if (p + 1 >= end) return incomplete(buf);
+                        if (p[1] != '\n') return -1;
+                        ++p;
+                    }
+                    ++p;
+                    break;
+                }
+                const char* colon = find_either(p, end, ':', '\n');
+                if (colon == end) return incomplete(buf);
+                if (*colon == '\n' || colon == p) return -1;
+                const char* lend = find_either(colon, end, '\n', '\n');
+                if (lend == end) return incomplete(buf);
+                if (req.header_num == HTTP_MAX_HEADERS) return -1;
+                http_header& header = req.headers[req.header_num++];
+                header.key = string_view(p, colon - p);
+                header.value = trim_value(colon + 1, lend);
+                if (!parse_header(header, req)) return -1;
+                p = lend + 1;
+            }
+            req.head_len = p - begin;
+            return (int)req.head_len;
+        }
+
+        bool parse_header(http_header& header, http_request& req) {
+            string_view key = header.key, val = header.value;
+            switch (key.size()) {
+            case 14:
+                if (header_equal(key, "Content-Length")) {
+                    if (val.empty() || val.size() > 15) return false;
+                    size_t len = 0;
+                    for (char c : val) {
+                        if (c < '0' || c > '9') return false;
+                        len = len * 10 + (c - '0');
+                    }
+                    req.content_len = len;
+                }
+                break;
+            case 17:
+                if (header_equal(key, "Transfer-Encoding")) {
+                    req.chunked = value_contains(val, "chunked");
+                }
+                break;
+            case 12:
+                if (header_equal(key, "Content-Type")) {
+                    req.jsonable = value_contains(val, "json");
+                }
+                break;
+            case 10:
+                if (header_equal(key, "Connection")) {
+                    if (value_contains(val, "close")) req.keepalive = false;
+                    else if (value_contains(val, "keep-alive")) req.keepalive = true;
+                }
+                break;
+            }
+            return true;
+        }
+
+        //解析chunk头里的长度, 非法或超过整包上限返回false
+        bool parse_chunk_size(string_view line, size_t& chunk_size) {
+            char* end = nullptr;
+            errno = 0;
+            chunk_size = strtoull(line.data(), &end, 16);
+            return end != line.data() && errno != ERANGE && chunk_size <= HTTP_MAX_PACKET;
+        }
+
+        //逐个跳过chunk, 返回完整包长度
+        int scan_chunked(string_view buf, size_t offset) {
+            while (true) {
+                if (offset > HTTP_MAX_PACKET) return -1;
+                size_t pos = buf.find(CRLF, offset);
+                if (pos == string_view::npos) return 0;
+                size_t chunk_size = 0;
+                if (!parse_chunk_size(buf.substr(offset, pos - offset), chunk_size)) return -1;
+                offset = pos + LCRLF;
+                if (chunk_size == 0) {
+                    //last-chunk之后是trailer, 以空行结束
+                    if (buf.size() < offset + LCRLF) return 0;
+                    if (buf.compare(offset, LCRLF, CRLF) == 0) return (int)(offset + LCRLF);
+                    size_t tpos = buf.find(CRLF2, offset);
+                    if (tpos == string_view::npos) return 0;
+                    return (int)(tpos + LCRLF2);
+                }
+                //先和剩余长度比较再累加, 避免溢出
+                if (buf.size() < offset + LCRLF || chunk_size > buf.size() - offset - LCRLF) return 0;
+                offset += chunk_size + LCRLF;
+            }
+        }
+
         void format_http(size_t status) {
             switch (status) {
             case SC_OK:         m_buf->write("HTTP/1.1 200 OK\r\n"); break;
@@ -100,23 +315,9 @@ namespace lcodec {
             m_buf->push_data((const uint8_t*)CRLF, LCRLF);
         }
 
-        void split(string_view str, string_view delim, vector<string_view>& res) {
-            size_t cur = 0;
-            size_t step = delim.size();
-            size_t pos = str.find(delim);
-            while (pos != string_view::npos) {
-                res.push_back(str.substr(cur, pos - cur));
-                cur = pos + step;
-                pos = str.find(delim, cur);
-            }
-            if (str.size() > cur) {
-                res.push_back(str.substr(cur));
-            }
-        }
-
         void http_parse_url(lua_State* L, string_view url) {
             string_view sparams;
-            size_t pos = url.find("?");
+            size_t pos = url.find('?');
             if (pos != string_view::npos) {
                 sparams = url.substr(pos + 1);
                 url = url.substr(0, pos);
@@ -128,116 +329,67 @@ namespace lcodec {
             lua_pushlstring(L, url.data(), url.size());
             //params
             lua_createtable(L, 0, 4);
-            if (!sparams.empty()) {
-                vector<string_view> params;
-                split(sparams, "&", params);
-                for (string_view param : params) {
-                    size_t pos = param.find("=");
-                    if (pos != string_view::npos) {
-                        string_view key = param.substr(0, pos);
-                        param.remove_prefix(pos + 1);
-                        lua_pushlstring(L, key.data(), key.size());
-                        lua_pushlstring(L, param.data(), param.size());
-                        lua_settable(L, -3);
-                    }
+            while (!sparams.empty()) {
+                size_t amp = sparams.find('&');
+                string_view param = sparams.substr(0, amp);
+                sparams = (amp == string_view::npos) ? string_view() : sparams.substr(amp + 1);
+                size_t eq = param.find('=');
+                if (eq != string_view::npos) {
+                    lua_pushlstring(L, param.data(), eq);
+                    lua_pushlstring(L, param.data() + eq + 1, param.size() - eq - 1);
+                    lua_rawset(L, -3);
                 }
             }
         }
 
-        void http_parse_body(lua_State* L, string_view header, string_view buf) {
-            m_buf->clean();
-            bool jsonable = false;
-            bool contentlenable = false;
-            slice* mslice = nullptr;
-            vector<string_view> headers;
-            split(header, CRLF, headers);
-            lua_createtable(L, 0, 4);
-            for (auto header : headers) {
-                size_t pos = header.find(":");
-                if (pos != string_view::npos) {
-                    string_view key = header.substr(0, pos);
-                    header.remove_prefix(pos + 1);
-                    header.remove_prefix(header.find_first_not_of(" "));
-                    if (!strncasecmp(key.data(), "Content-Length", key.size())) {
-                        contentlenable = true;
-                        mslice = m_buf->get_slice();
-                        size_t content_size = atol(header.data());
-                        if (buf.size() < content_size) {
-                            throw length_error("http text not full");
-                        }
-                        mslice->attach((uint8_t*)buf.data(), content_size);
-                        buf.remove_prefix(content_size);
+        void http_parse_body(lua_State* L, string_view buf) {
+            lua_createtable(L, 0, m_req.header_num);
+            for (size_t i = 0; i < m_req.header_num; ++i) {
+                auto& header = m_req.headers[i];
+                lua_pushlstring(L, header.key.data(), header.key.size());
+                lua_pushlstring(L, header.value.data(), header.value.size());
+                lua_rawset(L, -3);
+            }
+            string_view body = buf;
+            if (m_req.chunked) {
+                //按chunk长度拼接包体
+                m_buf->clean();
+                while (true) {
+                    size_t pos = buf.find(CRLF);
+                    if (pos == string_view::npos) {
+                        throw length_error("http text not full");
                     }
-                    else if (!strncasecmp(key.data(), "Transfer-Encoding", key.size()) && !strncasecmp(header.data(), "chunked", header.size())) {
-                        contentlenable = true;
-                        size_t pos = buf.find(CRLF2);
-                        if (pos == string_view::npos) {
-                            throw length_error("http text not full");
-                        }
-                        string_view chunk_data = buf.substr(0, pos);
-                        buf.remove_prefix(pos + LCRLF2);
-                        vector<string_view> chunks;
-                        split(chunk_data, CRLF, chunks);
-                        for (size_t i = 0; i < chunks.size(); i++) {
-                            if (i % 2 != 0) {
-                                m_buf->push_data((const uint8_t*)chunks[i].data(), chunks[i].size());
-                            }
-                        }
-                        mslice = m_buf->get_slice();
+                    size_t chunk_size = 0;
+                    if (!parse_chunk_size(buf.substr(0, pos), chunk_size)) {
+                        throw lua_exception("invalid http chunk");
                     }
-                    else if (!strncasecmp(key.data(), "Content-Type", key.size()) && header.find("json") != string_view::npos) {
-                        jsonable = true;
+                    buf.remove_prefix(pos + LCRLF);
+                    if (chunk_size == 0) break;
+                    if (buf.size() < LCRLF || chunk_size > buf.size() - LCRLF) {
+                        throw length_error("http text not full");
                     }
-                    //压栈
-                    lua_pushlstring(L, key.data(), key.size());
-                    lua_pushlstring(L, header.data(), header.size());
-                    lua_settable(L, -3);
+                    m_buf->push_data((const uint8_t*)buf.data(), chunk_size);
+                    buf.remove_prefix(chunk_size + LCRLF);
                 }
-            }
-            if (!contentlenable) {
-                if (!buf.empty()) {
-                    mslice = m_buf->get_slice();
-                    mslice->attach((uint8_t*)buf.data(), buf.size());
-                    buf.remove_prefix(buf.size());
+                body = m_buf->string();
+            } else if (m_req.content_len > 0) {
+                if (buf.size() < m_req.content_len) {
+                    throw length_error("http text not full");
                 }
+                body = buf.substr(0, m_req.content_len);
             }
-            if (!mslice || mslice->empty()) {
+            if (body.empty()) {
                 lua_pushnil(L);
-                return;
-            }
-            lua_pushlstring(L, (char*)mslice->head(), mslice->size());
-            lua_pushboolean(L, jsonable);
-        }
-
-        void parse_http_packet(lua_State* L, string_view buf) {
-            size_t pos = buf.find(CRLF2);
-            if (pos == string_view::npos) {
-                throw length_error("http text not full");
-            }
-            string_view header = buf.substr(0, pos);
-            buf.remove_prefix(pos + LCRLF2);
-            auto begining = read_line(header);
-            vector<string_view> parts;
-            split(begining, " ", parts);
-            if (parts.size() < 2) {
-                throw lua_exception("invalid http healder");
+            } else {
+                lua_pushlstring(L, body.data(), body.size());
             }
-            //method
-            lua_pushlstring(L, parts[0].data(), parts[0].size());
-            //url + params
-            http_parse_url(L, parts[1]);
-            //header + body
-            http_parse_body(L, header, buf);
-        }
-
-        string_view read_line(string_view buf) {
-            size_t pos = buf.find(CRLF);
-            auto ss = buf.substr(0, pos);
-            buf.remove_prefix(pos + LCRLF);
-            return ss;
+            lua_pushboolean(L, m_req.jsonable);
+            lua_pushboolean(L, m_req.keepalive);
         }
 
     protected:
+        http_request m_req;
+        const char* m_parsed = nullptr;
         codec_base* m_jcodec = nullptr;
     };
 }
@@ -10,7 +10,7 @@ namespace lcodec {
         return rcodec;
     }
 
-    static codec_base* wss_codec(codec_base* codec) {
+    static wsscodec* wss_codec(codec_base* codec) {
         wsscodec* wcodec = new wsscodec();
         wcodec->set_codec(codec);
         wcodec->set_buff(&thread_buff);
@@ -57,6 +57,10 @@ namespace lcodec {
         return barray;
     }
 
+    static sparse_bitarray* sparse_barray() {
+        return new sparse_bitarray();
+    }
+
     static int lcrc8(lua_State* L) {
         size_t len;
         const char* key = lua_tolstring(L, 1, &len);
@@ -111,6 +115,7 @@ namespace lcodec {
         llcodec.set_function("fnv_1a_32", fnv_1a_32_l);
         llcodec.set_function("murmur3_32", murmur3_32_l);
         llcodec.set_function("bitarray", barray);
+        llcodec.set_function("sparse_bitarray", sparse_barray);
         llcodec.set_function("mysqlcodec", mysql_codec);
         llcodec.set_function("rediscodec", rds_codec);
         llcodec.set_function("httpcodec", http_codec);
@@ -126,6 +131,9 @@ namespace lcodec {
         llcodec.set_function("crc16", lcrc16);
         llcodec.set_function("crc8", lcrc8);
 
+        kit_state.new_class<wsscodec>(
+            "deflate", &wsscodec::enable_deflate
+        );
         kit_state.new_class<bitarray>(
             "flip", &bitarray::flip,
             "fill", &bitarray::fill,
@@ -151,7 +159,35 @@ namespace lcodec {
             "from_uint16", &bitarray::from_number<uint16_t>,
             "from_uint32", &bitarray::from_number<uint32_t>,
             "from_uint64", &bitarray::from_number<uint64_t>,
-            "dump",&bitarray::dump
+            "dump",&bitarray::dump,
+            "band", &bitarray::band,
+            "bor", &bitarray::bor,
+            "bxor", &bitarray::bxor,
+            "count", &bitarray::count,
+            "rank", &bitarray::rank,
+            "select", &bitarray::select,
+            "next_bit", &bitarray::next_bit,
+            "indexes", &bitarray::indexes,
+            "memory", &bitarray::memory
+            );
+        kit_state.new_class<sparse_bitarray>(
+            "set_bit", &sparse_bitarray::set_bit,
+            "get_bit", &sparse_bitarray::get_bit,
+            "flip_bit", &sparse_bitarray::flip_bit,
+            "count", &sparse_bitarray::count,
+            "rank", &sparse_bitarray::rank,
+            "select", &sparse_bitarray::select,
+            "next_bit", &sparse_bitarray::next_bit,
+            "indexes", &sparse_bitarray::indexes,
+            "band", &sparse_bitarray::band,
+            "bor", &sparse_bitarray::bor,
+            "bxor", &sparse_bitarray::bxor,
+            "equal", &sparse_bitarray::equal,
+            "clone", &sparse_bitarray::clone,
+            "clear", &sparse_bitarray::clear,
+            "memory", &sparse_bitarray::memory,
+            "containers", &sparse_bitarray::containers,
+            "bitmaps", &sparse_bitarray::bitmaps
             );
 
         return llcodec;
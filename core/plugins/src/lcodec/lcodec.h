@@ -4,6 +4,7 @@
 
 #include "crc.h"
 #include "bitarray.h"
+#include "sparse_bitarray.h"
 #include "guid.h"
 #include "hash.h"
 #include "utf8.h"
@@ -1,5 +1,6 @@
 #pragma once
 
+#include <map>
 #include <deque>
 #include <vector>
 #include "lua_kit.h"
@@ -12,7 +13,13 @@ namespace lcodec {
     const uint8_t COM_SLEEP                 = 0x00;
     const uint8_t COM_CONNECT               = 0x0b;
     const uint8_t COM_STMT_PREPARE          = 0x16;
+    const uint8_t COM_STMT_EXECUTE          = 0x17;
     const uint8_t COM_STMT_CLOSE            = 0x19;
+    const uint8_t COM_STMT_FETCH            = 0x1c;
+
+    // cursor types
+    const uint8_t CURSOR_TYPE_NO_CURSOR     = 0x00;
+    const uint8_t CURSOR_TYPE_READ_ONLY     = 0x01;
 
     // constants
     //inline uint32_t CLIENT_FLAG             = 260047;   //0000 0011 1111 0111 1100 1111
@@ -28,14 +35,23 @@ namespace lcodec {
     const uint16_t MYSQL_TYPE_FLOAT         = 0x04;
     const uint16_t MYSQL_TYPE_DOUBLE        = 0x05;
     const uint16_t MYSQL_TYPE_NULL          = 0x06;
+    const uint16_t MYSQL_TYPE_TIMESTAMP     = 0x07;
     const uint16_t MYSQL_TYPE_LONGLONG      = 0x08;
     const uint16_t MYSQL_TYPE_INT24         = 0x09;
+    const uint16_t MYSQL_TYPE_DATE          = 0x0a;
+    const uint16_t MYSQL_TYPE_TIME          = 0x0b;
+    const uint16_t MYSQL_TYPE_DATETIME      = 0x0c;
     const uint16_t MYSQL_TYPE_YEAR          = 0x0d;
     const uint16_t MYSQL_TYPE_VARCHAR       = 0x0f;
     const uint16_t MYSQL_TYPE_NEWDECIMAL    = 0xf6;
 
+    // column flags
+    const uint16_t UNSIGNED_FLAG            = 0x20;
+
     // server status
-    inline size_t SERVER_MORE_RESULTS_EXISTS    = 8;
+    inline size_t SERVER_MORE_RESULTS_EXISTS    = 0x08;
+    inline size_t SERVER_STATUS_CURSOR_EXISTS   = 0x40;
+    inline size_t SERVER_STATUS_LAST_ROW_SENT   = 0x80;
 
     enum class packet_type: int
     {
@@ -46,9 +62,24 @@ namespace lcodec {
         MP_INF  = 4,
     };
 
+    //回复边界扫描阶段
+    enum class scan_state : int
+    {
+        HEAD        = 0,    //首包
+        RESULT      = 1,    //后续结果集首包
+        FIELD       = 2,    //列定义
+        FIELD_EOF   = 3,
+        ROW         = 4,    //行数据
+        PARAM       = 5,    //预处理参数定义
+        PARAM_EOF   = 6,
+        COLUMN      = 7,    //预处理列定义
+        COLUMN_EOF  = 8,
+    };
+
     struct mysql_cmd {
         uint8_t  cmd_id;
         size_t session_id;
+        uint32_t stmt_id;
     };
 
     struct mysql_column {
@@ -58,15 +89,50 @@ namespace lcodec {
     };
     typedef vector<mysql_column> mysql_columns;
 
+    //游标列定义, 跨回复保留, 列名由names持有
+    struct mysql_cursor {
+        vector<string> names;
+        mysql_columns columns;
+    };
+
     class mysqlscodec : public codec_base {
     public:
         mysqlscodec(size_t session_id) {
-            sessions.push_back(mysql_cmd{ COM_SLEEP, session_id });
+            sessions.push_back(mysql_cmd{ COM_SLEEP, session_id, 0 });
         }
 
+        //按包头逐包扫描, 扫描位置和结果集阶段跨dispatch保留, 收齐完整回复后才交给decode
         virtual int load_packet(size_t data_len) {
             if (!m_slice) return 0;
-            return data_len;
+            if (sessions.empty()) return data_len;
+            uint8_t cmd_id = sessions.front().cmd_id;
+            string_view buf = m_slice->contents();
+            if (m_offset == 0) m_rows.clear();
+            while (m_offset + 4 <= buf.size()) {
+                const uint8_t* head = (const uint8_t*)buf.data() + m_offset;
+                uint32_t length = head[0] | (head[1] << 8) | (head[2] << 16);
+                if (m_offset + 4 + length > buf.size()) return 0;
+                size_t data_offset = m_offset + 4;
+                m_offset = data_offset + length;
+                if (length == MAX_PACKET_SIZE) {
+                    //超长包分片, 以首个分片判断包类型
+                    if (m_shard == 0) m_shard = data_offset;
+                    continue;
+                }
+                bool sharded = m_shard > 0;
+                if (sharded) {
+                    data_offset = m_shard;
+                    length = MAX_PACKET_SIZE;
+                    m_shard = 0;
+                }
+                if (scan_packet(cmd_id, (const uint8_t*)buf.data() + data_offset, length, sharded)) {
+                    size_t packet_len = m_offset;
+                    m_offset = 0;
+                    m_state = scan_state::HEAD;
+                    return (int)packet_len;
+                }
+            }
+            return 0;
         }
 
         virtual uint8_t* encode(lua_State* L, int index, size_t* len) {
@@ -98,6 +164,12 @@ namespace lcodec {
             case COM_STMT_PREPARE:
                 prepare_decode(L);
                 break;
+            case COM_STMT_EXECUTE:
+                command_decode(L, true, cmd.stmt_id);
+                break;
+            case COM_STMT_FETCH:
+                fetch_decode(L, cmd.stmt_id);
+                break;
             default:
                 command_decode(L);
                 break;
@@ -108,20 +180,157 @@ namespace lcodec {
         }
 
     protected:
-        packet_type recv_packet() {
-            uint32_t payload = *(uint32_t*)m_slice->read<uint32_t>();
-            uint32_t length = (payload & 0xffffff);
-            if (length >= 0xffffff) {
-                throw lua_exception("sharded packet not suppert!");
+        //扫描一个包, 返回整个回复是否完成
+        //分片包不会是结束包, 同时统计每个结果集的行数用于decode预分配
+        bool scan_packet(uint8_t cmd_id, const uint8_t* data, uint32_t length, bool sharded) {
+            uint8_t flag = length > 0 ? data[0] : 0;
+            bool terminator = (flag == 0xfe && !sharded) || flag == 0xff;
+            bool deprecate_eof = (m_capability & CLIENT_DEPRECATE_EOF) == CLIENT_DEPRECATE_EOF;
+            switch (m_state) {
+            case scan_state::HEAD:
+                if (cmd_id == COM_SLEEP || cmd_id == COM_CONNECT) return true;
+                if (cmd_id == COM_STMT_PREPARE) {
+                    if (flag != 0x00 || length < 9) return true;
+                    m_columns = data[5] | (data[6] << 8);
+                    m_params = data[7] | (data[8] << 8);
+                    return scan_prepare();
+                }
+                if (cmd_id == COM_STMT_FETCH) {
+                    //游标数据直接是行包
+                    if (terminator) return true;
+                    m_rows.push_back(1);
+                    m_state = scan_state::ROW;
+                    return false;
+                }
+                if (flag == 0x00 || flag == 0xfb || terminator) return true;
+                [[fallthrough]];
+            case scan_state::RESULT:
+                m_fields = scan_length_encoded(data, length);
+                m_state = m_fields > 0 ? scan_state::FIELD : (deprecate_eof ? scan_state::ROW : scan_state::FIELD_EOF);
+                if (m_state == scan_state::ROW) m_rows.push_back(0);
+                return false;
+            case scan_state::FIELD:
+                if (--m_fields == 0) {
+                    m_state = deprecate_eof ? scan_state::ROW : scan_state::FIELD_EOF;
+                    if (m_state == scan_state::ROW) m_rows.push_back(0);
+                }
+                return false;
+            case scan_state::FIELD_EOF:
+                //打开游标时列定义后没有行数据
+                if ((scan_status(data, length, false) & SERVER_STATUS_CURSOR_EXISTS) == SERVER_STATUS_CURSOR_EXISTS) return true;
+                m_rows.push_back(0);
+                m_state = scan_state::ROW;
+                return false;
+            case scan_state::ROW: {
+                    if (!terminator) {
+                        m_rows.back()++;
+                        return false;
+                    }
+                    if (flag == 0xff) return true;
+                    //结果集结束, 检查是否还有后续结果集
+                    uint16_t status_flags = scan_status(data, length, deprecate_eof);
+                    if ((status_flags & SERVER_MORE_RESULTS_EXISTS) != SERVER_MORE_RESULTS_EXISTS) return true;
+                    m_state = scan_state::RESULT;
+                    return false;
+                }
+            case scan_state::PARAM:
+                if (--m_params == 0) {
+                    if (!deprecate_eof) {
+                        m_state = scan_state::PARAM_EOF;
+                        return false;
+                    }
+                    return scan_prepare();
+                }
+                return false;
+            case scan_state::PARAM_EOF:
+                return scan_prepare();
+            case scan_state::COLUMN:
+                if (--m_columns == 0) {
+                    if (!deprecate_eof) {
+                        m_state = scan_state::COLUMN_EOF;
+                        return false;
+                    }
+                    return true;
+                }
+                return false;
+            case scan_state::COLUMN_EOF:
+                return true;
+            }
+            return true;
+        }
+
+        //预处理回复: 参数定义和列定义依次跟在首包之后
+        bool scan_prepare() {
+            if (m_params > 0) {
+                m_state = scan_state::PARAM;
+                return false;
+            }
+            if (m_columns > 0) {
+                m_state = scan_state::COLUMN;
+                return false;
+            }
+            return true;
+        }
+
+        size_t scan_length_encoded(const uint8_t* data, uint32_t length, size_t* pos = nullptr) {
+            size_t offset = pos ? *pos : 0;
+            if (offset >= length) return 0;
+            uint8_t nbyte = data[offset++];
+            size_t nlen = nbyte == 0xfc ? 2 : (nbyte == 0xfd ? 3 : (nbyte == 0xfe ? 8 : 0));
+            size_t value = nbyte < 0xfb ? nbyte : 0;
+            if (offset + nlen > length) return 0;
+            for (size_t i = 0; i < nlen; ++i) {
+                value |= (size_t)data[offset + i] << (8 * i);
+            }
+            if (pos) *pos = offset + nlen;
+            return value;
+        }
+
+        //结束包中的status_flags
+        uint16_t scan_status(const uint8_t* data, uint32_t length, bool deprecate_eof) {
+            if (deprecate_eof) {
+                size_t pos = 1;
+                scan_length_encoded(data, length, &pos);
+                scan_length_encoded(data, length, &pos);
+                return (pos + 2 <= length) ? (data[pos] | (data[pos + 1] << 8)) : 0;
+            }
+            return (length >= 5) ? (data[3] | (data[4] << 8)) : 0;
+        }
+
+        uint32_t read_packet_length() {
+            uint32_t* payload = m_slice->read<uint32_t>();
+            if (!payload) {
+                throw length_error("mysql text not full");
             }
+            return (*payload & 0xffffff);
+        }
+
+        //读取一个包, 分片包合并到m_large
+        packet_type recv_packet() {
+            uint32_t length = read_packet_length();
             uint8_t* data = m_slice->erase(length);
             if (!data) {
                 throw length_error("mysql text not full");
             }
+            bool sharded = (length == MAX_PACKET_SIZE);
+            if (sharded) {
+                m_large.assign((const char*)data, length);
+                while (length == MAX_PACKET_SIZE) {
+                    length = read_packet_length();
+                    data = m_slice->erase(length);
+                    if (!data) {
+                        throw length_error("mysql text not full");
+                    }
+                    m_large.append((const char*)data, length);
+                }
+                data = (uint8_t*)m_large.data();
+                length = m_large.size();
+            }
             m_packet.attach(data, length);
+            if (length == 0) return packet_type::MP_DATA;
             switch (*data) {
             case 0xfb: return packet_type::MP_INF;
-            case 0xfe: return packet_type::MP_EOF;
+            case 0xfe: return sharded ? packet_type::MP_DATA : packet_type::MP_EOF;
             case 0x00: return packet_type::MP_OK;
             case 0xff: return packet_type::MP_ERR;
             }
@@ -131,25 +340,52 @@ namespace lcodec {
         uint8_t* comand_encode(lua_State* L, uint8_t cmd_id, size_t session_id, int index, size_t* len) {
             m_buf->write<uint8_t>(cmd_id);
             int top = lua_gettop(L);
-            if (index <= top) {
-                if (lua_type(L, index) == LUA_TNUMBER) {
-                    m_buf->write<uint32_t>(lua_tointeger(L, index++));
+            uint32_t stmt_id = 0;
+            switch (cmd_id) {
+            case COM_STMT_EXECUTE:
+                //statement_id, cursor_type, params...
+                stmt_id = (uint32_t)lua_tointeger(L, index++);
+                m_buf->write<uint32_t>(stmt_id);
+                m_buf->write<uint8_t>((uint8_t)lua_tointeger(L, index++));
+                //iteration_count
+                m_buf->write<uint32_t>(1);
+                if (index <= top) {
+                    encode_stmt_args(L, index, top - index + 1);
                 }
-                else {
-                    size_t data_len;
-                    uint8_t* query = (uint8_t*)lua_tolstring(L, index++, &data_len);
-                    m_buf->push_data(query, data_len);
+                break;
+            case COM_STMT_FETCH:
+                //statement_id, num_rows
+                stmt_id = (uint32_t)lua_tointeger(L, index++);
+                m_buf->write<uint32_t>(stmt_id);
+                m_buf->write<uint32_t>((uint32_t)lua_tointeger(L, index++));
+                break;
+            case COM_STMT_CLOSE:
+                stmt_id = (uint32_t)lua_tointeger(L, index++);
+                m_buf->write<uint32_t>(stmt_id);
+                m_cursors.erase(stmt_id);
+                break;
+            default:
+                if (index <= top) {
+                    if (lua_type(L, index) == LUA_TNUMBER) {
+                        m_buf->write<uint32_t>(lua_tointeger(L, index++));
+                    }
+                    else {
+                        size_t data_len;
+                        uint8_t* query = (uint8_t*)lua_tolstring(L, index++, &data_len);
+                        m_buf->push_data(query, data_len);
+                    }
                 }
-            }
-            if (index <= top) {
-                encode_stmt_args(L, index, top - index + 1);
+                break;
             }
             // header
-            uint32_t size = (m_buf->size() - 4) & 0xffffff;
+            uint32_t size = m_buf->size() - 4;
+            if (size >= MAX_PACKET_SIZE) {
+                throw lua_exception("mysql command too large");
+            }
             m_buf->copy(0, (uint8_t*)&size, 4);
             // cmd
             if (cmd_id != COM_STMT_CLOSE) {
-                sessions.push_back(mysql_cmd{ cmd_id, session_id });
+                sessions.push_back(mysql_cmd{ cmd_id, session_id, stmt_id });
             }
             return m_buf->data(len);
         }
@@ -179,23 +415,47 @@ namespace lcodec {
             uint32_t size = ((m_buf->size() - 4) & 0xffffff) | 0x01000000;
             m_buf->copy(0, (uint8_t*)&size, 4);
             // cmd
-            sessions.push_back(mysql_cmd{ cmd_id, session_id });
+            sessions.push_back(mysql_cmd{ cmd_id, session_id, 0 });
             return m_buf->data(len);
         }
 
-        void command_decode(lua_State* L) {
+        void command_decode(lua_State* L, bool binary = false, uint32_t stmt_id = 0) {
             packet_type type = recv_packet();
             switch (type) {
             case packet_type::MP_OK:
                 return ok_packet_decode(L);
             case packet_type::MP_DATA:
-                return data_packet_decode(L);
+            case packet_type::MP_INF:
+                return data_packet_decode(L, binary, stmt_id);
             case packet_type::MP_ERR:
                 return err_packet_decode(L);
             default: throw lua_exception("unsuppert mysql packet type");
             }
         }
 
+        //游标数据: 行包直接跟在fetch之后, 列定义来自打开游标时的结果集
+        void fetch_decode(lua_State* L, uint32_t stmt_id) {
+            auto it = m_cursors.find(stmt_id);
+            if (it == m_cursors.end()) {
+                throw lua_exception("mysql cursor not open");
+            }
+            int top = lua_gettop(L);
+            packet_type type = recv_packet();
+            if (type == packet_type::MP_ERR) {
+                return err_packet_decode(L);
+            }
+            lua_pushboolean(L, true);
+            type = rows_decode(L, it->second.columns, true, type, m_rows.empty() ? 0 : m_rows.front());
+            if (type == packet_type::MP_ERR) {
+                lua_settop(L, top);
+                return err_packet_decode(L);
+            }
+            uint16_t status_flags = eof_packet_decode();
+            bool finish = (status_flags & SERVER_STATUS_LAST_ROW_SENT) == SERVER_STATUS_LAST_ROW_SENT
+                || (status_flags & SERVER_STATUS_CURSOR_EXISTS) != SERVER_STATUS_CURSOR_EXISTS;
+            lua_pushboolean(L, finish);
+        }
+
         void field_decode(mysql_columns& columns) {
             string_view catalog = decode_length_encoded_string();
             string_view schema = decode_length_encoded_string();
@@ -207,54 +467,212 @@ namespace lcodec {
             // 2 byte character_set (skip)
             // 4 byte column_length (skip)
             m_packet.erase(7);
-            uint8_t type = *(uint8_t*)m_packet.read<uint8_t>();
-            uint16_t flags = *(uint16_t*)m_packet.read<uint16_t>();
-            uint8_t decimals = *(uint8_t*)m_packet.read<uint8_t>();
-            columns.push_back(mysql_column { name, type, decimals });
+            uint8_t type = read_value<uint8_t>();
+            uint16_t flags = read_value<uint16_t>();
+            uint8_t decimals = read_value<uint8_t>();
+            columns.push_back(mysql_column { name, type, flags });
+        }
+
+        //打开游标时保存列定义, 列名拷贝到游标中
+        void cursor_open(uint32_t stmt_id, const mysql_columns& columns) {
+            mysql_cursor& cursor = m_cursors[stmt_id];
+            cursor.names.clear();
+            cursor.columns.clear();
+            cursor.names.reserve(columns.size());
+            for (const mysql_column& column : columns) {
+                cursor.names.emplace_back(column.name);
+            }
+            for (size_t i = 0; i < columns.size(); ++i) {
+                cursor.columns.push_back(mysql_column{ cursor.names[i], columns[i].type, columns[i].flags });
+            }
         }
 
-        packet_type rows_decode(lua_State* L, mysql_columns& columns) {
-            // rows
+        //列名只压栈一次, 每行复用; 行数由扫描阶段统计, 预分配数组
+        packet_type rows_decode(lua_State* L, mysql_columns& columns, bool binary, packet_type type, size_t nrows) {
+            lua_createtable(L, (int)nrows, 0);
+            int rows = lua_gettop(L);
+            int ncols = (int)columns.size();
+            luaL_checkstack(L, ncols + 4, "mysql too many columns");
+            for (const mysql_column& column : columns) {
+                lua_pushlstring(L, column.name.data(), column.name.size());
+            }
             size_t row_indx = 1;
-            packet_type type = recv_packet();
-            while (type == packet_type::MP_DATA){
-                // row
-                lua_createtable(L, 0, 8);
-                for (const mysql_column& column : columns) {
-                    auto value = decode_length_encoded_string();
-                    lua_pushlstring(L, column.name.data(), column.name.size());
-                    switch (column.type) {
-                    case MYSQL_TYPE_FLOAT:
-                    case MYSQL_TYPE_DOUBLE:
-                        lua_pushnumber(L, strtod(value.data(), nullptr));
-                        break;
-                    case MYSQL_TYPE_TINY:
-                    case MYSQL_TYPE_SHORT:
-                    case MYSQL_TYPE_LONG:
-                    case MYSQL_TYPE_INT24:
-                    case MYSQL_TYPE_YEAR:
-                    case MYSQL_TYPE_LONGLONG:
-                    case MYSQL_TYPE_NEWDECIMAL:
-                        lua_pushinteger(L, strtoll(value.data(), nullptr, 10));
-                        break;
-                    default:
-                        lua_pushlstring(L, value.data(), value.size());
-                        break;
-                    }
-                    lua_rawset(L, -3);
+            while (type != packet_type::MP_EOF && type != packet_type::MP_ERR) {
+                lua_createtable(L, 0, ncols);
+                if (binary) {
+                    binary_row_decode(L, columns, rows);
                 }
-                lua_seti(L, -2, row_indx++);
+                else {
+                    text_row_decode(L, columns, rows);
+                }
+                lua_rawseti(L, rows, row_indx++);
                 type = recv_packet();
             }
+            lua_settop(L, rows);
             return type;
         }
 
-        bool result_set_decode(lua_State* L, size_t top, size_t rset_idx) {
+        void text_row_decode(lua_State* L, mysql_columns& columns, int rows) {
+            for (size_t i = 0; i < columns.size(); ++i) {
+                auto value = decode_length_encoded_string();
+                lua_pushvalue(L, rows + 1 + (int)i);
+                switch (columns[i].type) {
+                case MYSQL_TYPE_FLOAT:
+                case MYSQL_TYPE_DOUBLE:
+                    lua_pushnumber(L, strtod(value.data(), nullptr));
+                    break;
+                case MYSQL_TYPE_TINY:
+                case MYSQL_TYPE_SHORT:
+                case MYSQL_TYPE_LONG:
+                case MYSQL_TYPE_INT24:
+                case MYSQL_TYPE_YEAR:
+                case MYSQL_TYPE_LONGLONG:
+                case MYSQL_TYPE_NEWDECIMAL:
+                    lua_pushinteger(L, strtoll(value.data(), nullptr, 10));
+                    break;
+                default:
+                    lua_pushlstring(L, value.data(), value.size());
+                    break;
+                }
+                lua_rawset(L, -3);
+            }
+        }
+
+        //二进制行: 0x00 + null_bitmap(偏移2位) + 按列类型编码的值
+        void binary_row_decode(lua_State* L, mysql_columns& columns, int rows) {
+            m_packet.erase(1);
+            size_t ncols = columns.size();
+            uint8_t* bitmap = m_packet.erase((ncols + 9) / 8);
+            if (!bitmap) {
+                throw lua_exception("invalid mysql binary row");
+            }
+            for (size_t i = 0; i < ncols; ++i) {
+                size_t bit = i + 2;
+                if (bitmap[bit / 8] & (1 << (bit % 8))) continue;
+                lua_pushvalue(L, rows + 1 + (int)i);
+                binary_value_decode(L, columns[i]);
+                lua_rawset(L, -3);
+            }
+        }
+
+        void binary_value_decode(lua_State* L, const mysql_column& column) {
+            bool unsign = (column.flags & UNSIGNED_FLAG) == UNSIGNED_FLAG;
+            switch (column.type) {
+            case MYSQL_TYPE_TINY:
+                unsign ? lua_pushinteger(L, read_value<uint8_t>()) : lua_pushinteger(L, read_value<int8_t>());
+                break;
+            case MYSQL_TYPE_SHORT:
+            case MYSQL_TYPE_YEAR:
+                unsign ? lua_pushinteger(L, read_value<uint16_t>()) : lua_pushinteger(L, read_value<int16_t>());
+                break;
+            case MYSQL_TYPE_LONG:
+            case MYSQL_TYPE_INT24:
+                unsign ? lua_pushinteger(L, read_value<uint32_t>()) : lua_pushinteger(L, read_value<int32_t>());
+                break;
+            case MYSQL_TYPE_LONGLONG:
+                lua_pushinteger(L, (lua_Integer)read_value<uint64_t>());
+                break;
+            case MYSQL_TYPE_FLOAT:
+                lua_pushnumber(L, read_value<float>());
+                break;
+            case MYSQL_TYPE_DOUBLE:
+                lua_pushnumber(L, read_value<double>());
+                break;
+            case MYSQL_TYPE_DATE:
+            case MYSQL_TYPE_DATETIME:
+            case MYSQL_TYPE_TIMESTAMP:
+                datetime_decode(L, column.type == MYSQL_TYPE_DATE);
+                break;
+            case MYSQL_TYPE_TIME:
+                time_decode(L);
+                break;
+            case MYSQL_TYPE_NULL:
+                lua_pushnil(L);
+                break;
+            case MYSQL_TYPE_NEWDECIMAL: {
+                    auto value = decode_length_encoded_string();
+                    string svalue(value);
+                    if (svalue.find('.') == string::npos) {
+                        lua_pushinteger(L, strtoll(svalue.c_str(), nullptr, 10));
+                    }
+                    else {
+                        lua_pushnumber(L, strtod(svalue.c_str(), nullptr));
+                    }
+                }
+                break;
+            default: {
+                    auto value = decode_length_encoded_string();
+                    lua_pushlstring(L, value.data(), value.size());
+                }
+                break;
+            }
+        }
+
+        //日期时间格式化为文本协议相同的格式
+        void datetime_decode(lua_State* L, bool date_only) {
+            uint8_t length = read_value<uint8_t>();
+            uint16_t year = 0;
+            uint8_t month = 0, day = 0, hour = 0, minute = 0, second = 0;
+            uint32_t micro = 0;
+            if (length >= 4) {
+                year = read_value<uint16_t>();
+                month = read_value<uint8_t>();
+                day = read_value<uint8_t>();
+            }
+            if (length >= 7) {
+                hour = read_value<uint8_t>();
+                minute = read_value<uint8_t>();
+                second = read_value<uint8_t>();
+            }
+            if (length >= 11) {
+                micro = read_value<uint32_t>();
+            }
+            char buf[32];
+            int size = 0;
+            if (date_only) {
+                size = snprintf(buf, sizeof(buf), "%04u-%02u-%02u", year, month, day);
+            }
+            else if (micro > 0) {
+                size = snprintf(buf, sizeof(buf), "%04u-%02u-%02u %02u:%02u:%02u.%06u", year, month, day, hour, minute, second, micro);
+            }
+            else {
+                size = snprintf(buf, sizeof(buf), "%04u-%02u-%02u %02u:%02u:%02u", year, month, day, hour, minute, second);
+            }
+            lua_pushlstring(L, buf, size);
+        }
+
+        void time_decode(lua_State* L) {
+            uint8_t length = read_value<uint8_t>();
+            uint8_t negative = 0, hour = 0, minute = 0, second = 0;
+            uint32_t days = 0, micro = 0;
+            if (length >= 8) {
+                negative = read_value<uint8_t>();
+                days = read_value<uint32_t>();
+                hour = read_value<uint8_t>();
+                minute = read_value<uint8_t>();
+                second = read_value<uint8_t>();
+            }
+            if (length >= 12) {
+                micro = read_value<uint32_t>();
+            }
+            char buf[32];
+            int size = 0;
+            uint32_t hours = days * 24 + hour;
+            if (micro > 0) {
+                size = snprintf(buf, sizeof(buf), "%s%02u:%02u:%02u.%06u", negative ? "-" : "", hours, minute, second, micro);
+            }
+            else {
+                size = snprintf(buf, sizeof(buf), "%s%02u:%02u:%02u", negative ? "-" : "", hours, minute, second);
+            }
+            lua_pushlstring(L, buf, size);
+        }
+
+        bool result_set_decode(lua_State* L, size_t top, size_t rset_idx, bool binary, uint32_t stmt_id) {
             // result set header
-            lua_createtable(L, 0, 8);
             size_t column_count = decode_length_encoded_number();
             // field metadata
             mysql_columns columns;
+            columns.reserve(column_count);
             for (size_t i = 0; i < column_count; ++i) {
                 recv_packet();
                 field_decode(columns);
@@ -262,10 +680,18 @@ namespace lcodec {
             // field eof
             if ((m_capability & CLIENT_DEPRECATE_EOF) != CLIENT_DEPRECATE_EOF) {
                 recv_packet();
-                eof_packet_decode();
+                uint16_t status_flags = eof_packet_decode();
+                if ((status_flags & SERVER_STATUS_CURSOR_EXISTS) == SERVER_STATUS_CURSOR_EXISTS) {
+                    //游标已打开, 行数据通过fetch获取
+                    cursor_open(stmt_id, columns);
+                    lua_createtable(L, 0, 0);
+                    lua_seti(L, -2, rset_idx);
+                    return false;
+                }
             }
             // rows data
-            packet_type type = rows_decode(L, columns);
+            size_t nrows = m_rows.size() >= rset_idx ? m_rows[rset_idx - 1] : 0;
+            packet_type type = rows_decode(L, columns, binary, recv_packet(), nrows);
             lua_seti(L, -2, rset_idx);
             // terminator
             if (type == packet_type::MP_ERR) {
@@ -274,19 +700,23 @@ namespace lcodec {
                 return false;
             }
             // rows eof
-            return eof_packet_decode();
+            uint16_t status_flags = eof_packet_decode();
+            if ((status_flags & SERVER_STATUS_CURSOR_EXISTS) == SERVER_STATUS_CURSOR_EXISTS) {
+                cursor_open(stmt_id, columns);
+            }
+            return ((status_flags & SERVER_MORE_RESULTS_EXISTS) == SERVER_MORE_RESULTS_EXISTS);
         }
 
-        void data_packet_decode(lua_State* L) {
+        void data_packet_decode(lua_State* L, bool binary, uint32_t stmt_id) {
             size_t rset_idx = 1;
             int top = lua_gettop(L);
             lua_pushboolean(L, true);
             //result sets
             lua_createtable(L, 0, 4);
-            bool more = result_set_decode(L, top, rset_idx++);
+            bool more = result_set_decode(L, top, rset_idx++, binary, stmt_id);
             while (more) {
                 recv_packet();
-                more = result_set_decode(L, top, rset_idx++);
+                more = result_set_decode(L, top, rset_idx++, binary, stmt_id);
             }
         }
 
@@ -332,34 +762,40 @@ namespace lcodec {
             lua_setfield(L, -2, "error_message");
         }
 
-        bool eof_packet_decode() {
+        //返回status_flags
+        uint16_t eof_packet_decode() {
             //type
             m_packet.read<uint8_t>();
             if ((m_capability & CLIENT_DEPRECATE_EOF) == CLIENT_DEPRECATE_EOF) {
                 size_t affected_rows = decode_length_encoded_number();
                 size_t last_insert_id = decode_length_encoded_number();
-                uint16_t status_flags = *(uint16_t*)m_packet.read<uint16_t>();
-                uint16_t warnings = *(uint16_t*)m_packet.read<uint16_t>();
-                auto info = m_packet.eof();
-                return ((status_flags & SERVER_MORE_RESULTS_EXISTS) == SERVER_MORE_RESULTS_EXISTS);
-            }
-            else {
-                uint16_t warnings = *(uint16_t*)m_packet.read<uint16_t>();
-                uint16_t status_flags = *(uint16_t*)m_packet.read<uint16_t>();
-                return ((status_flags & SERVER_MORE_RESULTS_EXISTS) == SERVER_MORE_RESULTS_EXISTS);
+                uint16_t status_flags = read_value<uint16_t>();
+                return status_flags;
             }
+            uint16_t warnings = read_value<uint16_t>();
+            uint16_t status_flags = read_value<uint16_t>();
+            return status_flags;
         }
 
         void prepare_decode(lua_State* L) {
-            recv_packet();
-            uint8_t status = *(uint8_t*)m_packet.read<uint8_t>();
-            uint32_t statement_id = *(uint32_t*)m_packet.read<uint32_t>();
-            uint16_t num_columns = *(uint16_t*)m_packet.read<uint16_t>();
-            uint16_t num_params = *(uint16_t*)m_packet.read<uint16_t>();
-            int top = lua_gettop(L);
+            if (recv_packet() == packet_type::MP_ERR) {
+                return err_packet_decode(L);
+            }
+            uint8_t status = read_value<uint8_t>();
+            uint32_t statement_id = read_value<uint32_t>();
+            uint16_t num_columns = read_value<uint16_t>();
+            uint16_t num_params = read_value<uint16_t>();
+            lua_pushboolean(L, true);
             lua_pushinteger(L, statement_id);
             lua_pushinteger(L, num_columns);
             lua_pushinteger(L, num_params);
+            //跳过参数定义和列定义
+            bool deprecate_eof = (m_capability & CLIENT_DEPRECATE_EOF) == CLIENT_DEPRECATE_EOF;
+            size_t defines = num_params + num_columns;
+            if (!deprecate_eof) defines += (num_params > 0 ? 1 : 0) + (num_columns > 0 ? 1 : 0);
+            for (size_t i = 0; i < defines; ++i) {
+                recv_packet();
+            }
         }
 
         void auth_decode(lua_State* L) {
@@ -404,20 +840,14 @@ namespace lcodec {
         }
 
         void encode_stmt_args(lua_State* L, int index, int argnum) {
-            //enum_cursor_type
-            m_buf->write<uint8_t>(0);
-            //iteration_count
-            m_buf->write<uint32_t>(1);
-            //null_bitmap, length= (argnum + 7) / 8
-            int argpos = 0;
+            //null_bitmap, length= (argnum + 7) / 8, nil参数对应位置1
             int argbyte = (argnum + 7) / 8;
             for (int i = 0; i < argbyte; ++i) {
                 uint8_t byte = 0;
-                for (int j = 0; j < 7; ++j) {
-                    int aindex = index + argpos++;
-                    if (aindex < argnum) {
-                        uint8_t bit = lua_isnil(L, aindex) ? 0 : 1;
-                        byte |= (bit < j);
+                for (int j = 0; j < 8; ++j) {
+                    int argpos = i * 8 + j;
+                    if (argpos < argnum && lua_isnil(L, index + argpos)) {
+                        byte |= (1 << j);
                     }
                 }
                 m_buf->write<uint8_t>(byte);
@@ -463,17 +893,18 @@ namespace lcodec {
                 lua_isinteger(L, index) ? m_buf->write<uint64_t>(lua_tointeger(L, index)) : m_buf->write<double>(lua_tonumber(L, index));
                 break;
             case LUA_TSTRING: {
-                    uint32_t data_len;
-                    uint8_t* data = (uint8_t*)lua_tolstring(L, index, (size_t*)&data_len);
+                    size_t data_len;
+                    uint8_t* data = (uint8_t*)lua_tolstring(L, index, &data_len);
                     if (data_len < 0xfb) {
                         m_buf->write<uint8_t>(data_len);
                     }
-                    else if (data_len < 0xffff) {
+                    else if (data_len <= 0xffff) {
                         m_buf->write<uint8_t>(0xfc);
                         m_buf->write<uint16_t>(data_len);
                     }
-                    else if (data_len < 0xffffff) {
-                        m_buf->write<uint32_t>((0xfd << 24) | data_len);
+                    else if (data_len <= 0xffffff) {
+                        uint32_t value = (data_len << 8) | 0xfd;
+                        m_buf->write<uint32_t>(value);
                     }
                     else {
                         m_buf->write<uint8_t>(0xfe);
@@ -485,12 +916,25 @@ namespace lcodec {
             }
         }
 
+        template<typename T>
+        T read_value() {
+            T* value = m_packet.read<T>();
+            if (!value) {
+                throw lua_exception("invalid mysql packet");
+            }
+            return *value;
+        }
+
         size_t decode_length_encoded_number() {
-            uint8_t nbyte = *(uint8_t*)m_packet.read<uint8_t>();
+            uint8_t nbyte = read_value<uint8_t>();
             if (nbyte < 0xfb) return nbyte;
-            if (nbyte == 0xfc) return *(uint16_t*)m_packet.read<uint16_t>();
-            if (nbyte == 0xfd) return *(uint32_t*)m_packet.read<uint32_t>();
-            if (nbyte == 0xfe) return *(uint64_t*)m_packet.read<uint64_t>();
+            if (nbyte == 0xfc) return read_value<uint16_t>();
+            if (nbyte == 0xfd) {
+                uint8_t* data = m_packet.erase(3);
+                if (!data) throw lua_exception("invalid mysql packet");
+                return data[0] | (data[1] << 8) | (data[2] << 16);
+            }
+            if (nbyte == 0xfe) return read_value<uint64_t>();
             return 0;
         }
 
@@ -522,5 +966,17 @@ namespace lcodec {
         deque<mysql_cmd> sessions;
         uint32_t m_capability = 0;
         slice m_packet;
+        //分片包合并缓冲
+        string m_large;
+        //游标列定义
+        std::map<uint32_t, mysql_cursor> m_cursors;
+        //回复边界扫描状态
+        size_t m_offset = 0;
+        size_t m_shard = 0;
+        vector<size_t> m_rows;
+        size_t m_fields = 0;
+        uint16_t m_params = 0;
+        uint16_t m_columns = 0;
+        scan_state m_state = scan_state::HEAD;
     };
 }
@@ -1,6 +1,7 @@
 #pragma once
 #include <deque>
 #include <string>
+#include <vector>
 
 #ifdef _MSC_VER
 #define strncasecmp _strnicmp
@@ -16,22 +17,87 @@ namespace lcodec {
     inline size_t       CRLF_LEN    = 2;
     inline const char*  RDS_CRLF    = "\r\n";
 
+    //请求会话, count大于0表示pipeline, 对应count个回复
+    struct redis_session {
+        uint32_t session_id;
+        uint32_t count;
+    };
+
     class rdscodec : public codec_base {
     public:
+        //增量扫描回复边界, 扫描位置跨dispatch保留, 收齐完整回复后才交给decode
         virtual int load_packet(size_t data_len) {
             if (!m_slice) return 0;
-            return data_len;
+            string_view buf = m_slice->contents();
+            while (m_offset < buf.size()) {
+                if (m_bulk >= 0) {
+                    size_t next = m_offset + m_bulk + CRLF_LEN;
+                    if (buf.size() < next) return 0;
+                    m_offset = next;
+                    m_bulk = -1;
+                    if (finish_value() && finish_reply()) return finish_packet();
+                    continue;
+                }
+                size_t pos = buf.find(RDS_CRLF, m_offset);
+                if (pos == string_view::npos) return 0;
+                string_view line = buf.substr(m_offset, pos - m_offset);
+                m_offset = pos + CRLF_LEN;
+                if (line.empty()) return -1;
+                switch (line[0]) {
+                case '+':
+                case '-':
+                case ':':
+                    break;
+                case '$':
+                    m_bulk = atoll(line.data() + 1);
+                    if (m_bulk >= 0) continue;
+                    break;
+                case '*': {
+                        int64_t length = atoll(line.data() + 1);
+                        if (length > 0) {
+                            m_depths.push_back(length);
+                            continue;
+                        }
+                    }
+                    break;
+                default:
+                    return -1;
+                }
+                if (finish_value() && finish_reply()) return finish_packet();
+            }
+            return 0;
         }
 
+        //参数: session_id, cmd, ...
+        //pipeline参数: session_id, { {cmd, ...}, {cmd, ...} }, 所有命令编码到同一个缓冲
         virtual uint8_t* encode(lua_State* L, int index, size_t* len) {
             m_buf->clean();
             int n = lua_gettop(L);
             uint32_t session_id = lua_tointeger(L, index++);
-            m_buf->write(fmt::format("*{}\r\n", n - index + 1));
+            if (lua_type(L, index) == LUA_TTABLE) {
+                uint32_t count = (uint32_t)lua_rawlen(L, index);
+                for (uint32_t i = 1; i <= count; ++i) {
+                    if (lua_rawgeti(L, index, i) != LUA_TTABLE) {
+                        luaL_error(L, "invalid redis pipeline command:%d", i);
+                    }
+                    int cmd_idx = lua_gettop(L);
+                    int argc = (int)lua_rawlen(L, cmd_idx);
+                    write_header('*', argc);
+                    for (int j = 1; j <= argc; ++j) {
+                        lua_rawgeti(L, cmd_idx, j);
+                        encode_bulk_string(L, lua_gettop(L));
+                        lua_pop(L, 1);
+                    }
+                    lua_pop(L, 1);
+                }
+                if (count > 0) sessions.push_back({ session_id, count });
+                return m_buf->data(len);
+            }
+            write_header('*', n - index + 1);
             for (int i = index; i <= n; ++i) {
                 encode_bulk_string(L, i);
             }
-            sessions.push_back(session_id);
+            sessions.push_back({ session_id, 0 });
             return m_buf->data(len);
         }
 
@@ -39,8 +105,13 @@ namespace lcodec {
             int top = lua_gettop(L);
             size_t osize = m_slice->size();
             string_view buf = m_slice->contents();
-            lua_pushinteger(L, sessions.empty() ? 0 : sessions.front());
-            parse_redis_packet(L, buf);
+            redis_session session = sessions.empty() ? redis_session{ 0, 0 } : sessions.front();
+            lua_pushinteger(L, session.session_id);
+            if (session.count > 0) {
+                parse_redis_pipeline(L, buf, session.count);
+            } else {
+                parse_redis_packet(L, buf);
+            }
             if (!sessions.empty()) sessions.pop_front();
             m_packet_len = osize - buf.size();
             m_slice->erase(m_packet_len);
@@ -52,6 +123,58 @@ namespace lcodec {
         }
 
     protected:
+        //一个值扫描完成, 逐层递减所属数组的剩余元素, 返回整个回复是否完成
+        bool finish_value() {
+            while (!m_depths.empty()) {
+                if (--m_depths.back() > 0) return false;
+                m_depths.pop_back();
+            }
+            return true;
+        }
+
+        //一个回复扫描完成, pipeline需要收齐全部回复
+        bool finish_reply() {
+            if (sessions.empty() || sessions.front().count <= 1) return true;
+            if (++m_replies < sessions.front().count) return false;
+            return true;
+        }
+
+        int finish_packet() {
+            size_t packet_len = m_offset;
+            m_offset = 0;
+            m_replies = 0;
+            return (int)packet_len;
+        }
+
+        void write_header(char type, size_t len) {
+            char header[32] = { type };
+            auto res = fmt::format_to_n(header + 1, sizeof(header) - 3, "{}", len);
+            *res.out++ = '\r';
+            *res.out++ = '\n';
+            m_buf->push_data((const uint8_t*)header, res.out - header);
+        }
+
+        void write_bulk(const char* data, size_t len) {
+            write_header('$', len);
+            m_buf->push_data((const uint8_t*)data, len);
+            m_buf->push_data((const uint8_t*)RDS_CRLF, CRLF_LEN);
+        }
+
+        //pipeline回复: 全部成功标记, 结果数组(失败的命令对应错误信息)
+        void parse_redis_pipeline(lua_State* L, string_view& buf, uint32_t count) {
+            bool success = true;
+            lua_pushboolean(L, true);
+            lua_createtable(L, count, 0);
+            for (uint32_t i = 1; i <= count; ++i) {
+                parse_redis_packet(L, buf);
+                if (!lua_toboolean(L, -2)) success = false;
+                lua_seti(L, -3, i);
+                lua_pop(L, 1);
+            }
+            lua_pushboolean(L, success);
+            lua_replace(L, -3);
+        }
+
         void parse_redis_success(lua_State* L, string_view line) {
             lua_pushboolean(L, true);
             lua_pushlstring(L, line.data(), line.size());
@@ -70,9 +193,10 @@ namespace lcodec {
         void parse_redis_string(lua_State* L, string_view line, string_view& buf, bool rootable = false) {
             int64_t length = atoll(line.data());
             if (length >= 0) {
-                string_view nline;
-                if (!read_line(buf, nline))
+                if (buf.size() < length + CRLF_LEN)
                     throw length_error("redis text not full");
+                string_view nline = buf.substr(0, length);
+                buf.remove_prefix(length + CRLF_LEN);
                 if (!strncasecmp(nline.data(), "[js]", 4)) {
                     nline.remove_prefix(4);
                     m_jcodec->decode(L, (uint8_t*)nline.data(), nline.size());
@@ -92,7 +216,7 @@ namespace lcodec {
         void parse_redis_array(lua_State* L, string_view line, string_view& buf, bool rootable = false) {
             int64_t length = atoll(line.data());
             if (length >= 0) {
-                lua_createtable(L, 0, 4);
+                lua_createtable(L, (int)length, 0);
                 for (int i = 1; i <= length; ++i) {
                     string_view line;
                     if (!read_line(buf, line)) throw length_error("redis text not full");
@@ -161,24 +285,28 @@ namespace lcodec {
 
         void number_encode(double value) {
             auto svalue = std::to_string(value);
-            m_buf->write(fmt::format("${}\r\n{}\r\n", svalue.size(), svalue.c_str()));
+            write_bulk(svalue.c_str(), svalue.size());
         }
 
         void integer_encode(int64_t integer) {
-            auto svalue = std::to_string(integer);
-            m_buf->write(fmt::format("${}\r\n{}\r\n", svalue.size(), svalue.c_str()));
+            char value[32];
+            auto res = fmt::format_to_n(value, sizeof(value), "{}", integer);
+            write_bulk(value, res.out - value);
         }
 
         void string_encode(lua_State* L, int idx) {
             size_t len;
             const char* data = lua_tolstring(L, idx, &len);
-            m_buf->write(fmt::format("${}\r\n{}\r\n", len, string_view(data, len)));
+            write_bulk(data, len);
         }
 
         void table_encode(lua_State* L, int idx) {
             size_t len;
             char* body = (char*)m_jcodec->encode(L, idx, &len);
-            m_buf->write(fmt::format("${}\r\n[js]{}\r\n", len + 4, string_view(body, len)));
+            write_header('$', len + 4);
+            m_buf->push_data((const uint8_t*)"[js]", 4);
+            m_buf->push_data((const uint8_t*)body, len);
+            m_buf->push_data((const uint8_t*)RDS_CRLF, CRLF_LEN);
         }
 
         void encode_bulk_string(lua_State* L, int idx) {
@@ -202,7 +330,12 @@ namespace lcodec {
         }
 
     protected:
-        deque<uint32_t> sessions;
+        deque<redis_session> sessions;
         codec_base* m_jcodec = nullptr;
+        //回复边界扫描状态
+        size_t m_offset = 0;
+        int64_t m_bulk = -1;
+        uint32_t m_replies = 0;
+        vector<int64_t> m_depths;
     };
 }
@@ -0,0 +1,379 @@
+#pragma once
+
+#include "bitarray.h"
+
+namespace lcodec {
+
+    //稀疏位图(roaring): 位置按高16位分桶, 桶内不超过4096个时存有序的低16位数组, 否则存65536位的位图
+    //位置从1开始, 最大0xffffffff, 适合在很大的id范围里记录少量玩家的标记
+    class sparse_bitarray
+    {
+    public:
+        static constexpr size_t ARRAY_MAX = 4096;
+        static constexpr size_t BITMAP_WORDS = 65536 / BITS_PER_BWORD;
+        static constexpr size_t MAX_POS = 0xffffffff;
+
+    private:
+        struct container {
+            uint16_t key = 0;
+            size_t card = 0;
+            std::vector<uint16_t> array;
+            std::vector<BWORD> bitmap;
+
+            bool is_bitmap() const {
+                return !bitmap.empty();
+            }
+
+            bool get(uint16_t low) const {
+                if (is_bitmap())
+                    return (bitmap[I_BWORD(low)] & I_BIT(low)) != 0;
+                return std::binary_search(array.begin(), array.end(), low);
+            }
+
+            //返回是否有变化
+            bool set(uint16_t low) {
+                if (is_bitmap()) {
+                    BWORD& word = bitmap[I_BWORD(low)];
+                    if (word & I_BIT(low))
+                        return false;
+                    word |= I_BIT(low);
+                    card++;
+                    return true;
+                }
+                auto it = std::lower_bound(array.begin(), array.end(), low);
+                if (it != array.end() && *it == low)
+                    return false;
+                array.insert(it, low);
+                card++;
+                normalize();
+                return true;
+            }
+
+            bool reset(uint16_t low) {
+                if (is_bitmap()) {
+                    BWORD& word = bitmap[I_BWORD(low)];
+                    if (!(word & I_BIT(low)))
+                        return false;
+                    word &= ~I_BIT(low);
+                    card--;
+                    normalize();
+                    return true;
+                }
+                auto it = std::lower_bound(array.begin(), array.end(), low);
+                if (it == array.end() || *it != low)
+                    return false;
+                array.erase(it);
+                card--;
+                return true;
+            }
+
+            //按数量在两种存储之间转换
+            void normalize() {
+                if (is_bitmap() && card <= ARRAY_MAX) {
+                    std::vector<uint16_t> values;
+                    values.reserve(card);
+                    each([&](uint16_t low) { values.push_back(low); });
+                    array.swap(values);
+                    std::vector<BWORD>().swap(bitmap);
+                }
+                else if (!is_bitmap() && card > ARRAY_MAX) {
+                    bitmap = to_bitmap();
+                    std::vector<uint16_t>().swap(array);
+                }
+            }
+
+            std::vector<BWORD> to_bitmap() const {
+                if (is_bitmap())
+                    return bitmap;
+                std::vector<BWORD> words(BITMAP_WORDS, 0);
+                for (uint16_t low : array)
+                    words[I_BWORD(low)] |= I_BIT(low);
+                return words;
+            }
+
+            //不大于low的个数
+            size_t rank(uint16_t low) const {
+                if (!is_bitmap())
+                    return std::upper_bound(array.begin(), array.end(), low) - array.begin();
+                size_t w = I_BWORD(low), off = low % BITS_PER_BWORD;
+                BWORD mask = (off == BITS_PER_BWORD - 1) ? ~(BWORD)0 : ((I_BIT(off) << 1) - 1);
+                return bits::count(bitmap.data(), w) + bits::popcount(bitmap[w] & mask);
+            }
+
+            //第r个, r从1开始且不超过card
+            uint16_t select(size_t r) const {
+                if (!is_bitmap())
+                    return array[r - 1];
+                for (size_t w = 0; w < BITMAP_WORDS; ++w) {
+                    size_t cnt = bits::popcount(bitmap[w]);
+                    if (r <= cnt)
+                        return (uint16_t)(w * BITS_PER_BWORD + bits::select(bitmap[w], r));
+                    r -= cnt;
+                }
+                return 0;
+            }
+
+            //不小于low的第一个, 不存在返回-1
+            int64_t next(size_t low) const {
+                if (!is_bitmap()) {
+                    auto it = std::lower_bound(array.begin(), array.end(), low);
+                    return it == array.end() ? -1 : *it;
+                }
+                size_t w = I_BWORD(low);
+                if (w >= BITMAP_WORDS)
+                    return -1;
+                BWORD word = bitmap[w] & (~(BWORD)0 << (low % BITS_PER_BWORD));
+                while (word == 0) {
+                    if (++w >= BITMAP_WORDS)
+                        return -1;
+                    word = bitmap[w];
+                }
+                return w * BITS_PER_BWORD + bits::lowest(word);
+            }
+
+            template<typename F>
+            void each(F&& func) const {
+                if (!is_bitmap()) {
+                    for (uint16_t low : array)
+                        func(low);
+                    return;
+                }
+                for (size_t w = 0; w < BITMAP_WORDS; ++w) {
+                    BWORD word = bitmap[w];
+                    while (word) {
+                        func((uint16_t)(w * BITS_PER_BWORD + bits::lowest(word)));
+                        word &= word - 1;
+                    }
+                }
+            }
+
+            size_t memory() const {
+                return sizeof(container) + array.capacity() * sizeof(uint16_t) + bitmap.capacity() * sizeof(BWORD);
+            }
+        };
+
+    public:
+        void set_bit(size_t pos, size_t b) {
+            if (pos == 0 || pos > MAX_POS)
+                return;
+            uint16_t key = (uint16_t)(pos >> 16), low = (uint16_t)pos;
+            auto it = find(key);
+            if (b) {
+                if (it == containers_.end() || it->key != key) {
+                    it = containers_.insert(it, container());
+                    it->key = key;
+                }
+                count_ += it->set(low) ? 1 : 0;
+                return;
+            }
+            if (it != containers_.end() && it->key == key && it->reset(low)) {
+                count_--;
+                if (it->card == 0)
+                    containers_.erase(it);
+            }
+        }
+
+        size_t get_bit(size_t pos) {
+            if (pos == 0 || pos > MAX_POS)
+                return 0;
+            uint16_t key = (uint16_t)(pos >> 16);
+            auto it = find(key);
+            return (it != containers_.end() && it->key == key && it->get((uint16_t)pos)) ? 1 : 0;
+        }
+
+        void flip_bit(size_t pos) {
+            set_bit(pos, !get_bit(pos));
+        }
+
+        size_t count() {
+            return count_;
+        }
+
+        //位置[1, pos]内的个数
+        size_t rank(size_t pos) {
+            if (pos == 0)
+                return 0;
+            pos = std::min(pos, MAX_POS);
+            uint16_t key = (uint16_t)(pos >> 16);
+            size_t res = 0;
+            for (auto& c : containers_) {
+                if (c.key > key)
+                    break;
+                res += (c.key < key) ? c.card : c.rank((uint16_t)pos);
+            }
+            return res;
+        }
+
+        //第k个的位置, 不存在返回0
+        size_t select(size_t k) {
+            if (k == 0 || k > count_)
+                return 0;
+            for (auto& c : containers_) {
+                if (k <= c.card)
+                    return ((size_t)c.key << 16) | c.select(k);
+                k -= c.card;
+            }
+            return 0;
+        }
+
+        //不小于pos的第一个位置, 不存在返回0
+        size_t next_bit(size_t pos) {
+            pos = std::max<size_t>(pos, 1);
+            if (pos > MAX_POS)
+                return 0;
+            uint16_t key = (uint16_t)(pos >> 16);
+            for (auto it = find(key); it != containers_.end(); ++it) {
+                int64_t low = it->next(it->key == key ? (uint16_t)pos : 0);
+                if (low >= 0)
+                    return ((size_t)it->key << 16) | (size_t)low;
+            }
+            return 0;
+        }
+
+        std::vector<size_t> indexes() {
+            std::vector<size_t> res;
+            res.reserve(count_);
+            for (auto& c : containers_) {
+                size_t high = (size_t)c.key << 16;
+                c.each([&](uint16_t low) { res.push_back(high | low); });
+            }
+            return res;
+        }
+
+        void band(sparse_bitarray* r) {
+            merge<bits::op::band>(r);
+        }
+
+        void bor(sparse_bitarray* r) {
+            merge<bits::op::bor>(r);
+        }
+
+        void bxor(sparse_bitarray* r) {
+            merge<bits::op::bxor>(r);
+        }
+
+        bool equal(sparse_bitarray* r) {
+            if (count_ != r->count_ || containers_.size() != r->containers_.size())
+                return false;
+            for (size_t i = 0; i < containers_.size(); ++i) {
+                auto& a = containers_[i];
+                auto& b = r->containers_[i];
+                if (a.key != b.key || a.card != b.card || a.array != b.array || a.bitmap != b.bitmap)
+                    return false;
+            }
+            return true;
+        }
+
+        sparse_bitarray* clone() {
+            return new sparse_bitarray(*this);
+        }
+
+        void clear() {
+            containers_.clear();
+            count_ = 0;
+        }
+
+        size_t memory() {
+            size_t res = sizeof(sparse_bitarray) + (containers_.capacity() - containers_.size()) * sizeof(container);
+            for (auto& c : containers_)
+                res += c.memory();
+            return res;
+        }
+
+        //分桶数和其中位图桶的个数
+        size_t containers() {
+            return containers_.size();
+        }
+
+        size_t bitmaps() {
+            return std::count_if(containers_.begin(), containers_.end(), [](const container& c) { return c.is_bitmap(); });
+        }
+
+    private:
+        std::vector<container>::iterator find(uint16_t key) {
+            return std::lower_bound(containers_.begin(), containers_.end(), key, [](const container& c, uint16_t k) { return c.key < k; });
+        }
+
+        template<bits::op OP>
+        static container combine(const container& a, const container& b) {
+            container res;
+            res.key = a.key;
+            if (!a.is_bitmap() && !b.is_bitmap()) {
+                //两个都是数组时有序合并
+                res.array.reserve(OP == bits::op::band ? std::min(a.card, b.card) : a.card + b.card);
+                auto out = std::back_inserter(res.array);
+                if constexpr (OP == bits::op::band)
+                    std::set_intersection(a.array.begin(), a.array.end(), b.array.begin(), b.array.end(), out);
+                else if constexpr (OP == bits::op::bor)
+                    std::set_union(a.array.begin(), a.array.end(), b.array.begin(), b.array.end(), out);
+                else
+                    std::set_symmetric_difference(a.array.begin(), a.array.end(), b.array.begin(), b.array.end(), out);
+                res.card = res.array.size();
+            }
+            else if (OP == bits::op::band && (!a.is_bitmap() || !b.is_bitmap())) {
+                //数组和位图求交只需要逐个检查数组里的值
+                const container& arr = a.is_bitmap() ? b : a;
+                const container& map = a.is_bitmap() ? a : b;
+                for (uint16_t low : arr.array) {
+                    if (map.get(low))
+                        res.array.push_back(low);
+                }
+                res.card = res.array.size();
+            }
+            else {
+                res.bitmap = a.to_bitmap();
+                if (b.is_bitmap()) {
+                    bits::transform<OP>(res.bitmap.data(), b.bitmap.data(), BITMAP_WORDS);
+                }
+                else {
+                    auto other = b.to_bitmap();
+                    bits::transform<OP>(res.bitmap.data(), other.data(), BITMAP_WORDS);
+                }
+                res.card = bits::count(res.bitmap.data(), BITMAP_WORDS);
+            }
+            res.normalize();
+            return res;
+        }
+
+        template<bits::op OP>
+        void merge(sparse_bitarray* r) {
+            if (r == this) {
+                if (OP == bits::op::bxor)
+                    clear();
+                return;
+            }
+            std::vector<container> res;
+            res.reserve(containers_.size() + (OP == bits::op::band ? 0 : r->containers_.size()));
+            auto a = containers_.begin(), ae = containers_.end();
+            auto b = r->containers_.cbegin(), be = r->containers_.cend();
+            while (a != ae || b != be) {
+                if (b == be || (a != ae && a->key < b->key)) {
+                    if (OP != bits::op::band)
+                        res.push_back(std::move(*a));
+                    ++a;
+                }
+                else if (a == ae || b->key < a->key) {
+                    if (OP != bits::op::band)
+                        res.push_back(*b);
+                    ++b;
+                }
+                else {
+                    container c = combine<OP>(*a, *b);
+                    if (c.card > 0)
+                        res.push_back(std::move(c));
+                    ++a;
+                    ++b;
+                }
+            }
+            containers_.swap(res);
+            count_ = 0;
+            for (auto& c : containers_)
+                count_ += c.card;
+        }
+
+    private:
+        size_t count_ = 0;
+        std::vector<container> containers_;
+    };
+
+}
@@ -1,12 +1,27 @@
 #pragma once
+#include <memory>
 
 #include "lua_kit.h"
 
+//不导出zlib同名宏, 避免和crc32等函数冲突
+#define MINIZ_NO_ZLIB_COMPATIBLE_NAMES
+#include "miniz.h"
+
+#if defined(__SSE2__) && !defined(_MSC_VER)
+#include <immintrin.h>
+#define WS_SIMD_MASK
+#endif
+
 using namespace std;
 using namespace luakit;
 
 namespace lcodec {
 
+    const size_t WS_MAX_MESSAGE     = 16 * 1024 * 1024;     //单条消息(分片合并/解压后)上限
+    const size_t WS_DEFLATE_MIN     = 32;                   //短消息压缩收益小, 不压缩
+    const size_t WS_MAX_HEAD        = 10;
+    const uint8_t WS_DEFLATE_TAIL[] = { 0x00, 0x00, 0xff, 0xff };
+
     inline uint64_t byteswap8(uint64_t const u64) {
         uint8_t* data = (uint8_t*) &u64;
         return ((uint64_t)data[7] << 0)
@@ -25,24 +40,80 @@ namespace lcodec {
             | ((uint16_t)data[0] << 8);
     }
 
+    //掩码异或, dst可以等于src(原地解掩码)
+    //SSE2每次16字节, 编译开启AVX2时每次32字节, 其余按8字节整字, 尾部逐字节
+    inline void ws_mask(uint8_t* dst, const uint8_t* src, size_t len, const uint8_t* key) {
+        uint32_t key32;
+        memcpy(&key32, key, sizeof(key32));
+        size_t i = 0;
+#ifdef WS_SIMD_MASK
+#ifdef __AVX2__
+        __m256i ykey = _mm256_set1_epi32((int)key32);
+        for (; i + 32 <= len; i += 32) {
+            __m256i v = _mm256_loadu_si256((const __m256i*)(src + i));
+            _mm256_storeu_si256((__m256i*)(dst + i), _mm256_xor_si256(v, ykey));
+        }
+#endif
+        __m128i xkey = _mm_set1_epi32((int)key32);
+        for (; i + 16 <= len; i += 16) {
+            __m128i v = _mm_loadu_si128((const __m128i*)(src + i));
+            _mm_storeu_si128((__m128i*)(dst + i), _mm_xor_si128(v, xkey));
+        }
+#endif
+        uint64_t key64 = ((uint64_t)key32 << 32) | key32;
+        for (; i + 8 <= len; i += 8) {
+            uint64_t v;
+            memcpy(&v, src + i, sizeof(v));
+            v ^= key64;
+            memcpy(dst + i, &v, sizeof(v));
+        }
+        for (; i < len; ++i) {
+            dst[i] = src[i] ^ key[i & 3];
+        }
+    }
+
     class wsscodec : public codec_base {
     public:
+        ~wsscodec() {
+            if (m_deflate) {
+                mz_deflateEnd(&m_zout);
+                mz_inflateEnd(&m_zin);
+            }
+        }
+
+        //握手协商permessage-deflate后开启, takeover表示该方向跨消息保留压缩上下文
+        bool enable_deflate(bool send_takeover, bool recv_takeover) {
+            if (!m_deflate) {
+                if (mz_deflateInit2(&m_zout, MZ_BEST_SPEED, MZ_DEFLATED, -MZ_DEFAULT_WINDOW_BITS, 8, MZ_DEFAULT_STRATEGY) != MZ_OK) {
+                    return false;
+                }
+                if (mz_inflateInit2(&m_zin, -MZ_DEFAULT_WINDOW_BITS) != MZ_OK) {
+                    mz_deflateEnd(&m_zout);
+                    return false;
+                }
+                m_deflate = true;
+            }
+            m_send_takeover = send_takeover;
+            m_recv_takeover = recv_takeover;
+            return true;
+        }
+
         virtual int load_packet(size_t data_len) {
             if (!m_slice) return 0;
-            uint8_t* payload = (uint8_t*)m_slice->peek(sizeof(uint8_t), 1);
-            if (!payload) return 0;
-            uint8_t masklen = (((*payload) & 0x80) == 0x80) ? 4 : 0;
-            uint8_t payloadlen = (*payload) & 0x7f;
-            if (payloadlen < 0x7e) {
-                m_packet_len = masklen + payloadlen + sizeof(uint16_t);
-                return m_packet_len;
-            }
-            size_t ext_len = (payloadlen == 0x7f) ? 8 : 2;
-            uint8_t* data = m_slice->peek(ext_len, sizeof(uint16_t));
-            if (!data) return 0;
-            size_t length = (payloadlen == 0x7f) ? byteswap8(*(uint64_t*)data) : byteswap2(*(uint16_t*)data);
-            m_packet_len = masklen + ext_len + length + sizeof(uint16_t);
-            if (m_packet_len > m_slice->size()) return 0;
+            uint8_t* head = m_slice->peek(sizeof(uint16_t));
+            if (!head) return 0;
+            size_t masklen = ((head[1] & 0x80) == 0x80) ? 4 : 0;
+            size_t length = head[1] & 0x7f;
+            size_t ext_len = 0;
+            if (length >= 0x7e) {
+                ext_len = (length == 0x7f) ? 8 : 2;
+                uint8_t* data = m_slice->peek(ext_len, sizeof(uint16_t));
+                if (!data) return 0;
+                length = (length == 0x7f) ? byteswap8(*(uint64_t*)data) : byteswap2(*(uint16_t*)data);
+            }
+            if (length > WS_MAX_MESSAGE) return -1;
+            m_packet_len = sizeof(uint16_t) + ext_len + masklen + length;
+            if (m_packet_len > data_len) return 0;
             return m_packet_len;
         }
 
@@ -55,63 +126,189 @@ namespace lcodec {
             } else {
                 body = (uint8_t*)lua_tolstring(L, index + 1, len);
             }
-            m_buf->write<uint8_t>((0x80 | opcode));
-            if (*len < 0x7e) {
-                m_buf->write<uint8_t>(*len);
-            } else if (*len <= 0xffff) {
-                m_buf->write<uint8_t>(0x7e);
-                m_buf->write<uint16_t>(byteswap2(*len));
-            } else {
-                m_buf->write<uint8_t>(0x7f);
-                m_buf->write<uint64_t>(byteswap8(*len));
+            if (m_deflate && opcode <= 0x02 && *len >= WS_DEFLATE_MIN) {
+                return deflate_frame(L, opcode, body, len);
+            }
+            size_t hlen = head_len(*len);
+            uint8_t* head = m_buf->peek_space(hlen + *len);
+            if (!head) {
+                luaL_error(L, "websocket frame too large");
             }
-            m_buf->push_data(body, *len);
+            fill_head(head, 0x80 | opcode, *len, hlen);
+            if (*len > 0) {
+                memcpy(head + hlen, body, *len);
+            }
+            m_buf->pop_space(hlen + *len);
             return m_buf->data(len);
         }
 
         virtual size_t decode(lua_State* L) {
             uint8_t head = *(uint8_t*)m_slice->read<uint8_t>();
-            if ((head & 0x80) != 0x80) throw lua_exception("sharded packet not suppert!");
-            uint8_t payload  = *(uint8_t*)m_slice->read<uint8_t>();
+            uint8_t payload = *(uint8_t*)m_slice->read<uint8_t>();
+            bool fin = ((head & 0x80) == 0x80);
+            bool rsv1 = ((head & 0x40) == 0x40);
             uint8_t opcode = head & 0xf;
+            if ((head & 0x30) != 0 || (rsv1 && !m_deflate)) throw lua_exception("websocket rsv bits not negotiated!");
             bool mask = ((payload & 0x80) == 0x80);
             payload = payload & 0x7f;
             if (payload >= 0x7e) {
                 m_slice->erase((payload == 0x7f) ? 8 : 2);
             }
+            uint8_t* maskkey = mask ? m_slice->erase(4) : nullptr;
+            size_t data_len;
+            uint8_t* data = m_slice->data(&data_len);
+            m_slice->erase(data_len);
+            //控制帧不分片, 可以插在分片消息中间
+            if (opcode >= 0x08) {
+                if (!fin || rsv1 || data_len > 0x7d) throw lua_exception("websocket control frame invalid!");
+                if (mask) ws_mask(data, data, data_len, maskkey);
+                return push_message(L, opcode, data, data_len);
+            }
+            if (opcode == 0x00) {
+                if (!m_fragment || rsv1) throw lua_exception("websocket continuation frame invalid!");
+            } else {
+                if (m_fragment) throw lua_exception("websocket message interleaved!");
+                //单帧未压缩消息原地解掩码, 不拷贝
+                if (fin && !rsv1) {
+                    if (mask) ws_mask(data, data, data_len, maskkey);
+                    return push_message(L, opcode, data, data_len);
+                }
+                m_opcode = opcode;
+                m_compressed = rsv1;
+                m_fragment = true;
+                message()->clean();
+            }
+            if (m_compressed) {
+                if (mask) ws_mask(data, data, data_len, maskkey);
+                inflate(data, data_len);
+                if (fin) {
+                    inflate(WS_DEFLATE_TAIL, sizeof(WS_DEFLATE_TAIL));
+                    if (!m_recv_takeover) mz_inflateReset(&m_zin);
+                }
+            } else {
+                //分片解掩码时直接写入消息缓冲, 异或和拷贝一趟完成
+                if (m_msg->size() + data_len > WS_MAX_MESSAGE) throw lua_exception("websocket message too large!");
+                uint8_t* dst = m_msg->peek_space(data_len);
+                if (!dst) throw lua_exception("websocket message too large!");
+                if (mask) {
+                    ws_mask(dst, data, data_len, maskkey);
+                } else if (data_len > 0) {
+                    memcpy(dst, data, data_len);
+                }
+                m_msg->pop_space(data_len);
+            }
+            if (!fin) return 0;
+            m_fragment = false;
+            size_t msg_len;
+            uint8_t* msg = m_msg->data(&msg_len);
+            return push_message(L, m_opcode, msg, msg_len);
+        }
+
+        void set_codec(codec_base* codec) {
+            m_jcodec = codec;
+        }
+
+    protected:
+        luabuf* message() {
+            if (!m_msg) m_msg = std::make_unique<luabuf>();
+            return m_msg.get();
+        }
+
+        size_t push_message(lua_State* L, uint8_t opcode, uint8_t* data, size_t len) {
             int top = lua_gettop(L);
             lua_pushstring(L, "WSS");
             lua_pushinteger(L, opcode);
-            if (mask) {
-                size_t data_len;
-                char* maskkey = (char*)m_slice->erase(4);
-                char* data = (char*)m_slice->data(&data_len);
-                xor_byte(data, maskkey, data_len, 4);
-            }
-            size_t osize = m_slice->size();
             if (opcode == 0x02) {
-                m_jcodec->set_slice(m_slice);
+                slice mslice(data, len);
+                m_jcodec->set_slice(&mslice);
                 m_jcodec->decode(L);
             } else {
-                lua_pushlstring(L, (char*)m_slice->head(), osize);
+                lua_pushlstring(L, (char*)data, len);
             }
-            m_slice->erase(osize);
             return lua_gettop(L) - top;
         }
 
-        void set_codec(codec_base* codec) {
-            m_jcodec = codec;
+        size_t head_len(size_t len) {
+            return (len < 0x7e) ? 2 : ((len <= 0xffff) ? 4 : WS_MAX_HEAD);
         }
 
-    protected:
-        char* xor_byte(char* buffer, char* mask, size_t blen, size_t mlen) {
-            for (size_t i = 0; i < blen; i++) {
-                buffer[i] = buffer[i] ^ mask[i % mlen];
+        void fill_head(uint8_t* head, uint8_t flag, size_t len, size_t hlen) {
+            head[0] = flag;
+            if (hlen == 2) {
+                head[1] = (uint8_t)len;
+            } else if (hlen == 4) {
+                uint16_t len16 = byteswap2((uint16_t)len);
+                head[1] = 0x7e;
+                memcpy(head + 2, &len16, sizeof(len16));
+            } else {
+                uint64_t len64 = byteswap8(len);
+                head[1] = 0x7f;
+                memcpy(head + 2, &len64, sizeof(len64));
+            }
+        }
+
+        //帧头长度取决于压缩后长度: 预留最大帧头, 压缩结果直接写入发送缓冲, 再回填帧头
+        uint8_t* deflate_frame(lua_State* L, size_t opcode, uint8_t* body, size_t* len) {
+            size_t bound = mz_deflateBound(&m_zout, *len) + 16;
+            uint8_t* out = m_buf->peek_space(WS_MAX_HEAD + bound);
+            if (!out) {
+                luaL_error(L, "websocket frame too large");
+            }
+            m_zout.next_in = body;
+            m_zout.avail_in = (unsigned int)*len;
+            m_zout.next_out = out + WS_MAX_HEAD;
+            m_zout.avail_out = (unsigned int)bound;
+            int ret = mz_deflate(&m_zout, MZ_SYNC_FLUSH);
+            if (ret != MZ_OK || m_zout.avail_in > 0) {
+                luaL_error(L, "websocket deflate failed: %d", ret);
+            }
+            //sync flush结尾的00 00 ff ff不发送, 接收方补回
+            size_t zlen = bound - m_zout.avail_out - sizeof(WS_DEFLATE_TAIL);
+            if (!m_send_takeover) {
+                mz_deflateReset(&m_zout);
+            }
+            size_t hlen = head_len(zlen);
+            uint8_t* head = out + WS_MAX_HEAD - hlen;
+            fill_head(head, 0xc0 | opcode, zlen, hlen);
+            m_buf->pop_space(WS_MAX_HEAD + zlen);
+            *len = hlen + zlen;
+            return head;
+        }
+
+        //解压到消息缓冲, 输出写满时内部字典可能还有数据, 继续取直到输入耗尽且输出未满
+        void inflate(const uint8_t* data, size_t len) {
+            m_zin.next_in = data;
+            m_zin.avail_in = (unsigned int)len;
+            size_t space = std::max<size_t>(len * 4, 4096);
+            while (true) {
+                uint8_t* out = m_msg->peek_space(space);
+                if (!out) throw lua_exception("websocket message too large!");
+                m_zin.next_out = out;
+                m_zin.avail_out = (unsigned int)space;
+                int ret = mz_inflate(&m_zin, MZ_SYNC_FLUSH);
+                m_msg->pop_space(space - m_zin.avail_out);
+                if (m_msg->size() > WS_MAX_MESSAGE) throw lua_exception("websocket message too large!");
+                if (ret == MZ_STREAM_END) {
+                    //对端结束了deflate流, 下条消息从新流开始
+                    mz_inflateReset(&m_zin);
+                    break;
+                }
+                if (ret != MZ_OK && ret != MZ_BUF_ERROR) throw lua_exception("websocket inflate failed: %d", ret);
+                if (m_zin.avail_in == 0 && m_zin.avail_out > 0) break;
+                if (ret == MZ_BUF_ERROR && m_zin.avail_out == space) break;
             }
-            return buffer;
         }
 
     protected:
         codec_base* m_jcodec = nullptr;
+        std::unique_ptr<luabuf> m_msg = nullptr;
+        mz_stream m_zout = {};
+        mz_stream m_zin = {};
+        uint8_t m_opcode = 0;
+        bool m_fragment = false;
+        bool m_compressed = false;
+        bool m_deflate = false;
+        bool m_send_takeover = true;
+        bool m_recv_takeover = true;
     };
 }
@@ -1,4 +1,5 @@
-#include <list>
+#include <vector>
+#include <algorithm>
 #include "ltimer.h"
 #include "croncpp.h"
 #include "lua_kit.h"
@@ -12,35 +13,133 @@ constexpr int TIME_LEVEL_MASK = (TIME_LEVEL - 1);
 
 namespace ltimer {
 
+	constexpr uint32_t TIMER_NULL = UINT32_MAX;
+	constexpr uint32_t TIME_SLOTS = TIME_NEAR + 4 * TIME_LEVEL;
+
+	//侵入式定时器节点, 通过下标串成双向链表, 空闲节点复用
+	//句柄为(代数<<32 | 下标), 节点释放时代数递增, 旧句柄自动失效
 	struct timer_node {
 		size_t expire;
 		uint64_t timer_id;
+		uint32_t prev;
+		uint32_t next;
+		uint32_t slot;		//所在槽位, TIMER_NULL表示空闲
+		uint32_t gen;
+		uint32_t period;	//周期(tick), 0表示一次性
+		uint32_t cron;		//cron表达式下标, TIMER_NULL表示无
 	};
 
-	using timer_list = std::list<timer_node>;
-	using integer_vector = std::vector<uint64_t>;
+	struct timer_cron {
+		cron::cronexpr expr;
+		time_t next = 0;	//上次计算出的触发时间, 保证单调递增
+	};
 
 	class lua_timer {
 	public:
-		integer_vector update(size_t elapse);
-		void insert(uint64_t timer_id, size_t escape);
+		lua_timer() {
+			std::fill_n(m_head, TIME_SLOTS, TIMER_NULL);
+			std::fill_n(m_tail, TIME_SLOTS, TIMER_NULL);
+		}
+		int update(lua_State* L);
+		size_t update(size_t elapse);
+		int insert_cron(lua_State* L);
+		uint64_t insert(uint64_t timer_id, size_t escape, size_t period);
+		bool reschedule(uint64_t handle, size_t escape);
+		bool set_period(uint64_t handle, size_t period);
+		bool cancel(uint64_t handle);
+		size_t size() { return m_count; }
+		void set_tick(size_t tick_ms) { m_tick_ms = tick_ms > 0 ? tick_ms : 1; }
 
 	protected:
 		void shift();
-		void add_node(timer_node&& node);
-		void execute(integer_vector& timers);
+		void execute();
+		void add_node(uint32_t idx);
+		uint32_t find_node(uint64_t handle);
+		void link(uint32_t slot, uint32_t idx);
+		void unlink(uint32_t idx);
+		void free_node(uint32_t idx);
+		uint32_t alloc_node();
+		bool rearm(uint32_t idx);
+		size_t cron_escape(timer_cron& cron);
 		void move_list(uint32_t level, uint32_t idx);
 
 	protected:
 		size_t time = 0;
-		timer_list near[TIME_NEAR];
-		timer_list t[4][TIME_LEVEL];
+		size_t m_target = 0;	//本次update推进到的tick
+		size_t m_tick_ms = 20;	//单个tick的毫秒数, 用于换算cron时间
+		size_t m_count = 0;
+		uint32_t m_free = TIMER_NULL;
+		uint32_t m_head[TIME_SLOTS];
+		uint32_t m_tail[TIME_SLOTS];
+		std::vector<timer_node> m_nodes;
+		std::vector<timer_cron> m_crons;
+		std::vector<uint32_t> m_cron_free;
+		std::vector<uint64_t> m_fired;	//本次update到期的id, 复用避免每帧分配
 	};
 
-	void lua_timer::add_node(timer_node&& node) {
-		size_t expire = node.expire;
+	uint32_t lua_timer::alloc_node() {
+		if (m_free != TIMER_NULL) {
+			uint32_t idx = m_free;
+			m_free = m_nodes[idx].next;
+			return idx;
+		}
+		m_nodes.push_back(timer_node{ 0, 0, TIMER_NULL, TIMER_NULL, TIMER_NULL, 1, 0, TIMER_NULL });
+		return (uint32_t)(m_nodes.size() - 1);
+	}
+
+	void lua_timer::free_node(uint32_t idx) {
+		timer_node& node = m_nodes[idx];
+		if (node.cron != TIMER_NULL) {
+			m_cron_free.push_back(node.cron);
+			node.cron = TIMER_NULL;
+		}
+		node.gen++;
+		node.slot = TIMER_NULL;
+		node.next = m_free;
+		m_free = idx;
+		m_count--;
+	}
+
+	uint32_t lua_timer::find_node(uint64_t handle) {
+		uint32_t idx = (uint32_t)handle;
+		if (idx >= m_nodes.size()) return TIMER_NULL;
+		timer_node& node = m_nodes[idx];
+		if (node.slot == TIMER_NULL || node.gen != (uint32_t)(handle >> 32)) return TIMER_NULL;
+		return idx;
+	}
+
+	//追加到槽位尾部, 同一槽位按插入顺序触发
+	void lua_timer::link(uint32_t slot, uint32_t idx) {
+		timer_node& node = m_nodes[idx];
+		node.slot = slot;
+		node.next = TIMER_NULL;
+		node.prev = m_tail[slot];
+		if (m_tail[slot] != TIMER_NULL) {
+			m_nodes[m_tail[slot]].next = idx;
+		} else {
+			m_head[slot] = idx;
+		}
+		m_tail[slot] = idx;
+	}
+
+	void lua_timer::unlink(uint32_t idx) {
+		timer_node& node = m_nodes[idx];
+		if (node.prev != TIMER_NULL) {
+			m_nodes[node.prev].next = node.next;
+		} else {
+			m_head[node.slot] = node.next;
+		}
+		if (node.next != TIMER_NULL) {
+			m_nodes[node.next].prev = node.prev;
+		} else {
+			m_tail[node.slot] = node.prev;
+		}
+	}
+
+	void lua_timer::add_node(uint32_t idx) {
+		size_t expire = m_nodes[idx].expire;
 		if ((expire | TIME_NEAR_MASK) == (time | TIME_NEAR_MASK)) {
-			near[expire & TIME_NEAR_MASK].emplace_back(node);
+			link(expire & TIME_NEAR_MASK, idx);
 			return;
 		}
 		uint32_t i;
@@ -51,20 +150,121 @@ namespace ltimer {
 			}
 			mask <<= TIME_LEVEL_SHIFT;
 		}
-		t[i][((expire >> (TIME_NEAR_SHIFT + i * TIME_LEVEL_SHIFT)) & TIME_LEVEL_MASK)].emplace_back(node);
+		link(TIME_NEAR + i * TIME_LEVEL + ((expire >> (TIME_NEAR_SHIFT + i * TIME_LEVEL_SHIFT)) & TIME_LEVEL_MASK), idx);
+	}
+
+	//返回节点句柄, 用于取消和重新调度; period大于0时为周期定时器, 到期后在轮内自动重新挂载
+	uint64_t lua_timer::insert(uint64_t timer_id, size_t escape, size_t period) {
+		uint32_t idx = alloc_node();
+		timer_node& node = m_nodes[idx];
+		node.expire = time + escape;
+		node.timer_id = timer_id;
+		node.period = (uint32_t)period;
+		add_node(idx);
+		m_count++;
+		return ((uint64_t)node.gen << 32) | idx;
+	}
+
+	//insert_cron(timer_id, cex): 返回句柄和下次触发时间, 表达式错误返回0和错误信息
+	int lua_timer::insert_cron(lua_State* L) {
+		uint64_t timer_id = (uint64_t)luaL_checkinteger(L, 1);
+		timer_cron cron;
+		try {
+			cron.expr = cron::make_cron(luaL_checkstring(L, 2));
+		}
+		catch (const std::exception& e) {
+			return luakit::variadic_return(L, 0, e.what());
+		}
+		size_t escape = cron_escape(cron);
+		if (escape == 0) {
+			return luakit::variadic_return(L, 0, "cron never fires");
+		}
+		uint32_t cidx;
+		if (m_cron_free.empty()) {
+			cidx = (uint32_t)m_crons.size();
+			m_crons.push_back(std::move(cron));
+		} else {
+			cidx = m_cron_free.back();
+			m_cron_free.pop_back();
+			m_crons[cidx] = std::move(cron);
+		}
+		time_t next = m_crons[cidx].next;
+		uint64_t handle = insert(timer_id, escape, 0);
+		m_nodes[(uint32_t)handle].cron = cidx;
+		return luakit::variadic_return(L, handle, (int64_t)next);
 	}
 
-	void lua_timer::insert(uint64_t timer_id, size_t escape) {
-		timer_node node{ time + escape, timer_id };
-		add_node(std::move(node));
+	//距下次cron触发的tick数, 无下次触发时返回0
+	size_t lua_timer::cron_escape(timer_cron& cron) {
+		time_t base = std::max((time_t)now(), cron.next);
+		cron.next = cron::cron_next(cron.expr, base);
+		if (cron.next == cron::INVALID_TIME) return 0;
+		int64_t ms = (int64_t)cron.next * 1000 - (int64_t)now_ms();
+		return ms <= 0 ? 1 : (size_t)((ms + m_tick_ms - 1) / m_tick_ms);
+	}
+
+	//到期的周期/cron定时器在轮内重新挂载
+	bool lua_timer::rearm(uint32_t idx) {
+		timer_node& node = m_nodes[idx];
+		if (node.cron != TIMER_NULL) {
+			size_t escape = cron_escape(m_crons[node.cron]);
+			if (escape == 0) return false;
+			node.expire = time + escape;
+		} else if (node.period > 0) {
+			//按计划时间累加避免漂移, 同一次update内错过的周期合并为一次触发
+			size_t expire = node.expire + node.period;
+			if (expire <= m_target) {
+				expire += ((m_target - expire) / node.period + 1) * node.period;
+			}
+			node.expire = expire;
+		} else {
+			return false;
+		}
+		add_node(idx);
+		return true;
+	}
+
+	//周期变化时已挂载的下次触发也按新周期从当前tick重新调度
+	bool lua_timer::set_period(uint64_t handle, size_t period) {
+		uint32_t idx = find_node(handle);
+		if (idx == TIMER_NULL) return false;
+		timer_node& node = m_nodes[idx];
+		if (node.period == period) return true;
+		node.period = (uint32_t)period;
+		if (node.cron == TIMER_NULL && period > 0) {
+			unlink(idx);
+			node.expire = time + period;
+			add_node(idx);
+		}
+		return true;
+	}
+
+	bool lua_timer::reschedule(uint64_t handle, size_t escape) {
+		uint32_t idx = find_node(handle);
+		if (idx == TIMER_NULL) return false;
+		unlink(idx);
+		m_nodes[idx].expire = time + escape;
+		add_node(idx);
+		return true;
+	}
+
+	bool lua_timer::cancel(uint64_t handle) {
+		uint32_t idx = find_node(handle);
+		if (idx == TIMER_NULL) return false;
+		unlink(idx);
+		free_node(idx);
+		return true;
 	}
 
 	void lua_timer::move_list(uint32_t level, uint32_t idx) {
-		timer_list& list = t[level][idx];
-		for (auto node : list) {
-			add_node(std::move(node));
+		uint32_t slot = TIME_NEAR + level * TIME_LEVEL + idx;
+		uint32_t cur = m_head[slot];
+		m_head[slot] = m_tail[slot] = TIMER_NULL;
+		while (cur != TIMER_NULL) {
+			uint32_t next = m_nodes[cur].next;
+			add_node(cur);
+			cur = next;
 		}
-		list.clear();
 	}
 
 	void lua_timer::shift() {
@@ -88,22 +288,49 @@ namespace ltimer {
 		}
 	}
 
-	void lua_timer::execute(integer_vector& timers) {
-		uint32_t idx = time & TIME_NEAR_MASK;
-		for (auto node : near[idx]) {
-			timers.emplace_back(node.timer_id);
+	void lua_timer::execute() {
+		uint32_t slot = time & TIME_NEAR_MASK;
+		uint32_t cur = m_head[slot];
+		m_head[slot] = m_tail[slot] = TIMER_NULL;
+		while (cur != TIMER_NULL) {
+			timer_node& node = m_nodes[cur];
+			uint32_t next = node.next;
+			m_fired.push_back(node.timer_id);
+			if (!rearm(cur)) {
+				free_node(cur);
+			}
+			cur = next;
 		}
-		near[idx].clear();
 	}
 
-	integer_vector lua_timer::update(size_t elapse) {
-		integer_vector timers;
-		execute(timers);
+	size_t lua_timer::update(size_t elapse) {
+		m_fired.clear();
+		m_target = time + elapse;
+		execute();
 		for (size_t i = 0; i < elapse; i++) {
 			shift();
-			execute(timers);
+			execute();
 		}
-		return timers;
+		return m_fired.size();
+	}
+
+	//update(elapse, [out]): 到期id写入out(复用的lua表)并返回个数, 不传out时返回新表
+	int lua_timer::update(lua_State* L) {
+		size_t count = update((size_t)luaL_checkinteger(L, 1));
+		if (lua_istable(L, 2)) {
+			for (size_t i = 0; i < count; ++i) {
+				lua_pushinteger(L, m_fired[i]);
+				lua_rawseti(L, 2, i + 1);
+			}
+			lua_pushinteger(L, count);
+			return 1;
+		}
+		lua_createtable(L, count, 0);
+		for (size_t i = 0; i < count; ++i) {
+			lua_pushinteger(L, m_fired[i]);
+			lua_rawseti(L, -2, i + 1);
+		}
+		return 1;
 	}
 
 	static int cron_next(lua_State* L, std::string cex) {
@@ -119,12 +346,33 @@ namespace ltimer {
 	}
 
 	thread_local lua_timer thread_timer;
-	static void timer_insert(uint64_t timer_id, size_t escape) {
-		thread_timer.insert(timer_id, escape);
+	static uint64_t timer_insert(uint64_t timer_id, size_t escape, size_t period) {
+		return thread_timer.insert(timer_id, escape, period);
+	}
+
+	static int timer_insert_cron(lua_State* L) {
+		return thread_timer.insert_cron(L);
+	}
+
+	static bool timer_set_period(uint64_t handle, size_t period) {
+		return thread_timer.set_period(handle, period);
+	}
+
+	static bool timer_reschedule(uint64_t handle, size_t escape) {
+		return thread_timer.reschedule(handle, escape);
+	}
+
+	static bool timer_cancel(uint64_t handle) {
+		return thread_timer.cancel(handle);
+	}
+
+	static int timer_update(lua_State* L) {
+		return thread_timer.update(L);
 	}
 
-	static integer_vector timer_update(size_t elapse) {
-		return thread_timer.update(elapse);
+	//独立的时间轮, 不影响全局定时器
+	static lua_timer* timer_wheel() {
+		return new lua_timer();
 	}
 
 	static int timer_time(lua_State* L) {
@@ -134,8 +382,24 @@ namespace ltimer {
 	luakit::lua_table open_ltimer(lua_State* L) {
 		luakit::kit_state kit_state(L);
 		auto luatimer = kit_state.new_table();
+		kit_state.new_class<lua_timer>(
+			"insert", &lua_timer::insert,
+			"cancel", &lua_timer::cancel,
+			"reschedule", &lua_timer::reschedule,
+			"set_period", &lua_timer::set_period,
+			"set_tick", &lua_timer::set_tick,
+			"insert_cron", &lua_timer::insert_cron,
+			"size", &lua_timer::size,
+			"update", (int(lua_timer::*)(lua_State*))&lua_timer::update
+		);
 		luatimer.set_function("time", timer_time);
+		luatimer.set_function("wheel", timer_wheel);
 		luatimer.set_function("insert", timer_insert);
+		luatimer.set_function("cancel", timer_cancel);
+		luatimer.set_function("reschedule", timer_reschedule);
+		luatimer.set_function("set_period", timer_set_period);
+		luatimer.set_function("insert_cron", timer_insert_cron);
+		luatimer.set_function("set_tick", [](size_t tick_ms) { thread_timer.set_tick(tick_ms); });
 		luatimer.set_function("update", timer_update);
 		luatimer.set_function("now", []() { return now(); });
 		luatimer.set_function("now_ms", []() { return now_ms(); });
@@ -1,4 +1,5 @@
 #include <algorithm>
+#include <type_traits>
 #include "zset.hpp"
 
 extern "C" {
@@ -6,10 +7,17 @@ extern "C" {
 #include "lauxlib.h"
 }
 
-#define METANAME "lzet"
-
 using zset_type = lzset::zset<std::allocator>;
+//原跳表实现, 用于对比测试
+using skip_zset_type = lzset::zset<std::allocator, lzset::skip_list>;
+
+template<typename T>
+static const char* meta_name()
+{
+	return std::is_same_v<T, zset_type> ? "lzet" : "lzet_skiplist";
+}
 
+template<typename zset_type>
 static int lupdate(lua_State* L)
 {
 	zset_type* zset = (zset_type*)lua_touserdata(L, 1);
@@ -31,6 +39,7 @@ static int lupdate(lua_State* L)
 	return lua_error(L);
 }
 
+template<typename zset_type>
 static int lrank(lua_State* L)
 {
 	zset_type* zset = (zset_type*)lua_touserdata(L, 1);
@@ -48,6 +57,7 @@ static int lrank(lua_State* L)
 	return 0;
 }
 
+template<typename zset_type>
 static int lkey_by_rank(lua_State* L)
 {
 	zset_type* zset = (zset_type*)lua_touserdata(L, 1);
@@ -59,16 +69,17 @@ static int lkey_by_rank(lua_State* L)
 	if (zset->size() == 0 || zset->size() < rank)
 		return 0;
 
-	zset_type::const_iterator it = (rank == 1 ? zset->begin() : zset->find_by_rank(rank));
+	typename zset_type::const_iterator it = (rank == 1 ? zset->begin() : zset->find_by_rank(rank));
 
 	if (it != zset->end()) {
 		lua_pushinteger(L, it->key);
-		lua_pushinteger(L, zset->score(it->key));
+		lua_pushinteger(L, zset->score_of(*it));
 		return 2;
 	}
 	return 0;
 }
 
+template<typename zset_type>
 static int lhas(lua_State* L)
 {
 	zset_type* zset = (zset_type*)lua_touserdata(L, 1);
@@ -80,6 +91,7 @@ static int lhas(lua_State* L)
 	return 1;
 }
 
+template<typename zset_type>
 static int lsize(lua_State* L)
 {
 	zset_type* zset = (zset_type*)lua_touserdata(L, 1);
@@ -90,39 +102,61 @@ static int lsize(lua_State* L)
 	return 1;
 }
 
+template<typename zset_type>
 static int lclear(lua_State* L)
 {
 	zset_type* zset = (zset_type*)lua_touserdata(L, 1);
 	if (nullptr == zset)
 		return luaL_argerror(L, 1, "invalid lua-zset pointer");
-	zset->clear();
-	return 0;
+	try
+	{
+		zset->clear();
+		return 0;
+	}
+	catch (const std::exception& ex)
+	{
+		lua_pushstring(L, ex.what());
+	}
+	return lua_error(L);
 }
 
+template<typename zset_type>
 static int lerase(lua_State* L)
 {
 	zset_type* zset = (zset_type*)lua_touserdata(L, 1);
 	if (nullptr == zset)
 		return luaL_argerror(L, 1, "invalid lua-zset pointer");
 	int64_t key = (int64_t)luaL_checkinteger(L, 2);
-	lua_pushinteger(L, zset->erase(key));
-	return 1;
+	try
+	{
+		lua_pushinteger(L, zset->erase(key));
+		return 1;
+	}
+	catch (const std::exception& ex)
+	{
+		lua_pushstring(L, ex.what());
+	}
+	return lua_error(L);
 }
 
+template<typename zset_type>
 static int lrange(lua_State* L)
 {
 	zset_type* zset = (zset_type*)lua_touserdata(L, 1);
 	if (nullptr == zset)
 		return luaL_argerror(L, 1, "invalid lua-zset pointer");
-	int64_t start = luaL_checkinteger(L, 2) - 1;
-	int64_t end = luaL_checkinteger(L, 3) - 1;
+	int64_t start = luaL_checkinteger(L, 2);
+	int64_t end = luaL_checkinteger(L, 3);
 	bool reverse = lua_toboolean(L, 4) != 0;
 	int64_t llen = (int64_t)zset->size();
 
+	//负数从末尾倒数, -1是最后一名
 	if (start < 0)
-		start = llen + start;
+		start = llen + start + 1;
 	if (end < 0)
-		end = llen + end;
+		end = llen + end + 1;
+	start--;
+	end--;
 	if (start < 0)
 		start = 0;
 
@@ -136,7 +170,7 @@ static int lrange(lua_State* L)
 	if (ranglen >= std::numeric_limits<int>::max())
 		return luaL_error(L, "zset.range out off limit");
 
-	zset_type::const_iterator it{ nullptr };
+	typename zset_type::const_iterator it{ nullptr };
 	if (reverse) {
 		it = zset->tail();
 		if (start > 0)
@@ -157,7 +191,7 @@ static int lrange(lua_State* L)
 		lua_rawseti(L, -2, 1);
 		lua_pushinteger(L, ++start);
 		lua_rawseti(L, -2, 2);
-		lua_pushinteger(L, zset->score(it->key));
+		lua_pushinteger(L, zset->score_of(*it));
 		lua_rawseti(L, -2, 3);
 		lua_rawseti(L, -2, idx++);
 		reverse ? --it : ++it;
@@ -165,6 +199,152 @@ static int lrange(lua_State* L)
 	return 1;
 };
 
+//分数在[min, max]内的条目, 按排名顺序最多返回limit个{key, rank, score}
+template<typename zset_type>
+static int lrange_by_score(lua_State* L)
+{
+	zset_type* zset = (zset_type*)lua_touserdata(L, 1);
+	if (nullptr == zset)
+		return luaL_argerror(L, 1, "invalid lua-zset pointer");
+	int64_t min = luaL_checkinteger(L, 2);
+	int64_t max = luaL_checkinteger(L, 3);
+	int64_t limit = luaL_optinteger(L, 4, std::numeric_limits<int>::max());
+	if (min > max || limit <= 0)
+		return 0;
+
+	size_t rank = 0;
+	auto it = zset->lower_bound(zset->reverse() ? min : max, rank);
+	int idx = 0;
+	for (; it != zset->end() && idx < limit; ++it)
+	{
+		int64_t score = zset->score_of(*it);
+		if (score < min || score > max)
+			break;
+		if (idx == 0)
+			lua_createtable(L, 0, 0);
+		lua_createtable(L, 3, 0);
+		lua_pushinteger(L, it->key);
+		lua_rawseti(L, -2, 1);
+		lua_pushinteger(L, rank++);
+		lua_rawseti(L, -2, 2);
+		lua_pushinteger(L, score);
+		lua_rawseti(L, -2, 3);
+		lua_rawseti(L, -2, ++idx);
+	}
+	return idx > 0 ? 1 : 0;
+}
+
+//批量导入{key, score, timestamp, ...}, 返回导入后的条目数
+template<typename zset_type>
+static int lload(lua_State* L)
+{
+	zset_type* zset = (zset_type*)lua_touserdata(L, 1);
+	if (nullptr == zset)
+		return luaL_argerror(L, 1, "invalid lua-zset pointer");
+	luaL_checktype(L, 2, LUA_TTABLE);
+	lua_Integer count = luaL_len(L, 2);
+	std::vector<int64_t> items;
+	items.reserve((size_t)count);
+	for (lua_Integer i = 1; i <= count; ++i)
+	{
+		lua_rawgeti(L, 2, i);
+		items.push_back((int64_t)lua_tointeger(L, -1));
+		lua_pop(L, 1);
+	}
+	try
+	{
+		zset->load(items);
+	}
+	catch (const std::exception& ex)
+	{
+		return luaL_error(L, "zset.load failed: %s", ex.what());
+	}
+	lua_pushinteger(L, zset->size());
+	return 1;
+}
+
+//占用字节数和每条目字节数
+template<typename zset_type>
+static int lmemory(lua_State* L)
+{
+	zset_type* zset = (zset_type*)lua_touserdata(L, 1);
+	if (nullptr == zset)
+		return luaL_argerror(L, 1, "invalid lua-zset pointer");
+	size_t bytes = zset->memory();
+	size_t count = zset->size();
+	lua_pushinteger(L, bytes);
+	lua_pushnumber(L, count > 0 ? (double)bytes / count : 0);
+	return 2;
+}
+
+//写快照: 成功返回true和条目数, 失败返回false和原因
+template<typename zset_type>
+static int lsave(lua_State* L)
+{
+	zset_type* zset = (zset_type*)lua_touserdata(L, 1);
+	if (nullptr == zset)
+		return luaL_argerror(L, 1, "invalid lua-zset pointer");
+	std::string err;
+	if (!zset->save(luaL_checkstring(L, 2), err))
+	{
+		lua_pushboolean(L, false);
+		lua_pushstring(L, err.c_str());
+		return 2;
+	}
+	lua_pushboolean(L, true);
+	lua_pushinteger(L, zset->size());
+	return 2;
+}
+
+//从快照恢复: 成功返回true和条目数, 失败返回false和原因
+template<typename zset_type>
+static int lrestore(lua_State* L)
+{
+	zset_type* zset = (zset_type*)lua_touserdata(L, 1);
+	if (nullptr == zset)
+		return luaL_argerror(L, 1, "invalid lua-zset pointer");
+	std::string err;
+	if (!zset->restore(luaL_checkstring(L, 2), err))
+	{
+		lua_pushboolean(L, false);
+		lua_pushstring(L, err.c_str());
+		return 2;
+	}
+	lua_pushboolean(L, true);
+	lua_pushinteger(L, zset->size());
+	return 2;
+}
+
+//打开更新日志: 成功返回true和回放的记录数, 失败返回false和原因
+template<typename zset_type>
+static int lopen_log(lua_State* L)
+{
+	zset_type* zset = (zset_type*)lua_touserdata(L, 1);
+	if (nullptr == zset)
+		return luaL_argerror(L, 1, "invalid lua-zset pointer");
+	std::string err;
+	if (!zset->open_log(luaL_checkstring(L, 2), err))
+	{
+		lua_pushboolean(L, false);
+		lua_pushstring(L, err.c_str());
+		return 2;
+	}
+	lua_pushboolean(L, true);
+	lua_pushinteger(L, zset->log_count());
+	return 2;
+}
+
+template<typename zset_type>
+static int lclose_log(lua_State* L)
+{
+	zset_type* zset = (zset_type*)lua_touserdata(L, 1);
+	if (nullptr == zset)
+		return luaL_argerror(L, 1, "invalid lua-zset pointer");
+	zset->close_log();
+	return 0;
+}
+
+template<typename zset_type>
 static int lrelease(lua_State* L)
 {
 	zset_type* zset = (zset_type*)lua_touserdata(L, 1);
@@ -174,28 +354,36 @@ static int lrelease(lua_State* L)
 	return 0;
 }
 
+template<typename zset_type>
 static int lcreate(lua_State* L)
 {
 	size_t max_count = (size_t)luaL_checkinteger(L, 1);
 	bool reverse = lua_toboolean(L, 2) != 0;
 	void* p = lua_newuserdatauv(L, sizeof(zset_type), 0);
 	new (p) zset_type(max_count, reverse);
-	if (luaL_newmetatable(L, METANAME))//mt
+	if (luaL_newmetatable(L, meta_name<zset_type>()))//mt
 	{
 		luaL_Reg l[] = {
-			{ "update", lupdate },
-			{ "has", lhas},
-			{ "rank", lrank},
-			{ "key_by_rank", lkey_by_rank},
-			{ "range", lrange},
-			{ "clear", lclear},
-			{ "size", lsize},
-			{ "erase", lerase},
+			{ "update", lupdate<zset_type> },
+			{ "has", lhas<zset_type> },
+			{ "rank", lrank<zset_type> },
+			{ "key_by_rank", lkey_by_rank<zset_type> },
+			{ "range", lrange<zset_type> },
+			{ "clear", lclear<zset_type> },
+			{ "size", lsize<zset_type> },
+			{ "erase", lerase<zset_type> },
+			{ "range_by_score", lrange_by_score<zset_type> },
+			{ "load", lload<zset_type> },
+			{ "memory", lmemory<zset_type> },
+			{ "save", lsave<zset_type> },
+			{ "restore", lrestore<zset_type> },
+			{ "open_log", lopen_log<zset_type> },
+			{ "close_log", lclose_log<zset_type> },
 			{ NULL,NULL }
 		};
 		luaL_newlib(L, l); //{}
 		lua_setfield(L, -2, "__index");//mt[__index] = {}
-		lua_pushcfunction(L, lrelease);
+		lua_pushcfunction(L, lrelease<zset_type>);
 		lua_setfield(L, -2, "__gc");//mt[__gc] = lrelease
 	}
 	lua_setmetatable(L, -2);// set userdata metatable
@@ -206,8 +394,9 @@ extern "C" {
 	int LUAMOD_API luaopen_lzset(lua_State* L)
 	{
 		luaL_Reg l[] = {
-			{"new",lcreate},
-			{"release",lrelease },
+			{"new",lcreate<zset_type>},
+			{"new_skiplist",lcreate<skip_zset_type>},
+			{"release",lrelease<zset_type> },
 			{NULL,NULL}
 		};
 		luaL_newlib(L, l);
@@ -0,0 +1,670 @@
+#pragma once
+#include <cassert>
+#include <cstdint>
+#include <memory>
+#include <vector>
+#include <iterator>
+#include <algorithm>
+
+namespace lzset
+{
+	class rank_tree_sentinel {};
+
+	template<typename TreeType>
+	class rank_tree_iterator
+	{
+		using leaf_type = typename TreeType::leaf_type;
+		using score_type = typename TreeType::score_type;
+		leaf_type* leaf_ = nullptr;
+		size_t index_ = 0;
+	public:
+		explicit rank_tree_iterator(leaf_type* leaf, size_t index = 0)
+			:leaf_(leaf)
+			, index_(index)
+		{
+		}
+
+		const score_type& operator*() const
+		{
+			return leaf_->items[index_];
+		}
+
+		const score_type* operator->() const
+		{
+			return &leaf_->items[index_];
+		}
+
+		rank_tree_iterator& operator++()
+		{
+			if (++index_ >= leaf_->size)
+			{
+				leaf_ = leaf_->next;
+				index_ = 0;
+			}
+			return *this;
+		}
+
+		rank_tree_iterator& operator--()
+		{
+			if (index_ > 0)
+			{
+				--index_;
+				return *this;
+			}
+			leaf_ = leaf_->prev;
+			index_ = leaf_ ? leaf_->size - 1 : 0;
+			return *this;
+		}
+
+		bool operator!=(const rank_tree_sentinel) const {
+			return leaf_ != nullptr;
+		}
+
+		bool operator==(const rank_tree_sentinel) const {
+			return leaf_ == nullptr;
+		}
+	};
+
+	//带子树计数的B+树, 叶子连续存放条目并双向链接, 内部节点记录每个子树的条目数用于排名
+	template<typename Score, typename Alloc = std::allocator<char>>
+	class rank_tree
+	{
+	public:
+		using score_type = Score;
+
+	private:
+		//64路, 1000万条目不超过5层
+		static constexpr size_t LEAF_SIZE = 64;
+		static constexpr size_t FANOUT = 64;
+		static constexpr size_t MAX_DEPTH = 16;
+		//批量构建时按7/8填充, 给后续插入留空间
+		static constexpr size_t LEAF_FILL = LEAF_SIZE * 7 / 8;
+		static constexpr size_t INNER_FILL = FANOUT * 7 / 8;
+
+		struct node_type
+		{
+			explicit node_type(bool leaf_) : leaf(leaf_) {}
+			bool leaf;
+			size_t size = 0;
+		};
+
+		struct leaf_type : node_type
+		{
+			leaf_type() : node_type(true) {}
+			leaf_type* prev = nullptr;
+			leaf_type* next = nullptr;
+			score_type items[LEAF_SIZE];
+		};
+
+		//children[i]的条目都在[keys[i-1], keys[i])内
+		struct inner_type : node_type
+		{
+			inner_type() : node_type(false) {}
+			size_t counts[FANOUT];
+			node_type* children[FANOUT];
+			score_type keys[FANOUT - 1];
+		};
+
+		struct step
+		{
+			inner_type* node;
+			size_t index;
+		};
+
+		template<typename T>
+		T* make_node()
+		{
+			char* node_memory = alloc_.allocate(sizeof(T));
+			return new (node_memory) T();
+		}
+
+		template<typename T>
+		void free_node(T* node)
+		{
+			std::destroy_at(node);
+			alloc_.deallocate((char*)node, sizeof(T));
+		}
+
+		leaf_type* make_leaf()
+		{
+			leaves_++;
+			return make_node<leaf_type>();
+		}
+
+		inner_type* make_inner()
+		{
+			inners_++;
+			return make_node<inner_type>();
+		}
+
+		void free_leaf(leaf_type* node)
+		{
+			leaves_--;
+			free_node(node);
+		}
+
+		void free_inner(inner_type* node)
+		{
+			inners_--;
+			free_node(node);
+		}
+
+		void free_tree(node_type* node)
+		{
+			if (node->leaf)
+			{
+				free_leaf((leaf_type*)node);
+				return;
+			}
+			inner_type* inner = (inner_type*)node;
+			for (size_t i = 0; i < inner->size; ++i)
+			{
+				free_tree(inner->children[i]);
+			}
+			free_inner(inner);
+		}
+
+		void free_all()
+		{
+			if (root_ != nullptr)
+			{
+				free_tree(root_);
+				root_ = nullptr;
+			}
+			head_ = tail_ = nullptr;
+			length_ = 0;
+		}
+
+		static size_t child_index(const inner_type* node, const score_type& score)
+		{
+			return std::upper_bound(node->keys, node->keys + node->size - 1, score) - node->keys;
+		}
+
+		static size_t item_index(const leaf_type* node, const score_type& score)
+		{
+			return std::lower_bound(node->items, node->items + node->size, score) - node->items;
+		}
+
+		static size_t sum_counts(const inner_type* node)
+		{
+			size_t sum = 0;
+			for (size_t i = 0; i < node->size; ++i)
+			{
+				sum += node->counts[i];
+			}
+			return sum;
+		}
+
+		//从根下降到叶子, 记录路径和左侧的条目数
+		leaf_type* descend(const score_type& score, step* path, size_t& depth, size_t& rank) const
+		{
+			node_type* node = root_;
+			while (!node->leaf)
+			{
+				inner_type* inner = (inner_type*)node;
+				size_t idx = child_index(inner, score);
+				for (size_t i = 0; i < idx; ++i)
+				{
+					rank += inner->counts[i];
+				}
+				assert(depth < MAX_DEPTH);
+				path[depth++] = { inner, idx };
+				node = inner->children[idx];
+			}
+			return (leaf_type*)node;
+		}
+
+		static void insert_child(inner_type* node, size_t idx, const score_type& key, node_type* child, size_t count)
+		{
+			assert(idx > 0 && node->size < FANOUT);
+			std::copy_backward(node->children + idx, node->children + node->size, node->children + node->size + 1);
+			std::copy_backward(node->counts + idx, node->counts + node->size, node->counts + node->size + 1);
+			std::copy_backward(node->keys + idx - 1, node->keys + node->size - 1, node->keys + node->size);
+			node->children[idx] = child;
+			node->counts[idx] = count;
+			node->keys[idx - 1] = key;
+			node->size++;
+		}
+
+		static void remove_child(inner_type* node, size_t idx)
+		{
+			assert(idx > 0 && idx < node->size);
+			std::copy(node->children + idx + 1, node->children + node->size, node->children + idx);
+			std::copy(node->counts + idx + 1, node->counts + node->size, node->counts + idx);
+			std::copy(node->keys + idx, node->keys + node->size - 1, node->keys + idx - 1);
+			node->size--;
+		}
+
+		//子节点分裂后把右半部分插入父节点, 父节点满了继续向上分裂
+		void split_up(step* path, size_t depth, node_type* left, node_type* right, score_type key, size_t lcount, size_t rcount)
+		{
+			while (depth > 0)
+			{
+				step& s = path[--depth];
+				inner_type* parent = s.node;
+				parent->counts[s.index] = lcount;
+				if (parent->size < FANOUT)
+				{
+					insert_child(parent, s.index + 1, key, right, rcount);
+					return;
+				}
+				size_t half = FANOUT / 2;
+				inner_type* sibling = make_inner();
+				score_type up = parent->keys[half - 1];
+				std::copy(parent->children + half, parent->children + FANOUT, sibling->children);
+				std::copy(parent->counts + half, parent->counts + FANOUT, sibling->counts);
+				std::copy(parent->keys + half, parent->keys + FANOUT - 1, sibling->keys);
+				sibling->size = FANOUT - half;
+				parent->size = half;
+				if (s.index < half)
+				{
+					insert_child(parent, s.index + 1, key, right, rcount);
+				}
+				else
+				{
+					insert_child(sibling, s.index + 1 - half, key, right, rcount);
+				}
+				left = parent;
+				right = sibling;
+				key = up;
+				lcount = sum_counts(parent);
+				rcount = sum_counts(sibling);
+			}
+			//根分裂, 树长高一层
+			inner_type* root = make_inner();
+			root->size = 2;
+			root->children[0] = left;
+			root->children[1] = right;
+			root->counts[0] = lcount;
+			root->counts[1] = rcount;
+			root->keys[0] = key;
+			root_ = root;
+		}
+
+		//相邻叶子合并, 合并后太满则两边均分
+		bool merge_leaf(inner_type* parent, size_t idx)
+		{
+			leaf_type* left = (leaf_type*)parent->children[idx];
+			leaf_type* right = (leaf_type*)parent->children[idx + 1];
+			size_t total = left->size + right->size;
+			if (total <= LEAF_SIZE * 3 / 4)
+			{
+				std::copy(right->items, right->items + right->size, left->items + left->size);
+				left->size = total;
+				left->next = right->next;
+				if (right->next)
+					right->next->prev = left;
+				else
+					tail_ = left;
+				parent->counts[idx] += parent->counts[idx + 1];
+				remove_child(parent, idx + 1);
+				free_leaf(right);
+				return true;
+			}
+			size_t half = total / 2;
+			if (left->size > half)
+			{
+				size_t n = left->size - half;
+				std::copy_backward(right->items, right->items + right->size, right->items + right->size + n);
+				std::copy(left->items + half, left->items + left->size, right->items);
+			}
+			else
+			{
+				size_t n = half - left->size;
+				std::copy(right->items, right->items + n, left->items + left->size);
+				std::copy(right->items + n, right->items + right->size, right->items);
+			}
+			right->size = total - half;
+			left->size = half;
+			parent->keys[idx] = right->items[0];
+			parent->counts[idx] = left->size;
+			parent->counts[idx + 1] = right->size;
+			return false;
+		}
+
+		//相邻内部节点连同父节点的分隔键一起合并或者均分
+		bool merge_inner(inner_type* parent, size_t idx)
+		{
+			inner_type* left = (inner_type*)parent->children[idx];
+			inner_type* right = (inner_type*)parent->children[idx + 1];
+			size_t total = left->size + right->size;
+			node_type* children[FANOUT * 2];
+			size_t counts[FANOUT * 2];
+			score_type keys[FANOUT * 2];
+			std::copy(left->children, left->children + left->size, children);
+			std::copy(right->children, right->children + right->size, children + left->size);
+			std::copy(left->counts, left->counts + left->size, counts);
+			std::copy(right->counts, right->counts + right->size, counts + left->size);
+			std::copy(left->keys, left->keys + left->size - 1, keys);
+			keys[left->size - 1] = parent->keys[idx];
+			std::copy(right->keys, right->keys + right->size - 1, keys + left->size);
+			if (total <= FANOUT * 3 / 4)
+			{
+				std::copy(children, children + total, left->children);
+				std::copy(counts, counts + total, left->counts);
+				std::copy(keys, keys + total - 1, left->keys);
+				left->size = total;
+				parent->counts[idx] += parent->counts[idx + 1];
+				remove_child(parent, idx + 1);
+				free_inner(right);
+				return true;
+			}
+			size_t half = total / 2;
+			std::copy(children, children + half, left->children);
+			std::copy(counts, counts + half, left->counts);
+			std::copy(keys, keys + half - 1, left->keys);
+			std::copy(children + half, children + total, right->children);
+			std::copy(counts + half, counts + total, right->counts);
+			std::copy(keys + half, keys + total - 1, right->keys);
+			left->size = half;
+			right->size = total - half;
+			parent->keys[idx] = keys[half - 1];
+			parent->counts[idx] = sum_counts(left);
+			parent->counts[idx + 1] = sum_counts(right);
+			return false;
+		}
+
+		//删除后节点低于1/4时与相邻兄弟合并或者均分, 父节点变小继续向上检查
+		void rebalance(step* path, size_t depth)
+		{
+			while (depth > 0)
+			{
+				step& s = path[--depth];
+				inner_type* parent = s.node;
+				node_type* child = parent->children[s.index];
+				size_t limit = child->leaf ? LEAF_SIZE / 4 : FANOUT / 4;
+				if (child->size >= limit || parent->size < 2)
+					break;
+				size_t idx = (s.index + 1 < parent->size) ? s.index : s.index - 1;
+				bool merged = child->leaf ? merge_leaf(parent, idx) : merge_inner(parent, idx);
+				if (!merged)
+					break;
+			}
+			//根只剩一个子节点时降低一层
+			while (!root_->leaf && root_->size == 1)
+			{
+				inner_type* root = (inner_type*)root_;
+				root_ = root->children[0];
+				free_inner(root);
+			}
+		}
+
+		void remove_at(leaf_type* leaf, size_t pos, step* path, size_t depth)
+		{
+			for (size_t d = 0; d < depth; ++d)
+			{
+				path[d].node->counts[path[d].index]--;
+			}
+			std::copy(leaf->items + pos + 1, leaf->items + leaf->size, leaf->items + pos);
+			leaf->size--;
+			length_--;
+			rebalance(path, depth);
+		}
+
+	public:
+		using allocator_type = Alloc;
+
+		friend class rank_tree_iterator<rank_tree>;
+		using const_iterator = rank_tree_iterator<rank_tree>;
+
+		rank_tree(const allocator_type& alloc = allocator_type())
+			:alloc_(alloc)
+		{
+			clear();
+		}
+
+		rank_tree(const rank_tree&) = delete;
+		rank_tree& operator=(const rank_tree&) = delete;
+
+		~rank_tree()
+		{
+			free_all();
+		}
+
+		void clear()
+		{
+			free_all();
+			root_ = head_ = tail_ = make_leaf();
+		}
+
+		const_iterator insert(score_type score)
+		{
+			step path[MAX_DEPTH];
+			size_t depth = 0, rank = 0;
+			leaf_type* leaf = descend(score, path, depth, rank);
+			for (size_t d = 0; d < depth; ++d)
+			{
+				path[d].node->counts[path[d].index]++;
+			}
+			length_++;
+			size_t pos = item_index(leaf, score);
+			if (leaf->size < LEAF_SIZE)
+			{
+				std::copy_backward(leaf->items + pos, leaf->items + leaf->size, leaf->items + leaf->size + 1);
+				leaf->items[pos] = score;
+				leaf->size++;
+				return const_iterator{ leaf, pos };
+			}
+			//叶子满了对半分裂
+			size_t half = LEAF_SIZE / 2;
+			leaf_type* right = make_leaf();
+			std::copy(leaf->items + half, leaf->items + LEAF_SIZE, right->items);
+			right->size = LEAF_SIZE - half;
+			leaf->size = half;
+			right->prev = leaf;
+			right->next = leaf->next;
+			if (leaf->next)
+				leaf->next->prev = right;
+			else
+				tail_ = right;
+			leaf->next = right;
+			leaf_type* target = leaf;
+			if (pos > half)
+			{
+				target = right;
+				pos -= half;
+			}
+			std::copy_backward(target->items + pos, target->items + target->size, target->items + target->size + 1);
+			target->items[pos] = score;
+			target->size++;
+			split_up(path, depth, leaf, right, right->items[0], leaf->size, right->size);
+			return const_iterator{ target, pos };
+		}
+
+		const_iterator update(score_type curscore, score_type newscore)
+		{
+			step path[MAX_DEPTH];
+			size_t depth = 0, rank = 0;
+			leaf_type* leaf = descend(curscore, path, depth, rank);
+			size_t pos = item_index(leaf, curscore);
+			assert(pos < leaf->size && !(curscore < leaf->items[pos]));
+			//新位置落在叶子首尾之间, 叶子内移动即可, 分隔键和计数都不变
+			if (pos > 0 && pos + 1 < leaf->size && leaf->items[0] < newscore && newscore < leaf->items[leaf->size - 1])
+			{
+				size_t npos = item_index(leaf, newscore);
+				if (npos > pos)
+				{
+					std::copy(leaf->items + pos + 1, leaf->items + npos, leaf->items + pos);
+					npos--;
+				}
+				else if (npos < pos)
+				{
+					std::copy_backward(leaf->items + npos, leaf->items + pos, leaf->items + pos + 1);
+				}
+				leaf->items[npos] = newscore;
+				return const_iterator{ leaf, npos };
+			}
+			remove_at(leaf, pos, path, depth);
+			return insert(newscore);
+		}
+
+		//排名从1开始, 不存在时返回0
+		size_t get_rank(score_type score) const
+		{
+			step path[MAX_DEPTH];
+			size_t depth = 0, rank = 0;
+			leaf_type* leaf = descend(score, path, depth, rank);
+			size_t pos = item_index(leaf, score);
+			if (pos < leaf->size && !(score < leaf->items[pos]))
+			{
+				return rank + pos + 1;
+			}
+			return 0;
+		}
+
+		const_iterator find_by_rank(size_t rank) const
+		{
+			if (rank == 0 || rank > length_)
+			{
+				return const_iterator{ nullptr };
+			}
+			size_t left = rank - 1;
+			node_type* node = root_;
+			while (!node->leaf)
+			{
+				inner_type* inner = (inner_type*)node;
+				size_t i = 0;
+				while (left >= inner->counts[i])
+				{
+					left -= inner->counts[i++];
+				}
+				node = inner->children[i];
+			}
+			return const_iterator{ (leaf_type*)node, left };
+		}
+
+		//第一个不小于score的条目, rank为它的排名
+		const_iterator lower_bound(score_type score, size_t& rank) const
+		{
+			step path[MAX_DEPTH];
+			size_t depth = 0;
+			rank = 0;
+			leaf_type* leaf = descend(score, path, depth, rank);
+			size_t pos = item_index(leaf, score);
+			rank += pos + 1;
+			if (pos < leaf->size)
+			{
+				return const_iterator{ leaf, pos };
+			}
+			return const_iterator{ leaf->next };
+		}
+
+		size_t erase(score_type score)
+		{
+			step path[MAX_DEPTH];
+			size_t depth = 0, rank = 0;
+			leaf_type* leaf = descend(score, path, depth, rank);
+			size_t pos = item_index(leaf, score);
+			if (pos < leaf->size && !(score < leaf->items[pos]))
+			{
+				remove_at(leaf, pos, path, depth);
+				return 1;
+			}
+			return 0;
+		}
+
+		//有序且不重复的数据自底向上批量构建
+		template<typename Iter>
+		void assign(Iter first, Iter last)
+		{
+			free_all();
+			size_t count = std::distance(first, last);
+			if (count == 0)
+			{
+				root_ = head_ = tail_ = make_leaf();
+				return;
+			}
+			std::vector<node_type*> level, next_level;
+			std::vector<size_t> counts, next_counts;
+			std::vector<score_type> mins, next_mins;
+			size_t nleaf = (count + LEAF_FILL - 1) / LEAF_FILL;
+			leaf_type* prev = nullptr;
+			for (size_t i = 0; i < nleaf; ++i)
+			{
+				size_t n = count / nleaf + (i < count % nleaf ? 1 : 0);
+				leaf_type* leaf = make_leaf();
+				for (size_t j = 0; j < n; ++j, ++first)
+				{
+					leaf->items[j] = *first;
+				}
+				leaf->size = n;
+				leaf->prev = prev;
+				if (prev)
+					prev->next = leaf;
+				else
+					head_ = leaf;
+				prev = leaf;
+				level.push_back(leaf);
+				counts.push_back(n);
+				mins.push_back(leaf->items[0]);
+			}
+			tail_ = prev;
+			while (level.size() > 1)
+			{
+				size_t total = level.size(), k = 0;
+				size_t ninner = (total + INNER_FILL - 1) / INNER_FILL;
+				next_level.clear();
+				next_counts.clear();
+				next_mins.clear();
+				for (size_t i = 0; i < ninner; ++i)
+				{
+					size_t n = total / ninner + (i < total % ninner ? 1 : 0);
+					inner_type* inner = make_inner();
+					for (size_t j = 0; j < n; ++j)
+					{
+						inner->children[j] = level[k + j];
+						inner->counts[j] = counts[k + j];
+						if (j > 0)
+						{
+							inner->keys[j - 1] = mins[k + j];
+						}
+					}
+					inner->size = n;
+					next_level.push_back(inner);
+					next_counts.push_back(sum_counts(inner));
+					next_mins.push_back(mins[k]);
+					k += n;
+				}
+				level.swap(next_level);
+				counts.swap(next_counts);
+				mins.swap(next_mins);
+			}
+			root_ = level[0];
+			length_ = count;
+		}
+
+		const_iterator begin() const
+		{
+			return const_iterator{ length_ > 0 ? head_ : nullptr };
+		}
+
+		rank_tree_sentinel end() const
+		{
+			return rank_tree_sentinel{};
+		}
+
+		const_iterator tail() const
+		{
+			return length_ > 0 ? const_iterator{ tail_, tail_->size - 1 } : const_iterator{ nullptr };
+		}
+
+		size_t size() const
+		{
+			return length_;
+		}
+
+		//节点占用的字节数
+		size_t memory() const
+		{
+			return leaves_ * sizeof(leaf_type) + inners_ * sizeof(inner_type);
+		}
+	private:
+		allocator_type alloc_;
+		size_t length_ = 0;
+		size_t leaves_ = 0;
+		size_t inners_ = 0;
+		node_type* root_ = nullptr;
+		leaf_type* head_ = nullptr;
+		leaf_type* tail_ = nullptr;
+	};
+} // namespace lzset
@@ -6,6 +6,12 @@
 #include <unordered_map>
 #include <limits>
 #include <memory>
+#include <vector>
+#include <string>
+#include <algorithm>
+#include <filesystem>
+#include "rank_tree.hpp"
+#include "zset_store.hpp"
 
 namespace lzset
 {
@@ -103,11 +109,13 @@ namespace lzset
 			assert(level > 0);
 			size_t size = sizeof(node_type) + (size_t(level) - 1) * sizeof(level_type);
 			char* node_memory = alloc_.allocate(size);
+			memory_ += size;
 			return new (node_memory) node_type{ size , score };
 		}
 
 		void free_node(node_type* node)
 		{
+			memory_ -= node->size;
 			std::destroy_at(node);
 			alloc_.deallocate((char*)node, node->size);
 		}
@@ -372,6 +380,33 @@ namespace lzset
 			return 0; /* not found */
 		}
 
+		/* First element not less than score, rank is its 1-based rank. */
+		const_iterator lower_bound(score_type score, size_t& rank) const
+		{
+			node_type* x = header_;
+			rank = 0;
+			for (int i = level_ - 1; i >= 0; i--)
+			{
+				while (x->level[i].forward && x->level[i].forward->score < score)
+				{
+					rank += x->level[i].span;
+					x = x->level[i].forward;
+				}
+			}
+			rank += 1;
+			return const_iterator{ x->level[0].forward };
+		}
+
+		template<typename Iter>
+		void assign(Iter first, Iter last)
+		{
+			clear();
+			for (; first != last; ++first)
+			{
+				insert(*first);
+			}
+		}
+
 		const_iterator begin() const
 		{
 			return const_iterator{ header_->level[0].forward };
@@ -391,16 +426,158 @@ namespace lzset
 		{
 			return length_;
 		}
+
+		size_t memory() const
+		{
+			return memory_;
+		}
 	private:
 		allocator_type alloc_;
 		std::mt19937 gen_;
+		size_t memory_ = 0;
 		size_t length_ = 0;
 		int level_ = 1;
 		node_type* header_ = nullptr;
 		node_type* tail_ = nullptr;
 	};
 
-	template<template<typename T> class Alloc = std::allocator>
+
+	//key到排名数据的线性探测表, key为0的槽位是空位(zset不接受key为0)
+	template<typename Value, typename Alloc>
+	class key_index
+	{
+		static constexpr size_t MIN_CAPACITY = 16;
+	public:
+		key_index()
+		{
+			clear();
+		}
+
+		Value* find(int64_t key)
+		{
+			for (size_t i = home(key);; i = (i + 1) & mask_)
+			{
+				if (slots_[i].key == key)
+					return &slots_[i];
+				if (slots_[i].key == 0)
+					return nullptr;
+			}
+		}
+
+		const Value* find(int64_t key) const
+		{
+			return const_cast<key_index*>(this)->find(key);
+		}
+
+		//返回key所在的槽位, 不存在时插入, 指针在下次插入前有效
+		Value* emplace(int64_t key)
+		{
+			if ((size_ + 1) * 4 > slots_.size() * 3)
+			{
+				rehash(slots_.size() * 2);
+			}
+			size_t i = home(key);
+			for (; slots_[i].key != 0; i = (i + 1) & mask_)
+			{
+				if (slots_[i].key == key)
+					return &slots_[i];
+			}
+			slots_[i].key = key;
+			size_++;
+			return &slots_[i];
+		}
+
+		//删除后把后面的元素前移, 不留墓碑
+		bool erase(int64_t key)
+		{
+			size_t i = home(key);
+			for (; slots_[i].key != key; i = (i + 1) & mask_)
+			{
+				if (slots_[i].key == 0)
+					return false;
+			}
+			for (size_t j = (i + 1) & mask_; slots_[j].key != 0; j = (j + 1) & mask_)
+			{
+				size_t h = home(slots_[j].key);
+				if (((j - h) & mask_) >= ((j - i) & mask_))
+				{
+					slots_[i] = slots_[j];
+					i = j;
+				}
+			}
+			slots_[i] = Value{};
+			size_--;
+			return true;
+		}
+
+		void reserve(size_t count)
+		{
+			size_t capacity = slots_.size();
+			while (count * 4 > capacity * 3)
+				capacity *= 2;
+			if (capacity > slots_.size())
+				rehash(capacity);
+		}
+
+		template<typename F>
+		void for_each(F&& func) const
+		{
+			for (const Value& slot : slots_)
+			{
+				if (slot.key != 0)
+					func(slot);
+			}
+		}
+
+		void clear()
+		{
+			std::vector<Value, Alloc>(MIN_CAPACITY).swap(slots_);
+			mask_ = MIN_CAPACITY - 1;
+			shift_ = 64 - 4;
+			size_ = 0;
+		}
+
+		size_t size() const
+		{
+			return size_;
+		}
+
+		size_t memory() const
+		{
+			return slots_.capacity() * sizeof(Value);
+		}
+	private:
+		size_t home(int64_t key) const
+		{
+			return size_t((uint64_t(key) * 0x9E3779B97F4A7C15ull) >> shift_);
+		}
+
+		void rehash(size_t capacity)
+		{
+			std::vector<Value, Alloc> slots(capacity);
+			slots.swap(slots_);
+			mask_ = capacity - 1;
+			shift_ = 64;
+			for (size_t n = capacity; n > 1; n >>= 1)
+				shift_--;
+			for (const Value& slot : slots)
+			{
+				if (slot.key == 0)
+					continue;
+				size_t i = home(slot.key);
+				while (slots_[i].key != 0)
+					i = (i + 1) & mask_;
+				slots_[i] = slot;
+			}
+		}
+
+		std::vector<Value, Alloc> slots_;
+		size_t size_ = 0;
+		size_t mask_ = 0;
+		int shift_ = 0;
+	};
+
+	template<template<typename T> class Alloc = std::allocator, template<typename, typename> class List = rank_tree>
 	class zset
 	{
 		struct context
@@ -447,11 +624,13 @@ namespace lzset
 				return score < val.score;
 			}
 		};
+		//快照直接映射成context数组
+		static_assert(sizeof(context) == 3 * sizeof(int64_t));
 	public:
 		template<typename T>
 		using allocator_type = Alloc<T>;
-		using skip_list_type = skip_list<context, allocator_type<char>>;
-		using const_iterator = typename skip_list_type::const_iterator;
+		using list_type = List<context, allocator_type<char>>;
+		using const_iterator = typename list_type::const_iterator;
 
 		zset(size_t max_count = std::numeric_limits<size_t>::max(), bool reverse = false)
 			: reverse_(reverse)
@@ -463,72 +642,245 @@ namespace lzset
 			if (max_count_ == 0 || key == 0)
 				return;
 
-			if (reverse_)
-				score = -score;
-
-			auto iter = dict_.find(key);
-			if (dict_.size() == max_count_ && iter == dict_.end() && *zsl_.tail() < context{ key, score, timestamp })
-			{
+			context ctx{ key, reverse_ ? -score : score, timestamp };
+			context* cur = dict_.find(key);
+			//分数和时间都没变时不追加日志
+			if (cur != nullptr && cur->score == ctx.score && cur->timestamp == timestamp)
 				return;
-			}
 
-			if (iter == dict_.end())
+			if (log_)
+				log_->append(update_log::op_update, key, score, timestamp);
+
+			if (cur == nullptr)
 			{
-				auto it = zsl_.insert(context{ key, score, timestamp });
-				dict_.emplace(key, &(*it));
+				if (dict_.size() == max_count_ && *zsl_.tail() < ctx)
+					return;
+				zsl_.insert(ctx);
+				*dict_.emplace(key) = ctx;
 			}
 			else
 			{
-				auto it = zsl_.update(*iter->second, context{ key, score, timestamp });
-				iter->second = &(*it);
+				zsl_.update(*cur, ctx);
+				*cur = ctx;
 			}
 
 			if (dict_.size() > max_count_)
 			{
-				erase((*zsl_.tail()).key);
+				remove((*zsl_.tail()).key);
+			}
+		}
+
+		//批量导入(key, score, timestamp)三元组, 已有的key被覆盖, 排序后一次性重建
+		void load(const std::vector<int64_t>& items)
+		{
+			if (max_count_ == 0)
+				return;
+			if (log_)
+			{
+				for (size_t i = 0; i + 2 < items.size(); i += 3)
+				{
+					log_->append(update_log::op_load, items[i], items[i + 1], items[i + 2]);
+				}
+				log_->append(update_log::op_load_end, 0, 0, 0);
+			}
+			for (size_t i = 0; i + 2 < items.size(); i += 3)
+			{
+				if (items[i] == 0)
+					continue;
+				*dict_.emplace(items[i]) = context{ items[i], reverse_ ? -items[i + 1] : items[i + 1], items[i + 2] };
+			}
+			std::vector<context> sorted;
+			sorted.reserve(dict_.size());
+			dict_.for_each([&](const context& ctx) { sorted.push_back(ctx); });
+			std::sort(sorted.begin(), sorted.end());
+			if (sorted.size() > max_count_)
+			{
+				for (size_t i = max_count_; i < sorted.size(); ++i)
+				{
+					dict_.erase(sorted[i].key);
+				}
+				sorted.resize(max_count_);
 			}
+			zsl_.assign(sorted.begin(), sorted.end());
 		}
 
 		size_t rank(int64_t key) const
 		{
-			if (auto iter = dict_.find(key); iter != dict_.end())
+			if (const context* ctx = dict_.find(key); ctx != nullptr)
 			{
-				return zsl_.get_rank(*iter->second);
+				return zsl_.get_rank(*ctx);
 			}
 			return 0;
 		}
 
 		int64_t score(int64_t key) const
 		{
-			auto iter = dict_.find(key);
-			if (iter != dict_.end())
+			if (const context* ctx = dict_.find(key); ctx != nullptr)
 			{
-				return reverse_ ? -iter->second->score : iter->second->score;
+				return score_of(*ctx);
 			}
 			return 0;
 		}
 
+		int64_t score_of(const context& ctx) const
+		{
+			return reverse_ ? -ctx.score : ctx.score;
+		}
+
 		bool has(int64_t key) const
 		{
-			return (dict_.find(key) != dict_.end());
+			return dict_.find(key) != nullptr;
 		}
 
 		void clear()
 		{
+			if (log_)
+				log_->append(update_log::op_clear, 0, 0, 0);
 			dict_.clear();
 			zsl_.clear();
 		}
 
 		size_t erase(int64_t key)
 		{
-			auto iter = dict_.find(key);
-			if (iter != dict_.end())
+			if (log_ && dict_.find(key) != nullptr)
+				log_->append(update_log::op_erase, key, 0, 0);
+			return remove(key);
+		}
+
+		//按排名顺序写入快照, 先写临时文件再改名, 成功后清空更新日志
+		bool save(const std::string& path, std::string& err)
+		{
+			std::error_code ec;
+			std::string temp = path + ".tmp";
+			std::filesystem::remove(temp, ec);
 			{
-				zsl_.erase(*iter->second);
-				dict_.erase(iter);
-				return 1;
+				mmap_file file;
+				size_t count = zsl_.size();
+				if (!file.open(temp, true, sizeof(snapshot_header) + count * sizeof(context), err))
+					return false;
+				context* out = (context*)(file.data() + sizeof(snapshot_header));
+				for (auto it = zsl_.begin(); it != zsl_.end(); ++it)
+				{
+					*out++ = *it;
+				}
+				snapshot_header* header = (snapshot_header*)file.data();
+				memcpy(header->magic, SNAPSHOT_MAGIC, sizeof(header->magic));
+				header->count = count;
+				header->max_count = max_count_;
+				header->reverse = reverse_ ? 1 : 0;
+				header->checksum = snapshot_checksum((const int64_t*)(header + 1), count * 3);
+				if (!file.sync())
+				{
+					err = "sync snapshot " + temp + " failed";
+					return false;
+				}
 			}
-			return 0;
+			std::filesystem::rename(temp, path, ec);
+			if (ec)
+			{
+				err = "rename snapshot " + path + " failed: " + ec.message();
+				return false;
+			}
+			return log_ == nullptr || log_->reset(err);
+		}
+
+		//从快照恢复, 快照已按排名有序, 校验后直接批量构建
+		bool restore(const std::string& path, std::string& err)
+		{
+			if (log_)
+			{
+				err = "restore with update log opened";
+				return false;
+			}
+			mmap_file file;
+			if (!file.open(path, false, 0, err))
+				return false;
+			const snapshot_header* header = (const snapshot_header*)file.data();
+			if (file.size() < sizeof(snapshot_header) || memcmp(header->magic, SNAPSHOT_MAGIC, sizeof(header->magic)) != 0)
+			{
+				err = "invalid snapshot " + path;
+				return false;
+			}
+			if (file.size() != sizeof(snapshot_header) + header->count * sizeof(context))
+			{
+				err = "truncated snapshot " + path;
+				return false;
+			}
+			if ((header->reverse != 0) != reverse_)
+			{
+				err = "snapshot order mismatch " + path;
+				return false;
+			}
+			const context* first = (const context*)(header + 1);
+			if (snapshot_checksum((const int64_t*)first, header->count * 3) != header->checksum)
+			{
+				err = "snapshot checksum mismatch " + path;
+				return false;
+			}
+			//先在临时索引中校验, 全部通过才替换, 损坏的快照不影响当前数据
+			size_t count = std::min<size_t>(header->count, max_count_);
+			key_index<context, allocator_type<context>> dict;
+			dict.reserve(count);
+			for (size_t i = 0; i < count; ++i)
+			{
+				if (first[i].key == 0 || (i > 0 && !(first[i - 1] < first[i])))
+				{
+					err = "corrupted snapshot " + path;
+					return false;
+				}
+				*dict.emplace(first[i].key) = first[i];
+				if (dict.size() != i + 1)
+				{
+					err = "corrupted snapshot " + path;
+					return false;
+				}
+			}
+			zsl_.assign(first, first + count);
+			dict_ = std::move(dict);
+			return true;
+		}
+
+		//打开更新日志并回放其中的记录, 之后的修改都追加到日志
+		bool open_log(const std::string& path, std::string& err)
+		{
+			log_.reset();
+			auto log = std::make_unique<update_log>();
+			std::vector<int64_t> loads;
+			auto replay = [&](const update_log::record& rec) {
+				switch (rec.op)
+				{
+				case update_log::op_update:
+					update(rec.key, rec.score, rec.timestamp);
+					break;
+				case update_log::op_erase:
+					remove(rec.key);
+					break;
+				case update_log::op_clear:
+					clear();
+					break;
+				case update_log::op_load:
+					loads.insert(loads.end(), { rec.key, rec.score, rec.timestamp });
+					break;
+				case update_log::op_load_end:
+					load(loads);
+					loads.clear();
+					break;
+				}
+			};
+			if (!log->open(path, replay, err))
+				return false;
+			log_ = std::move(log);
+			return true;
+		}
+
+		void close_log()
+		{
+			log_.reset();
+		}
+
+		size_t log_count() const
+		{
+			return log_ ? log_->count() : 0;
 		}
 
 		const_iterator find_by_rank(size_t rank) const
@@ -536,6 +888,13 @@ namespace lzset
 			return zsl_.find_by_rank(rank);
 		}
 
+		//按排名顺序第一个分数不高于score的条目(逆序时不低于), rank为它的排名
+		const_iterator lower_bound(int64_t score, size_t& rank) const
+		{
+			context ctx{ std::numeric_limits<int64_t>::min(), reverse_ ? -score : score, std::numeric_limits<int64_t>::min() };
+			return zsl_.lower_bound(ctx, rank);
+		}
+
 		const_iterator begin() const
 		{
 			return zsl_.begin();
@@ -546,7 +905,7 @@ namespace lzset
 			return zsl_.tail();
 		}
 
-		skip_list_iterator_sentinel end() const
+		auto end() const
 		{
 			return zsl_.end();
 		}
@@ -556,10 +915,34 @@ namespace lzset
 			assert(dict_.size() == zsl_.size());
 			return dict_.size();
 		}
+
+		bool reverse() const
+		{
+			return reverse_;
+		}
+
+		//排序结构和key索引占用的字节数
+		size_t memory() const
+		{
+			return zsl_.memory() + dict_.memory();
+		}
+	private:
+		size_t remove(int64_t key)
+		{
+			if (context* ctx = dict_.find(key); ctx != nullptr)
+			{
+				zsl_.erase(*ctx);
+				dict_.erase(key);
+				return 1;
+			}
+			return 0;
+		}
+
 	private:
 		bool reverse_ = false;
 		const size_t max_count_;
-		skip_list_type zsl_;
-		std::unordered_map<int64_t, const context*, std::hash<int64_t>, std::equal_to<int64_t>, allocator_type<std::pair<const int64_t, const context*>>> dict_;
+		list_type zsl_;
+		std::unique_ptr<update_log> log_;
+		key_index<context, allocator_type<context>> dict_;
 	};
-} // namespace moon
\ No newline at end of file
+} // namespace lzset
@@ -0,0 +1,201 @@
+#include "zset_store.hpp"
+
+#ifdef WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <errno.h>
+#endif
+
+namespace lzset
+{
+#ifdef WIN32
+	static std::string last_error(const char* what, const std::string& path)
+	{
+		return std::string(what) + " " + path + " failed: " + std::to_string(GetLastError());
+	}
+
+	bool mmap_file::open(const std::string& path, bool writable, size_t size, std::string& err)
+	{
+		close();
+		writable_ = writable;
+		DWORD access = writable ? (GENERIC_READ | GENERIC_WRITE) : GENERIC_READ;
+		HANDLE file = CreateFileA(path.c_str(), access, FILE_SHARE_READ, nullptr, writable ? OPEN_ALWAYS : OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+		if (file == INVALID_HANDLE_VALUE)
+		{
+			err = last_error("open", path);
+			return false;
+		}
+		file_ = file;
+		LARGE_INTEGER fsize;
+		GetFileSizeEx(file, &fsize);
+		size_ = (size_t)fsize.QuadPart;
+		if (writable && size_ < size)
+		{
+			return truncate(size, err);
+		}
+		return map(err);
+	}
+
+	bool mmap_file::truncate(size_t size, std::string& err)
+	{
+		unmap();
+		LARGE_INTEGER pos;
+		pos.QuadPart = (LONGLONG)size;
+		if (!SetFilePointerEx((HANDLE)file_, pos, nullptr, FILE_BEGIN) || !SetEndOfFile((HANDLE)file_))
+		{
+			//映射已经解除, 大小清零避免按旧大小访问
+			err = last_error("truncate", "");
+			size_ = 0;
+			return false;
+		}
+		size_ = size;
+		return map(err);
+	}
+
+	bool mmap_file::map(std::string& err)
+	{
+		if (size_ == 0)
+			return true;
+		mapping_ = CreateFileMappingA((HANDLE)file_, nullptr, writable_ ? PAGE_READWRITE : PAGE_READONLY, 0, 0, nullptr);
+		if (mapping_ == nullptr)
+		{
+			err = last_error("mapping", "");
+			size_ = 0;
+			return false;
+		}
+		data_ = (char*)MapViewOfFile((HANDLE)mapping_, writable_ ? FILE_MAP_WRITE : FILE_MAP_READ, 0, 0, size_);
+		if (data_ == nullptr)
+		{
+			err = last_error("map view", "");
+			size_ = 0;
+			return false;
+		}
+		return true;
+	}
+
+	void mmap_file::unmap()
+	{
+		if (data_)
+		{
+			UnmapViewOfFile(data_);
+			data_ = nullptr;
+		}
+		if (mapping_)
+		{
+			CloseHandle((HANDLE)mapping_);
+			mapping_ = nullptr;
+		}
+	}
+
+	bool mmap_file::sync()
+	{
+		if (data_ == nullptr)
+			return true;
+		return FlushViewOfFile(data_, size_) && FlushFileBuffers((HANDLE)file_);
+	}
+
+	void mmap_file::close()
+	{
+		unmap();
+		if (file_)
+		{
+			CloseHandle((HANDLE)file_);
+			file_ = nullptr;
+		}
+		size_ = 0;
+	}
+#else
+	static std::string last_error(const char* what, const std::string& path)
+	{
+		return std::string(what) + " " + path + " failed: " + strerror(errno);
+	}
+
+	bool mmap_file::open(const std::string& path, bool writable, size_t size, std::string& err)
+	{
+		close();
+		writable_ = writable;
+		fd_ = ::open(path.c_str(), writable ? (O_RDWR | O_CREAT) : O_RDONLY, 0644);
+		if (fd_ < 0)
+		{
+			err = last_error("open", path);
+			return false;
+		}
+		struct stat st;
+		if (fstat(fd_, &st) != 0)
+		{
+			err = last_error("stat", path);
+			close();
+			return false;
+		}
+		size_ = (size_t)st.st_size;
+		if (writable && size_ < size)
+		{
+			return truncate(size, err);
+		}
+		return map(err);
+	}
+
+	bool mmap_file::truncate(size_t size, std::string& err)
+	{
+		unmap();
+		if (ftruncate(fd_, (off_t)size) != 0)
+		{
+			//映射已经解除, 大小清零避免按旧大小访问
+			err = last_error("truncate", "");
+			size_ = 0;
+			return false;
+		}
+		size_ = size;
+		return map(err);
+	}
+
+	bool mmap_file::map(std::string& err)
+	{
+		if (size_ == 0)
+			return true;
+		int prot = writable_ ? (PROT_READ | PROT_WRITE) : PROT_READ;
+		void* data = mmap(nullptr, size_, prot, MAP_SHARED, fd_, 0);
+		if (data == MAP_FAILED)
+		{
+			err = last_error("mmap", "");
+			size_ = 0;
+			return false;
+		}
+		data_ = (char*)data;
+		return true;
+	}
+
+	void mmap_file::unmap()
+	{
+		if (data_)
+		{
+			munmap(data_, size_);
+			data_ = nullptr;
+		}
+	}
+
+	bool mmap_file::sync()
+	{
+		if (data_ == nullptr)
+			return true;
+		return msync(data_, size_, MS_SYNC) == 0;
+	}
+
+	void mmap_file::close()
+	{
+		unmap();
+		if (fd_ >= 0)
+		{
+			::close(fd_);
+			fd_ = -1;
+		}
+		size_ = 0;
+	}
+#endif
+} // namespace lzset
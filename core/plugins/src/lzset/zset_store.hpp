@@ -0,0 +1,148 @@
+#pragma once
+#include <string>
+#include <atomic>
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+
+namespace lzset
+{
+	//内存映射文件, 快照和更新日志共用
+	class mmap_file
+	{
+	public:
+		mmap_file() = default;
+		mmap_file(const mmap_file&) = delete;
+		mmap_file& operator=(const mmap_file&) = delete;
+		~mmap_file() { close(); }
+
+		//打开并映射整个文件, writable时文件不存在则创建, 不足size的部分补0
+		bool open(const std::string& path, bool writable, size_t size, std::string& err);
+		//把文件截断或者扩展到size后重新映射
+		bool truncate(size_t size, std::string& err);
+		bool sync();
+		void close();
+
+		char* data() const { return data_; }
+		size_t size() const { return size_; }
+	private:
+		bool map(std::string& err);
+		void unmap();
+
+	private:
+#ifdef WIN32
+		void* file_ = nullptr;
+		void* mapping_ = nullptr;
+#else
+		int fd_ = -1;
+#endif
+		bool writable_ = false;
+		char* data_ = nullptr;
+		size_t size_ = 0;
+	};
+
+	//快照文件头, 后面紧跟按排名顺序排列的count个(key, score, timestamp)
+	struct snapshot_header
+	{
+		char magic[8];
+		uint64_t count;
+		uint64_t max_count;
+		int64_t reverse;
+		uint64_t checksum;
+	};
+
+	constexpr char SNAPSHOT_MAGIC[8] = { 'L', 'Z', 'S', 'E', 'T', 0, 0, 1 };
+
+	inline uint64_t snapshot_checksum(const int64_t* values, size_t count)
+	{
+		uint64_t hash = 14695981039346656037ull;
+		for (size_t i = 0; i < count; ++i)
+		{
+			hash = (hash ^ uint64_t(values[i])) * 1099511628211ull;
+		}
+		return hash;
+	}
+
+	//更新日志: 定长记录追加到映射文件, 进程崩溃后已写入的记录仍在页缓存里
+	class update_log
+	{
+	public:
+		enum op_type : int64_t
+		{
+			op_none = 0,
+			op_update = 1,
+			op_erase = 2,
+			op_clear = 3,
+			op_load = 4,
+			op_load_end = 5,
+		};
+
+		struct record
+		{
+			int64_t op;
+			int64_t key;
+			int64_t score;
+			int64_t timestamp;
+		};
+
+		//每次扩展64K条记录
+		static constexpr size_t CHUNK = 65536 * sizeof(record);
+
+		//打开日志并逐条回放已有记录, 之后的记录追加在最后一条之后
+		template<typename F>
+		bool open(const std::string& path, F&& replay, std::string& err)
+		{
+			if (!file_.open(path, true, CHUNK, err))
+				return false;
+			const record* records = (const record*)file_.data();
+			size_t total = file_.size() / sizeof(record);
+			//op为0的记录是没写完或者没用过的位置
+			for (count_ = 0; count_ < total && records[count_].op != op_none; ++count_)
+			{
+				replay(records[count_]);
+			}
+			return true;
+		}
+
+		void append(int64_t op, int64_t key, int64_t score, int64_t timestamp)
+		{
+			size_t need = (count_ + 1) * sizeof(record);
+			if (need > file_.size())
+			{
+				std::string err;
+				if (!file_.truncate(std::max(file_.size() + CHUNK, need), err))
+					throw std::runtime_error(err);
+			}
+			//之前扩容失败时映射为空
+			if (file_.data() == nullptr)
+				throw std::runtime_error("update log not mapped");
+			record* rec = (record*)file_.data() + count_++;
+			rec->key = key;
+			rec->score = score;
+			rec->timestamp = timestamp;
+			//op最后写入, 中途退出时这条记录不会被回放
+			std::atomic_signal_fence(std::memory_order_release);
+			rec->op = op;
+		}
+
+		//快照已经包含全部记录, 清空日志
+		bool reset(std::string& err)
+		{
+			if (!file_.truncate(0, err))
+				return false;
+			//文件已清空, 再扩容失败时由append重新扩容
+			count_ = 0;
+			return file_.truncate(CHUNK, err);
+		}
+
+		size_t count() const
+		{
+			return count_;
+		}
+
+	private:
+		mmap_file file_;
+		size_t count_ = 0;
+	};
+} // namespace lzset
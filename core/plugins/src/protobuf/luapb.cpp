@@ -1,3 +1,4 @@
+#include <vector>
 #include <algorithm>
 #include "pb.c"
 #include "lua_kit.h"
@@ -8,7 +9,181 @@ using namespace luakit;
 
 namespace luapb {
 
-    thread_local std::unordered_map<uint32_t,std::string> pb_cmd_ids;
+    //协议号绑定的消息类型, 协议重新加载后首次使用时按名字重新解析
+    struct pb_cmd {
+        std::string name;
+        const pb_Type* type = nullptr;
+        const pb_State* state = nullptr;
+        unsigned version = 0;
+        int pool = LUA_NOREF;       // 空闲消息表栈
+        uint32_t pool_size = 0;
+        uint32_t pool_cap = 0;
+    };
+
+    //64K以内的协议号直接下标访问, 其余走哈希表
+    constexpr uint32_t PB_CMD_DIRECT = 0x10000;
+    thread_local std::vector<pb_cmd> pb_cmd_list;
+    thread_local std::unordered_map<uint32_t, pb_cmd> pb_cmd_ids;
+
+    static pb_cmd* pb_find_cmd(uint32_t cmd_id) {
+        if (cmd_id < PB_CMD_DIRECT) {
+            if (cmd_id >= pb_cmd_list.size()) return nullptr;
+            pb_cmd* cmd = &pb_cmd_list[cmd_id];
+            return cmd->name.empty() ? nullptr : cmd;
+        }
+        auto it = pb_cmd_ids.find(cmd_id);
+        return it == pb_cmd_ids.end() ? nullptr : &it->second;
+    }
+
+    static void pb_bind_cmd(uint32_t cmd_id, std::string fullname) {
+        pb_cmd* cmd = nullptr;
+        if (cmd_id < PB_CMD_DIRECT) {
+            if (cmd_id >= pb_cmd_list.size()) pb_cmd_list.resize(cmd_id + 1);
+            cmd = &pb_cmd_list[cmd_id];
+        } else {
+            cmd = &pb_cmd_ids[cmd_id];
+        }
+        cmd->name = fullname;
+        cmd->state = nullptr;
+    }
+
+    static const pb_Type* pb_cmd_type(lua_State* L, lpb_State* LS, pb_cmd* cmd) {
+        if (cmd->state != lpbS_state(LS) || cmd->version != LS->type_version) {
+            cmd->type = lpb_type(L, LS, pb_lslice(cmd->name.c_str(), cmd->name.size()));
+            cmd->state = lpbS_state(LS);
+            cmd->version = LS->type_version;
+        }
+        return cmd->type;
+    }
+
+    //池中的表挂上标记元表, 用于识别重复回收
+    static const char pb_pool_mark = 0;
+
+    static void pb_push_mark(lua_State* L) {
+        if (lua_rawgetp(L, LUA_REGISTRYINDEX, &pb_pool_mark) != LUA_TTABLE) {
+            lua_pop(L, 1);
+            lua_newtable(L);
+            lua_pushvalue(L, -1);
+            lua_rawsetp(L, LUA_REGISTRYINDEX, &pb_pool_mark);
+        }
+    }
+
+    static void pb_clear_table(lua_State* L) {
+        lua_pushnil(L);
+        while (lua_next(L, -2)) {
+            lua_pop(L, 1);
+            lua_pushvalue(L, -1);
+            lua_pushnil(L);
+            lua_rawset(L, -4);
+        }
+    }
+
+    //压入消息表: 优先复用对象池, 清空旧字段后按类型重新填充默认值
+    //proto3的repeated/map字段总会填充, 保留原表只清空内容, 省去重新分配和扩容
+    static void pb_push_table(lua_State* L, lpb_State* LS, pb_cmd* cmd, const pb_Type* t) {
+        if (cmd->pool_size == 0) {
+            lpb_pushtypetable(L, LS, t);
+            return;
+        }
+        luaL_checkstack(L, 8, "too many levels");
+        lua_rawgeti(L, LUA_REGISTRYINDEX, cmd->pool);
+        lua_rawgeti(L, -1, cmd->pool_size);
+        lua_pushnil(L);
+        lua_rawseti(L, -3, cmd->pool_size--);
+        lua_remove(L, -2);
+        lua_pushnil(L);
+        lua_setmetatable(L, -2);
+        lua_pushnil(L);
+        while (lua_next(L, -2)) {
+            if (t->is_proto3 && lua_type(L, -1) == LUA_TTABLE && lua_type(L, -2) == LUA_TSTRING) {
+                const pb_Field* f = pb_fname(t, lpb_name(LS, lpb_toslice(L, -2)));
+                if (f && f->repeated) {
+                    pb_clear_table(L);
+                    lua_pop(L, 1);
+                    continue;
+                }
+            }
+            lua_pop(L, 1);
+            lua_pushvalue(L, -1);
+            lua_pushnil(L);
+            lua_rawset(L, -4);
+        }
+        lpb_inittypetable(L, LS, t);
+    }
+
+    //设置协议的消息表池容量, 0表示关闭
+    static int pb_bind_pool(lua_State* L) {
+        pb_cmd* cmd = pb_find_cmd((uint32_t)luaL_checkinteger(L, 1));
+        if (cmd == nullptr) luaL_error(L, "invalid pb cmd: %d", (int)lua_tointeger(L, 1));
+        cmd->pool_cap = (uint32_t)luaL_optinteger(L, 2, 0);
+        if (cmd->pool_cap == 0 || cmd->pool_size > cmd->pool_cap) {
+            luaL_unref(L, LUA_REGISTRYINDEX, cmd->pool);
+            cmd->pool = LUA_NOREF;
+            cmd->pool_size = 0;
+        }
+        return 0;
+    }
+
+    //回收解码出的消息表, 未开启池或池已满时忽略
+    static int pb_recycle(lua_State* L) {
+        pb_cmd* cmd = pb_find_cmd((uint32_t)luaL_checkinteger(L, 1));
+        if (cmd == nullptr || cmd->pool_size >= cmd->pool_cap || !lua_istable(L, 2)) {
+            lua_pushboolean(L, 0);
+            return 1;
+        }
+        lua_settop(L, 2);
+        pb_push_mark(L);
+        if (lua_getmetatable(L, 2) && lua_rawequal(L, 3, 4)) {
+            lua_pushboolean(L, 0);
+            return 1;
+        }
+        lua_settop(L, 3);
+        lua_setmetatable(L, 2);
+        cmd->pool = lpb_reftable(L, cmd->pool);
+        lua_pushvalue(L, 2);
+        lua_rawseti(L, 3, ++cmd->pool_size);
+        lua_pushboolean(L, 1);
+        return 1;
+    }
+
+    static const pb_Type* pb_check_cmd(lua_State* L, lpb_State* LS, pb_cmd** cmd) {
+        uint32_t cmd_id = (uint32_t)luaL_checkinteger(L, 1);
+        *cmd = pb_find_cmd(cmd_id);
+        if (*cmd == nullptr) luaL_error(L, "invalid pb cmd: %d", cmd_id);
+        const pb_Type* t = pb_cmd_type(L, LS, *cmd);
+        if (t == nullptr) luaL_error(L, "pb message not define cmd: %d", cmd_id);
+        return t;
+    }
+
+    //按协议号编码消息体
+    static int pb_encode_cmd(lua_State* L) {
+        pb_cmd* cmd;
+        lpb_State* LS = lpb_lstate(L);
+        const pb_Type* t = pb_check_cmd(L, LS, &cmd);
+        luaL_checktype(L, 2, LUA_TTABLE);
+        lpb_Env e;
+        e.L = L, e.LS = LS;
+        pb_resetbuffer(e.b = &LS->buffer);
+        lua_pushvalue(L, 2);
+        if (LS->use_enc_hooks) lpb_useenchooks(L, LS, t);
+        lpbE_encode(&e, t, -1);
+        lua_pushlstring(L, pb_buffer(e.b), pb_bufflen(e.b));
+        pb_resetbuffer(e.b);
+        return 1;
+    }
+
+    //按协议号解码消息体
+    static int pb_decode_cmd(lua_State* L) {
+        pb_cmd* cmd;
+        lpb_State* LS = lpb_lstate(L);
+        const pb_Type* t = pb_check_cmd(L, LS, &cmd);
+        pb_Slice s = lua_isnoneornil(L, 2) ? pb_lslice(NULL, 0) : lpb_checkslice(L, 2);
+        lpb_Env e;
+        lua_settop(L, 2);
+        pb_push_table(L, LS, cmd, t);
+        e.L = L, e.LS = LS, e.s = &s;
+        return lpbD_message(&e, t);
+    }
 
     constexpr int FlagMask_REQ      = 0x01;
     constexpr int FlagMask_RES      = 0x02;
@@ -87,7 +262,9 @@ namespace luapb {
             pb_header* header =(pb_header*)m_slice->erase(sizeof(pb_header));
             //cmd_id
             lpb_State* LS = lpb_lstate(L);
-            const pb_Type* t = pb_type_from_enum(L, LS, header->cmd_id);
+            pb_cmd* cmd = pb_find_cmd(header->cmd_id);
+            if (cmd == nullptr) throw lua_exception("pb decode invalid cmdid: %d!", header->cmd_id);
+            const pb_Type* t = pb_cmd_type(L, LS, cmd);
             if (t == nullptr) {
                 throw lua_exception("pb message not define cmd: %d", header->cmd_id);
             }
@@ -110,7 +287,7 @@ namespace luapb {
             lua_push_function(L, [&](lua_State* L) {
                 lpb_Env e;
                 pb_Slice s = pb_lslice(data, data_len);
-                lpb_pushtypetable(L, LS, t);
+                pb_push_table(L, LS, cmd, t);
                 e.L = L, e.LS = LS, e.s = &s;
                 lpbD_message(&e, t);
                 return 1;
@@ -122,16 +299,10 @@ namespace luapb {
         }
 
     protected:
-        const pb_Type* pb_type_from_enum(lua_State* L, lpb_State* LS, size_t cmd_id) {
-            auto it = pb_cmd_ids.find(cmd_id);
-            if (it == pb_cmd_ids.end()) throw lua_exception("pb decode invalid cmdid: %d!", cmd_id);
-            return lpb_type(L, LS, pb_lslice(it->second.c_str(), it->second.size()));
-        }
-
         const pb_Type* pb_type_from_stack(lua_State* L, lpb_State* LS, pb_header* header) {
-            auto it = pb_cmd_ids.find(header->cmd_id);
-            if (it == pb_cmd_ids.end()) luaL_error(L, "invalid pb cmd: %d", header->cmd_id);
-            return lpb_type(L, LS, pb_lslice(it->second.c_str(), it->second.size()));
+            pb_cmd* cmd = pb_find_cmd(header->cmd_id);
+            if (cmd == nullptr) luaL_error(L, "invalid pb cmd: %d", header->cmd_id);
+            return pb_cmd_type(L, LS, cmd);
         }
 
         bool encrypt(uint8_t flag) {
@@ -155,7 +326,11 @@ namespace luapb {
         luaopen_pb(L);
         lua_table luapb(L);
         luapb.set_function("pbcodec", pb_codec);
-        luapb.set_function("bind_cmd", [](uint32_t cmd_id, std::string fullname) { pb_cmd_ids[cmd_id] = fullname; });
+        luapb.set_function("bind_cmd", pb_bind_cmd);
+        luapb.set_function("bind_pool", pb_bind_pool);
+        luapb.set_function("recycle", pb_recycle);
+        luapb.set_function("encode_cmd", pb_encode_cmd);
+        luapb.set_function("decode_cmd", pb_decode_cmd);
         luapb.set_function("xor_init", [](uint64_t key) { xor_init(key); });
         return luapb;
     }
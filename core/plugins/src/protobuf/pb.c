@@ -144,6 +144,7 @@ typedef struct lpb_State {
     int defs_index;
     int enc_hooks_index;
     int dec_hooks_index;
+    unsigned type_version; /* bumped on load/clear, invalidates cached pb_Type pointers */
     unsigned use_dec_hooks : 1;
     unsigned use_enc_hooks : 1;
     unsigned enum_as_value : 1;
@@ -1234,6 +1235,7 @@ static int Lpb_load(lua_State *L) {
     pb_Slice s = lpb_checkslice(L, 1);
     int r = pb_load(&LS->local, &s);
     if (r == PB_OK) global_state = &LS->local;
+    ++LS->type_version;
     lua_pushboolean(L, r == PB_OK);
     lua_pushinteger(L, pb_pos(s)+1);
     return 2;
@@ -1248,6 +1250,7 @@ static int Lpb_load_unsafe(lua_State *L) {
     if (data == NULL) lpb_typeerror(L, 1, "userdata");
     r = pb_load(&LS->local, &s);
     if (r == PB_OK) global_state = &LS->local;
+    ++LS->type_version;
     lua_pushboolean(L, r == PB_OK);
     lua_pushinteger(L, pb_pos(s)+1);
     return 2;
@@ -1274,6 +1277,7 @@ static int Lpb_loadfile(lua_State *L) {
     s = pb_result(&b);
     ret = pb_load(&LS->local, &s);
     if (ret == PB_OK) global_state = &LS->local;
+    ++LS->type_version;
     pb_resetbuffer(&b);
     lua_pushboolean(L, ret == PB_OK);
     lua_pushinteger(L, pb_pos(s)+1);
@@ -1533,6 +1537,7 @@ static int Lpb_clear(lua_State *L) {
     lpb_State *LS = lpb_lstate(L);
     pb_State *S = (pb_State*)LS->state;
     pb_Type *t;
+    ++LS->type_version;
     if (lua_isnoneornil(L, 1)) {
         pb_free(&LS->local), pb_init(&LS->local);
         luaL_unref(L, LUA_REGISTRYINDEX, LS->defs_index);
@@ -1826,10 +1831,9 @@ static void lpb_usedechooks(lua_State *L, lpb_State *LS, const pb_Type *t) {
     lua_pop(L, 2);
 }
 
-static void lpb_pushtypetable(lua_State *L, lpb_State *LS, const pb_Type *t) {
+/* fill default fields into an empty message table on the top of stack */
+static void lpb_inittypetable(lua_State *L, lpb_State *LS, const pb_Type *t) {
     int mode = LS->encode_mode;
-    luaL_checkstack(L, 5, "too many levels");
-    lpb_newmsgtable(L, t);
     switch (t->is_proto3 && mode == LPB_DEFDEF ? LPB_COPYDEF : mode) {
     case LPB_COPYDEF:
         lpb_setdeffields(L, LS, t,
@@ -1847,6 +1851,12 @@ static void lpb_pushtypetable(lua_State *L, lpb_State *LS, const pb_Type *t) {
     }
 }
 
+static void lpb_pushtypetable(lua_State *L, lpb_State *LS, const pb_Type *t) {
+    luaL_checkstack(L, 5, "too many levels");
+    lpb_newmsgtable(L, t);
+    lpb_inittypetable(L, LS, t);
+}
+
 static void lpbD_rawfield(lpb_Env *e, const pb_Field *f) {
     lua_State *L = e->L;
     pb_Slice sv, *s = e->s;
@@ -2173,6 +2183,7 @@ static int Lpb_use(lua_State *L) {
     case 0: if (GS) LS->state = GS; break;
     case 1: LS->state = &LS->local; break;
     }
+    ++LS->type_version;
     lua_pushboolean(L, GS != NULL);
     return 1;
 }
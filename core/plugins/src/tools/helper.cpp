@@ -4,6 +4,7 @@
 #include <stdlib.h>
 #include <string.h>
 #include <iostream>
+#include "thread_affinity.hpp"
 
 
 #ifdef WIN32
@@ -187,6 +188,18 @@ namespace tools
 		helper.set_function("cpu_core_num", []() { return CHelper::CpuCoreNum(); });
 		helper.set_function("mem_usage", [](bool real) { return CHelper::MemUsage(::getpid(),real); });
 		helper.set_function("pwuser", []() { return CHelper::GetCurUser(); });
+		helper.set_function("thread_placement", [](lua_State* L) {
+			int priority = 0;
+			luakit::kit_state kit_state(L);
+			auto placement = kit_state.new_table();
+			placement.set("tid", utility::thread_id());
+			placement.set("cpu", utility::current_cpu());
+			placement.set("cpus", utility::format_cpu_list(utility::get_thread_affinity()));
+			placement.set("policy", utility::get_thread_priority(priority));
+			placement.set("priority", priority);
+			placement.set("numa", utility::format_cpu_list(utility::get_thread_numa()));
+			return placement;
+			});
 		return helper;
 	}
 }
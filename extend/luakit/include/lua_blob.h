@@ -0,0 +1,91 @@
+#pragma once
+#include <string_view>
+
+#include "lua_base.h"
+
+namespace luakit {
+
+    //引用计数的不可变数据块, 在缓存和网络之间传递编码好的数据时只增加引用, 不复制内容
+    using blob_ptr = std::shared_ptr<const std::string>;
+
+    //各个模块按名字共用同一个元表
+    const char* const BLOB_META = "__lua_blob_meta__";
+
+    inline blob_ptr* lua_to_blob_ptr(lua_State* L, int idx) {
+        return (blob_ptr*)luaL_testudata(L, idx, BLOB_META);
+    }
+
+    inline int blob_gc(lua_State* L) {
+        blob_ptr* blob = lua_to_blob_ptr(L, 1);
+        if (blob) {
+            std::destroy_at(blob);
+        }
+        return 0;
+    }
+
+    inline int blob_size(lua_State* L) {
+        blob_ptr* blob = lua_to_blob_ptr(L, 1);
+        lua_pushinteger(L, (blob && *blob) ? (*blob)->size() : 0);
+        return 1;
+    }
+
+    //复制成lua字符串
+    inline int blob_string(lua_State* L) {
+        blob_ptr* blob = lua_to_blob_ptr(L, 1);
+        if (blob && *blob) {
+            lua_pushlstring(L, (*blob)->data(), (*blob)->size());
+            return 1;
+        }
+        lua_pushstring(L, "");
+        return 1;
+    }
+
+    inline void lua_push_blob(lua_State* L, blob_ptr blob) {
+        void* p = lua_newuserdatauv(L, sizeof(blob_ptr), 0);
+        new (p) blob_ptr(std::move(blob));
+        if (luaL_newmetatable(L, BLOB_META)) {
+            luaL_Reg l[] = {
+                { "size", blob_size },
+                { "string", blob_string },
+                { NULL, NULL }
+            };
+            luaL_newlib(L, l);
+            lua_setfield(L, -2, "__index");
+            lua_pushcfunction(L, blob_size);
+            lua_setfield(L, -2, "__len");
+            lua_pushcfunction(L, blob_gc);
+            lua_setfield(L, -2, "__gc");
+        }
+        lua_setmetatable(L, -2);
+    }
+
+    //数据块直接共享, lua字符串需要复制一份
+    inline blob_ptr lua_to_blob(lua_State* L, int idx) {
+        blob_ptr* blob = lua_to_blob_ptr(L, idx);
+        if (blob) {
+            return *blob;
+        }
+        if (lua_type(L, idx) == LUA_TSTRING) {
+            size_t len;
+            const char* data = lua_tolstring(L, idx, &len);
+            return std::make_shared<const std::string>(data, len);
+        }
+        return nullptr;
+    }
+
+    //只读视图, 有效期同栈上的值
+    inline bool lua_blob_view(lua_State* L, int idx, std::string_view& view) {
+        blob_ptr* blob = lua_to_blob_ptr(L, idx);
+        if (blob) {
+            view = *blob ? std::string_view(**blob) : std::string_view();
+            return true;
+        }
+        if (lua_type(L, idx) == LUA_TSTRING) {
+            size_t len;
+            const char* data = lua_tolstring(L, idx, &len);
+            view = std::string_view(data, len);
+            return true;
+        }
+        return false;
+    }
+}
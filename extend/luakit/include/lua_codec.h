@@ -4,6 +4,10 @@
 #pragma warning(disable: 4267)
 #endif
 
+#include <deque>
+#include <string_view>
+#include <unordered_map>
+
 #include "lua_buff.h"
 
 namespace luakit {
@@ -18,15 +22,234 @@ namespace luakit {
     const uint8_t type_int64        = 8;
     const uint8_t type_string       = 9;
     const uint8_t type_undefine     = 10;
-    const uint8_t type_max          = 11;
+    const uint8_t type_lstring      = 11;
+    const uint8_t type_shape_def    = 12;
+    const uint8_t type_shape        = 13;
+    const uint8_t type_dict8        = 14;
+    const uint8_t type_dict16       = 15;
+    const uint8_t type_max          = 16;
 
     const uint8_t max_encode_depth  = 16;
     const uint8_t max_uint8         = UCHAR_MAX - type_max;
 
-    int decode_one(lua_State* L, slice* slice);
-    void encode_one(lua_State* L, luabuf* buff, int idx, int depth);
+    //结构(shape): 固定键集合的表只编码值
+    //注册结构id取[1, 0x7fff], 消息内学习的结构id从0x8000开始
+    const uint8_t max_shape_keys    = 64;
+    const uint16_t max_shape_id     = 0x7fff;
+    const uint16_t local_shape_flag = 0x8000;
+    //字典只收录短字符串(同LUAI_MAXSHORTLEN), 短字符串在虚拟机内唯一
+    const size_t max_dict_len       = 40;
+
+    class codec_cache;
+    int decode_one(lua_State* L, slice* slice, codec_cache* cache = nullptr);
+    void encode_one(lua_State* L, luabuf* buff, int idx, int depth, codec_cache* cache = nullptr);
     void serialize_one(lua_State* L, luabuf* buff, int index, int depth, int line, size_t max_len);
 
+    uint64_t shape_key_hash(std::string_view key);
+
+    struct codec_shape {
+        uint16_t id = 0;
+        int keys_ref = LUA_NOREF;
+        std::vector<std::string> keys;
+        std::vector<uint64_t> hashes;
+
+        void assign(uint16_t sid, std::string_view* views, size_t count) {
+            id = sid;
+            keys.resize(count);
+            hashes.resize(count);
+            for (size_t i = 0; i < count; ++i) {
+                keys[i].assign(views[i].data(), views[i].size());
+                hashes[i] = shape_key_hash(views[i]);
+            }
+        }
+
+        //键集合一致时输出键的位置映射, 键数量少, 按哈希线性查找
+        bool match(std::string_view* views, uint64_t* vhashes, size_t count, uint8_t* order) {
+            if (count != keys.size()) return false;
+            for (size_t i = 0; i < count; ++i) {
+                size_t j = i;
+                if (hashes[j] != vhashes[i]) {
+                    for (j = 0; j < count && hashes[j] != vhashes[i]; ++j);
+                    if (j == count) return false;
+                }
+                if (keys[j] != views[i]) return false;
+                order[j] = (uint8_t)i;
+            }
+            return true;
+        }
+    };
+
+    inline uint64_t shape_key_hash(std::string_view key) {
+        uint64_t h = 0xcbf29ce484222325ull;
+        for (char c : key) {
+            h = (h ^ (uint8_t)c) * 0x100000001b3ull;
+        }
+        h ^= h >> 29;
+        return h * 0xbf58476d1ce4e5b9ull;
+    }
+
+    //编码缓存
+    //结构: 注册结构跨消息有效, 学习结构只在单条消息内有效
+    //字典: 高频短字符串编码为序号, 短字符串在虚拟机内唯一, 按指针查找
+    class codec_cache {
+    public:
+        int set_dict(lua_State* L, int index) {
+            index = lua_absindex(L, index);
+            size_t count = lua_rawlen(L, index);
+            if (count > USHRT_MAX + 1) {
+                return luaL_error(L, "dictionary too many strings");
+            }
+            lua_createtable(L, count, 0);
+            for (size_t i = 0; i < count; ++i) {
+                lua_rawgeti(L, index, i + 1);
+                if (lua_type(L, -1) != LUA_TSTRING || lua_rawlen(L, -1) > max_dict_len) {
+                    return luaL_error(L, "dictionary only support short string");
+                }
+                lua_rawseti(L, -2, i + 1);
+            }
+            luaL_unref(L, LUA_REGISTRYINDEX, m_dict_ref);
+            m_dict_ref = luaL_ref(L, LUA_REGISTRYINDEX);
+            m_dict.clear();
+            m_dict_size = count;
+            //字典表常驻注册表, 其中的字符串指针保持有效
+            lua_rawgeti(L, LUA_REGISTRYINDEX, m_dict_ref);
+            for (size_t i = 0; i < count; ++i) {
+                lua_rawgeti(L, -1, i + 1);
+                m_dict.emplace(lua_tostring(L, -1), (uint16_t)i);
+                lua_pop(L, 1);
+            }
+            lua_pop(L, 1);
+            return 0;
+        }
+
+        int dict_find(const char* str, size_t len) {
+            if (m_dict_size == 0 || len > max_dict_len) return -1;
+            auto it = m_dict.find(str);
+            return it == m_dict.end() ? -1 : it->second;
+        }
+
+        bool dict_push(lua_State* L, uint16_t idx) {
+            if (idx >= m_dict_size || m_dict_index == 0) return false;
+            lua_rawgeti(L, m_dict_index, idx + 1);
+            return true;
+        }
+
+        bool active() { return m_learn || !m_sigs.empty(); }
+        bool learning() { return m_learn; }
+        void set_learn(bool learn) { m_learn = learn; }
+
+        void begin_encode() {
+            m_nlocal = 0;
+            m_local_sigs.clear();
+        }
+
+        //解码期间字典表放在栈上, 返回占用的栈槽数
+        int begin_decode(lua_State* L) {
+            m_ndecode = 0;
+            m_dict_index = 0;
+            if (m_dict_size == 0) return 0;
+            lua_rawgeti(L, LUA_REGISTRYINDEX, m_dict_ref);
+            m_dict_index = lua_gettop(L);
+            return 1;
+        }
+
+        void end_decode(lua_State* L) {
+            if (m_dict_index > 0) {
+                lua_remove(L, m_dict_index);
+                m_dict_index = 0;
+            }
+        }
+
+        int regist(lua_State* L, uint16_t id, std::string_view* views, size_t count) {
+            if (count == 0 || count > max_shape_keys) {
+                return luaL_error(L, "shape keys out of range");
+            }
+            if (m_ids.size() <= id) {
+                m_ids.resize(id + 1);
+            }
+            auto& shape = m_ids[id];
+            if (shape) {
+                //热更新时重复注册, 替换旧结构
+                m_sigs.erase(signature(shape->keys));
+                luaL_unref(L, LUA_REGISTRYINDEX, shape->keys_ref);
+            } else {
+                shape = std::make_unique<codec_shape>();
+            }
+            shape->assign(id, views, count);
+            lua_createtable(L, count, 0);
+            for (size_t i = 0; i < count; ++i) {
+                lua_pushlstring(L, views[i].data(), views[i].size());
+                lua_rawseti(L, -2, i + 1);
+            }
+            shape->keys_ref = luaL_ref(L, LUA_REGISTRYINDEX);
+            m_sigs[signature(shape->keys)] = shape.get();
+            return 0;
+        }
+
+        codec_shape* find(uint64_t sig, std::string_view* views, uint64_t* hashes, size_t count, uint8_t* order) {
+            auto it = m_sigs.find(sig);
+            if (it != m_sigs.end() && it->second->match(views, hashes, count, order)) {
+                return it->second;
+            }
+            it = m_local_sigs.find(sig);
+            if (it != m_local_sigs.end() && it->second->match(views, hashes, count, order)) {
+                return it->second;
+            }
+            return nullptr;
+        }
+
+        codec_shape* learn(uint64_t sig, std::string_view* views, size_t count) {
+            if (m_nlocal > max_shape_id) return nullptr;
+            if (m_nlocal == m_locals.size()) {
+                m_locals.push_back(std::make_unique<codec_shape>());
+            }
+            auto shape = m_locals[m_nlocal].get();
+            shape->assign(local_shape_flag | m_nlocal++, views, count);
+            m_local_sigs[sig] = shape;
+            return shape;
+        }
+
+        codec_shape* get(uint16_t id) {
+            if (id < m_ids.size()) return m_ids[id].get();
+            return nullptr;
+        }
+
+        std::vector<std::string>& define_keys() {
+            if (m_ndecode == m_decodes.size()) {
+                m_decodes.emplace_back();
+            }
+            return m_decodes[m_ndecode++];
+        }
+
+        std::vector<std::string>* decode_keys(uint16_t id) {
+            if (id < m_ndecode) return &m_decodes[id];
+            return nullptr;
+        }
+
+    protected:
+        uint64_t signature(std::vector<std::string>& keys) {
+            uint64_t sig = keys.size();
+            for (auto& key : keys) {
+                sig += shape_key_hash(key);
+            }
+            return sig;
+        }
+
+    protected:
+        bool m_learn = false;
+        int m_dict_ref = LUA_NOREF;
+        int m_dict_index = 0;
+        size_t m_dict_size = 0;
+        size_t m_nlocal = 0;
+        size_t m_ndecode = 0;
+        std::vector<std::unique_ptr<codec_shape>> m_ids;
+        std::vector<std::unique_ptr<codec_shape>> m_locals;
+        std::deque<std::vector<std::string>> m_decodes;
+        std::unordered_map<uint64_t, codec_shape*> m_sigs;
+        std::unordered_map<uint64_t, codec_shape*> m_local_sigs;
+        std::unordered_map<const char*, uint16_t> m_dict;
+    };
+
     template<typename T>
     void value_encode(luabuf* buff, T data) {
         buff->push_data((const uint8_t*)&data, sizeof(T));
@@ -45,20 +268,52 @@ namespace luakit {
         return *value;
     }
 
-    inline void string_encode(lua_State* L, luabuf* buff, int index) {
+    inline void string_encode(lua_State* L, luabuf* buff, int index, codec_cache* cache = nullptr) {
         size_t sz = 0;
         const char* ptr = lua_tolstring(L, index, &sz);
-        if (sz > USHRT_MAX) {
+        if (cache) {
+            int idx = cache->dict_find(ptr, sz);
+            if (idx >= 0) {
+                if (idx <= UCHAR_MAX) {
+                    value_encode(buff, type_dict8);
+                    value_encode<uint8_t>(buff, idx);
+                } else {
+                    value_encode(buff, type_dict16);
+                    value_encode<uint16_t>(buff, idx);
+                }
+                return;
+            }
+        }
+        if (sz > UINT_MAX) {
             luaL_error(L, "encode can't pack too long string");
             return;
         }
-        value_encode(buff, type_string);
-        value_encode<uint16_t>(buff, sz);
+        if (sz > USHRT_MAX) {
+            value_encode(buff, type_lstring);
+            value_encode<uint32_t>(buff, sz);
+        } else {
+            value_encode(buff, type_string);
+            value_encode<uint16_t>(buff, sz);
+        }
         if (sz > 0) {
             value_encode(buff, ptr, sz);
         }
     }
 
+    //字符串的类型和长度头, 内容由调用者另外发送, 返回头部长度
+    inline size_t string_head_encode(uint8_t* head, size_t sz) {
+        if (sz > USHRT_MAX) {
+            uint32_t len = (uint32_t)sz;
+            head[0] = type_lstring;
+            memcpy(head + 1, &len, sizeof(len));
+            return 1 + sizeof(len);
+        }
+        uint16_t len = (uint16_t)sz;
+        head[0] = type_string;
+        memcpy(head + 1, &len, sizeof(len));
+        return 1 + sizeof(len);
+    }
+
     inline void integer_encode(luabuf* buff, int64_t integer) {
         if (integer >= 0 && integer <= max_uint8) {
             integer += type_max;
@@ -84,29 +339,94 @@ namespace luakit {
         value_encode(buff, number);
     }
 
-    inline void table_encode(lua_State* L, luabuf* buff, int index, int depth) {
+    //字符串键的表按结构编码, 键值对暂存在栈上只迭代一次
+    inline bool shape_encode(lua_State* L, luabuf* buff, int index, int depth, codec_cache* cache) {
+        std::string_view keys[max_shape_keys];
+        uint64_t hashes[max_shape_keys];
+        uint8_t order[max_shape_keys];
+        int top = lua_gettop(L);
+        uint64_t sig = 0;
+        size_t count = 0;
+        lua_checkstack(L, max_shape_keys * 2 + 4);
+        lua_pushnil(L);
+        while (lua_next(L, index) != 0) {
+            if (count == max_shape_keys || lua_type(L, -2) != LUA_TSTRING) {
+                lua_settop(L, top);
+                return false;
+            }
+            size_t len;
+            const char* key = lua_tolstring(L, -2, &len);
+            if (len > UCHAR_MAX) {
+                lua_settop(L, top);
+                return false;
+            }
+            keys[count] = std::string_view(key, len);
+            hashes[count] = shape_key_hash(keys[count]);
+            sig += hashes[count++];
+            lua_pushvalue(L, -2);
+        }
+        if (count == 0) {
+            return false;
+        }
+        //栈上依次为键值对: 第i个值位于top + 2 * i + 2
+        sig += count;
+        codec_shape* shape = cache->find(sig, keys, hashes, count, order);
+        if (shape) {
+            value_encode(buff, type_shape);
+            value_encode<uint16_t>(buff, shape->id);
+        } else if (cache->learning() && (shape = cache->learn(sig, keys, count))) {
+            value_encode(buff, type_shape_def);
+            value_encode<uint8_t>(buff, count);
+            for (size_t i = 0; i < count; ++i) {
+                value_encode<uint8_t>(buff, keys[i].size());
+                value_encode(buff, keys[i].data(), keys[i].size());
+                order[i] = i;
+            }
+        } else {
+            value_encode(buff, type_tab_head);
+            for (size_t i = 0; i < count; ++i) {
+                encode_one(L, buff, top + 2 * i + 1, depth, cache);
+                encode_one(L, buff, top + 2 * i + 2, depth, cache);
+            }
+            value_encode(buff, type_tab_tail);
+            lua_settop(L, top);
+            return true;
+        }
+        for (size_t i = 0; i < count; ++i) {
+            encode_one(L, buff, top + 2 * order[i] + 2, depth, cache);
+        }
+        lua_settop(L, top);
+        return true;
+    }
+
+    inline void table_encode(lua_State* L, luabuf* buff, int index, int depth, codec_cache* cache) {
         index = lua_absindex(L, index);
+        if (cache && cache->active() && lua_rawlen(L, index) == 0) {
+            if (shape_encode(L, buff, index, depth, cache)) {
+                return;
+            }
+        }
         value_encode(buff, type_tab_head);
         if (is_lua_array(L, index)) {
             int rawlen = lua_rawlen(L, index);
             for (int i = 1; i <= rawlen; ++i) {
                 lua_rawgeti(L, index, i);
                 integer_encode(buff, i);
-                encode_one(L, buff, -1, depth);
+                encode_one(L, buff, -1, depth, cache);
                 lua_pop(L, 1);
             }
         } else {
             lua_pushnil(L);
             while (lua_next(L, index) != 0) {
-                encode_one(L, buff, -2, depth);
-                encode_one(L, buff, -1, depth);
+                encode_one(L, buff, -2, depth, cache);
+                encode_one(L, buff, -1, depth, cache);
                 lua_pop(L, 1);
             }
         }
         value_encode(buff, type_tab_tail);
     }
 
-    inline void encode_one(lua_State* L, luabuf* buff, int idx, int depth) {
+    inline void encode_one(lua_State* L, luabuf* buff, int idx, int depth, codec_cache* cache) {
         if (depth > max_encode_depth) {
             luaL_error(L, "encode can't pack too depth table");
         }
@@ -116,10 +436,10 @@ namespace luakit {
             value_encode(buff, type_nil);
             break;
         case LUA_TSTRING:
-            string_encode(L, buff, idx);
+            string_encode(L, buff, idx, cache);
             break;
         case LUA_TTABLE:
-            table_encode(L, buff, idx, depth + 1);
+            table_encode(L, buff, idx, depth + 1, cache);
             break;
         case LUA_TBOOLEAN:
             lua_toboolean(L, idx) ? value_encode(buff, type_true) : value_encode(buff, type_false);
@@ -133,52 +453,131 @@ namespace luakit {
         }
     }
 
-    inline slice* encode_slice(lua_State* L, luabuf* buff) {
+    inline slice* encode_slice(lua_State* L, luabuf* buff, codec_cache* cache = nullptr) {
         buff->clean();
         int n = lua_gettop(L);
         if (n > UCHAR_MAX) {
             luaL_error(L, "encode can't pack too many args");
         }
+        if (cache) {
+            cache->begin_encode();
+        }
         buff->write<uint8_t>(n);
         for (int i = 1; i <= n; i++) {
-            encode_one(L, buff, i, 0);
+            encode_one(L, buff, i, 0, cache);
         }
         return buff->get_slice();
     }
 
-    inline int encode(lua_State* L, luabuf* buff) {
+    inline int encode(lua_State* L, luabuf* buff, codec_cache* cache = nullptr) {
         size_t data_len = 0;
-        slice* slice = encode_slice(L, buff);
+        slice* slice = encode_slice(L, buff, cache);
         const char* data = (const char*)slice->data(&data_len);
         lua_pushlstring(L, data, data_len);
         return 1;
     }
 
-    inline void string_decode(lua_State* L, uint16_t sz, slice* slice) {
+    inline void string_decode(lua_State* L, uint32_t sz, slice* slice) {
         if (sz == 0) {
             lua_pushstring(L, "");
             return;
         }
         auto str = (const char*)slice->peek(sz);
-        if (str == nullptr || sz > USHRT_MAX) {
+        if (str == nullptr) {
             throw lua_exception("decode string is out of range");
         }
         slice->erase(sz);
         lua_pushlstring(L, str, sz);
     }
 
-    inline void table_decode(lua_State* L, slice* slice) {
+    inline void table_decode(lua_State* L, slice* slice, codec_cache* cache) {
         lua_createtable(L, 0, 8);
         do {
-            if (decode_one(L, slice) == type_tab_tail) {
+            if (decode_one(L, slice, cache) == type_tab_tail) {
                 break;
             }
-            decode_one(L, slice);
+            decode_one(L, slice, cache);
             lua_rawset(L, -3);
         } while (1);
     }
 
-    inline void decode_value(lua_State* L, slice* slice, uint8_t type) {
+    //结构字段值必须恰好解出一个, 否则rawset会写坏键名表
+    inline void shape_value(lua_State* L, slice* slice, codec_cache* cache) {
+        int top = lua_gettop(L);
+        decode_one(L, slice, cache);
+        if (lua_gettop(L) != top + 1) {
+            throw lua_exception("decode shape value failed");
+        }
+    }
+
+    //消息内定义的结构, 键名随定义下发
+    inline void shape_def_decode(lua_State* L, slice* slice, codec_cache* cache) {
+        if (!cache) {
+            throw lua_exception("decode shape without shape cache");
+        }
+        uint8_t count = value_decode<uint8_t>(L, slice);
+        auto& keys = cache->define_keys();
+        keys.resize(count);
+        for (uint8_t i = 0; i < count; ++i) {
+            uint8_t len = value_decode<uint8_t>(L, slice);
+            auto key = (const char*)slice->peek(len);
+            if (key == nullptr) {
+                throw lua_exception("decode shape key is out of range");
+            }
+            slice->erase(len);
+            keys[i].assign(key, len);
+        }
+        lua_createtable(L, 0, count);
+        for (uint8_t i = 0; i < count; ++i) {
+            lua_pushlstring(L, keys[i].data(), keys[i].size());
+            shape_value(L, slice, cache);
+            lua_rawset(L, -3);
+        }
+    }
+
+    inline void shape_decode(lua_State* L, slice* slice, codec_cache* cache) {
+        uint16_t id = value_decode<uint16_t>(L, slice);
+        if (!cache) {
+            throw lua_exception("decode shape without shape cache");
+        }
+        if (id & local_shape_flag) {
+            auto keys = cache->decode_keys(id & ~local_shape_flag);
+            if (!keys) {
+                throw lua_exception("decode unknown local shape %d", id & ~local_shape_flag);
+            }
+            size_t count = keys->size();
+            lua_createtable(L, 0, count);
+            for (size_t i = 0; i < count; ++i) {
+                auto& key = (*keys)[i];
+                lua_pushlstring(L, key.data(), key.size());
+                shape_value(L, slice, cache);
+                lua_rawset(L, -3);
+            }
+            return;
+        }
+        codec_shape* shape = cache->get(id);
+        if (!shape) {
+            throw lua_exception("decode unknown shape %d", id);
+        }
+        //注册结构的键名缓存在注册表, 直接复用lua字符串
+        size_t count = shape->keys.size();
+        lua_rawgeti(L, LUA_REGISTRYINDEX, shape->keys_ref);
+        lua_createtable(L, 0, count);
+        for (size_t i = 0; i < count; ++i) {
+            lua_rawgeti(L, -2, i + 1);
+            shape_value(L, slice, cache);
+            lua_rawset(L, -3);
+        }
+        lua_remove(L, -2);
+    }
+
+    inline void dict_decode(lua_State* L, uint16_t idx, codec_cache* cache) {
+        if (!cache || !cache->dict_push(L, idx)) {
+            throw lua_exception("decode unknown dictionary string %d", idx);
+        }
+    }
+
+    inline void decode_value(lua_State* L, slice* slice, uint8_t type, codec_cache* cache = nullptr) {
         switch (type) {
         case type_nil:
             lua_pushnil(L);
@@ -195,8 +594,23 @@ namespace luakit {
         case type_string:
             string_decode(L, value_decode<uint16_t>(L, slice), slice);
             break;
+        case type_lstring:
+            string_decode(L, value_decode<uint32_t>(L, slice), slice);
+            break;
         case type_tab_head:
-            table_decode(L, slice);
+            table_decode(L, slice, cache);
+            break;
+        case type_shape_def:
+            shape_def_decode(L, slice, cache);
+            break;
+        case type_shape:
+            shape_decode(L, slice, cache);
+            break;
+        case type_dict8:
+            dict_decode(L, value_decode<uint8_t>(L, slice), cache);
+            break;
+        case type_dict16:
+            dict_decode(L, value_decode<uint16_t>(L, slice), cache);
             break;
         case type_tab_tail:
             break;
@@ -218,23 +632,29 @@ namespace luakit {
         }
     }
 
-    inline int decode_one(lua_State* L, slice* slice) {
+    inline int decode_one(lua_State* L, slice* slice, codec_cache* cache) {
         uint8_t type = value_decode<uint8_t>(L, slice);
-        decode_value(L, slice, type);
+        decode_value(L, slice, type, cache);
         return type;
     }
 
-    inline int decode_slice(lua_State* L, slice* slice) {
+    inline int decode_slice(lua_State* L, slice* slice, codec_cache* cache = nullptr) {
         int top = lua_gettop(L);
         try {
+            if (cache) {
+                top += cache->begin_decode(L);
+            }
             uint8_t argnum = value_decode<uint8_t>(L, slice);
             lua_checkstack(L, argnum);
             while (1) {
                 uint8_t* type = slice->read();
                 if (type == nullptr) break;
-                decode_value(L, slice, *type);
+                decode_value(L, slice, *type, cache);
             }
             int getnum = lua_gettop(L) - top;
+            if (cache) {
+                cache->end_decode(L);
+            }
             if (argnum != getnum) {
                 throw lua_exception("decode arg num expect %d, but get %d", argnum, getnum);
             }
@@ -245,12 +665,12 @@ namespace luakit {
         return 0;
     }
 
-    inline int decode(lua_State* L, luabuf* buff) {
+    inline int decode(lua_State* L, luabuf* buff, codec_cache* cache = nullptr) {
         buff->clean();
         size_t data_len = 0;
         const char* buf = lua_tolstring(L, 1, &data_len);
         buff->push_data((uint8_t*)buf, data_len);
-        return decode_slice(L, buff->get_slice());
+        return decode_slice(L, buff->get_slice(), cache);
     }
 
     inline void serialize_value(luabuf* buff, const char* str) {
@@ -468,6 +888,8 @@ namespace luakit {
 
     class luacodec : public codec_base {
     public:
+        void set_cache(codec_cache* cache) { m_cache = cache; }
+
         virtual int load_packet(size_t data_len) {
             if (!m_slice) return 0;
             uint32_t* packet_len = (uint32_t*)m_slice->peek(sizeof(uint32_t));
@@ -485,9 +907,12 @@ namespace luakit {
             if (n > UCHAR_MAX) {
                 luaL_error(L, "encode can't pack too many args");
             }
+            if (m_cache) {
+                m_cache->begin_encode();
+            }
             m_buf->write<uint8_t>(n - index + 1);
             for (int i = index; i <= n; i++) {
-                encode_one(L, m_buf, i, 0);
+                encode_one(L, m_buf, i, 0, m_cache);
             }
             return m_buf->data(len);
         }
@@ -495,19 +920,28 @@ namespace luakit {
         virtual size_t decode(lua_State* L) {
             if (!m_slice) return 0;
             int top = lua_gettop(L);
+            if (m_cache) {
+                top += m_cache->begin_decode(L);
+            }
             uint8_t argnum = value_decode<uint8_t>(L, m_slice);
             lua_checkstack(L, argnum);
             while (1) {
                 uint8_t* type = m_slice->read();
                 if (type == nullptr) break;
-                decode_value(L, m_slice, *type);
+                decode_value(L, m_slice, *type, m_cache);
             }
             int getnum = lua_gettop(L) - top;
+            if (m_cache) {
+                m_cache->end_decode(L);
+            }
             if (argnum != getnum) {
                 throw lua_exception("decode arg num expect %d, but get %d", argnum, getnum);
             }
             m_slice = nullptr;
             return getnum;
         }
+
+    protected:
+        codec_cache* m_cache = nullptr;
     };
 }
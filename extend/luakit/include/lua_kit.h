@@ -1,5 +1,6 @@
 #pragma once
 #include "lua_buff.h"
+#include "lua_blob.h"
 #include "lua_time.h"
 #include "lua_codec.h"
 #include "lua_table.h"
@@ -25,8 +26,17 @@ namespace luakit {
             m_buf = new luabuf();
             lua_checkstack(m_L, 1024);
             lua_table luakit = new_table("luakit");
-            luakit.set_function("encode", [&](lua_State* L) { return encode(L, m_buf); });
-            luakit.set_function("decode", [&](lua_State* L) { return decode(L, m_buf); });
+            luakit.set_function("encode", [&](lua_State* L) { return encode(L, m_buf, &m_cache); });
+            luakit.set_function("decode", [&](lua_State* L) { return decode(L, m_buf, &m_cache); });
+            luakit.set_function("shape", [&](lua_State* L) { return regist_shape(L); });
+            luakit.set_function("dictionary", [&](lua_State* L) {
+                luaL_checktype(L, 1, LUA_TTABLE);
+                return m_cache.set_dict(L, 1);
+            });
+            luakit.set_function("shape_learn", [&](lua_State* L) {
+                m_cache.set_learn(lua_toboolean(L, 1));
+                return 0;
+            });
             luakit.set_function("unserialize", [&](lua_State* L) {  return unserialize(L); });
             luakit.set_function("serialize", [&](lua_State* L) { return serialize(L, m_buf); });
         }
@@ -43,6 +53,7 @@ namespace luakit {
                 if (!m_buf) m_buf = new luabuf();
                 m_codec = new luacodec();
                 m_codec->set_buff(m_buf);
+                m_codec->set_cache(&m_cache);
             }
             return m_codec;
         }
@@ -233,9 +244,55 @@ namespace luakit {
             lua_pop(m_L, 1);
         }
 
+    protected:
+        //luakit.shape(id, { key1, key2, ... }): 注册消息结构, 收发双方需注册一致
+        int regist_shape(lua_State* L) {
+            lua_Integer id = luaL_checkinteger(L, 1);
+            luaL_checktype(L, 2, LUA_TTABLE);
+            if (id <= 0 || id > max_shape_id) {
+                return luaL_error(L, "shape id out of range");
+            }
+            size_t count = lua_rawlen(L, 2);
+            if (count == 0 || count > max_shape_keys) {
+                return luaL_error(L, "shape keys out of range");
+            }
+            //先全部校验再拷贝, 出错时不会跨过std::string析构
+            for (size_t i = 0; i < count; ++i) {
+                if (lua_rawgeti(L, 2, i + 1) != LUA_TSTRING) {
+                    return luaL_error(L, "shape key #%d must be a string", (int)(i + 1));
+                }
+                size_t len;
+                const char* key = lua_tolstring(L, -1, &len);
+                if (len > UCHAR_MAX) {
+                    return luaL_error(L, "shape key too long");
+                }
+                for (size_t j = 0; j < i; ++j) {
+                    lua_rawgeti(L, 2, j + 1);
+                    bool same = lua_rawequal(L, -1, -2);
+                    lua_pop(L, 1);
+                    if (same) {
+                        return luaL_error(L, "shape key '%s' duplicated", key);
+                    }
+                }
+                lua_pop(L, 1);
+            }
+            std::string names[max_shape_keys];
+            std::string_view keys[max_shape_keys];
+            for (size_t i = 0; i < count; ++i) {
+                lua_rawgeti(L, 2, i + 1);
+                size_t len;
+                const char* key = lua_tolstring(L, -1, &len);
+                names[i].assign(key, len);
+                keys[i] = names[i];
+                lua_pop(L, 1);
+            }
+            return m_cache.regist(L, (uint16_t)id, keys, count);
+        }
+
     protected:
         luabuf* m_buf = nullptr; 
         luacodec* m_codec = nullptr;
+        codec_cache m_cache;
         lua_State* m_L = nullptr;
     };
 
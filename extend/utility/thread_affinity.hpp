@@ -0,0 +1,225 @@
+#pragma once
+
+#include <string> //std::string
+#include <vector> //std::vector
+#include <thread> //std::thread::hardware_concurrency
+#include <cstdlib> //std::strtol
+#include <string_view> //std::string_view
+
+#ifdef WIN32
+#include "windows.h" //SetThreadAffinityMask()
+#else
+#include <sched.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#endif
+
+namespace utility
+{
+	//numa内存策略(linux/mempolicy.h)
+	constexpr int MPOL_DEFAULT_MODE = 0;
+	constexpr int MPOL_BIND_MODE = 2;
+	constexpr int MAX_NUMA_NODE = 256;
+	constexpr int NODE_WORD_BITS = sizeof(unsigned long) * 8;
+
+	//cpu个数
+	inline int cpu_count()
+	{
+#ifdef WIN32
+		return (int)std::thread::hardware_concurrency();
+#else
+		long count = sysconf(_SC_NPROCESSORS_CONF);
+		return count > 0 ? (int)count : (int)std::thread::hardware_concurrency();
+#endif
+	}
+
+	//解析cpu/node列表, 格式: "0-3,8,10-11", 编号必须小于limit, 区间不能倒序
+	inline std::vector<int> parse_cpu_list(std::string_view spec, int limit)
+	{
+		std::vector<int> cpus;
+		std::string str(spec);
+		const char* p = str.c_str();
+		while (*p) {
+			char* end = nullptr;
+			long first = std::strtol(p, &end, 10);
+			if (end == p || first < 0 || first >= limit) return {};
+			long last = first;
+			p = end;
+			if (*p == '-') {
+				last = std::strtol(++p, &end, 10);
+				if (end == p || last < first || last >= limit) return {};
+				p = end;
+			}
+			for (long i = first; i <= last; ++i) {
+				cpus.push_back((int)i);
+			}
+			if (*p == ',') ++p;
+			else if (*p) return {};
+		}
+		return cpus;
+	}
+
+	//cpu/node列表格式化, 连续的编号合并为区间
+	inline std::string format_cpu_list(const std::vector<int>& cpus)
+	{
+		std::string str;
+		size_t i = 0;
+		while (i < cpus.size()) {
+			size_t j = i;
+			while (j + 1 < cpus.size() && cpus[j + 1] == cpus[j] + 1) ++j;
+			if (!str.empty()) str.append(",");
+			str.append(std::to_string(cpus[i]));
+			if (j > i) str.append("-").append(std::to_string(cpus[j]));
+			i = j + 1;
+		}
+		return str;
+	}
+
+	//当前线程id
+	inline long thread_id()
+	{
+#ifdef WIN32
+		return (long)GetCurrentThreadId();
+#else
+		return (long)syscall(SYS_gettid);
+#endif
+	}
+
+	//当前线程运行的cpu
+	inline int current_cpu()
+	{
+#ifdef WIN32
+		return (int)GetCurrentProcessorNumber();
+#else
+		return sched_getcpu();
+#endif
+	}
+
+	//绑定当前线程到指定cpu列表
+	inline bool set_thread_affinity(std::string_view spec)
+	{
+		auto cpus = parse_cpu_list(spec, cpu_count());
+		if (cpus.empty()) return false;
+#ifdef WIN32
+		DWORD_PTR mask = 0;
+		for (int cpu : cpus) {
+			if (cpu >= (int)sizeof(DWORD_PTR) * 8) return false;
+			mask |= (DWORD_PTR)1 << cpu;
+		}
+		return SetThreadAffinityMask(GetCurrentThread(), mask) != 0;
+#else
+		cpu_set_t cpuset;
+		CPU_ZERO(&cpuset);
+		for (int cpu : cpus) {
+			if (cpu >= CPU_SETSIZE) return false;
+			CPU_SET(cpu, &cpuset);
+		}
+		return pthread_setaffinity_np(pthread_self(), sizeof(cpuset), &cpuset) == 0;
+#endif
+	}
+
+	//当前线程可运行的cpu列表
+	inline std::vector<int> get_thread_affinity()
+	{
+		std::vector<int> cpus;
+#ifndef WIN32
+		cpu_set_t cpuset;
+		CPU_ZERO(&cpuset);
+		if (pthread_getaffinity_np(pthread_self(), sizeof(cpuset), &cpuset) == 0) {
+			for (int cpu = 0; cpu < CPU_SETSIZE; ++cpu) {
+				if (CPU_ISSET(cpu, &cpuset)) cpus.push_back(cpu);
+			}
+		}
+#endif
+		return cpus;
+	}
+
+	//设置当前线程优先级
+	//nice值: "-20" ~ "19"; 实时调度: "fifo:N"/"rr:N", N为1~99
+	inline bool set_thread_priority(std::string_view spec)
+	{
+		int policy = -1;
+		if (spec.substr(0, 5) == "fifo:") {
+			policy = 1;
+			spec.remove_prefix(5);
+		} else if (spec.substr(0, 3) == "rr:") {
+			policy = 2;
+			spec.remove_prefix(3);
+		}
+		std::string str(spec);
+		char* end = nullptr;
+		long value = std::strtol(str.c_str(), &end, 10);
+		if (str.empty() || *end) return false;
+#ifdef WIN32
+		int prio = THREAD_PRIORITY_NORMAL;
+		if (policy > 0) prio = THREAD_PRIORITY_TIME_CRITICAL;
+		else if (value <= -10) prio = THREAD_PRIORITY_HIGHEST;
+		else if (value < 0) prio = THREAD_PRIORITY_ABOVE_NORMAL;
+		else if (value >= 10) prio = THREAD_PRIORITY_LOWEST;
+		else if (value > 0) prio = THREAD_PRIORITY_BELOW_NORMAL;
+		return SetThreadPriority(GetCurrentThread(), prio) != 0;
+#else
+		if (policy > 0) {
+			sched_param param = {};
+			param.sched_priority = (int)value;
+			return pthread_setschedparam(pthread_self(), policy == 1 ? SCHED_FIFO : SCHED_RR, &param) == 0;
+		}
+		//linux下nice值按线程生效
+		return setpriority(PRIO_PROCESS, (id_t)thread_id(), (int)value) == 0;
+#endif
+	}
+
+	//当前线程调度策略和优先级
+	inline std::string get_thread_priority(int& priority)
+	{
+#ifdef WIN32
+		priority = GetThreadPriority(GetCurrentThread());
+		return "other";
+#else
+		int policy = 0;
+		sched_param param = {};
+		pthread_getschedparam(pthread_self(), &policy, &param);
+		if (policy == SCHED_FIFO || policy == SCHED_RR) {
+			priority = param.sched_priority;
+			return policy == SCHED_FIFO ? "fifo" : "rr";
+		}
+		priority = getpriority(PRIO_PROCESS, (id_t)thread_id());
+		return "other";
+#endif
+	}
+
+	//绑定当前线程的内存分配到指定numa节点
+	inline bool set_thread_numa(std::string_view spec)
+	{
+#if defined(__linux) && defined(SYS_set_mempolicy)
+		auto nodes = parse_cpu_list(spec, MAX_NUMA_NODE);
+		if (nodes.empty()) return false;
+		unsigned long nodemask[MAX_NUMA_NODE / NODE_WORD_BITS] = {};
+		for (int node : nodes) {
+			if (node >= MAX_NUMA_NODE) return false;
+			nodemask[node / NODE_WORD_BITS] |= 1UL << (node % NODE_WORD_BITS);
+		}
+		return syscall(SYS_set_mempolicy, MPOL_BIND_MODE, nodemask, MAX_NUMA_NODE + 1) == 0;
+#else
+		return false;
+#endif
+	}
+
+	//当前线程绑定的numa节点, 未绑定返回空
+	inline std::vector<int> get_thread_numa()
+	{
+		std::vector<int> nodes;
+#if defined(__linux) && defined(SYS_get_mempolicy)
+		int mode = MPOL_DEFAULT_MODE;
+		unsigned long nodemask[MAX_NUMA_NODE / NODE_WORD_BITS] = {};
+		if (syscall(SYS_get_mempolicy, &mode, nodemask, MAX_NUMA_NODE + 1, nullptr, 0) == 0 && mode != MPOL_DEFAULT_MODE) {
+			for (int node = 0; node < MAX_NUMA_NODE; ++node) {
+				if (nodemask[node / NODE_WORD_BITS] & (1UL << (node % NODE_WORD_BITS))) nodes.push_back(node);
+			}
+		}
+#endif
+		return nodes;
+	}
+}
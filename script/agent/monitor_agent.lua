@@ -1,5 +1,6 @@
 --monitor_agent.lua
 local RpcClient     = import("network/rpc_client.lua")
+local lhelper       = require("lhelper")
 local tunpack       = table.unpack
 local env_addr      = environ.addr
 local log_err       = logger.err
@@ -48,6 +49,8 @@ function MonitorAgent:__init()
     event_mgr:add_listener(self, "rpc_count_lua_obj")
     event_mgr:add_listener(self, "rpc_set_gc_step")
     event_mgr:add_listener(self, "rpc_check_endless_loop")
+    event_mgr:add_listener(self, "rpc_thread_placement")
+    event_mgr:add_listener(self, "rpc_frame_perf")
 
     event_mgr:add_trigger(self, "on_router_connected")
 
@@ -271,6 +274,19 @@ function MonitorAgent:rpc_check_endless_loop(start)
     return { code = 0, msg = "ok", start = start }
 end
 
+--线程绑核/优先级/numa分布
+function MonitorAgent:rpc_thread_placement()
+    local adata   = hive.scheduler:collect("rpc_thread_placement")
+    adata["hive"] = lhelper.thread_placement()
+    return adata
+end
+
+function MonitorAgent:rpc_frame_perf()
+    local adata   = hive.scheduler:collect("rpc_frame_perf")
+    adata["hive"] = hive.perf_stats(false)
+    return adata
+end
+
 hive.monitor = MonitorAgent()
 
 return MonitorAgent
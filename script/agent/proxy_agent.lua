@@ -1,6 +1,8 @@
 local sformat    = string.format
 local log_warn   = logger.warn
 local scheduler  = hive.load("scheduler")
+local event_mgr  = hive.get("event_mgr")
+local update_mgr = hive.get("update_mgr")
 
 local thread     = import("feature/worker_agent.lua")
 local ProxyAgent = singleton(thread)
@@ -20,6 +22,10 @@ function ProxyAgent:__init()
             log_warn("[ProxyAgent:__init] open statis !!!,it will degrade performance")
         end
     end
+    --帧耗时上报(各线程)
+    if environ.status("HIVE_STATIS") then
+        update_mgr:attach_minute(self)
+    end
     --添加忽略的rpc统计事件
     self:ignore_statis("rpc_heartbeat")
     self:ignore_statis("on_heartbeat")
@@ -59,6 +65,16 @@ function ProxyAgent:http_del(url, querys, headers, timeout, debug)
     return self:call("rpc_http_del", url, querys, headers, timeout, debug)
 end
 
+--每分钟上报本线程帧耗时分布
+function ProxyAgent:on_minute()
+    local stats = hive.perf_stats(true)
+    if hive.title == self.service then
+        event_mgr:notify_listener("on_frame_perf", hive.title, stats)
+        return
+    end
+    self:send("on_frame_perf", hive.title, stats)
+end
+
 function ProxyAgent:ignore_statis(name)
     self.ignore_statistics[name] = true
 end
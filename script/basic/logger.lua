@@ -31,12 +31,15 @@ function logger.init()
     local rolltype            = environ.number("HIVE_LOG_ROLL", 0)
     local log_size            = environ.number("HIVE_LOG_SIZE", 50 * 1024 * 1024)
     local maxdays             = environ.number("HIVE_LOG_DAYS", 7)
+    local fsync_ms            = environ.number("HIVE_LOG_FSYNC", 0)
     log_func                  = environ.status("HIVE_LOG_FUNC")
     log_lvl                   = environ.number("HIVE_LOG_LVL", 1)
     local wlvl                = environ.number("HIVE_WEBHOOK_LVL", LOG_LEVEL.ERROR)
 
     log.set_max_logsize(log_size)
     log.set_clean_time(maxdays * 24 * 3600)
+    log.set_fsync_time(fsync_ms)
+    log.set_compress(environ.status("HIVE_LOG_ZIP"))
     log.option(path, service_name, index, rolltype, wlvl);
     --设置日志过滤
     logger.filter(log_lvl)
@@ -83,6 +83,13 @@ PeriodTime.WEEK_S                = 604800    --1周（s）
 PeriodTime.HOUR_M                = 60        --1小时(m)
 PeriodTime.DAY_30_S              = 2592000   --30天(秒)
 
+--帧耗时阶段(对应core/hive frame_phase)
+local FramePhase                 = enum("FramePhase", 0)
+FramePhase.SCHEDULER             = 0     --线程消息调度
+FramePhase.IO                    = 1     --网络IO
+FramePhase.TIMER                 = 2     --定时器派发
+FramePhase.UPDATE                = 3     --逻辑更新
+
 --数据加载状态
 local DBLoading                  = enum("DBLoading", 0)
 DBLoading.INIT                   = 0
@@ -20,6 +20,7 @@ local lmd5         = crypt.md5
 local lsha1        = crypt.sha1
 local bsonpairs    = bson.pairs
 local bint64       = bson.int64
+local mongocodec   = bson.mongocodec
 local lrandomkey   = crypt.randomkey
 local lb64encode   = crypt.b64_encode
 local lb64decode   = crypt.b64_decode
@@ -39,6 +40,9 @@ local SECOND_10_MS = hive.enum("PeriodTime", "SECOND_10_MS")
 local DB_TIMEOUT   = hive.enum("NetwkTime", "DB_CALL_TIMEOUT")
 local POOL_COUNT   = environ.number("HIVE_DB_POOL_COUNT", 3)
 
+--支持的压缩算法, 对应codec中的compressor id
+local COMPRESSORS  = { snappy = 1 }
+
 local MongoDB      = class()
 local prop         = property(MongoDB)
 prop:reader("name", "")         --dbname
@@ -52,6 +56,7 @@ prop:reader("sessions", {})     --sessions
 prop:reader("readpref", { mode = "primary" })    --readPreference
 prop:reader("auth_source", "admin") --authSource
 prop:reader("alives", {})           --alives
+prop:reader("compressors", nil)     --compressors
 prop:reader("req_counter", nil)
 prop:reader("res_counter", nil)
 
@@ -74,10 +79,10 @@ function MongoDB:__release()
 end
 
 function MongoDB:close()
-    for sock in pairs(self.alives) do
+    for _, sock in pairs(self.alives) do
         sock:close()
     end
-    for sock in pairs(self.connections) do
+    for _, sock in pairs(self.connections) do
         sock:close()
     end
     timer_mgr:unregister(self.timer_id)
@@ -121,6 +126,15 @@ function MongoDB:set_options(opts)
             self.readpref = { mode = value }
         elseif key == "authSource" then
             self.auth_source = value
+        elseif key == "compressors" then
+            self.compressors = {}
+            for name in sgmatch(value, "[^,]+") do
+                if COMPRESSORS[name] then
+                    tinsert(self.compressors, name)
+                else
+                    log_warn("[MongoDB][set_options] compressor {} not supported!", name)
+                end
+            end
         end
     end
 end
@@ -161,6 +175,7 @@ function MongoDB:login(socket)
         return false
     end
     socket:set_codec(self.codec)
+    local compressor = self:negotiate(socket)
     if #self.user > 1 and #self.passwd > 1 then
         local aok, aerr = self:auth(socket, self.user, self.passwd)
         if not aok then
@@ -170,12 +185,27 @@ function MongoDB:login(socket)
             return false
         end
     end
+    --认证完成后再启用压缩
+    if compressor then
+        socket:set_codec(mongocodec(COMPRESSORS[compressor]))
+    end
     self.connections[id] = nil
     tinsert(self.alives, socket)
     log_info("[MongoDB][login] connect db({}:{}:{}:{}) success!", ip, port, self.name, id)
     return true, SUCCESS
 end
 
+--握手协商压缩算法, 返回服务器选中的算法
+function MongoDB:negotiate(socket)
+    if not self.compressors or #self.compressors == 0 then
+        return
+    end
+    local ok, doc = self:adminCommand(socket, "isMaster", 1, "compression", self.compressors)
+    if ok and doc.compression then
+        return doc.compression[1]
+    end
+end
+
 function MongoDB:salt_password(password, salt, iter)
     if self.salted_pass then
         return self.salted_pass
@@ -291,18 +321,26 @@ function MongoDB:on_socket_recv(sock, session_id, result)
     end
 end
 
-function MongoDB:op_msg(sock, session_id, cmd, ...)
+--lazy: 回复以bson惰性文档返回, 字段访问时才解码
+function MongoDB:op_msg(sock, session_id, lazy, cmd, ...)
     if not sock then
         return false, "db not connected"
     end
-    local tick = lclock_ms()
-    if not sock:send_data(session_id, cmd, ...) then
+    local tick, codec = lclock_ms(), sock.codec
+    if not sock:send_data(session_id, lazy, cmd, ...) then
+        if lazy then
+            codec.cancel(session_id)
+        end
         return false, "send failed"
     end
     sock.sessions[session_id] = cmd
     self.req_counter:count_increase()
     local _<close> = hdefer(function()
         sock.sessions[session_id] = nil
+        --超时或断开时codec里的惰性标记不会被回复消费
+        if lazy then
+            codec.cancel(session_id)
+        end
         local utime               = lclock_ms() - tick
         if utime > SLOW_MS then
             log_warn("[MongoDB][op_msg] cmd ({}:{}) execute so big {}!", cmd, session_id, utime)
@@ -313,12 +351,18 @@ end
 
 function MongoDB:adminCommand(sock, cmd, cmd_v, ...)
     local session_id = thread_mgr:build_session_id()
-    return self:op_msg(sock, session_id, cmd, cmd_v, "$db", "admin", ...)
+    return self:op_msg(sock, session_id, false, cmd, cmd_v, "$db", "admin", ...)
 end
 
 function MongoDB:runCommand(cmd, cmd_v, ...)
     local session_id = thread_mgr:build_session_id()
-    return self:op_msg(self.executer, session_id, cmd, cmd_v or 1, "$db", self.name, ...)
+    return self:op_msg(self.executer, session_id, false, cmd, cmd_v or 1, "$db", self.name, ...)
+end
+
+--回复为只读的惰性文档, 可用bson.totable转换
+function MongoDB:lazyCommand(cmd, cmd_v, ...)
+    local session_id = thread_mgr:build_session_id()
+    return self:op_msg(self.executer, session_id, true, cmd, cmd_v or 1, "$db", self.name, ...)
 end
 
 function MongoDB:sendCommand(cmd, cmd_v, ...)
@@ -371,6 +415,20 @@ function MongoDB:unsafe_insert(co_name, doc)
     return self:sendCommand("insert", co_name, "documents", { doc })
 end
 
+--批量写入, 文档以OP_MSG document sequence发送
+function MongoDB:bulk_insert(co_name, docs, ordered)
+    return self:runCommand("insert", co_name, "ordered", ordered ~= false, "documents", docs)
+end
+
+--updates: { {update, selector, upsert, multi}, ... }
+function MongoDB:bulk_update(co_name, updates, ordered)
+    local cmd_datas = {}
+    for i, args in ipairs(updates) do
+        cmd_datas[i] = { q = args[2], u = args[1], upsert = args[3], multi = args[4] }
+    end
+    return self:runCommand("update", co_name, "ordered", ordered ~= false, "updates", cmd_datas)
+end
+
 function MongoDB:update(co_name, update, selector, upsert, multi)
     local cmd_data = { q = selector, u = update, upsert = upsert, multi = multi }
     return self:runCommand("update", co_name, "updates", { cmd_data })
@@ -451,6 +509,40 @@ function MongoDB:find(co_name, query, projection, sortor, limit, skip)
     return true, results
 end
 
+-- 游标迭代: 每批结果惰性解码, 迭代完一批后再getMore
+-- for doc in iter do ... end, doc为惰性文档
+function MongoDB:find_iter(co_name, query, projection, sortor, limit, skip)
+    local fsortor     = self:format_pairs(sortor)
+    local succ, reply = self:lazyCommand("find", co_name, "filter", query,
+            "projection", projection or {}, "sort", fsortor or {}, "limit", limit or 0, "skip", skip or 0)
+    if not succ then
+        return succ, reply
+    end
+    local cursor    = reply.cursor
+    local documents = cursor.firstBatch
+    local index     = 0
+    return true, function()
+        while true do
+            index     = index + 1
+            local doc = documents[index]
+            if doc then
+                return doc
+            end
+            if not cursor.id or cursor.id == 0 then
+                return
+            end
+            local msucc, moreply = self:lazyCommand("getMore", bint64(cursor.id), "collection", co_name)
+            if not msucc then
+                log_err("[MongoDB][find_iter] getMore {} failed: {}", co_name, moreply)
+                return
+            end
+            cursor    = moreply.cursor
+            documents = cursor.nextBatch
+            index     = 0
+        end
+    end
+end
+
 function MongoDB:find_and_modify(co_name, update, selector, upsert, fields, new)
     return self:runCommand("findAndModify", co_name, "query", selector, "update", update, "fields", fields, "upsert", upsert, "new", new)
 end
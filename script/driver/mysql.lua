@@ -33,6 +33,11 @@ local COM_STMT_PREPARE = 0x16
 local COM_STMT_EXECUTE = 0x17
 local COM_STMT_CLOSE   = 0x19
 local COM_STMT_RESET   = 0x1a
+local COM_STMT_FETCH   = 0x1c
+
+-- cursor types
+local CURSOR_NONE      = 0x00
+local CURSOR_READ_ONLY = 0x01
 
 local MysqlDB          = class()
 local prop             = property(MysqlDB)
@@ -184,9 +189,14 @@ function MysqlDB:on_socket_recv(socket, session_id, ...)
 end
 
 function MysqlDB:request(cmd, quote, ...)
-    if self.executer then
+    return self:sock_request(self.executer, cmd, quote, ...)
+end
+
+--在指定连接上请求
+function MysqlDB:sock_request(sock, cmd, quote, ...)
+    if sock then
         local session_id = thread_mgr:build_session_id()
-        if self.executer:send_data(cmd, session_id, ...) then
+        if sock:send_data(cmd, session_id, ...) then
             return thread_mgr:yield(session_id, quote, DB_TIMEOUT)
         end
     end
@@ -197,14 +207,51 @@ function MysqlDB:query(query)
     return self:request(COM_QUERY, "mysql query", query)
 end
 
--- 注册预处理语句
+-- 注册预处理语句, 返回: ok, prepare_id, 列数, 参数数
+-- 预处理句柄属于连接, 后续执行需要使用相同的executer
 function MysqlDB:prepare(sql)
     return self:request(COM_STMT_PREPARE, "mysql prepare", sql)
 end
 
---执行预处理语句
+--执行预处理语句, 二进制协议返回按列类型解码的结果集
 function MysqlDB:execute(prepare_id, ...)
-    return self:request(COM_STMT_EXECUTE, "mysql_execute", prepare_id, ...)
+    return self:request(COM_STMT_EXECUTE, "mysql_execute", prepare_id, CURSOR_NONE, ...)
+end
+
+--以只读游标执行预处理语句, 结果集留在服务端, 通过fetch分批读取
+function MysqlDB:open_cursor(prepare_id, ...)
+    return self:request(COM_STMT_EXECUTE, "mysql open_cursor", prepare_id, CURSOR_READ_ONLY, ...)
+end
+
+--从游标读取num_rows行, 返回: ok, rows, finish
+function MysqlDB:fetch(prepare_id, num_rows)
+    return self:request(COM_STMT_FETCH, "mysql fetch", prepare_id, num_rows)
+end
+
+--游标流式读取, 每批行数据回调handler(rows), 结束后关闭游标
+--游标只在打开它的连接上有效, 回调期间executer可能切换, 全程使用打开时的连接
+function MysqlDB:stream(prepare_id, num_rows, handler, ...)
+    local sock, total = self.executer, 0
+    local ok, res = self:sock_request(sock, COM_STMT_EXECUTE, "mysql open_cursor", prepare_id, CURSOR_READ_ONLY, ...)
+    if not ok then
+        return false, res
+    end
+    while true do
+        local fok, rows, finish = self:sock_request(sock, COM_STMT_FETCH, "mysql fetch", prepare_id, num_rows)
+        if not fok then
+            self:sock_request(sock, COM_STMT_RESET, "mysql stmt_reset", prepare_id)
+            return false, rows
+        end
+        if #rows > 0 then
+            total = total + #rows
+            handler(rows)
+        end
+        if finish then
+            break
+        end
+    end
+    self:sock_request(sock, COM_STMT_RESET, "mysql stmt_reset", prepare_id)
+    return true, total
 end
 
 --重置预处理句柄
@@ -214,7 +261,10 @@ end
 
 --关闭预处理句柄，无返回包
 function MysqlDB:stmt_close(prepare_id)
-    return self:request(COM_STMT_CLOSE, "mysql stmt_close", prepare_id)
+    if self.executer then
+        return self.executer:send_data(COM_STMT_CLOSE, 0, prepare_id)
+    end
+    return false
 end
 
 local escape_map = {
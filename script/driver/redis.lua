@@ -313,6 +313,41 @@ function RedisDB:commit(socket, cmd, ...)
     return ok, res
 end
 
+--pipeline: cmds = { {cmd, key, ...}, ... }, 一次发送, 按顺序返回结果数组
+--集群模式下按key选择节点, 所有命令需落在同一节点
+--任一命令失败时ok为false, 失败命令对应的结果为错误信息
+function RedisDB:pipeline(cmds, key)
+    --空批次没有回包, 不发送
+    if #cmds == 0 then
+        return true, {}
+    end
+    local sock = self:choose_node(key)
+    if not sock then
+        return false, "db not connected"
+    end
+    local session_id = thread_mgr:build_session_id()
+    if not sock:send_data(session_id, cmds) then
+        return false, "send request failed"
+    end
+    self.req_counter:count_increase()
+    local ok, res = thread_mgr:yield(session_id, "redis_pipeline", DB_TIMEOUT)
+    if type(res) ~= "table" then
+        log_err("[RedisDB][pipeline] exec {} cmds failed: {}", #cmds, res)
+        return false, res
+    end
+    if not ok then
+        log_err("[RedisDB][pipeline] exec {} cmds has failed: {}", #cmds, res)
+        return ok, res
+    end
+    for i, cmd in ipairs(cmds) do
+        local convertor = rconvertors[slower(cmd[1])]
+        if convertor and res[i] ~= nil then
+            res[i] = convertor(res[i])
+        end
+    end
+    return ok, res
+end
+
 function RedisDB:send(cmd, key, ...)
     local sock = self:choose_node(key)
     if sock then
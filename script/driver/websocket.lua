@@ -1,5 +1,8 @@
 --websocket.lua
 
+local sgmatch         = string.gmatch
+local smatch          = string.match
+local tconcat         = table.concat
 local log_err         = logger.err
 local log_info        = logger.info
 local log_debug       = logger.debug
@@ -28,6 +31,7 @@ prop:reader("alive", false)
 prop:reader("session", nil)         --连接成功对象
 prop:reader("listener", nil)
 prop:reader("port", 0)
+prop:accessor("deflate", false)     --是否支持permessage-deflate
 
 function WebSocket:__init(host)
     self.host   = host
@@ -68,6 +72,7 @@ end
 
 function WebSocket:on_socket_accept(session)
     local socket = WebSocket(self.host)
+    socket:set_deflate(self.deflate)
     socket:accept(session, session.ip, self.port)
 end
 
@@ -110,7 +115,7 @@ function WebSocket:accept(session, ip, port)
     session.on_call_data = function(recv_len, method, ...)
         if method == "WSS" then
             self:on_socket_recv(session, token, ...)
-        else
+        elseif method then
             self:on_handshake(session, token, ...)
         end
     end
@@ -147,6 +152,10 @@ function WebSocket:on_handshake(session, token, url, params, headers, body)
     if headers["Sec-WebSocket-Protocol"] then
         cbheaders["Sec-WebSocket-Protocol"] = "mqtt"
     end
+    local extension = self:negotiate_deflate(headers["Sec-WebSocket-Extensions"])
+    if extension then
+        cbheaders["Sec-WebSocket-Extensions"] = extension
+    end
     self.alive   = true
     --handshake 完成
     self.token   = token
@@ -159,6 +168,53 @@ function WebSocket:on_handshake(session, token, url, params, headers, body)
     return true
 end
 
+--permessage-deflate协商: 选第一个能接受的offer
+--压缩窗口固定为15位, 要求server_max_window_bits小于15的offer不接受
+local DEFLATE_PARAMS = {
+    server_no_context_takeover = true,
+    client_no_context_takeover = true,
+    server_max_window_bits = true,
+    client_max_window_bits = true,
+}
+function WebSocket:negotiate_deflate(offers)
+    if not self.deflate or not offers then
+        return
+    end
+    for offer in sgmatch(offers, "[^,]+") do
+        local name, params, valid = nil, {}, true
+        for token in sgmatch(offer, "[^;]+") do
+            local key, value = smatch(token, "^%s*([%w_%-]+)%s*=?%s*\"?(%d*)\"?%s*$")
+            if not name then
+                name = key
+            elseif DEFLATE_PARAMS[key] then
+                params[key] = value
+            else
+                valid = false
+            end
+        end
+        local wbits = params.server_max_window_bits
+        if valid and name == "permessage-deflate" and (not wbits or wbits == "15") then
+            local server_takeover = not params.server_no_context_takeover
+            local client_takeover = not params.client_no_context_takeover
+            if not self.wcodec.deflate(server_takeover, client_takeover) then
+                return
+            end
+            local response = { "permessage-deflate" }
+            if not server_takeover then
+                response[#response + 1] = "server_no_context_takeover"
+            end
+            if not client_takeover then
+                response[#response + 1] = "client_no_context_takeover"
+            end
+            --RFC7692 7.1.2.1: 接受了客户端提出的server_max_window_bits时必须原样回应
+            if wbits then
+                response[#response + 1] = "server_max_window_bits=15"
+            end
+            return tconcat(response, "; ")
+        end
+    end
+end
+
 function WebSocket:send_data(...)
     if self.alive then
         local send_len = self.session.call_data(...)
@@ -8,6 +8,8 @@ local worker_call        = hive.worker_call
 local worker_broadcast   = hive.worker_broadcast
 local worker_update      = hive.worker_update
 local worker_names       = hive.worker_names
+local worker_recv        = hive.worker_recv
+local worker_stats       = hive.worker_stats
 
 local FLAG_REQ           = hive.enum("FlagMask", "REQ")
 local FLAG_RES           = hive.enum("FlagMask", "RES")
@@ -21,6 +23,7 @@ local Scheduler          = singleton()
 
 function Scheduler:__init()
     hive.worker_setup("hive")
+    hive.worker_budget(environ.number("HIVE_THREAD_BUDGET", 100), environ.number("HIVE_THREAD_BATCH", 64))
 end
 
 function Scheduler:quit()
@@ -83,6 +86,11 @@ function Scheduler:names()
     return worker_names()
 end
 
+--按来源/rpc的排队与处理耗时统计
+function Scheduler:stats()
+    return worker_stats()
+end
+
 --事件分发
 local function notify_rpc(session_id, title, rpc, ...)
     local rpc_datas = event_mgr:notify_listener(rpc, ...)
@@ -91,12 +99,22 @@ local function notify_rpc(session_id, title, rpc, ...)
     end
 end
 
-function hive.on_scheduler(session_id, flag, ...)
+local function dispatch(ok, session_id, flag, ...)
+    if not ok then
+        return false
+    end
     if flag == FLAG_REQ then
         thread_mgr:fork(notify_rpc, session_id, ...)
-        return
+    else
+        thread_mgr:response(session_id, ...)
+    end
+    return true
+end
+
+--分批处理同一来源的消息
+function hive.on_scheduler(source)
+    while dispatch(worker_recv()) do
     end
-    thread_mgr:response(session_id, ...)
 end
 
 hive.scheduler = Scheduler()
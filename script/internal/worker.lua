@@ -5,9 +5,13 @@ local hxpcall            = hive.xpcall
 local log_err            = logger.err
 local tunpack            = table.unpack
 local wcall              = hive.call
+local wrecv              = hive.recv
 local lclock_ms          = timer.clock_ms
 local ltime              = timer.time
 local luabus             = luabus
+local perf_begin         = hive.perf_begin
+local perf_mark          = hive.perf_mark
+local perf_finish        = hive.perf_finish
 
 local event_mgr          = hive.load("event_mgr")
 local update_mgr         = hive.load("update_mgr")
@@ -18,6 +22,9 @@ local FLAG_REQ           = hive.enum("FlagMask", "REQ")
 local FLAG_RES           = hive.enum("FlagMask", "RES")
 local THREAD_RPC_TIMEOUT = hive.enum("NetwkTime", "THREAD_RPC_TIMEOUT")
 local HALF_MS            = hive.enum("PeriodTime", "HALF_MS")
+local PH_SCHEDULER       = hive.enum("FramePhase", "SCHEDULER")
+local PH_IO              = hive.enum("FramePhase", "IO")
+local PH_UPDATE          = hive.enum("FramePhase", "UPDATE")
 local KernCode           = enum("KernCode")
 
 --初始化核心
@@ -60,6 +67,7 @@ function hive.main()
     --初始化基础模块
     environ.init()
     service.init()
+    hive.set_budget(environ.number("HIVE_THREAD_BUDGET", 100), environ.number("HIVE_THREAD_BATCH", 64))
     --主循环
     init_mainloop()
     --加载统计
@@ -86,12 +94,17 @@ end
 --底层驱动
 hive.run = function()
     hxpcall(function()
+        perf_begin()
         local sclock_ms = lclock_ms()
         hive.update(sclock_ms)
+        perf_mark(PH_SCHEDULER)
         local scheduler_ms = lclock_ms() - sclock_ms
         luabus.wait(sclock_ms, 10)
+        perf_mark(PH_IO)
         local now_ms, clock_ms = ltime()
         update_mgr:update(nil, now_ms, clock_ms)
+        perf_mark(PH_UPDATE)
+        perf_finish()
         --时间告警
         local work_ms = lclock_ms() - sclock_ms
         if work_ms > HALF_MS then
@@ -110,13 +123,22 @@ local function notify_rpc(session_id, title, rpc, ...)
     end
 end
 
---rpc调用
-hive.on_worker   = function(session_id, flag, ...)
+local function dispatch(ok, session_id, flag, ...)
+    if not ok then
+        return false
+    end
     if flag == FLAG_REQ then
         thread_mgr:fork(notify_rpc, session_id, ...)
-        return
+    else
+        thread_mgr:response(session_id, ...)
+    end
+    return true
+end
+
+--rpc调用, 分批处理同一来源的消息
+hive.on_worker   = function(source)
+    while dispatch(wrecv()) do
     end
-    thread_mgr:response(session_id, ...)
 end
 
 --访问主线程
@@ -1,4 +1,5 @@
 local log_info   = logger.info
+local lhelper    = require("lhelper")
 
 local event_mgr  = hive.get("event_mgr")
 local update_mgr = hive.get("update_mgr")
@@ -14,6 +15,9 @@ function WorkerEvt:__init()
     event_mgr:add_listener(self, "rpc_count_lua_obj")
     event_mgr:add_listener(self, "rpc_full_gc")
     event_mgr:add_listener(self, "rpc_set_gc_speed")
+    event_mgr:add_listener(self, "rpc_thread_placement")
+    event_mgr:add_listener(self, "rpc_mailbox_stats")
+    event_mgr:add_listener(self, "rpc_frame_perf")
 end
 
 --热更新
@@ -44,6 +48,18 @@ function WorkerEvt:rpc_set_gc_speed(pause, step_mul)
     gc_mgr:set_gc_speed(pause, step_mul)
 end
 
+function WorkerEvt:rpc_thread_placement()
+    return KernCode.SUCCESS, lhelper.thread_placement()
+end
+
+function WorkerEvt:rpc_mailbox_stats()
+    return KernCode.SUCCESS, hive.stats()
+end
+
+function WorkerEvt:rpc_frame_perf()
+    return KernCode.SUCCESS, hive.perf_stats(false)
+end
+
 hive.worker_evt = WorkerEvt()
 
 return WorkerEvt
@@ -5,6 +5,9 @@ local log_err       = logger.err
 local lclock_ms     = timer.clock_ms
 local ltime         = timer.time
 local luabus        = luabus
+local perf_begin    = hive.perf_begin
+local perf_mark     = hive.perf_mark
+local perf_finish   = hive.perf_finish
 
 local HiveMode      = enum("HiveMode")
 local ServiceStatus = enum("ServiceStatus")
@@ -14,6 +17,9 @@ local update_mgr    = hive.load("update_mgr")
 local event_mgr     = hive.load("event_mgr")
 
 local HALF_MS       = hive.enum("PeriodTime", "HALF_MS")
+local PH_SCHEDULER  = hive.enum("FramePhase", "SCHEDULER")
+local PH_IO         = hive.enum("FramePhase", "IO")
+local PH_UPDATE     = hive.enum("FramePhase", "UPDATE")
 
 --初始化核心
 local function init_core()
@@ -147,13 +153,18 @@ end
 
 --底层驱动
 hive.run  = function()
+    perf_begin()
     local sclock_ms = lclock_ms()
     scheduler:update(sclock_ms)
+    perf_mark(PH_SCHEDULER)
     local scheduler_ms = lclock_ms() - sclock_ms
     luabus.wait(sclock_ms, 10)
+    perf_mark(PH_IO)
     --系统更新
     local now_ms, clock_ms = ltime()
     update_mgr:update(scheduler, now_ms, clock_ms)
+    perf_mark(PH_UPDATE)
+    perf_finish()
     --时间告警
     local work_ms = lclock_ms() - sclock_ms
     if work_ms > HALF_MS then
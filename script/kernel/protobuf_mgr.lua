@@ -19,6 +19,10 @@ local pb_decode    = protobuf.decode
 local pb_encode    = protobuf.encode
 local pb_enum_id   = protobuf.enum
 local pb_bind_cmd  = protobuf.bind_cmd
+local pb_bind_pool = protobuf.bind_pool
+local pb_recycle   = protobuf.recycle
+local pb_encode_id = protobuf.encode_cmd
+local pb_decode_id = protobuf.decode_cmd
 
 local event_mgr    = hive.get("event_mgr")
 
@@ -95,7 +99,7 @@ function ProtobufMgr:encode(cmd_id, data)
         log_err("[ProtobufMgr][encode] find proto name failed! cmd_id:{}", cmd_id)
         return
     end
-    local ok, pb_str = pcall(pb_encode, proto_name, data or {})
+    local ok, pb_str = pcall(pb_encode_id, cmd_id, data or {})
     if ok then
         return pb_str
     end
@@ -117,9 +121,14 @@ function ProtobufMgr:decode(cmd_id, pb_str)
             log_err("[ProtobufMgr][decode] find proto name failed! cmd_id:{}", cmd_id)
             return
         end
-        proto_name = cmd_id
+        local ok, pb_data = pcall(pb_decode, cmd_id, pb_str)
+        if ok then
+            return pb_data, cmd_id
+        end
+        log_err("[ProtobufMgr][decode] cmd_id:{},res:{}", cmd_id, pb_data)
+        return
     end
-    local ok, pb_data = pcall(pb_decode, proto_name, pb_str)
+    local ok, pb_data = pcall(pb_decode_id, cmd_id, pb_str)
     if ok then
         return pb_data, proto_name
     end
@@ -185,6 +194,22 @@ function ProtobufMgr:register(doer, cmd_id, callback)
     event_mgr:add_cmd_listener(doer, cmd_id, callback)
 end
 
+--开启协议的消息表池, 处理函数不能持有消息表
+--客户端协议通过NetServer:bind_pool开启, 处理完后由NetServer回收
+function ProtobufMgr:bind_pool(cmd_id, capacity)
+    if not self.pb_indexs[cmd_id] then
+        log_err("[ProtobufMgr][bind_pool] proto_name: [{}] can't find!", cmd_id)
+        return false
+    end
+    pb_bind_pool(cmd_id, capacity)
+    return true
+end
+
+--回收消息表, 未开启池的协议忽略
+function ProtobufMgr:recycle(cmd_id, data)
+    return pb_recycle(cmd_id, data)
+end
+
 -- 重新加载
 function ProtobufMgr:on_reload()
     if not self.allow_reload then
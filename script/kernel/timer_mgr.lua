@@ -1,19 +1,26 @@
 --timer_mgr.lua
 local log_err         = logger.err
 local log_info        = logger.info
-local ipairs          = ipairs
 local tpack           = table.pack
 local tunpack         = table.unpack
 local new_guid        = codec.guid_new
 local lclock_ms       = timer.clock_ms
 local lnow_ms         = timer.now_ms
-local lcron_next      = timer.cron_next
 local ltinsert        = timer.insert
 local ltupdate        = timer.update
+local ltcancel        = timer.cancel
+local ltperiod        = timer.set_period
+local ltinsert_cron   = timer.insert_cron
+local ltset_tick      = timer.set_tick
+local mmax            = math.max
+local perf_mark       = hive.perf_mark
 
 --定时器精度，20ms
 local TIMER_ACCURYACY = 20
 
+local PH_UPDATE       = hive.enum("FramePhase", "UPDATE")
+local PH_TIMER        = hive.enum("FramePhase", "TIMER")
+
 local thread_mgr      = hive.get("thread_mgr")
 
 local TimerMgr        = singleton()
@@ -21,25 +28,26 @@ local prop            = property(TimerMgr)
 prop:reader("timers", {})
 prop:reader("last_ms", 0)
 prop:reader("escape_ms", 0)
+prop:reader("fired", {})    --到期id缓冲, 每帧复用
 function TimerMgr:__init()
     self.last_ms = lclock_ms()
+    ltset_tick(TIMER_ACCURYACY)
 end
 
+--周期和cron定时器由时间轮自动重新挂载, 这里只处理次数
 function TimerMgr:trigger(handle, clock_ms)
     if handle.times > 0 then
         handle.times = handle.times - 1
     end
     --防止在定时器中阻塞
     handle.params[#handle.params] = clock_ms - handle.last
+    handle.last = clock_ms
     thread_mgr:fork(handle.cb, tunpack(handle.params))
     --更新定时器数据
-    if handle.times == 0 then
+    if handle.times == 0 and self.timers[handle.timer_id] == handle then
         self.timers[handle.timer_id] = nil
-        return
+        ltcancel(handle.node)
     end
-    --继续注册
-    handle.last = clock_ms
-    ltinsert(handle.timer_id, handle.period)
 end
 
 function TimerMgr:on_frame(clock_ms)
@@ -47,13 +55,17 @@ function TimerMgr:on_frame(clock_ms)
     self.escape_ms  = escape_ms % TIMER_ACCURYACY
     self.last_ms    = clock_ms
     if escape_ms >= TIMER_ACCURYACY then
-        local timers = ltupdate(escape_ms // TIMER_ACCURYACY)
-        for _, timer_id in ipairs(timers or {}) do
-            local handle = self.timers[timer_id]
+        --定时器派发单独计入帧统计
+        perf_mark(PH_UPDATE)
+        local fired = self.fired
+        local count = ltupdate(escape_ms // TIMER_ACCURYACY, fired)
+        for i = 1, count do
+            local handle = self.timers[fired[i]]
             if handle then
                 self:trigger(handle, clock_ms)
             end
         end
+        perf_mark(PH_TIMER)
     end
 end
 
@@ -69,14 +81,16 @@ function TimerMgr:loop_interval(interval, period, cb, ...)
     return self:register(interval, period, -1, cb, ...)
 end
 
+--cron定时器按表达式重复触发
 function TimerMgr:cron(cex, cb, ...)
-    local time, time_str = lcron_next(cex)
-    if time < 0 then
-        log_err("[TimerMgr][cron] the cron is error:[{}],[{}]", cex, time_str)
+    local timer_id   = new_guid()
+    local node, time = ltinsert_cron(timer_id, cex)
+    if node == 0 then
+        log_err("[TimerMgr][cron] the cron is error:[{}],[{}]", cex, time)
         return
     end
-    log_info("[TimerMgr][cron] the cron next start:[{}],[{}]", cex, time_str)
-    self:once((time - hive.now) * 1000, cb, ...)
+    log_info("[TimerMgr][cron] the cron next start:[{}],[{}]", cex, time)
+    return self:save(timer_id, node, -1, cb, ...)
 end
 
 function TimerMgr:register(interval, period, times, cb, ...)
@@ -85,32 +99,39 @@ function TimerMgr:register(interval, period, times, cb, ...)
     local timer_id = new_guid(period, interval)
     --矫正时间误差
     interval       = interval + (reg_ms - self.last_ms)
-    ltinsert(timer_id, interval // TIMER_ACCURYACY)
+    local ticks    = (times ~= 1) and mmax(period // TIMER_ACCURYACY, 1) or 0
+    local node     = ltinsert(timer_id, interval // TIMER_ACCURYACY, ticks)
+    return self:save(timer_id, node, times, cb, ...)
+end
+
+function TimerMgr:save(timer_id, node, times, cb, ...)
     --包装回调参数
     local params          = tpack(...)
     params[#params + 1]   = 0
     --保存信息
     self.timers[timer_id] = {
         cb       = cb,
-        last     = reg_ms,
+        node     = node,
+        last     = lclock_ms(),
         times    = times,
         params   = params,
         timer_id = timer_id,
-        period   = period // TIMER_ACCURYACY
     }
     return timer_id
 end
 
 function TimerMgr:unregister(timer_id)
-    if timer_id then
+    local handle = timer_id and self.timers[timer_id]
+    if handle then
         self.timers[timer_id] = nil
+        ltcancel(handle.node)
     end
 end
 
 function TimerMgr:set_period(timer_id, period)
     local info = self.timers[timer_id]
-    if info then
-        info.period = period // TIMER_ACCURYACY
+    if info and info.times ~= 1 then
+        ltperiod(info.node, mmax(period // TIMER_ACCURYACY, 1))
     end
 end
 
@@ -27,6 +27,7 @@ prop:reader("hcodec", nil)          --codec
 prop:reader("jcodec", nil)          --codec
 prop:reader("listener", nil)        --网络连接对象
 prop:reader("clients", {})          --clients
+prop:reader("pipelines", {})        --pipeline回包队列
 prop:reader("handlers", {})         --handlers
 prop:accessor("limit_ips", nil)
 prop:reader("qps_counter", nil)
@@ -65,7 +66,8 @@ function HttpServer:setup(http_addr, induce)
 end
 
 function HttpServer:close(token, socket)
-    self.clients[token] = nil
+    self.clients[token]   = nil
+    self.pipelines[token] = nil
     socket:close()
 end
 
@@ -76,7 +78,8 @@ function HttpServer:on_socket_error(socket, token, err)
         return
     end
     log_debug("[HttpServer][on_socket_error] client(token:{}) close({})!", token, err)
-    self.clients[token] = nil
+    self.clients[token]   = nil
+    self.pipelines[token] = nil
 end
 
 function HttpServer:on_socket_accept(socket, token)
@@ -86,19 +89,27 @@ function HttpServer:on_socket_accept(socket, token)
         socket:close()
         return
     end
-    self.clients[token] = socket
+    self.clients[token]   = socket
+    self.pipelines[token] = { seq = 0, sent = 0, pends = {} }
 end
 
-function HttpServer:on_socket_recv(socket, method, url, params, headers, body, jsonable)
+function HttpServer:on_socket_recv(socket, method, url, params, headers, body, jsonable, keepalive)
     if self.open_log then
         log_debug("[HttpServer][on_socket_recv] recv:[{}][{}],query:{},body:{},head:{},jsonable:{}", method, url, params, body, headers, jsonable)
     end
+    --同一连接上的请求按序编号, 处理可能挂起, 回包时再排序
+    local request  = { keepalive = keepalive }
+    local pipeline = self.pipelines[socket:get_token()]
+    if pipeline then
+        pipeline.seq = pipeline.seq + 1
+        request.seq  = pipeline.seq
+    end
     local handlers = self.handlers[method]
     if not handlers then
-        self:response(socket, 404, "this http method hasn't suppert!")
+        self:response(socket, 404, "this http method hasn't suppert!", nil, request)
         return
     end
-    self:on_http_request(handlers, socket, url, body, params, headers, jsonable)
+    self:on_http_request(handlers, socket, url, body, params, headers, jsonable, request)
 end
 
 --注册get回调
@@ -126,7 +137,7 @@ function HttpServer:register_del(url, handler, target, decode)
 end
 
 --http post 回调
-function HttpServer:on_http_request(handlers, socket, url, body, params, headers, jsonable)
+function HttpServer:on_http_request(handlers, socket, url, body, params, headers, jsonable, request)
     self.qps_counter:count_increase()
     local handler_info = handlers[url] or handlers["*"]
     if handler_info then
@@ -140,7 +151,7 @@ function HttpServer:on_http_request(handlers, socket, url, body, params, headers
                 if not ok then
                     response = { code = 1, msg = response }
                 end
-                self:response(socket, 200, response, header)
+                self:response(socket, 200, response, header, request)
                 return
             end
         else
@@ -153,20 +164,24 @@ function HttpServer:on_http_request(handlers, socket, url, body, params, headers
                     log_err("[HttpServer][on_http_request] ok:{}, response:{}", ok, response)
                     response = { code = 1, msg = response }
                 end
-                self:response(socket, 200, response, header)
+                self:response(socket, 200, response, header, request)
                 return
             end
         end
     end
     log_warn("[HttpServer][on_http_request] request {} hasn't process!", url)
-    self:response(socket, 404, "this http request hasn't process!")
+    self:response(socket, 404, "this http request hasn't process!", nil, request)
 end
 
-function HttpServer:response(socket, status, response, headers)
+function HttpServer:response(socket, status, response, headers, request)
     local token = socket:get_token()
-    if not token or not response then
+    if not token then
         return
     end
+    --处理函数没有返回内容时也要回包, 否则同一连接上后续的pipeline回包会一直等待
+    if not response then
+        status, response, headers = 500, "http request hasn't response!", nil
+    end
     if not headers then
         headers = { ["Content-Type"] = "application/json" }
     end
@@ -174,12 +189,33 @@ function HttpServer:response(socket, status, response, headers)
         local html              = response:find("<html")
         headers["Content-Type"] = html and "text/html" or "text/plain"
     end
-    headers["connection"] = "close"
-    socket:send_data(status, headers, response)
-    self:close(token, socket)
     if self.open_log then
         log_debug("[HttpServer][response] head:{},response:{}", headers, response)
     end
+    local keepalive       = request and request.keepalive
+    headers["connection"] = keepalive and "keep-alive" or "close"
+    local pipeline        = self.pipelines[token]
+    if not pipeline or not request or not request.seq then
+        socket:send_data(status, headers, response)
+        self:close(token, socket)
+        return
+    end
+    --keep-alive连接上按请求顺序回包, 非keep-alive请求回包后关闭
+    pipeline.pends[request.seq] = { status, headers, response, keepalive }
+    while true do
+        local seq  = pipeline.sent + 1
+        local pend = pipeline.pends[seq]
+        if not pend then
+            break
+        end
+        pipeline.pends[seq] = nil
+        pipeline.sent       = seq
+        socket:send_data(pend[1], pend[2], pend[3])
+        if not pend[4] then
+            self:close(token, socket)
+            break
+        end
+    end
 end
 
 --取消url
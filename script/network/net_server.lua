@@ -14,6 +14,7 @@ local thread_mgr       = hive.get("thread_mgr")
 local protobuf_mgr     = hive.get("protobuf_mgr")
 local proxy_agent      = hive.get("proxy_agent")
 local heval            = hive.eval
+local pb_recycle       = protobuf.recycle
 
 local FLAG_REQ         = hive.enum("FlagMask", "REQ")
 local FLAG_RES         = hive.enum("FlagMask", "RES")
@@ -41,6 +42,7 @@ prop:reader("session_type", "default")  --会话类型
 prop:reader("session_count", 0)         --会话数量
 prop:reader("listener", nil)            --监听器
 prop:reader("command_cds", {})          --CMD定制CD
+prop:reader("pool_cmds", {})            --处理完后回收消息表的CMD
 prop:reader("codec", nil)               --编解码器
 prop:accessor("log_client_msg", nil)    --消息日志函数
 prop:accessor("timeout", NETWORK_TIMEOUT)
@@ -170,6 +172,14 @@ function NetServer:define_cmd_cd(cmd_id, cd_time)
     self.command_cds[cmd_id] = cd_time
 end
 
+-- 开启指定cmd的消息表池, 调用者保证该cmd的处理函数不持有消息表
+-- 包括不保存到其他对象, 不传给fork出的协程, 处理函数返回后消息表会被下一条消息复用
+function NetServer:bind_pool(cmd_id, capacity)
+    if protobuf_mgr:bind_pool(cmd_id, capacity) then
+        self.pool_cmds[cmd_id] = true
+    end
+end
+
 -- 查找指定cmd的cdtime
 function NetServer:get_cmd_cd(cmd_id)
     return self.command_cds[cmd_id] or flow_cd
@@ -195,6 +205,10 @@ function NetServer:on_socket_recv(session, cmd_id, flag, session_id, data)
             if not result[1] then
                 log_err("[NetServer][on_socket_recv] on_session_cmd failed! cmd_id:{}", cmd_id)
             end
+            --只回收通过bind_pool声明不持有消息表的协议
+            if self.pool_cmds[cmd] then
+                pb_recycle(cmd, bd)
+            end
         end
         thread_mgr:fork(dispatch_rpc_message, session, cmd_id, data)
         return
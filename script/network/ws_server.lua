@@ -14,13 +14,15 @@ prop:reader("port", 8191)           --WS server端口
 prop:reader("clients", {})          --clients
 prop:reader("handler", nil)
 
-function WSServer:__init(ws_addr)
-    self:setup(ws_addr)
+--deflate: 是否支持permessage-deflate压缩
+function WSServer:__init(ws_addr, deflate)
+    self:setup(ws_addr, deflate)
 end
 
-function WSServer:setup(ws_addr)
+function WSServer:setup(ws_addr, deflate)
     self.ip, self.port = saddr(ws_addr)
     local socket       = WebSocket(self)
+    socket:set_deflate(deflate or false)
     if not socket:listen(self.ip, self.port) then
         log_info("[WSServer][setup] now listen {} failed", ws_addr)
         signalquit(1)
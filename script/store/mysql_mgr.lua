@@ -76,6 +76,19 @@ function MysqlMgr:execute(db_name, primary_id, stmt, ...)
     return MYSQL_FAILED, "mysql db not exist"
 end
 
+--游标流式读取大结果集, 每批回调handler(rows), 返回读取总行数
+function MysqlMgr:stream(db_name, primary_id, stmt, num_rows, handler, ...)
+    local mysqldb = self:get_db(db_name, primary_id)
+    if mysqldb then
+        local ok, res_oe = mysqldb:stream(stmt, num_rows, handler, ...)
+        if not ok then
+            log_err("[MysqlMgr][stream] stream {} failed, because: {}", stmt, res_oe)
+        end
+        return ok and SUCCESS or MYSQL_FAILED, res_oe
+    end
+    return MYSQL_FAILED, "mysql db not exist"
+end
+
 function MysqlMgr:prepare(db_name, primary_id, sql)
     local mysqldb = self:get_db(db_name, primary_id)
     if mysqldb then
@@ -63,6 +63,20 @@ function RedisMgr:execute(db_name, cmd, ...)
     return REDIS_FAILED, sformat("redis db [%s] not exist", db_name)
 end
 
+--批量执行, cmds = { {cmd, key, ...}, ... }
+function RedisMgr:pipeline(db_name, cmds)
+    local redisdb = self:get_db(db_name)
+    if redisdb then
+        local ok, res_oe = redisdb:pipeline(cmds)
+        if not ok then
+            log_err("[RedisMgr][pipeline] execute {} cmds failed", #cmds)
+        end
+        self.db_counters[db_name or "default"]:count_increase()
+        return ok and SUCCESS or REDIS_FAILED, res_oe
+    end
+    return REDIS_FAILED, sformat("redis db [%s] not exist", db_name)
+end
+
 hive.redis_mgr = RedisMgr()
 
 return RedisMgr
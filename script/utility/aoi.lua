@@ -12,12 +12,24 @@ local EVENT_LEAVE = 2
 local AoiModel    = class()
 local prop        = property(AoiModel)
 prop:reader("space", nil)
+prop:reader("batch", false)
 prop:reader("event_cache", {})
+prop:reader("delta_cache", {})
+prop:reader("query_cache", {})
 
 --构造函数
-function AoiModel:__init(orginx, orginy, size)
+--batch: 批量模式, update只记录位置, 每帧调用flush按观察者派发合并后的增量
+--threads: 批量模式下flush按地图条带多线程处理, 大地图开启
+function AoiModel:__init(orginx, orginy, size, batch, threads)
     self.space = laoi.create(orginx, orginy, size, 16)
     self.space:enable_leave_event(true)
+    if batch then
+        self.batch = true
+        self.space:enable_batch(true)
+        if threads and threads > 1 then
+            self.space:enable_parallel(threads)
+        end
+    end
 end
 
 function AoiModel:__release()
@@ -43,7 +55,21 @@ end
 
 function AoiModel:update(id, x, y, view_size)
     self.space:update(id, x, y, view_size, view_size, 1)
-    self:update_aoi_event()
+    if not self.batch then
+        self:update_aoi_event()
+    end
+end
+
+--批量模式下每帧调用一次
+function AoiModel:flush()
+    local cache = self.delta_cache
+    local count = self.space:flush(cache)
+    local i     = 1
+    while i <= count do
+        local watcher, nenter, nleave, nmove = cache[i], cache[i + 1], cache[i + 2], cache[i + 3]
+        self:delta_ev(watcher, cache, i + 4, nenter, nleave, nmove)
+        i = i + 4 + nenter + nleave + nmove
+    end
 end
 
 function AoiModel:fire_event(id, eventid, fn)
@@ -67,6 +93,25 @@ function AoiModel:query(x, y, view_w, view_h)
     return out
 end
 
+--圆形/扇形/最近k个查询, 结果写入复用的query_cache, 只有前count项有效, 下次查询前用完
+--layers: 层过滤掩码(1 << layer), nil不过滤
+function AoiModel:query_circle(x, y, radius, layers)
+    local count = self.space:query_circle(mfloor(x), mfloor(y), mceil(radius), layers, self.query_cache)
+    return self.query_cache, count
+end
+
+--dir: 朝向角度, half: 半张角(度)
+function AoiModel:query_sector(x, y, radius, dir, half, layers)
+    local count = self.space:query_sector(mfloor(x), mfloor(y), mceil(radius), dir, half, layers, self.query_cache)
+    return self.query_cache, count
+end
+
+--按距离从近到远
+function AoiModel:query_nearest(x, y, radius, k, layers)
+    local count = self.space:query_nearest(mfloor(x), mfloor(y), mceil(radius), k, layers, self.query_cache)
+    return self.query_cache, count
+end
+
 function AoiModel:update_aoi_event(fn)
     local count = self.space:update_event(self.event_cache)
     for i = 1, count, 3 do
@@ -83,6 +128,22 @@ function AoiModel:update_aoi_event(fn)
     end
 end
 
+--单个观察者的增量: cache[first...]依次为nenter个进入, nleave个离开, nmove个移动
+--默认逐条派发, 需要合包下发时重载
+function AoiModel:delta_ev(watcher, cache, first, nenter, nleave, nmove)
+    local leave = first + nenter
+    local move  = leave + nleave
+    for i = first, leave - 1 do
+        self:enter_ev(watcher, cache[i])
+    end
+    for i = leave, move - 1 do
+        self:leave_ev(watcher, cache[i])
+    end
+    for i = move, move + nmove - 1 do
+        self:move_ev(watcher, cache[i])
+    end
+end
+
 function AoiModel:enter_ev(watcher, marker)
     log_debug("[AoiModel][enter_ev] watcher:{},marker:{}", watcher, marker)
 end
@@ -91,4 +152,8 @@ function AoiModel:leave_ev(watcher, marker)
     log_debug("[AoiModel][leave_ev] watcher:{},marker:{}", watcher, marker)
 end
 
+function AoiModel:move_ev(watcher, marker)
+    log_debug("[AoiModel][move_ev] watcher:{},marker:{}", watcher, marker)
+end
+
 return AoiModel
@@ -41,4 +41,27 @@ hive.startup(function()
     --import("qtest/algo_test.lua")
     import("qtest/profiler_test.lua")
     --import("qtest/lcache_test.lua")
+    --import("qtest/scheduler_test.lua")
+    --import("qtest/frame_perf_test.lua")
+    --import("qtest/logbench_test.lua")
+    --import("qtest/codec_stream_test.lua")
+    --import("qtest/redis_pipeline_test.lua")
+    --import("qtest/mysql_stmt_test.lua")
+    --import("qtest/bson_lazy_test.lua")
+    --import("qtest/mongo_bulk_test.lua")
+    --import("qtest/codec_shape_test.lua")
+    --import("qtest/codec_dict_test.lua")
+    --import("qtest/http_parser_test.lua")
+    --import("qtest/ws_frame_test.lua")
+    --import("qtest/pb_cmd_test.lua")
+    --import("qtest/timer_wheel_test.lua")
+    --import("qtest/timer_periodic_test.lua")
+    --import("qtest/aoi_batch_test.lua")
+    --import("qtest/aoi_parallel_test.lua")
+    --import("qtest/aoi_query_test.lua")
+    --import("qtest/zset_rank_test.lua")
+    --import("qtest/zset_snapshot_test.lua")
+    --import("qtest/lcache_shared_test.lua")
+    --import("qtest/lcache_blob_test.lua")
+    --import("qtest/bitarray_simd_test.lua")
 end)
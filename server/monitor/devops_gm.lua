@@ -48,6 +48,10 @@ function DevopsGmMgr:register_gm()
           args  = "service_name|string index|integer open|integer slow|integer fast|integer" },
         { group = "开发工具", gm_type = GMType.GLOBAL, name = "gm_check_endless_loop", desc = "检测死循环", comment = "开启/关闭,服务/index",
           args  = "start|integer service_name|string index|integer" },
+        { group = "运维", gm_type = GMType.GLOBAL, name = "gm_thread_placement", desc = "线程绑核分布", comment = "服务/index",
+          args  = "service_name|string index|integer" },
+        { group = "运维", gm_type = GMType.GLOBAL, name = "gm_frame_perf", desc = "线程帧耗时分布", comment = "服务/index(us)",
+          args  = "service_name|string index|integer" },
         --工具
         { group = "开发工具", gm_type = GMType.GLOBAL, name = "gm_guid_view", desc = "guid信息", comment = "(拆解guid)", args = "guid|integer" },
         { group = "开发工具", gm_type = GMType.GLOBAL, name = "gm_log_format", desc = "日志格式", comment = "0压缩,1格式化", args = "data|string swline|integer" },
@@ -177,6 +181,14 @@ function DevopsGmMgr:gm_check_endless_loop(start, service_name, index)
     return { code = 0 }
 end
 
+function DevopsGmMgr:gm_thread_placement(service_name, index)
+    return self:call_target_rpc(service_name, index, "rpc_thread_placement")
+end
+
+function DevopsGmMgr:gm_frame_perf(service_name, index)
+    return self:call_target_rpc(service_name, index, "rpc_frame_perf")
+end
+
 function DevopsGmMgr:gm_guid_view(guid)
     local group, index, gtype, time, serial = codec.guid_source(guid)
     return { group = group, gtype = gtype, index = index, time = time_str(time), serial = serial }
@@ -0,0 +1,219 @@
+--aoi_batch_test.lua
+--aoi批量模式测试: 逐个update派发事件与整帧合并增量的结果一致性, 进出抵消, 以及5k移动实体的单帧开销
+local log_info      = logger.info
+local log_err       = logger.err
+local oclock        = os.clock
+
+local laoi          = require("laoi")
+
+local MODE          = 3     --观察者|被观察者
+local EVENT_ENTER   = 1
+local EVENT_LEAVE   = 2
+
+--固定种子的线性同余, 两种模式走完全相同的移动序列
+local function lcg(seed)
+    local state = seed
+    return function(n)
+        state = (state * 1103515245 + 12345) % 2147483648
+        --低位周期很短, 取高位
+        return (state >> 8) % n
+    end
+end
+
+local function create(size, batch)
+    local space = laoi.create(0, 0, size, 16)
+    space:enable_leave_event(true)
+    space:enable_batch(batch)
+    return space
+end
+
+--每帧每个实体随机走一步
+local function step(pos, size, speed, rand)
+    for _, p in ipairs(pos) do
+        p[1] = math.max(0, math.min(size - 1, p[1] + rand(2 * speed + 1) - speed))
+        p[2] = math.max(0, math.min(size - 1, p[2] + rand(2 * speed + 1) - speed))
+    end
+end
+
+local function visible(views, watcher)
+    local view = views[watcher]
+    if not view then
+        view = {}
+        views[watcher] = view
+    end
+    return view
+end
+
+--逐个update的事件应用到可见集合
+local function apply_events(space, cache, views)
+    local count = space:update_event(cache)
+    for i = 1, count, 3 do
+        local view = visible(views, cache[i])
+        if cache[i + 2] == EVENT_ENTER then
+            view[cache[i + 1]] = true
+        elseif cache[i + 2] == EVENT_LEAVE then
+            view[cache[i + 1]] = nil
+        end
+    end
+    return count // 3
+end
+
+--insert的事件立即派发, 不进入批量增量
+local function spawn(space, count, size, view, rand, cache, views)
+    local pos = {}
+    for id = 1, count do
+        local x, y = rand(size), rand(size)
+        pos[id] = { x, y }
+        space:insert(id, x, y, view, view, 1, MODE)
+        if views then
+            apply_events(space, cache, views)
+        end
+    end
+    return pos
+end
+
+--合并增量应用到可见集合, move必须是可见的对象
+local function apply_deltas(space, cache, views)
+    local count, i, moves, valid = space:flush(cache), 1, 0, true
+    while i <= count do
+        local watcher, nenter, nleave, nmove = cache[i], cache[i + 1], cache[i + 2], cache[i + 3]
+        local view, first = visible(views, watcher), i + 4
+        for j = first, first + nenter - 1 do
+            valid = valid and not view[cache[j]]
+            view[cache[j]] = true
+        end
+        for j = first + nenter, first + nenter + nleave - 1 do
+            valid = valid and view[cache[j]]
+            view[cache[j]] = nil
+        end
+        for j = first + nenter + nleave, first + nenter + nleave + nmove - 1 do
+            valid = valid and view[cache[j]]
+        end
+        moves = moves + nmove
+        i = first + nenter + nleave + nmove
+    end
+    return count, moves, valid
+end
+
+local function same_views(a, b)
+    for watcher, view in pairs(a) do
+        local other = b[watcher] or {}
+        for marker in pairs(view) do
+            if not other[marker] then
+                return false
+            end
+        end
+        for marker in pairs(other) do
+            if not view[marker] then
+                return false
+            end
+        end
+    end
+    for watcher, view in pairs(b) do
+        if not a[watcher] and next(view) then
+            return false
+        end
+    end
+    return true
+end
+
+--两种模式同样的移动序列, 每帧结束时可见集合一致
+local function check_consistent()
+    local size, count, view, ticks = 512, 400, 64, 30
+    local direct, batch = create(size, false), create(size, true)
+    local dviews, bviews, dcache, bcache = {}, {}, {}, {}
+    local dpos = spawn(direct, count, size, view, lcg(7), dcache, dviews)
+    local bpos = spawn(batch, count, size, view, lcg(7), bcache, bviews)
+    local drand, brand, valid, raws, deltas = lcg(11), lcg(11), true, 0, 0
+    for _ = 1, ticks do
+        step(dpos, size, 12, drand)
+        step(bpos, size, 12, brand)
+        for id, p in ipairs(dpos) do
+            direct:update(id, p[1], p[2], view, view, 1)
+            raws = raws + apply_events(direct, dcache, dviews)
+        end
+        for id, p in ipairs(bpos) do
+            batch:update(id, p[1], p[2], view, view, 1)
+        end
+        local n, _, ok = apply_deltas(batch, bcache, bviews)
+        deltas = deltas + n
+        valid = valid and ok and same_views(dviews, bviews)
+    end
+    log_info("[aoi_batch] consistent: {}, {} ticks raw events {}, delta entries {}", valid, ticks, raws, deltas)
+    if not valid then
+        log_err("[aoi_batch] batch views differ from direct views")
+    end
+end
+
+--观察者走近(marker进入)同时marker走开(离开), 一帧内抵消; 同帧多次update只取最后位置
+local function check_coalesce()
+    local direct, batch = create(256, false), create(256, true)
+    local dcache, bcache = {}, {}
+    for _, space in ipairs({ direct, batch }) do
+        space:insert(1, 40, 40, 64, 64, 1, MODE)
+        space:insert(2, 100, 40, 0, 0, 1, 2)
+        space:update_event({})
+    end
+    direct:update(1, 80, 40, 64, 64, 1)
+    local raws = direct:update_event(dcache) // 3
+    direct:update(2, 160, 40, 0, 0, 1)
+    raws = raws + direct:update_event(dcache) // 3
+    batch:update(1, 80, 40, 64, 64, 1)
+    batch:update(2, 130, 40, 0, 0, 1)
+    batch:update(2, 160, 40, 0, 0, 1)
+    local pending = batch:flush(bcache)
+    --只有move: marker在视野内移动
+    batch:update(2, 90, 40, 0, 0, 1)
+    batch:update(2, 100, 40, 0, 0, 1)
+    batch:flush(bcache)
+    batch:update(2, 104, 40, 0, 0, 1)
+    local count = batch:flush(bcache)
+    local move = count == 5 and bcache[1] == 1 and bcache[4] == 1 and bcache[5] == 2
+    log_info("[aoi_batch] coalesce: direct {} events, batch {} entries, move only: {}", raws, pending, move)
+end
+
+--5k实体在同一张地图内持续移动, 以进程cpu时间计算单帧开销
+--direct只有进出事件, 同步移动还要逐个query周围对象(视野相同, 看得到我的就是我看得到的); batch一次得到进出和移动
+local function bench()
+    local size, count, view, speed, ticks = 2048, 5000, 192, 8, 20
+    for _, mode in ipairs({ "direct", "direct+query", "batch" }) do
+        local batch, query = mode == "batch", mode == "direct+query"
+        local space, cache, out, events = create(size, batch), {}, {}, 0
+        local rand = lcg(23)
+        local pos = spawn(space, count, size, view, rand)
+        collectgarbage("collect")
+        local sclock = oclock()
+        for _ = 1, ticks do
+            step(pos, size, speed, rand)
+            if batch then
+                for id, p in ipairs(pos) do
+                    space:update(id, p[1], p[2], view, view, 1)
+                end
+                local n, i = space:flush(cache), 1
+                while i <= n do
+                    local nenter, nleave, nmove = cache[i + 1], cache[i + 2], cache[i + 3]
+                    events = events + nenter + nleave + nmove
+                    i = i + 4 + nenter + nleave + nmove
+                end
+            else
+                for id, p in ipairs(pos) do
+                    space:update(id, p[1], p[2], view, view, 1)
+                    local n = space:update_event(cache)
+                    for i = 1, n, 3 do
+                        events = events + (cache[i + 2] > 0 and 1 or 0)
+                    end
+                    if query then
+                        events = events + (space:query(p[1], p[2], view, view, out) or 1) - 1
+                    end
+                end
+            end
+        end
+        local cost = oclock() - sclock
+        log_info("[aoi_batch] {} entities {}: {} ms/tick, {} events/tick", count, mode,
+                string.format("%.2f", cost * 1000 / ticks), events // ticks)
+    end
+end
+
+check_consistent()
+check_coalesce()
+bench()
@@ -0,0 +1,117 @@
+--aoi_parallel_test.lua
+--aoi并行测试: 不同线程数的flush输出与单线程逐项一致, 条带内并行处理的移动比例, 以及大量移动实体的单帧耗时
+local log_info      = logger.info
+local log_err       = logger.err
+local lclock_ms     = timer.clock_ms
+
+local laoi          = require("laoi")
+
+local MODE          = 3     --观察者|被观察者
+
+--固定种子的线性同余, 各个地图走完全相同的移动序列
+local function lcg(seed)
+    local state = seed
+    return function(n)
+        state = (state * 1103515245 + 12345) % 2147483648
+        --低位周期很短, 取高位
+        return (state >> 8) % n
+    end
+end
+
+local function create(size, threads)
+    local space = laoi.create(0, 0, size, 16)
+    space:enable_leave_event(true)
+    space:enable_batch(true)
+    space:enable_parallel(threads)
+    return space
+end
+
+local function spawn(space, count, size, view, rand)
+    local pos = {}
+    for id = 1, count do
+        local x, y = rand(size), rand(size)
+        pos[id] = { x, y }
+        space:insert(id, x, y, view, view, 1, MODE)
+    end
+    return pos
+end
+
+--每帧每个实体随机走一步
+local function step(pos, size, speed, rand)
+    for _, p in ipairs(pos) do
+        p[1] = math.max(0, math.min(size - 1, p[1] + rand(2 * speed + 1) - speed))
+        p[2] = math.max(0, math.min(size - 1, p[2] + rand(2 * speed + 1) - speed))
+    end
+end
+
+local function tick(space, pos, view, out)
+    for id, p in ipairs(pos) do
+        space:update(id, p[1], p[2], view, view, 1)
+    end
+    return space:flush(out)
+end
+
+--同样的移动序列, 1/2/4线程每帧输出完全一致
+local function check_same()
+    local size, count, view, ticks = 1024, 3000, 128, 20
+    local threads, spaces, poses, rands = { 1, 2, 4 }, {}, {}, {}
+    for i, n in ipairs(threads) do
+        spaces[i] = create(size, n)
+        poses[i] = spawn(spaces[i], count, size, view, lcg(5))
+        rands[i] = lcg(13)
+    end
+    local same, entries, parallel = true, 0, 0
+    for _ = 1, ticks do
+        local outs, counts = {}, {}
+        for i in ipairs(threads) do
+            step(poses[i], size, 10, rands[i])
+            outs[i] = {}
+            counts[i] = tick(spaces[i], poses[i], view, outs[i])
+        end
+        entries = entries + counts[1]
+        parallel = parallel + spaces[3]:parallel_count()
+        for i = 2, #threads do
+            if counts[i] ~= counts[1] then
+                same = false
+            end
+            for j = 1, counts[1] do
+                if outs[i][j] ~= outs[1][j] then
+                    same = false
+                    break
+                end
+            end
+        end
+    end
+    log_info("[aoi_parallel] same output: {}, {} ticks {} entries, 4 threads parallel moves {}%", same, ticks, entries,
+            parallel * 100 // (count * ticks))
+    if not same then
+        log_err("[aoi_parallel] parallel flush differs from single thread")
+    end
+end
+
+--大地图持续移动, 墙钟时间计算单帧flush耗时
+local function bench()
+    for _, case in ipairs({ { 2048, 5000, 192 }, { 4096, 20000, 192 } }) do
+        local size, count, view, ticks = case[1], case[2], case[3], 10
+        for _, threads in ipairs({ 1, 2, 4 }) do
+            local space, out = create(size, threads), {}
+            local rand = lcg(23)
+            local pos = spawn(space, count, size, view, rand)
+            local cost, parallel = 0, 0
+            collectgarbage("collect")
+            for _ = 1, ticks do
+                step(pos, size, 8, rand)
+                local sclock_ms = lclock_ms()
+                tick(space, pos, view, out)
+                cost = cost + lclock_ms() - sclock_ms
+                parallel = parallel + space:parallel_count()
+            end
+            log_info("[aoi_parallel] {} entities map {} threads {}: {} ms/tick, parallel moves {}%", count, size, threads,
+                    cost // ticks, parallel * 100 // (count * ticks))
+            space:enable_parallel(0)
+        end
+    end
+end
+
+check_same()
+bench()
@@ -0,0 +1,172 @@
+--aoi_query_test.lua
+--aoi范围查询测试: 圆形/扇形/最近k个查询与暴力遍历结果对比, 以及与原矩形查询的单次耗时对比
+local log_info      = logger.info
+local log_err       = logger.err
+local oclock        = os.clock
+
+local laoi          = require("laoi")
+
+local ORIGIN        = -512
+local SIZE          = 1024
+local CHECKS        = 300
+local ROUND         = 20000
+
+--固定种子的线性同余
+local function lcg(seed)
+    local state = seed
+    return function(n)
+        state = (state * 1103515245 + 12345) % 2147483648
+        --低位周期很短, 取高位
+        return (state >> 8) % n
+    end
+end
+
+--field: 整张地图均匀分布; square: 集中在128x128的广场
+local function build(count, spread, rand)
+    local space, objs = laoi.create(ORIGIN, ORIGIN, SIZE, 16), {}
+    local base = ORIGIN + (SIZE - spread) // 2
+    for id = 1, count do
+        local x, y, layer = base + rand(spread), base + rand(spread), 1 + rand(2)
+        objs[id] = { x = x, y = y, layer = layer }
+        space:insert(id, x, y, 0, 0, layer, 2)
+    end
+    return space, objs
+end
+
+local function layer_ok(obj, mask)
+    return mask == 0 or (mask & (1 << obj.layer)) ~= 0
+end
+
+local function sorted(buf, count)
+    local list = table.move(buf, 1, count, 1, {})
+    table.sort(list)
+    return table.concat(list, ",")
+end
+
+local function brute_circle(objs, x, y, r, mask)
+    local list = {}
+    for id, obj in ipairs(objs) do
+        local dx, dy = obj.x - x, obj.y - y
+        if dx * dx + dy * dy <= r * r and layer_ok(obj, mask) then
+            list[#list + 1] = id
+        end
+    end
+    return sorted(list, #list)
+end
+
+--扇形边界附近的点浮点误差可能不同, 跳过离边界太近的点
+local function brute_sector(objs, x, y, r, dir, half, mask)
+    local list, skip = {}, {}
+    for id, obj in ipairs(objs) do
+        local dx, dy = obj.x - x, obj.y - y
+        if dx * dx + dy * dy <= r * r and layer_ok(obj, mask) then
+            local diff = 0
+            if dx ~= 0 or dy ~= 0 then
+                diff = math.abs((math.deg(math.atan(dy, dx)) - dir + 540) % 360 - 180)
+            end
+            if math.abs(diff - half) < 0.01 then
+                skip[id] = true
+            elseif diff <= half then
+                list[#list + 1] = id
+            end
+        end
+    end
+    return list, skip
+end
+
+local function brute_nearest(objs, x, y, r, k, mask)
+    local list = {}
+    for _, obj in ipairs(objs) do
+        local dx, dy = obj.x - x, obj.y - y
+        local d2 = dx * dx + dy * dy
+        if d2 <= r * r and layer_ok(obj, mask) then
+            list[#list + 1] = d2
+        end
+    end
+    table.sort(list)
+    return table.concat(list, ",", 1, math.min(k, #list))
+end
+
+local function distances(objs, buf, count, x, y)
+    local list = {}
+    for i = 1, count do
+        local obj = objs[buf[i]]
+        list[i] = (obj.x - x) * (obj.x - x) + (obj.y - y) * (obj.y - y)
+    end
+    return table.concat(list, ",")
+end
+
+local function check(name, space, objs, spread, rand)
+    local buf, base, valid, total = {}, ORIGIN + (SIZE - spread) // 2, true, 0
+    local masks = { 0, 1 << 1, 1 << 2 }
+    for _ = 1, CHECKS do
+        local x, y, mask = base + rand(spread), base + rand(spread), masks[1 + rand(3)]
+        local r = 20 + rand(100)
+        local n = space:query_circle(x, y, r, mask, buf)
+        valid = valid and sorted(buf, n) == brute_circle(objs, x, y, r, mask)
+        total = total + n
+        local dir, half = rand(360), 15 + rand(150)
+        n = space:query_sector(x, y, r, dir, half, mask, buf)
+        local expect, skip = brute_sector(objs, x, y, r, dir, half, mask)
+        local got = {}
+        for i = 1, n do
+            if not skip[buf[i]] then
+                got[#got + 1] = buf[i]
+            end
+        end
+        valid = valid and sorted(got, #got) == sorted(expect, #expect)
+        local k = 1 + rand(16)
+        n = space:query_nearest(x, y, r, k, mask, buf)
+        valid = valid and distances(objs, buf, n, x, y) == brute_nearest(objs, x, y, r, k, mask)
+    end
+    log_info("[aoi_query] {} valid: {}, avg circle hits {}", name, valid, total // CHECKS)
+    if not valid then
+        log_err("[aoi_query] {} query differs from brute force", name)
+    end
+end
+
+local function cost_ns(func)
+    local best
+    for _ = 1, 3 do
+        local sclock = oclock()
+        for i = 1, ROUND do
+            func(i)
+        end
+        local cost = (oclock() - sclock) * 1000000000 // ROUND
+        best = best and math.min(best, cost) or cost
+    end
+    return best
+end
+
+--同样的查询中心, 矩形取外接正方形
+local function bench(name, space, spread, radius)
+    local rand, base, buf = lcg(99), ORIGIN + (SIZE - spread) // 2, {}
+    local xs, ys = {}, {}
+    for i = 1, ROUND do
+        xs[i], ys[i] = base + rand(spread), base + rand(spread)
+    end
+    local rect = cost_ns(function(i) space:query(xs[i], ys[i], radius * 2, radius * 2, buf) end)
+    local circle = cost_ns(function(i) space:query_circle(xs[i], ys[i], radius, 0, buf) end)
+    local layer = cost_ns(function(i) space:query_circle(xs[i], ys[i], radius, 1 << 1, buf) end)
+    local sector = cost_ns(function(i) space:query_sector(xs[i], ys[i], radius, i % 360, 45, 0, buf) end)
+    local nearest = cost_ns(function(i) space:query_nearest(xs[i], ys[i], radius, 8, 0, buf) end)
+    log_info("[aoi_query] {} r={}: rect {} ns, circle {} ns, circle+layer {} ns, sector(90°) {} ns, nearest(8) {} ns",
+            name, radius, rect, circle, layer, sector, nearest)
+end
+
+for _, case in ipairs({ { "field", 20000, SIZE }, { "square", 5000, 128 } }) do
+    local name, count, spread = case[1], case[2], case[3]
+    local rand = lcg(17)
+    local space, objs = build(count, spread, rand)
+    check(name, space, objs, spread, rand)
+    --移动后格子内的坐标列同步更新
+    for id, obj in ipairs(objs) do
+        obj.x = math.max(ORIGIN, math.min(ORIGIN + SIZE - 1, obj.x + rand(41) - 20))
+        obj.y = math.max(ORIGIN, math.min(ORIGIN + SIZE - 1, obj.y + rand(41) - 20))
+        space:update(id, obj.x, obj.y, 0, 0, obj.layer)
+    end
+    check(name .. " moved", space, objs, spread, rand)
+    for _, radius in ipairs({ 32, 96 }) do
+        bench(name, space, spread, radius)
+    end
+end
@@ -0,0 +1,216 @@
+--bitarray_simd_test.lua
+--位数组测试: 64位字的批量位运算/计数/rank/select/遍历与逐位参考结果一致, 稀疏位图与稠密位图一致, 以及百万位的耗时
+local log_info   = logger.info
+local log_err    = logger.err
+local oclock     = os.clock
+local tconcat    = table.concat
+
+local lcodec     = require("lcodec")
+
+local NBITS      = 1000000
+local ROUND      = 200
+
+--固定种子的线性同余
+local function lcg(seed)
+    local state = seed
+    return function(n)
+        state = (state * 1103515245 + 12345) % 2147483648
+        --低位周期很短, 取高位
+        return (state >> 8) % n
+    end
+end
+
+--按密度随机置位, 同时记录参考表
+local function random_array(nbits, density, seed)
+    local rand = lcg(seed)
+    local array, ref = lcodec.bitarray(nbits), {}
+    for i = 1, nbits do
+        if rand(1000) < density then
+            array.set_bit(i, 1)
+            ref[i] = 1
+        end
+    end
+    return array, ref
+end
+
+local function ref_string(ref, nbits)
+    local out = {}
+    for i = 1, nbits do
+        out[i] = ref[i] and "1" or "0"
+    end
+    return tconcat(out)
+end
+
+--各种长度(跨字边界)下与逐位参考比较
+local function check_dense()
+    local valid = true
+    for _, nbits in ipairs({ 1, 63, 64, 65, 127, 200, 1000 }) do
+        local a, ra = random_array(nbits, 500, nbits)
+        local b, rb = random_array(nbits, 300, nbits + 7)
+        local sand, sor, sxor, snot = {}, {}, {}, {}
+        for i = 1, nbits do
+            sand[i] = (ra[i] and rb[i]) and "1" or "0"
+            sor[i] = (ra[i] or rb[i]) and "1" or "0"
+            sxor[i] = ((ra[i] ~= nil) ~= (rb[i] ~= nil)) and "1" or "0"
+            snot[i] = ra[i] and "0" or "1"
+        end
+        local c1, c2, c3, c4 = a.clone(), a.clone(), a.clone(), a.clone()
+        c1.band(b)
+        c2.bor(b)
+        c3.bxor(b)
+        c4.flip()
+        valid = valid and c1.to_string() == tconcat(sand) and c2.to_string() == tconcat(sor)
+                and c3.to_string() == tconcat(sxor) and c4.to_string() == tconcat(snot)
+        --计数, rank, select, 遍历
+        local count, idx, iter = 0, a.indexes(), {}
+        for i = 1, nbits do
+            if ra[i] then
+                count = count + 1
+                valid = valid and a.rank(i) == count and a.select(count) == i and idx[count] == i
+            end
+        end
+        local pos = a.next_bit(1)
+        while pos > 0 do
+            iter[#iter + 1] = pos
+            pos = a.next_bit(pos + 1)
+        end
+        valid = valid and a.count() == count and #iter == count and a.select(count + 1) == 0
+        --移位, 反转, 切片, 拼接
+        local s = ref_string(ra, nbits)
+        for _, shift in ipairs({ 1, 13, 64, 70 }) do
+            local l, r = a.clone(), a.clone()
+            l.lshift(shift)
+            r.rshift(shift)
+            local sl = (s:sub(shift + 1) .. string.rep("0", nbits)):sub(1, nbits)
+            local sr = (string.rep("0", shift) .. s):sub(1, nbits)
+            valid = valid and l.to_string() == sl and r.to_string() == sr
+        end
+        local rev = a.clone()
+        rev.reverse()
+        valid = valid and rev.to_string() == s:reverse()
+        if nbits > 10 then
+            local part = a.slice(3, nbits - 5)
+            valid = valid and part.to_string() == s:sub(3, nbits - 5)
+            local cat = a.clone()
+            cat.concat(part)
+            valid = valid and cat.to_string() == s .. s:sub(3, nbits - 5)
+        end
+        local self_cat = a.clone()
+        self_cat.concat(self_cat)
+        valid = valid and self_cat.to_string() == s .. s
+        if not valid then
+            log_err("[bitarray_simd] dense mismatch at {} bits", nbits)
+            break
+        end
+    end
+    --原有的数值接口
+    local array = lcodec.bitarray(32)
+    array.from_uint32(65535)
+    array.rshift(1)
+    local number = array.to_uint32() == 32767
+    log_info("[bitarray_simd] dense same as reference: {}, number api: {}", valid, number)
+end
+
+--稀疏位图与稠密位图结果一致, 包括数组桶和位图桶之间的转换
+local function check_sparse()
+    local valid = true
+    local nbits = 300000
+    for _, density in ipairs({ 2, 100 }) do
+        local a = random_array(nbits, density, density)
+        local b = random_array(nbits, 50, density + 1)
+        local sa, sb = lcodec.sparse_bitarray(), lcodec.sparse_bitarray()
+        for _, pos in ipairs(a.indexes()) do
+            sa.set_bit(pos, 1)
+        end
+        for _, pos in ipairs(b.indexes()) do
+            sb.set_bit(pos, 1)
+        end
+        valid = valid and sa.count() == a.count() and tconcat(sa.indexes(), ",") == tconcat(a.indexes(), ",")
+        for _, pos in ipairs({ 1, 777, 65535, 65536, 65537, 200001, nbits }) do
+            valid = valid and sa.rank(pos) == a.rank(pos) and sa.get_bit(pos) == a.get_bit(pos)
+                    and sa.next_bit(pos) == a.next_bit(pos)
+        end
+        for _, k in ipairs({ 1, 100, a.count() }) do
+            valid = valid and sa.select(k) == a.select(k)
+        end
+        for _, op in ipairs({ "band", "bor", "bxor" }) do
+            local d, s = a.clone(), sa.clone()
+            d[op](b)
+            s[op](sb)
+            valid = valid and tconcat(s.indexes(), ",") == tconcat(d.indexes(), ",")
+        end
+        --删除后桶从位图退回数组
+        local s, left = sa.clone(), {}
+        for _, pos in ipairs(a.indexes()) do
+            if pos % 4 > 0 then
+                s.set_bit(pos, 0)
+            else
+                left[#left + 1] = pos
+            end
+        end
+        valid = valid and s.count() == #left and tconcat(s.indexes(), ",") == tconcat(left, ",")
+        log_info("[bitarray_simd] sparse density {}/1000: containers {}, bitmaps {} -> {} after erase, same as dense: {}",
+                density, sa.containers(), sa.bitmaps(), s.bitmaps(), valid)
+    end
+    if not valid then
+        log_err("[bitarray_simd] sparse mismatch")
+    end
+end
+
+local function cost_us(count, func)
+    collectgarbage("collect")
+    local sclock = oclock()
+    for i = 1, count do
+        func(i)
+    end
+    return (oclock() - sclock) * 1000000 // count
+end
+
+--百万位: 批量运算/计数/rank/select/遍历, 与逐位的lua循环对比; 稀疏时与稀疏位图对比内存和遍历
+local function bench()
+    local a = random_array(NBITS, 500, 1)
+    local b = random_array(NBITS, 500, 2)
+    local rand = lcg(3)
+    local band = cost_us(ROUND, function() a.band(b) end)
+    local bor = cost_us(ROUND, function() a.bor(b) end)
+    local bxor = cost_us(ROUND, function() a.bxor(b) end)
+    local bnot = cost_us(ROUND, function() a.flip() end)
+    local count = cost_us(ROUND, function() a.count() end)
+    local loop = cost_us(1, function()
+        local n = 0
+        for i = 1, NBITS do
+            n = n + a.get_bit(i)
+        end
+    end)
+    local ops = 100000
+    local rank = cost_us(1, function()
+        for _ = 1, ops do
+            a.rank(1 + rand(NBITS))
+        end
+    end) * 1000 // ops
+    local total = a.count()
+    local select = cost_us(1, function()
+        for _ = 1, ops do
+            a.select(1 + rand(total))
+        end
+    end) * 1000 // ops
+    local indexes = cost_us(10, function() a.indexes() end)
+    log_info("[bitarray_simd] {} bits: and {} us, or {} us, xor {} us, not {} us, count {} us (get_bit loop {} us), rank {} ns, select {} ns, indexes {} us ({} bits)",
+            NBITS, band, bor, bxor, bnot, count, loop, rank, select, indexes, total)
+    --稀疏: 千分之一
+    local d = random_array(NBITS, 1, 4)
+    local s = lcodec.sparse_bitarray()
+    for _, pos in ipairs(d.indexes()) do
+        s.set_bit(pos, 1)
+    end
+    local dense_iter = cost_us(100, function() d.indexes() end)
+    local sparse_iter = cost_us(100, function() s.indexes() end)
+    local dense_count = cost_us(100, function() d.count() end)
+    local sparse_count = cost_us(100, function() s.count() end)
+    log_info("[bitarray_simd] sparse {} of {} bits: memory dense {} B, sparse {} B; indexes {} us vs {} us; count {} us vs {} us",
+            d.count(), NBITS, d.memory(), s.memory(), dense_iter, sparse_iter, dense_count, sparse_count)
+end
+
+check_dense()
+check_sparse()
+bench()
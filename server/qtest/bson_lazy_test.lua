@@ -0,0 +1,204 @@
+--bson_lazy_test.lua
+--bson惰性解码测试: 1k文档批次对比全量解码和惰性解码的耗时/内存, 并通过模拟mongo服务验证游标迭代
+local ssub          = string.sub
+local sformat       = string.format
+local spack         = string.pack
+local sunpack       = string.unpack
+local log_info      = logger.info
+local log_err       = logger.err
+local lclock_ms     = timer.clock_ms
+local bencode       = bson.encode
+local bdecode       = bson.decode
+local blazy         = bson.lazy
+local btotable      = bson.totable
+
+local Socket        = import("driver/socket.lua")
+local MongoDB       = import("driver/mongo_new.lua")
+local thread_mgr    = hive.get("thread_mgr")
+
+local PORT          = 8750
+local BATCH         = 1000
+local TOTAL         = 3500
+local ROUND         = 50
+
+local function make_doc(i)
+    return {
+        uid = 100000 + i, name = "player" .. i, level = i % 100, exp = i * 13, gold = i * 1000, vip = i % 10,
+        online = (i % 2 == 0), login_time = 1700000000 + i, logout_time = 1700003600 + i, channel = "bench",
+        pos = { x = i * 1.5, y = i * 2.5, z = 0.5 }, attrs = { hp = 1000 + i, mp = 500 + i, atk = 80, def = 60 },
+        items = { { id = 1, num = i }, { id = 2, num = i + 1 }, { id = 3, num = i + 2 }, { id = 4, num = i + 3 } },
+        tags = { "a", "b", "c" }, desc = "bench document for lazy bson decode",
+    }
+end
+
+local function make_reply(first, last, cursor_id, key)
+    local docs = {}
+    for i = first, last do
+        docs[#docs + 1] = make_doc(i)
+    end
+    return bencode({ cursor = { [key] = docs, id = cursor_id, ns = "bench.player" }, ok = 1 })
+end
+
+--单次解码的内存分配(KB), 解码期间停止gc
+local function measure(func)
+    collectgarbage("collect")
+    collectgarbage("stop")
+    local before = collectgarbage("count")
+    local res    = func()
+    local mem    = collectgarbage("count") - before
+    collectgarbage("restart")
+    return mem, res
+end
+
+local function bench_decode()
+    local data = make_reply(1, BATCH, 0, "firstBatch")
+    --全量解码, 读取两个字段
+    local sclock_ms = lclock_ms()
+    for _ = 1, ROUND do
+        local reply = bdecode(data)
+        for _, doc in ipairs(reply.cursor.firstBatch) do
+            local _ = doc.uid + doc.level
+        end
+    end
+    local eager_ms = lclock_ms() - sclock_ms
+    --惰性解码, 读取两个字段
+    sclock_ms = lclock_ms()
+    for _ = 1, ROUND do
+        local reply = blazy(data)
+        for _, doc in ipairs(reply.cursor.firstBatch) do
+            local _ = doc.uid + doc.level
+        end
+    end
+    local lazy_ms = lclock_ms() - sclock_ms
+    local eager_kb = measure(function()
+        return bdecode(data)
+    end)
+    local lazy_kb = measure(function()
+        local reply = blazy(data)
+        local docs  = {}
+        for i, doc in ipairs(reply.cursor.firstBatch) do
+            docs[i] = doc.uid
+        end
+        return docs
+    end)
+    log_info("[bson_lazy] {} docs({} KB) x {}: eager {} ms {} KB, lazy(2 fields) {} ms {} KB", BATCH, #data // 1024, ROUND,
+            eager_ms, eager_kb // 1, lazy_ms, lazy_kb // 1)
+    --结果一致性
+    local eager  = bdecode(data).cursor.firstBatch
+    local lazy   = blazy(data).cursor.firstBatch
+    local doc    = lazy[BATCH]
+    local full   = btotable(doc)
+    local part   = btotable(doc, { "uid", "pos", "none" })
+    local fields = 0
+    for _ in pairs(doc) do
+        fields = fields + 1
+    end
+    log_info("[bson_lazy] len:{} same:{} items:{} tags:{} pos:{} fields:{} part:{},{},{}", #lazy, doc.attrs == doc.attrs,
+            doc.items[4].num == eager[BATCH].items[4].num, doc.tags[3] == "c", full.pos.y == eager[BATCH].pos.y, fields,
+            part.uid, part.pos.x, part.none)
+    local ok, err = pcall(function()
+        doc.uid = 1
+    end)
+    log_info("[bson_lazy] readonly: {}", not ok and err ~= nil)
+    --数字形式的键保持字符串, 重复键按出现顺序各遍历一次
+    local elems = spack("<Bzi4", 0x10, "a", 1) .. spack("<Bzi4", 0x10, "1", 2) .. spack("<Bzi4", 0x10, "a", 3)
+    local raw   = spack("<i4", #elems + 5) .. elems .. "\0"
+    local keys  = {}
+    for k, v in pairs(blazy(raw)) do
+        keys[#keys + 1] = sformat("%s(%s)=%d", k, type(k), v)
+    end
+    local order = table.concat(keys, ",")
+    log_info("[bson_lazy] pairs keys: {}, expect: {}", order, order == "a(string)=1,1(string)=2,a(string)=3")
+    --嵌套文档长度非法时报错, 不越界读取
+    elems = spack("<Bzi4", 0x03, "d", 1)
+    local sok = pcall(function()
+        return blazy(spack("<i4", #elems + 5) .. elems .. "\0").d
+    end)
+    --扫描失败后再次访问仍然报错, 不返回残缺的索引
+    elems = spack("<Bzi4", 0x10, "a", 1) .. spack("<Bz", 0x7e, "b")
+    local bad = blazy(spack("<i4", #elems + 5) .. elems .. "\0")
+    local iok1 = pcall(function() return bad.a end)
+    local iok2 = pcall(function() return bad.a end)
+    log_info("[bson_lazy] short embedded rejected: {}, failed index stays failed: {}", not sok, not iok1 and not iok2)
+end
+
+--模拟mongo服务: 解析OP_MSG请求, 支持find和getMore
+local MongoStub     = class()
+function MongoStub:__init()
+    self.clients = {}
+end
+
+function MongoStub:on_socket_accept(socket, token)
+    self.clients[token] = socket
+end
+
+function MongoStub:on_socket_error(socket, token, err)
+    self.clients[token] = nil
+end
+
+function MongoStub:on_socket_recv(socket)
+    local buf, pos = socket.recvbuf, 1
+    while pos + 4 <= #buf do
+        local len, request_id = sunpack("<I4I4", buf, pos)
+        if pos + len - 1 > #buf then
+            break
+        end
+        local cmd = bdecode(ssub(buf, pos + 21, pos + len - 1))
+        pos = pos + len
+        local reply
+        if cmd.find then
+            reply = make_reply(1, BATCH, 7, "firstBatch")
+        elseif cmd.getMore then
+            local first = (cmd.getMore - 6) * BATCH + 1
+            local last  = math.min(first + BATCH - 1, TOTAL)
+            reply = make_reply(first, last, last < TOTAL and cmd.getMore + 1 or 0, "nextBatch")
+        elseif cmd.sequence then
+            --body之后附带kind-1文档序列
+            local docs = bencode({ id = 1 }) .. bencode({ id = 2 })
+            reply = bencode({ ok = 1 }) .. spack("<BI4z", 1, 4 + 5 + #docs, "docs") .. docs
+        else
+            reply = bencode({ ok = 1 })
+        end
+        socket:send(spack("<I4I4I4I4I4B", 21 + #reply, 0, request_id, 2013, 0, 0) .. reply)
+    end
+    socket:pop(pos - 1)
+end
+
+local function bench_cursor()
+    local listener = Socket(MongoStub())
+    listener:listen("127.0.0.1", PORT)
+    local mongo_db = MongoDB({ hosts = { { "127.0.0.1", PORT } }, db = "bench", user = "", passwd = "", opts = {} })
+    while not mongo_db:available() do
+        thread_mgr:sleep(100)
+    end
+    local sclock_ms = lclock_ms()
+    local ok, docs  = mongo_db:find("player", {}, nil, nil, TOTAL)
+    local eager_ms  = lclock_ms() - sclock_ms
+    sclock_ms       = lclock_ms()
+    local iok, iter = mongo_db:find_iter("player", {})
+    local count, valid = 0, iok
+    for doc in iter do
+        count = count + 1
+        valid = valid and doc.uid == 100000 + count
+    end
+    local lazy_ms = lclock_ms() - sclock_ms
+    log_info("[bson_lazy] cursor {} docs: find {} docs {} ms, find_iter {} docs {} ms, valid: {}", TOTAL, ok and #docs,
+            eager_ms, count, lazy_ms, valid)
+    --惰性请求的回复带文档序列时合并返回, 不丢失序列中的文档
+    local sok, sreply = mongo_db:lazyCommand("sequence")
+    local merged = sok and sreply.docs and #sreply.docs == 2 and sreply.docs[2].id == 2
+    log_info("[bson_lazy] lazy reply with document sequence merged: {}", merged)
+    if not merged then
+        log_err("[bson_lazy] document sequence dropped")
+    end
+    if not valid or count ~= TOTAL then
+        log_err("[bson_lazy] find_iter failed")
+    end
+    mongo_db:close()
+    listener:close()
+end
+
+thread_mgr:fork(function()
+    bench_decode()
+    bench_cursor()
+end)
@@ -0,0 +1,83 @@
+--codec_dict_test.lua
+--luakit编码字典测试: 高频键名/短字符串编码为序号, 对比字节数和编解码耗时
+local log_info      = logger.info
+local log_err       = logger.err
+local lclock_ms     = timer.clock_ms
+local lencode       = luakit.encode
+local ldecode       = luakit.decode
+local ldictionary   = luakit.dictionary
+
+local ROUND         = 50000
+
+local DICTIONARY    = {
+    "player_id", "cache_name", "primary_key", "player", "player_bag", "player_attr", "fields", "code", "flush",
+    "item_id", "count", "bind", "name", "level", "gold", "rpc_cache_load", "rpc_cache_update",
+}
+
+--缓存服务的典型请求
+local function make_load(i)
+    return "rpc_cache_load", 100000 + i, { cache_name = "player", primary_key = "player_id", player_id = 100000 + i, flush = false }
+end
+
+local function make_update(i)
+    local rows = {}
+    for j = 1, 20 do
+        rows[j] = { player_id = 100000 + i, cache_name = "player_bag", item_id = 1000 + j, count = j, bind = (j % 2 == 0) }
+    end
+    return "rpc_cache_update", 100000 + i, { cache_name = "player_bag", primary_key = "player_id", fields = rows }
+end
+
+local function same(a, b)
+    if type(a) ~= "table" or type(b) ~= "table" then
+        return a == b
+    end
+    for k, v in pairs(a) do
+        if not same(v, b[k]) then
+            return false
+        end
+    end
+    for k in pairs(b) do
+        if a[k] == nil then
+            return false
+        end
+    end
+    return true
+end
+
+local PAYLOADS = { { "cache_load", make_load }, { "cache_update", make_update } }
+
+local function bench(mode)
+    for _, payload in ipairs(PAYLOADS) do
+        local name, args = payload[1], { payload[2](1) }
+        local data = lencode(table.unpack(args))
+        collectgarbage("collect")
+        local sclock_ms = lclock_ms()
+        for _ = 1, ROUND do
+            lencode(table.unpack(args))
+        end
+        local enc_ms = lclock_ms() - sclock_ms
+        collectgarbage("collect")
+        sclock_ms = lclock_ms()
+        for _ = 1, ROUND do
+            ldecode(data)
+        end
+        local dec_ms = lclock_ms() - sclock_ms
+        local valid = same(args, { ldecode(data) })
+        log_info("[codec_dict] {} {}: {} bytes, encode {} ns/msg, decode {} ns/msg, valid: {}", mode, name, #data,
+                enc_ms * 1000000 // ROUND, dec_ms * 1000000 // ROUND, valid)
+        if not valid then
+            log_err("[codec_dict] {} {} roundtrip failed", mode, name)
+        end
+    end
+end
+
+bench("raw")
+ldictionary(DICTIONARY)
+bench("dict")
+local data = lencode(make_load(2))
+--字典不一致时解码报错
+ldictionary({})
+local ok = pcall(ldecode, data)
+log_info("[codec_dict] decode without dictionary failed: {}", not ok)
+ldictionary(DICTIONARY)
+log_info("[codec_dict] long string rejected: {}", not pcall(ldictionary, { string.rep("k", 64) }))
@@ -0,0 +1,102 @@
+--codec_shape_test.lua
+--luakit编码结构缓存测试: 对比通用编码/消息内学习结构/注册结构的字节数和单条耗时
+local srep          = string.rep
+local log_info      = logger.info
+local log_err       = logger.err
+local lclock_ms     = timer.clock_ms
+local lencode       = luakit.encode
+local ldecode       = luakit.decode
+local lshape        = luakit.shape
+local lshape_learn  = luakit.shape_learn
+
+local ROUND         = 50000
+
+local function make_sync(i)
+    return {
+        id = 100000 + i, name = "player" .. i, level = i % 100, hp = 1000 + i, mp = 500 + i, online = true,
+        pos = { x = i * 1.5, y = i * 2.5, z = 0.5 },
+        buffs = { { id = 1, time = 60, stack = 1 }, { id = 2, time = 30, stack = 2 }, { id = 3, time = 10, stack = 3 } },
+    }
+end
+
+local function make_items(n)
+    local items = {}
+    for i = 1, n do
+        items[i] = { id = 1000 + i, uuid = 900000000 + i, count = i % 20, bind = (i % 2 == 0), expire = 0 }
+    end
+    return items
+end
+
+local function same(a, b)
+    if type(a) ~= "table" or type(b) ~= "table" then
+        return a == b
+    end
+    for k, v in pairs(a) do
+        if not same(v, b[k]) then
+            return false
+        end
+    end
+    for k in pairs(b) do
+        if a[k] == nil then
+            return false
+        end
+    end
+    return true
+end
+
+local PAYLOADS = {
+    { "sync_attr", function() return "rpc_sync_attr", 1001, make_sync(1) end },
+    { "item_list", function() return "rpc_sync_items", 1001, make_items(50) end },
+}
+
+local function bench(mode)
+    for _, payload in ipairs(PAYLOADS) do
+        local name, args = payload[1], { payload[2]() }
+        local data = lencode(table.unpack(args))
+        collectgarbage("collect")
+        local sclock_ms = lclock_ms()
+        for _ = 1, ROUND do
+            lencode(table.unpack(args))
+        end
+        local enc_ms = lclock_ms() - sclock_ms
+        collectgarbage("collect")
+        sclock_ms = lclock_ms()
+        for _ = 1, ROUND do
+            ldecode(data)
+        end
+        local dec_ms = lclock_ms() - sclock_ms
+        local res = { ldecode(data) }
+        log_info("[codec_shape] {} {}: {} bytes, encode {} ns/msg, decode {} ns/msg, valid: {}", mode, name, #data,
+                enc_ms * 1000000 // ROUND, dec_ms * 1000000 // ROUND, same(args, res))
+        if not same(args, res) then
+            log_err("[codec_shape] {} {} roundtrip failed", mode, name)
+        end
+    end
+end
+
+bench("generic")
+lshape_learn(true)
+bench("learn")
+lshape(1, { "id", "name", "level", "hp", "mp", "online", "pos", "buffs" })
+lshape(2, { "x", "y", "z" })
+lshape(3, { "id", "time", "stack" })
+lshape(4, { "id", "uuid", "count", "bind", "expire" })
+bench("regist")
+lshape_learn(false)
+bench("regist-only")
+
+--超过64K的字符串使用32位长度
+local long = srep("x", 200000)
+local ok, res = pcall(ldecode, lencode({ text = long }, long))
+log_info("[codec_shape] long string: ok:{} valid:{}", ok, ok and res.text == long)
+--混合键和嵌套空表回退通用编码
+local mixed = { [1] = "a", key = "b", sub = {}, map = { [1001] = { id = 1 }, [1002] = { id = 2 } } }
+log_info("[codec_shape] mixed table valid: {}", same(mixed, ldecode(lencode(mixed))))
+--注册结构的键必须是不重复的字符串
+local num_ok = pcall(lshape, 5, { "a", 1 })
+local dup_ok = pcall(lshape, 5, { "a", "b", "a" })
+log_info("[codec_shape] regist reject number key: {}, duplicate key: {}", not num_ok, not dup_ok)
+--字段值解析失败的包报错, 不写坏注册结构的键名表
+local bad_ok = pcall(ldecode, string.pack("<BBI2B", 1, 13, 2, 4))
+local pos    = { x = 1, y = 2, z = 3 }
+log_info("[codec_shape] malformed shape rejected: {}, shape intact: {}", not bad_ok, same(pos, ldecode(lencode(pos))))
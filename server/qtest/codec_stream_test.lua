@@ -0,0 +1,243 @@
+--codec_stream_test.lua
+--文本协议大回复解析压测: 服务端整包下发, 客户端socket每次读取16K并增量扫描包边界, 收齐后一次解析
+local ssub          = string.sub
+local srep          = string.rep
+local spack         = string.pack
+local sformat       = string.format
+local tconcat       = table.concat
+local log_info      = logger.info
+local log_err       = logger.err
+local lclock_ms     = timer.clock_ms
+
+local jsoncodec     = json.jsoncodec
+local httpcodec     = codec.httpcodec
+local rediscodec    = codec.rediscodec
+local mysqlcodec    = codec.mysqlcodec
+
+local Socket        = import("driver/socket.lua")
+local thread_mgr    = hive.get("thread_mgr")
+
+--socket接收缓冲实际可用上限约8M, 单个回复需小于该值
+local SIZES         = { 1, 2, 4, 6 }
+local PORT          = 8720
+local TIMEOUT       = 120000
+local VALUE         = srep("v", 90)
+
+local Host          = class()
+function Host:__init(name)
+    self.name = name
+end
+
+function Host:on_socket_accept(socket)
+    self.accept = socket
+    if self.on_accept then
+        self.on_accept(socket)
+    end
+end
+
+function Host:on_socket_recv(socket, ...)
+    if self.on_recv then
+        self.on_recv(socket, ...)
+    end
+end
+
+function Host:on_socket_error(socket, token, err)
+    log_err("[codec_stream] {} socket error: {}", self.name, err)
+end
+
+local function listen(name, port, on_accept, on_recv)
+    local host     = Host(name)
+    host.on_accept = on_accept
+    host.on_recv   = on_recv
+    local socket   = Socket(host)
+    if not socket:listen("127.0.0.1", port) then
+        return
+    end
+    return socket, host
+end
+
+local function connect(name, port, on_recv)
+    local host   = Host(name)
+    host.on_recv = on_recv
+    local socket = Socket(host)
+    local ok, err = socket:connect("127.0.0.1", port)
+    if not ok then
+        log_err("[codec_stream] {} connect failed: {}", name, err)
+        return
+    end
+    return socket
+end
+
+--redis: HGETALL风格的数组回复
+local function build_redis(size)
+    local items, count, len = {}, 0, 0
+    while len < size do
+        local field = "field" .. count
+        local item  = sformat("$%d\r\n%s\r\n$%d\r\n%s\r\n", #field, field, #VALUE, VALUE)
+        items[#items + 1] = item
+        len   = len + #item
+        count = count + 2
+    end
+    return sformat("*%d\r\n%s", count, tconcat(items)), count
+end
+
+local function bench_redis()
+    local reply
+    local listener = listen("redis-svr", PORT, nil, function(socket)
+        socket:pop(#socket.recvbuf)
+        socket:send(reply)
+    end)
+    local client = connect("redis-cli", PORT, function(socket, session_id, ok, res)
+        thread_mgr:response(session_id, ok, res)
+    end)
+    if not client then
+        return
+    end
+    client:set_codec(rediscodec(jsoncodec()))
+    for _, mb in ipairs(SIZES) do
+        local count
+        reply, count = build_redis(mb * 1024 * 1024)
+        local sclock_ms  = lclock_ms()
+        local session_id = thread_mgr:build_session_id()
+        client:send_data(session_id, "HGETALL", "bench")
+        local ok, res = thread_mgr:yield(session_id, "redis bench", TIMEOUT)
+        local cost_ms = lclock_ms() - sclock_ms
+        local valid = ok and type(res) == "table" and #res == count and res[count] == VALUE
+        log_info("[codec_stream] redis {}MB reply: {} items, cost {} ms, valid: {}", mb, count, cost_ms, valid)
+    end
+    client:close()
+    listener:close()
+end
+
+--mysql: 握手包 + 两列结果集
+local function mysql_packet(seq, payload)
+    return spack("<I3B", #payload, seq) .. payload
+end
+
+local function mysql_lenenc(str)
+    local len = #str
+    if len < 0xfb then
+        return spack("B", len) .. str
+    elseif len < 0x10000 then
+        return spack("<BI2", 0xfc, len) .. str
+    end
+    return spack("<BI3", 0xfd, len) .. str
+end
+
+local function build_handshake()
+    local payload = spack("<Bz I4 c8 B I2 B I2 I2 B", 10, "5.7.0", 1, "12345678", 0, 0xf7ff, 33, 2, 0x0008, 21)
+            .. srep("\0", 10) .. "123456789012\0" .. "mysql_native_password\0"
+    return mysql_packet(0, payload)
+end
+
+local function build_mysql(size)
+    local seq = 1
+    local function packet(payload)
+        local data = mysql_packet(seq % 256, payload)
+        seq = seq + 1
+        return data
+    end
+    local function column(name, ctype)
+        return packet(tconcat({ mysql_lenenc("def"), mysql_lenenc("bench"), mysql_lenenc("t"), mysql_lenenc("t"),
+                                mysql_lenenc(name), mysql_lenenc(name), spack("<BI2I4BI2BI2", 0x0c, 33, 255, ctype, 0, 0, 0) }))
+    end
+    local eof   = spack("<BI2I2", 0xfe, 0, 2)
+    local items = { packet(spack("B", 2)), column("id", 0x08), column("name", 0xfd), packet(eof) }
+    local len, count = 0, 0
+    while len < size do
+        count = count + 1
+        local row = packet(mysql_lenenc(tostring(count)) .. mysql_lenenc(VALUE))
+        items[#items + 1] = row
+        len = len + #row
+    end
+    items[#items + 1] = packet(eof)
+    return tconcat(items), count
+end
+
+local function bench_mysql()
+    local reply
+    local listener = listen("mysql-svr", PORT + 1, function(socket)
+        --等待客户端设置codec后再下发握手包
+        thread_mgr:fork(function()
+            thread_mgr:sleep(200)
+            socket:send(build_handshake())
+        end)
+    end, function(socket)
+        socket:pop(#socket.recvbuf)
+        socket:send(reply)
+    end)
+    local client = connect("mysql-cli", PORT + 1, function(socket, session_id, ...)
+        thread_mgr:response(session_id, ...)
+    end)
+    if not client then
+        return
+    end
+    local auth_id = thread_mgr:build_session_id()
+    client:set_codec(mysqlcodec(auth_id))
+    local charset = thread_mgr:yield(auth_id, "mysql handshake", TIMEOUT)
+    if charset ~= 33 then
+        log_err("[codec_stream] mysql handshake failed: {}", charset)
+        return
+    end
+    for _, mb in ipairs(SIZES) do
+        local count
+        reply, count = build_mysql(mb * 1024 * 1024)
+        local sclock_ms  = lclock_ms()
+        local session_id = thread_mgr:build_session_id()
+        client:send_data(0x03, session_id, "select * from bench")
+        local ok, res = thread_mgr:yield(session_id, "mysql bench", TIMEOUT)
+        local cost_ms = lclock_ms() - sclock_ms
+        local rows = ok and res[1] or {}
+        local valid = #rows == count and rows[count].id == count and rows[count].name == VALUE
+        log_info("[codec_stream] mysql {}MB reply: {} rows, cost {} ms, valid: {}", mb, count, cost_ms, valid)
+    end
+    client:close()
+    listener:close()
+end
+
+--http: 服务端解析大请求, Content-Length和chunked各一次
+local function build_http(size, chunked)
+    local body = srep(VALUE, size // #VALUE)
+    if not chunked then
+        return sformat("POST /bench HTTP/1.1\r\nHost: 127.0.0.1\r\nContent-Length: %d\r\n\r\n%s", #body, body), body
+    end
+    local items = { "POST /bench HTTP/1.1\r\nHost: 127.0.0.1\r\nTransfer-Encoding: chunked\r\n\r\n" }
+    for pos = 1, #body, 4096 do
+        local chunk = ssub(body, pos, pos + 4095)
+        items[#items + 1] = sformat("%x\r\n%s\r\n", #chunk, chunk)
+    end
+    items[#items + 1] = "0\r\n\r\n"
+    return tconcat(items), body
+end
+
+local function bench_http()
+    local block_id
+    local listener = listen("http-svr", PORT + 2, nil, function(socket, method, url, params, headers, body)
+        thread_mgr:response(block_id, true, body)
+    end)
+    listener:set_codec(httpcodec(jsoncodec()))
+    local client = connect("http-cli", PORT + 2)
+    if not client then
+        return
+    end
+    for _, mb in ipairs(SIZES) do
+        for _, chunked in ipairs({ false, true }) do
+            local request, body = build_http(mb * 1024 * 1024, chunked)
+            local sclock_ms = lclock_ms()
+            block_id = thread_mgr:build_session_id()
+            client:send(request)
+            local ok, res = thread_mgr:yield(block_id, "http bench", TIMEOUT)
+            local cost_ms = lclock_ms() - sclock_ms
+            log_info("[codec_stream] http {}MB request(chunked:{}): cost {} ms, valid: {}", mb, chunked, cost_ms, ok and res == body)
+        end
+    end
+    client:close()
+    listener:close()
+end
+
+thread_mgr:fork(function()
+    thread_mgr:sleep(1000)
+    bench_redis()
+    bench_mysql()
+    bench_http()
+end)
@@ -0,0 +1,20 @@
+--frame_perf_test.lua
+local log_info   = logger.info
+
+local timer_mgr  = hive.get("timer_mgr")
+local scheduler  = hive.get("scheduler")
+local thread_mgr = hive.get("thread_mgr")
+
+--制造定时器卡顿
+timer_mgr:loop(100, function()
+    local sum = 0
+    for i = 1, 200000 do
+        sum = sum + i
+    end
+end)
+
+thread_mgr:fork(function()
+    thread_mgr:sleep(3000)
+    log_info("[frame_perf_test] master: {}", hive.perf_stats(true))
+    log_info("[frame_perf_test] workers: {}", scheduler:collect("rpc_frame_perf"))
+end)
@@ -0,0 +1,177 @@
+--http_parser_test.lua
+--http请求解析测试: pipeline批量发送典型/异常请求统计解析吞吐, 验证keep-alive按序回包和超长包头拒绝
+local srep          = string.rep
+local sfind         = string.find
+local sformat       = string.format
+local tconcat       = table.concat
+local log_info      = logger.info
+local log_err       = logger.err
+local lclock_ms     = timer.clock_ms
+local oclock        = os.clock
+
+local jsoncodec     = json.jsoncodec
+local httpcodec     = codec.httpcodec
+
+local Socket        = import("driver/socket.lua")
+local HttpServer    = import("network/http_server.lua")
+local thread_mgr    = hive.get("thread_mgr")
+
+local PORT          = 8770
+local TIMEOUT       = 10000
+
+local function typical(i)
+    return sformat("GET /gm/player?player_id=%d&area=1 HTTP/1.1\r\nHost: 127.0.0.1:8770\r\nUser-Agent: curl/7.81.0\r\n"
+            .. "Accept: */*\r\nAccept-Encoding: gzip, deflate\r\nConnection: keep-alive\r\nX-Request-Id: %d\r\n"
+            .. "Content-Type: application/json\r\nCookie: session=abcdefghijklmnopqrstuvwxyz0123456789\r\n\r\n", i, i)
+end
+
+local function many_headers(i)
+    local lines = { sformat("GET /gm/headers?i=%d HTTP/1.1", i) }
+    for h = 1, 60 do
+        lines[#lines + 1] = sformat("X-Custom-Header-%02d: value-%d-%d", h, h, i)
+    end
+    return tconcat(lines, "\r\n") .. "\r\n\r\n"
+end
+
+local function long_url(i)
+    return sformat("GET /gm/query?i=%d&data=%s HTTP/1.1\r\nHost: 127.0.0.1\r\n\r\n", i, srep("q", 4096))
+end
+
+local function chunked(i)
+    local chunks = {}
+    for c = 1, 64 do
+        chunks[c] = "40\r\n" .. srep("c", 64) .. "\r\n"
+    end
+    return sformat("POST /gm/upload?i=%d HTTP/1.1\r\nHost: 127.0.0.1\r\nTransfer-Encoding: chunked\r\n\r\n", i) .. tconcat(chunks) .. "0\r\n\r\n"
+end
+
+local CASES = {
+    { "typical", typical, 20000, 2000 },
+    { "headers", many_headers, 5000, 500 },
+    { "long_url", long_url, 5000, 200 },
+    { "chunked", chunked, 5000, 200 },
+}
+
+local Host          = class()
+function Host:__init(on_recv)
+    self.on_recv = on_recv
+end
+
+function Host:on_socket_accept(socket, token)
+    self.accept = socket
+end
+
+function Host:on_socket_recv(socket, ...)
+    if self.on_recv then
+        self.on_recv(socket, ...)
+    end
+end
+
+function Host:on_socket_error(socket, token, err)
+    self.error = err
+end
+
+local function connect(port, on_recv)
+    local host   = Host(on_recv)
+    local socket = Socket(host)
+    if not socket:connect("127.0.0.1", port) then
+        log_err("[http_parser] connect {} failed", port)
+        return
+    end
+    return socket, host
+end
+
+local function wait(cond)
+    local sclock_ms = lclock_ms()
+    while not cond() and lclock_ms() - sclock_ms < TIMEOUT do
+        thread_mgr:sleep(5)
+    end
+    return cond()
+end
+
+--解析开销: 请求按批次pipeline发送, 服务端只计数不回包
+--socket每帧处理时长受限, 墙钟时间主要是帧等待, 以进程cpu时间计算单个请求开销
+local function bench_parse()
+    local received, bodies = 0, 0
+    local listener = Socket(Host(function(socket, method, url, params, headers, body)
+        received = received + 1
+        if body then
+            bodies = bodies + #body
+        end
+    end))
+    listener:listen("127.0.0.1", PORT)
+    listener:set_codec(httpcodec(jsoncodec()))
+    local client = connect(PORT)
+    for _, case in ipairs(CASES) do
+        local name, make, count, batch = case[1], case[2], case[3], case[4]
+        local reqs = {}
+        for i = 1, count do
+            reqs[i] = make(i)
+        end
+        received, bodies = 0, 0
+        local sclock = oclock()
+        for i = 1, count, batch do
+            client:send(tconcat(reqs, "", i, math.min(i + batch - 1, count)))
+            wait(function() return received >= math.min(i + batch - 1, count) end)
+        end
+        local cost = (oclock() - sclock) * 1000000 // count
+        log_info("[http_parser] {}: {} requests({} bytes each) cpu {} us/req, body bytes: {}", name, received, #reqs[1], cost, bodies)
+        if received ~= count then
+            log_err("[http_parser] {} only received {}", name, received)
+        end
+    end
+    client:close()
+    listener:close()
+end
+
+--keep-alive: 首个请求挂起, 后续请求先处理完, 回包仍按请求顺序
+local function check_pipeline()
+    local server = HttpServer(sformat("127.0.0.1:%d", PORT + 1))
+    server:register_get("/slow", function()
+        thread_mgr:sleep(100)
+        return "slow"
+    end)
+    server:register_get("/fast", function()
+        return "fast"
+    end)
+    server:register_get("/none", function()
+    end)
+    local recvs  = {}
+    local client = connect(PORT + 1, function(socket)
+        recvs[#recvs + 1] = socket.recvbuf
+        socket:pop(#socket.recvbuf)
+    end)
+    local req    = "GET %s HTTP/1.1\r\nHost: 127.0.0.1\r\n\r\n"
+    client:send(sformat(req, "/slow") .. sformat(req, "/none") .. sformat(req, "/fast") .. sformat(req, "/fast"))
+    wait(function()
+        local _, n = tconcat(recvs):gsub("HTTP/1.1 200", "")
+        return n >= 3
+    end)
+    local data = tconcat(recvs)
+    local p1, p2, p3 = sfind(data, "slow", 1, true), sfind(data, "fast", 1, true), sfind(data, "fast", (sfind(data, "fast", 1, true) or 0) + 1, true)
+    --没有返回内容的请求回500, 不阻塞后续回包
+    local p0 = sfind(data, "HTTP/1.1 500", 1, true)
+    local ordered = p0 and p1 and p2 and p3 and p1 < p0 and p0 < p2 and p2 < p3
+    local alive = client.alive
+    client:send("GET /fast HTTP/1.1\r\nHost: 127.0.0.1\r\nConnection: close\r\n\r\n")
+    wait(function() return not client.alive end)
+    log_info("[http_parser] pipeline ordered: {}, keep-alive: {}, close after 'Connection: close': {}", ordered, alive, not client.alive)
+    --超过64K仍未结束的包头直接断开
+    local flood = connect(PORT + 1)
+    flood:send("GET /fast HTTP/1.1\r\n" .. srep("X-Flood: " .. srep("f", 100) .. "\r\n", 800))
+    wait(function() return not flood.alive end)
+    log_info("[http_parser] oversize header rejected: {}", not flood.alive)
+    --接近2^64的chunk长度和超过上限的Content-Length直接断开
+    local huge_chunk = connect(PORT + 1)
+    huge_chunk:send("POST /fast HTTP/1.1\r\nHost: 127.0.0.1\r\nTransfer-Encoding: chunked\r\n\r\nfffffffffffffffe\r\nabc\r\n0\r\n\r\n")
+    local huge_length = connect(PORT + 1)
+    huge_length:send("POST /fast HTTP/1.1\r\nHost: 127.0.0.1\r\nContent-Length: 999999999999999\r\n\r\nabc")
+    wait(function() return not huge_chunk.alive and not huge_length.alive end)
+    log_info("[http_parser] huge chunk rejected: {}, huge content-length rejected: {}", not huge_chunk.alive, not huge_length.alive)
+    server:on_quit()
+end
+
+thread_mgr:fork(function()
+    bench_parse()
+    check_pipeline()
+end)
@@ -0,0 +1,130 @@
+--lcache_blob_test.lua
+--缓存数据块测试: 读取不复制value, get_raw/set_raw共享同一个数据块, 以及数据块不经解码直接通过call_blob转发
+local log_info   = logger.info
+local log_err    = logger.err
+local oclock     = os.clock
+
+local thread_mgr = hive.get("thread_mgr")
+
+local PORT       = 29713
+local COUNT      = 100000
+local SENDS      = 2000
+
+local jcodec     = json.jsoncodec()
+
+local function make_value(size)
+    local items = {}
+    for i = 1, size // 16 do
+        items[i] = { id = i, name = "item" .. i }
+    end
+    return { id = 1001, items = items }
+end
+
+local function cost_ns(count, func)
+    collectgarbage("collect")
+    local sclock = oclock()
+    for i = 1, count do
+        func(i)
+    end
+    return (oclock() - sclock) * 1000000000 // count
+end
+
+--数据块共享引用: 覆盖和清空都不影响已经取出的数据块
+local function check_blob()
+    local cache = lcache.new(10, jcodec)
+    local value = make_value(256)
+    cache:set("a", value, 1000)
+    local blob = cache:get_raw("a")
+    local raw = blob:string()
+    local same = cache:get("a").items[16].name == "item16" and #blob == blob:size() and #blob == #raw
+    cache:set_raw("b", blob)
+    cache:set_raw("c", raw)
+    local shared = cache:get("b").id == 1001 and cache:get("c").items[1].id == 1
+    cache:set("a", 1)
+    cache:del("b")
+    cache:clear()
+    local alive = blob:string() == raw and cache:get_raw("none") == nil
+    log_info("[lcache_blob] decode same: {}, set_raw shared: {}, blob alive after clear: {}", same, shared, alive)
+    if not (same and shared and alive) then
+        log_err("[lcache_blob] blob check failed")
+    end
+end
+
+--同样大小的value: get解码, get_raw只取引用, 耗时和value大小无关
+local function bench_get()
+    for _, size in ipairs({ 256, 16384 }) do
+        local cache = lcache.shared("qtest_blob_" .. size, 256 * 1024 * 1024, jcodec)
+        local count = COUNT * 256 // size
+        for i = 1, 1000 do
+            cache:set(i, make_value(size))
+        end
+        local bytes = cache:get_raw(1):size()
+        local get = cost_ns(count, function(i) cache:get(1 + i % 1000) end)
+        local raw = cost_ns(count, function(i) cache:get_raw(1 + i % 1000) end)
+        local copy = cost_ns(count, function(i) cache:get_raw(1 + i % 1000):string() end)
+        log_info("[lcache_blob] {} bytes: get {} ns, get_raw {} ns, get_raw+string {} ns", bytes, get, raw, copy)
+    end
+end
+
+--本机rpc连接: 数据块作为字符串参数到达对端, 与解码后重新编码的转发对比
+local function check_forward()
+    local recv, sessions = {}, {}
+    local listener = luabus.listen("127.0.0.1", PORT)
+    if not listener then
+        log_err("[lcache_blob] listen {} failed", PORT)
+        return
+    end
+    listener.on_accept = function(session)
+        sessions[#sessions + 1] = session
+        session.on_call = function(recv_len, session_id, rpc_flag, source, rpc, ...)
+            recv[#recv + 1] = { rpc, ... }
+        end
+        session.on_error = function() end
+    end
+    local client = luabus.connect("127.0.0.1", PORT, 1000)
+    local connected = false
+    client.on_connect = function(res)
+        connected = (res == "ok")
+    end
+    client.on_error = function() end
+    for _ = 1, 50 do
+        if connected then
+            break
+        end
+        thread_mgr:sleep(20)
+    end
+    local cache = lcache.new(10, jcodec)
+    cache:set("player", make_value(16384))
+    local blob = cache:get_raw("player")
+    client.call_blob(0, 0, hive.id, "rpc_player", 1001, blob)
+    client.call(0, 0, hive.id, "rpc_player", 1001, cache:get("player"))
+    for _ = 1, 50 do
+        if #recv >= 2 then
+            break
+        end
+        thread_mgr:sleep(20)
+    end
+    local first, second = recv[1] or {}, recv[2] or {}
+    local same = first[1] == "rpc_player" and first[2] == 1001 and first[3] == blob:string()
+            and json.decode(first[3]).items[1000].name == second[3].items[1000].name
+    --每轮少量发送后让出, 避免发送缓冲区堆满
+    local blob_ns, call_ns = 0, 0
+    for _ = 1, SENDS // 20 do
+        blob_ns = blob_ns + cost_ns(20, function() client.call_blob(0, 0, hive.id, "rpc_player", 1001, cache:get_raw("player")) end)
+        call_ns = call_ns + cost_ns(20, function() client.call(0, 0, hive.id, "rpc_player", 1001, cache:get("player")) end)
+        thread_mgr:sleep(5)
+    end
+    log_info("[lcache_blob] forward connected: {}, same payload: {}, {} bytes: call_blob {} ns, decode+call {} ns",
+            connected, same, #blob, blob_ns * 20 // SENDS, call_ns * 20 // SENDS)
+    if not same then
+        log_err("[lcache_blob] forwarded blob differs")
+    end
+    client.close()
+    listener.close()
+end
+
+thread_mgr:fork(function()
+    check_blob()
+    bench_get()
+    check_forward()
+end)
@@ -0,0 +1,238 @@
+--lcache_shared_test.lua
+--共享缓存测试: 未命中/过期/字节上限, S3-FIFO与LRU在zipf和扫描负载下的命中率, 以及多线程共享同一缓存的吞吐
+local log_info   = logger.info
+local log_err    = logger.err
+local oclock     = os.clock
+local lclock_ms  = timer.clock_ms
+
+local QueueLRU   = import("container/queue_lru.lua")
+
+local scheduler  = hive.load("scheduler")
+
+local THREADS    = 4
+local KEYS       = 100000
+local REQUESTS   = 1000000
+local WORKER_OPS = 500000
+local VALUE      = { id = 1001, name = "player1001", level = 32, items = { 1, 2, 3, 4 } }
+
+--固定种子的线性同余
+local function lcg(seed)
+    local state = seed
+    return function(n)
+        state = (state * 1103515245 + 12345) % 2147483648
+        --低位周期很短, 取高位
+        return (state >> 8) % n
+    end
+end
+
+--zipf分布的key序列: 预先算好累积分布, 二分查找
+local function zipf(count, alpha, seed)
+    local cdf, sum = {}, 0
+    for i = 1, count do
+        sum = sum + 1 / i ^ alpha
+        cdf[i] = sum
+    end
+    local rand = lcg(seed)
+    return function()
+        local u = rand(1 << 22) / (1 << 22) * sum
+        local lo, hi = 1, count
+        while lo < hi do
+            local mid = (lo + hi) // 2
+            if cdf[mid] < u then
+                lo = mid + 1
+            else
+                hi = mid
+            end
+        end
+        return lo
+    end
+end
+
+local function worker_bench()
+    local cache = lcache.shared("qtest_bench", 64 * 1024 * 1024, json.jsoncodec())
+    local next_key = zipf(KEYS, 0.9, 100 + hive.index)
+    local rand, hits = lcg(hive.index), 0
+    local marker = cache:get("marker")
+    local sclock_ms = lclock_ms()
+    for _ = 1, WORKER_OPS do
+        local key = next_key()
+        if rand(10) == 0 then
+            cache:set(key, VALUE)
+        elseif cache:get(key) then
+            hits = hits + 1
+        end
+    end
+    return lclock_ms() - sclock_ms, hits, marker and marker.id == VALUE.id
+end
+
+if not scheduler then
+    --工作线程
+    hive.startup(function()
+        local thread_mgr = hive.get("thread_mgr")
+        thread_mgr:fork(function()
+            thread_mgr:sleep(500)
+            hive.send_master("rpc_cache_bench", hive.title, worker_bench())
+        end)
+    end)
+    return
+end
+
+local jcodec     = json.jsoncodec()
+local event_mgr  = hive.get("event_mgr")
+local thread_mgr = hive.get("thread_mgr")
+local CacheBench = { results = {} }
+
+function CacheBench:rpc_cache_bench(name, cost_ms, hits, shared)
+    self.results[name] = { cost_ms, hits, shared }
+end
+
+--未命中不抛异常, 过期条目不可见, 字节上限生效, 原有按条数的接口不变
+local function check_basic()
+    local cache = lcache.shared("qtest_basic", 1024 * 1024, jcodec, 4)
+    local miss = cache:get("none") == nil and not cache:exist("none")
+    cache:set("ttl", VALUE, 50)
+    cache:set("keep", VALUE)
+    local before = cache:get("ttl").id == VALUE.id
+    thread_mgr:sleep(100)
+    local expired = cache:get("ttl") == nil and not cache:exist("ttl") and cache:get("keep").name == VALUE.name
+    local same = lcache.shared("qtest_basic", 1, jcodec):get("keep") ~= nil
+    --未满的缓存里过期条目在读取或写入时回收, 不再计入数量
+    local ttl_cache = lcache.new(100, jcodec)
+    for i = 1, 10 do
+        ttl_cache:set(i, VALUE, 30)
+    end
+    thread_mgr:sleep(60)
+    ttl_cache:get(1)
+    ttl_cache:exist(2)
+    local read_reclaim = ttl_cache:size() == 8 and ttl_cache:stats().expired == 2
+    ttl_cache:set("fresh", VALUE)
+    local reclaimed = read_reclaim and ttl_cache:size() == 7
+    --显式release之后__gc再次释放, 不影响其他句柄
+    local other = lcache.shared("qtest_basic", 1, jcodec)
+    lcache.release(other)
+    local unusable = not pcall(other.get, other, "keep")
+    other = nil
+    collectgarbage("collect")
+    local released = unusable and cache:get("keep") ~= nil
+    local big = {}
+    for i = 1, 1024 do
+        big[i] = i
+    end
+    for i = 1, 10000 do
+        cache:set(i, big)
+    end
+    local stats = cache:stats()
+    local bounded = stats.bytes <= 1024 * 1024 and stats.evictions > 0
+    --超过分片容量的新值写入失败, 旧值同时删除
+    local tiny = lcache.shared("qtest_oversize", 4096, jcodec, 1)
+    tiny:set("huge", VALUE)
+    local oversize = not tiny:set("huge", string.rep("h", 8192)) and tiny:get("huge") == nil
+    local small = lcache.new(5, jcodec)
+    for i = 1, 10 do
+        small:set(i, VALUE)
+    end
+    local counted = small:size() == 5 and small:get(10) ~= nil and small:del(10) and small:size() == 4
+    log_info("[lcache_shared] miss: {}, ttl: {}/{}, same instance: {}, expired reclaimed: {}, release once: {}, bytes bounded: {} ({} entries {} bytes), oversize dropped: {}, count bounded: {}",
+            miss, before, expired, same, reclaimed, released, bounded, stats.count, stats.bytes, oversize, counted)
+    if not (miss and before and expired and same and reclaimed and released and bounded and oversize and counted) then
+        log_err("[lcache_shared] basic check failed")
+    end
+end
+
+--同样的请求序列, 未命中时写入, 统计命中率
+local function hit_rate(cache, trace)
+    local hits = 0
+    for _, key in ipairs(trace) do
+        if cache:get(key) then
+            hits = hits + 1
+        else
+            cache:set(key, 1)
+        end
+    end
+    return hits * 1000 // #trace / 10
+end
+
+local function check_hit_rate()
+    local next_key = zipf(KEYS, 0.9, 7)
+    local traces = { zipf = {}, scan = {} }
+    for i = 1, REQUESTS do
+        traces.zipf[i] = next_key()
+    end
+    --热点请求中间穿插只访问一次的顺序扫描
+    local scan_key = KEYS
+    for i = 1, REQUESTS do
+        if i % 4 == 0 then
+            scan_key = scan_key + 1
+            traces.scan[i] = scan_key
+        else
+            traces.scan[i] = traces.zipf[i]
+        end
+    end
+    for _, name in ipairs({ "zipf", "scan" }) do
+        for _, ratio in ipairs({ 1, 10 }) do
+            local size = KEYS * ratio // 100
+            local s3fifo = hit_rate(lcache.new(size, jcodec), traces[name])
+            local lru = hit_rate(QueueLRU(size), traces[name])
+            log_info("[lcache_shared] {} cache {}% keys: s3fifo hit {}%, lru hit {}%", name, ratio, s3fifo, lru)
+        end
+    end
+end
+
+local function cost_ns(count, func)
+    collectgarbage("collect")
+    local sclock = oclock()
+    for i = 1, count do
+        func(i)
+    end
+    return (oclock() - sclock) * 1000000000 // count
+end
+
+--单线程: 命中/未命中/写入, 与lua实现的LRU(不编解码)对比
+local function bench_single()
+    local cache, lru = lcache.shared("qtest_single", 64 * 1024 * 1024, jcodec), QueueLRU(KEYS)
+    for i = 1, KEYS do
+        cache:set(i, VALUE)
+        lru:set(i, VALUE)
+    end
+    local rand = lcg(11)
+    local set = cost_ns(KEYS, function(i) cache:set(i, VALUE) end)
+    local hit = cost_ns(KEYS, function() cache:get(1 + rand(KEYS)) end)
+    local miss = cost_ns(KEYS, function(i) cache:get(-i) end)
+    local lru_set = cost_ns(KEYS, function(i) lru:set(i, VALUE) end)
+    local lru_hit = cost_ns(KEYS, function() lru:get(1 + rand(KEYS)) end)
+    log_info("[lcache_shared] single thread: set {} ns, hit {} ns, miss {} ns; lua lru set {} ns, hit {} ns",
+            set, hit, miss, lru_set, lru_hit)
+end
+
+--多线程共享: 主线程预先写入, 工作线程90%读10%写
+local function bench_threads()
+    local cache = lcache.shared("qtest_bench", 64 * 1024 * 1024, jcodec)
+    for i = 1, KEYS do
+        cache:set(i, VALUE)
+    end
+    cache:set("marker", VALUE)
+    event_mgr:add_listener(CacheBench, "rpc_cache_bench")
+    for i = 1, THREADS do
+        scheduler:startup("lcache_" .. i, "qtest.lcache_shared_test")
+    end
+    while table_ext.size(CacheBench.results) < THREADS do
+        thread_mgr:sleep(100)
+    end
+    local max_ms, hits, shared = 1, 0, true
+    for _, res in pairs(CacheBench.results) do
+        max_ms = math.max(max_ms, res[1])
+        hits = hits + res[2]
+        shared = shared and res[3]
+    end
+    local stats = cache:stats()
+    log_info("[lcache_shared] {} threads: {} ops in {} ms, {} ops/s, hit {}%, sees master writes: {}, {} entries",
+            THREADS, THREADS * WORKER_OPS, max_ms, THREADS * WORKER_OPS * 1000 // max_ms,
+            hits * 100 // (THREADS * WORKER_OPS * 9 // 10), shared, stats.count)
+end
+
+thread_mgr:fork(function()
+    check_basic()
+    check_hit_rate()
+    bench_single()
+    bench_threads()
+end)
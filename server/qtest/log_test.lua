@@ -57,4 +57,18 @@ end
 test1()
 test2()
 
+--空闲期间也按fsync节奏落盘最后一批日志
+local thread_mgr = hive.get("thread_mgr")
+thread_mgr:fork(function()
+    log.set_fsync_time(50)
+    log_debug("fsync first")
+    thread_mgr:sleep(10)
+    log_debug("fsync last")
+    local before = log.file_stats().fsync_calls
+    thread_mgr:sleep(1000)
+    local after = log.file_stats().fsync_calls
+    log.set_fsync_time(environ.number("HIVE_LOG_FSYNC", 0))
+    log_info("idle fsync: {} -> {} {}", before, after, after > before and "ok" or "failed")
+end)
+
 --os.exit()
@@ -0,0 +1,75 @@
+--logbench_test.lua
+--日志压测: 多个线程同时写日志, 统计单次调用耗时和总吞吐
+local lclock_ms  = timer.clock_ms
+local log_info   = logger.info
+
+local scheduler  = hive.load("scheduler")
+
+local THREADS    = 8
+local COUNT      = 100000
+
+local function bench()
+    --只写入独立的文件, 不输出到默认日志
+    local log_bench = logfeature.debug("logbench", nil, false, true)
+    local data      = { id = 1001, name = "bench", items = { 1, 2, 3 } }
+    local sclock_ms = lclock_ms()
+    for i = 1, COUNT do
+        log_bench("[logbench] index:{} name:{} rate:{} data:{}", i, "hive", 0.5, data)
+    end
+    return lclock_ms() - sclock_ms
+end
+
+if not scheduler then
+    --工作线程
+    hive.startup(function()
+        local thread_mgr = hive.get("thread_mgr")
+        thread_mgr:fork(function()
+            thread_mgr:sleep(500)
+            hive.send_master("rpc_log_bench", hive.title, bench())
+        end)
+    end)
+    return
+end
+
+local event_mgr  = hive.get("event_mgr")
+local thread_mgr = hive.get("thread_mgr")
+local LogBench   = { results = {} }
+
+function LogBench:rpc_log_bench(name, cost_ms)
+    self.results[name] = cost_ms
+end
+
+event_mgr:add_listener(LogBench, "rpc_log_bench")
+log.daemon(true)
+--小文件滚动, 验证滚动压缩
+log.set_max_logsize(16 * 1024 * 1024)
+log.set_compress(true)
+for i = 1, THREADS do
+    scheduler:startup("logbench_" .. i, "qtest.logbench_test")
+end
+
+thread_mgr:fork(function()
+    local single_ms = bench()
+    while table_ext.size(LogBench.results) < THREADS do
+        thread_mgr:sleep(100)
+    end
+    log.daemon(false)
+    log.set_compress(environ.status("HIVE_LOG_ZIP"))
+    log.set_max_logsize(environ.number("HIVE_LOG_SIZE", 50 * 1024 * 1024))
+    local max_ms, total_ms = 1, 0
+    for _, cost_ms in pairs(LogBench.results) do
+        total_ms = total_ms + cost_ms
+        max_ms   = math.max(max_ms, cost_ms)
+    end
+    log_info("[logbench] master: {} logs cost {} ms, {} ns/call", COUNT, single_ms, single_ms * 1000000 // COUNT)
+    log_info("[logbench] {} threads: {} logs, avg {} ns/call, throughput {} logs/s", THREADS, THREADS * COUNT,
+            total_ms * 1000000 // (THREADS * COUNT), THREADS * COUNT * 1000 // max_ms)
+    --等待后台压缩完成
+    thread_mgr:sleep(3000)
+    local stats = log.file_stats()
+    log_info("[logbench] file write: {} MB in {} writev, {} MB/s", stats.write_bytes // 1048576, stats.write_calls,
+            stats.write_bytes // math.max(stats.write_us, 1))
+    log_info("[logbench] compress: {} files, {} MB -> {} MB, saved {}%, {} MB/s", stats.compress_files, stats.compress_in // 1048576,
+            stats.compress_out // 1048576, 100 - stats.compress_out * 100 // math.max(stats.compress_in, 1),
+            stats.compress_in // math.max(stats.compress_us, 1))
+end)
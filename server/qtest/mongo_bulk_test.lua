@@ -0,0 +1,181 @@
+--mongo_bulk_test.lua
+--mongo批量写入测试: 本地模拟mongod, 对比逐条写入/document sequence批量写入/snappy压缩的耗时和网络字节数
+local ssub          = string.sub
+local srep          = string.rep
+local schar         = string.char
+local sfind         = string.find
+local spack         = string.pack
+local sunpack       = string.unpack
+local tconcat       = table.concat
+local mrandom       = math.random
+local log_info      = logger.info
+local log_err       = logger.err
+local lclock_ms     = timer.clock_ms
+local bencode       = bson.encode
+local bdecode       = bson.decode
+local snappy_encode = bson.snappy_encode
+local snappy_decode = bson.snappy_decode
+
+local Socket        = import("driver/socket.lua")
+local MongoDB       = import("driver/mongo_new.lua")
+local thread_mgr    = hive.get("thread_mgr")
+
+local PORT          = 8760
+local COUNT         = 20000
+local SINGLE        = 2000
+local BATCH         = 1000
+
+local function make_doc(i)
+    return {
+        uid = 100000 + i, name = "player" .. i, level = i % 100, gold = i * 1000, online = (i % 2 == 0),
+        pos = { x = i * 1.5, y = i * 2.5 }, items = { { id = 1, num = i }, { id = 2, num = i + 1 } },
+        desc = "bulk write document for mongo wire compression benchmark",
+    }
+end
+
+local function check_snappy()
+    local randoms = {}
+    for i = 1, 200000 do
+        randoms[i] = schar(mrandom(0, 255))
+    end
+    local cases = { "", "a", srep("abc", 100000), tconcat(randoms), srep("hello snappy ", 10) .. tconcat(randoms, "", 1, 1000) }
+    for _, data in ipairs(cases) do
+        local zdata = snappy_encode(data)
+        if snappy_decode(zdata) ~= data then
+            log_err("[mongo_bulk] snappy roundtrip failed: len {}", #data)
+            return false
+        end
+    end
+    log_info("[mongo_bulk] snappy roundtrip: {} cases ok, 300000 bytes text -> {} bytes", #cases, #snappy_encode(cases[3]))
+    return true
+end
+
+--模拟mongod: 解析OP_MSG/OP_COMPRESSED, 统计写入文档数和接收字节数
+local MongoStub     = class()
+function MongoStub:__init()
+    self.clients = {}
+    self.bytes   = 0
+    self.count   = 0
+end
+
+function MongoStub:on_socket_accept(socket, token)
+    self.clients[token] = { socket = socket }
+end
+
+function MongoStub:on_socket_error(socket, token, err)
+    self.clients[token] = nil
+end
+
+function MongoStub:read_sections(msg, pos)
+    local body, sequences = nil, {}
+    while pos <= #msg do
+        local kind = sunpack("B", msg, pos)
+        local size = sunpack("<I4", msg, pos + 1)
+        if kind == 0 then
+            body = bdecode(ssub(msg, pos + 1, pos + size))
+            pos  = pos + 1 + size
+        else
+            local stop = pos + size
+            local _, e = sfind(msg, "\0", pos + 5, true)
+            local key  = ssub(msg, pos + 5, e - 1)
+            local docs = {}
+            pos = e + 1
+            while pos < stop do
+                local len = sunpack("<I4", msg, pos)
+                docs[#docs + 1] = ssub(msg, pos, pos + len - 1)
+                pos = pos + len
+            end
+            sequences[key] = docs
+        end
+    end
+    for key, docs in pairs(sequences) do
+        body[key] = docs
+    end
+    return body
+end
+
+function MongoStub:execute(cmd)
+    if cmd.isMaster then
+        return { ok = 1, maxWireVersion = 17, compression = cmd.compression and { cmd.compression[1] } or nil }
+    elseif cmd.insert then
+        self.count = self.count + #cmd.documents
+        return { ok = 1, n = #cmd.documents }
+    elseif cmd.update then
+        return { ok = 1, n = #cmd.updates, nModified = #cmd.updates }
+    end
+    return { ok = 1 }
+end
+
+function MongoStub:on_socket_recv(socket, token)
+    local client   = self.clients[token]
+    local buf, pos = socket.recvbuf, 1
+    while pos + 16 <= #buf do
+        local len, request_id, _, opcode = sunpack("<I4I4I4I4", buf, pos)
+        if pos + len - 1 > #buf then
+            break
+        end
+        self.bytes = self.bytes + len
+        local msg  = ssub(buf, pos + 16, pos + len - 1)
+        pos = pos + len
+        if opcode == 2012 then
+            client.compressed = true
+            msg = snappy_decode(ssub(msg, 10))
+        end
+        local reply = bencode(self:execute(self:read_sections(msg, 5)))
+        local body  = spack("<I4B", 0, 0) .. reply
+        if client.compressed then
+            local zbody = snappy_encode(body)
+            socket:send(spack("<I4I4I4I4I4I4B", 25 + #zbody, 0, request_id, 2012, 2013, #body, 1) .. zbody)
+        else
+            socket:send(spack("<I4I4I4I4", 16 + #body, 0, request_id, 2013) .. body)
+        end
+    end
+    socket:pop(pos - 1)
+end
+
+local function bulk_insert(mongo_db, first, last)
+    for i = first, last, BATCH do
+        local docs = {}
+        for j = i, math.min(i + BATCH - 1, last) do
+            docs[#docs + 1] = make_doc(j)
+        end
+        local ok, res = mongo_db:bulk_insert("player", docs)
+        if not ok or res.n ~= #docs then
+            log_err("[mongo_bulk] bulk insert failed: {}", res)
+            return false
+        end
+    end
+    return true
+end
+
+local function bench(stub, name, mongo_db)
+    while not mongo_db:available() do
+        thread_mgr:sleep(100)
+    end
+    stub.bytes, stub.count = 0, 0
+    local sclock_ms = lclock_ms()
+    for i = 1, SINGLE do
+        mongo_db:insert("player", make_doc(i))
+    end
+    local single_ms, single_bytes = lclock_ms() - sclock_ms, stub.bytes
+    stub.bytes      = 0
+    sclock_ms       = lclock_ms()
+    bulk_insert(mongo_db, 1, COUNT)
+    local bulk_ms   = lclock_ms() - sclock_ms
+    log_info("[mongo_bulk] {}: single {} docs {} ms ({} docs/s, {} KB), bulk {} docs {} ms ({} docs/s, {} KB), stored: {}", name,
+            SINGLE, single_ms, SINGLE * 1000 // math.max(single_ms, 1), single_bytes // 1024, COUNT, bulk_ms,
+            COUNT * 1000 // math.max(bulk_ms, 1), stub.bytes // 1024, stub.count)
+    local ok, res = mongo_db:bulk_update("player", { { { ["$set"] = { level = 1 } }, { uid = 100001 } }, { { ["$set"] = { level = 2 } }, { uid = 100002 }, true } })
+    log_info("[mongo_bulk] {}: bulk update ok:{} n:{}", name, ok, ok and res.n)
+    mongo_db:close()
+end
+
+thread_mgr:fork(function()
+    check_snappy()
+    local stub     = MongoStub()
+    local listener = Socket(stub)
+    listener:listen("127.0.0.1", PORT)
+    bench(stub, "plain", MongoDB({ hosts = { { "127.0.0.1", PORT } }, db = "bench", user = "", passwd = "", opts = {} }))
+    bench(stub, "snappy", MongoDB({ hosts = { { "127.0.0.1", PORT } }, db = "bench", user = "", passwd = "", opts = { compressors = "snappy,zstd" } }))
+    listener:close()
+end)
@@ -0,0 +1,291 @@
+--mysql_stmt_test.lua
+--mysql预处理语句测试: 本地模拟mysql服务, 验证二进制协议类型解码和游标分批读取, 对比文本协议
+local ssub          = string.sub
+local srep          = string.rep
+local spack         = string.pack
+local sunpack       = string.unpack
+local sformat       = string.format
+local tconcat       = table.concat
+local log_info      = logger.info
+local log_err       = logger.err
+local lclock_ms     = timer.clock_ms
+
+local Socket        = import("driver/socket.lua")
+local MysqlDB       = import("driver/mysql.lua")
+local thread_mgr    = hive.get("thread_mgr")
+
+local PORT          = 8740
+local COUNT         = 50000
+local BATCH         = 1000
+
+local COM_QUERY        = 0x03
+local COM_PING         = 0x0e
+local COM_STMT_PREPARE = 0x16
+local COM_STMT_EXECUTE = 0x17
+local COM_STMT_CLOSE   = 0x19
+local COM_STMT_RESET   = 0x1a
+local COM_STMT_FETCH   = 0x1c
+
+local STATUS_CURSOR_EXISTS = 0x40
+local STATUS_LAST_ROW_SENT = 0x80
+
+--列定义: id, name, score, level(unsigned), ts, delta(signed), note(可为空)
+local COLUMNS = {
+    { "id", 0x08, 0 }, { "name", 0xfd, 0 }, { "score", 0x05, 0 }, { "level", 0x01, 0x20 },
+    { "ts", 0x0c, 0 }, { "delta", 0x03, 0 }, { "note", 0xfd, 0 },
+}
+
+local function lenenc(str)
+    local len = #str
+    if len < 0xfb then
+        return spack("B", len) .. str
+    elseif len < 0x10000 then
+        return spack("<BI2", 0xfc, len) .. str
+    end
+    return spack("<BI3", 0xfd, len) .. str
+end
+
+local function make_row(i)
+    return { id = i, name = "name" .. i, score = i / 4, level = 200 + i % 50, delta = -i, note = (i % 2 == 0) and "even" or nil,
+             ts = { 2024, 1 + i % 12, 1 + i % 28, i % 24, i % 60, i % 60 } }
+end
+
+--模拟mysql服务
+local MysqlStub     = class()
+function MysqlStub:__init()
+    self.clients = {}
+    self.stmts   = {}
+    self.stmt_id = 0
+    self.rows    = {}
+    for i = 1, COUNT do
+        self.rows[i] = make_row(i)
+    end
+end
+
+function MysqlStub:on_socket_accept(socket, token)
+    self.clients[token] = { socket = socket }
+    --等待客户端设置codec后再下发握手包
+    thread_mgr:fork(function()
+        thread_mgr:sleep(200)
+        local payload = spack("<Bz I4 c8 B I2 B I2 I2 B", 10, "5.7.0", 1, "12345678", 0, 0xf7ff, 33, 2, 0x0008, 21)
+                .. srep("\0", 10) .. "123456789012\0" .. "mysql_native_password\0"
+        socket:send(spack("<I3B", #payload, 0) .. payload)
+    end)
+end
+
+function MysqlStub:on_socket_error(socket, token, err)
+    self.clients[token] = nil
+end
+
+function MysqlStub:on_socket_recv(socket, token)
+    local client = self.clients[token]
+    local buf, pos = socket.recvbuf, 1
+    while pos + 3 <= #buf do
+        local len, seq = sunpack("<I3B", buf, pos)
+        if pos + 3 + len > #buf then
+            break
+        end
+        local payload = ssub(buf, pos + 4, pos + 3 + len)
+        pos = pos + 4 + len
+        local packets = {}
+        if not client.authed then
+            client.authed = true
+            packets[1] = self:ok_packet()
+        else
+            self:execute(payload, packets)
+        end
+        if #packets > 0 then
+            for i, packet in ipairs(packets) do
+                packets[i] = spack("<I3B", #packet, (seq + i) % 256) .. packet
+            end
+            socket:send(tconcat(packets))
+        end
+    end
+    socket:pop(pos - 1)
+end
+
+function MysqlStub:ok_packet()
+    return spack("<BBBI2I2", 0, 0, 0, 0x0002, 0)
+end
+
+function MysqlStub:eof_packet(status)
+    return spack("<BI2I2", 0xfe, 0, status or 0x0002)
+end
+
+function MysqlStub:column_packet(column)
+    return tconcat({ lenenc("def"), lenenc("bench"), lenenc("t"), lenenc("t"), lenenc(column[1]), lenenc(column[1]),
+                     spack("<BI2I4BI2BI2", 0x0c, 33, 255, column[2], column[3], 0, 0) })
+end
+
+function MysqlStub:columns_packets(packets)
+    packets[#packets + 1] = spack("B", #COLUMNS)
+    for _, column in ipairs(COLUMNS) do
+        packets[#packets + 1] = self:column_packet(column)
+    end
+end
+
+function MysqlStub:text_row(row)
+    local ts = sformat("%04d-%02d-%02d %02d:%02d:%02d", table.unpack(row.ts))
+    return tconcat({ lenenc(tostring(row.id)), lenenc(row.name), lenenc(tostring(row.score)), lenenc(tostring(row.level)),
+                     lenenc(ts), lenenc(tostring(row.delta)), row.note and lenenc(row.note) or "\xfb" })
+end
+
+--二进制行: 7列的null_bitmap为2字节, note列在第9位
+function MysqlStub:binary_row(row)
+    local bitmap = row.note and 0 or (1 << 8)
+    return tconcat({ spack("<BI2", 0, bitmap), spack("<i8", row.id), lenenc(row.name), spack("<dB", row.score, row.level),
+                     spack("<BI2BBBBB", 7, table.unpack(row.ts)), spack("<i4", row.delta), row.note and lenenc(row.note) or "" })
+end
+
+--解析COM_STMT_EXECUTE参数
+function MysqlStub:read_params(payload, pos, count)
+    local params = {}
+    local nbytes = (count + 7) // 8
+    local nulls  = { sunpack(srep("B", nbytes), payload, pos) }
+    pos = pos + nbytes + 1
+    local types = {}
+    for i = 1, count do
+        types[i] = sunpack("<I2", payload, pos)
+        pos = pos + 2
+    end
+    for i = 1, count do
+        if nulls[(i - 1) // 8 + 1] & (1 << ((i - 1) % 8)) == 0 then
+            local ptype = types[i]
+            if ptype == 0x08 then
+                params[i], pos = sunpack("<i8", payload, pos)
+            elseif ptype == 0x05 then
+                params[i], pos = sunpack("<d", payload, pos)
+            elseif ptype == 0x01 then
+                params[i], pos = sunpack("B", payload, pos)
+            else
+                params[i], pos = sunpack("s1", payload, pos)
+            end
+        end
+    end
+    return params
+end
+
+function MysqlStub:select_rows(min_id)
+    local rows = {}
+    for i = min_id + 1, COUNT do
+        rows[#rows + 1] = self.rows[i]
+    end
+    return rows
+end
+
+function MysqlStub:execute(payload, packets)
+    local cmd = sunpack("B", payload)
+    if cmd == COM_PING or cmd == COM_STMT_RESET then
+        packets[1] = self:ok_packet()
+    elseif cmd == COM_STMT_CLOSE then
+        self.stmts[sunpack("<I4", payload, 2)] = nil
+    elseif cmd == COM_QUERY then
+        self:columns_packets(packets)
+        packets[#packets + 1] = self:eof_packet()
+        for _, row in ipairs(self.rows) do
+            packets[#packets + 1] = self:text_row(row)
+        end
+        packets[#packets + 1] = self:eof_packet()
+    elseif cmd == COM_STMT_PREPARE then
+        self.stmt_id = self.stmt_id + 1
+        self.stmts[self.stmt_id] = { sql = ssub(payload, 2) }
+        packets[1] = spack("<BI4I2I2BI2", 0, self.stmt_id, #COLUMNS, 3, 0, 0)
+        for i = 1, 3 do
+            packets[#packets + 1] = self:column_packet({ "?", 0xfd, 0 })
+        end
+        packets[#packets + 1] = self:eof_packet()
+        for _, column in ipairs(COLUMNS) do
+            packets[#packets + 1] = self:column_packet(column)
+        end
+        packets[#packets + 1] = self:eof_packet()
+    elseif cmd == COM_STMT_EXECUTE then
+        local stmt_id, cursor = sunpack("<I4B", payload, 2)
+        local stmt   = self.stmts[stmt_id]
+        stmt.params  = self:read_params(payload, 11, 3)
+        stmt.rows    = self:select_rows(stmt.params[1] or 0)
+        stmt.fetched = 0
+        self:columns_packets(packets)
+        if cursor ~= 0 then
+            packets[#packets + 1] = self:eof_packet(0x0002 | STATUS_CURSOR_EXISTS)
+            return
+        end
+        packets[#packets + 1] = self:eof_packet()
+        for _, row in ipairs(stmt.rows) do
+            packets[#packets + 1] = self:binary_row(row)
+        end
+        packets[#packets + 1] = self:eof_packet()
+    elseif cmd == COM_STMT_FETCH then
+        local stmt_id, num_rows = sunpack("<I4I4", payload, 2)
+        local stmt = self.stmts[stmt_id]
+        local last = math.min(stmt.fetched + num_rows, #stmt.rows)
+        for i = stmt.fetched + 1, last do
+            packets[#packets + 1] = self:binary_row(stmt.rows[i])
+        end
+        stmt.fetched = last
+        local status = 0x0002 | STATUS_CURSOR_EXISTS
+        if last == #stmt.rows then
+            status = status | STATUS_LAST_ROW_SENT
+        end
+        packets[#packets + 1] = self:eof_packet(status)
+    end
+end
+
+local function check_row(res, row)
+    if not res then
+        return false
+    end
+    local ts = sformat("%04d-%02d-%02d %02d:%02d:%02d", table.unpack(row.ts))
+    return res.id == row.id and res.name == row.name and res.score == row.score and res.level == row.level
+            and res.delta == row.delta and res.note == row.note and res.ts == ts
+end
+
+local stub     = MysqlStub()
+local listener = Socket(stub)
+listener:listen("127.0.0.1", PORT)
+
+thread_mgr:fork(function()
+    local mysql_db = MysqlDB({ hosts = { { "127.0.0.1", PORT } }, db = "bench", user = "root", passwd = "123456" })
+    while #mysql_db:get_alives() == 0 do
+        thread_mgr:sleep(100)
+    end
+    mysql_db:set_executer(1)
+    local ok, stmt_id, ncols, nparams = mysql_db:prepare("select * from bench where id > ? and name = ? and level = ?")
+    log_info("[mysql_stmt] prepare: ok:{} stmt:{} columns:{} params:{}", ok, stmt_id, ncols, nparams)
+    --参数编码和类型解码
+    local res
+    ok, res = mysql_db:execute(stmt_id, COUNT - 2, nil, 3)
+    local rows = ok and res[1] or {}
+    local stmt = stub.stmts[stmt_id]
+    log_info("[mysql_stmt] params: {}, {}, {}", stmt.params[1], stmt.params[2], stmt.params[3])
+    log_info("[mysql_stmt] binary rows: {}, row1:{}, row2:{}", #rows, check_row(rows[1], stub.rows[COUNT - 1]), check_row(rows[2], stub.rows[COUNT]))
+    log_info("[mysql_stmt] row: {}", rows[1])
+    --文本协议和二进制协议对比
+    local sclock_ms = lclock_ms()
+    ok, res = mysql_db:query("select * from bench")
+    local text_ms, text_rows = lclock_ms() - sclock_ms, ok and #res[1] or 0
+    sclock_ms = lclock_ms()
+    ok, res = mysql_db:execute(stmt_id, 0, "", 0)
+    local binary_ms, binary_rows = lclock_ms() - sclock_ms, ok and #res[1] or 0
+    log_info("[mysql_stmt] {} rows: text {} rows {} ms, binary {} rows {} ms, valid: {}", COUNT, text_rows, text_ms, binary_rows, binary_ms,
+            check_row(res[1][COUNT], stub.rows[COUNT]))
+    --游标分批读取
+    local total, valid, batches = 0, true, 0
+    sclock_ms = lclock_ms()
+    local sok, count = mysql_db:stream(stmt_id, BATCH, function(batch)
+        batches = batches + 1
+        for _, row in ipairs(batch) do
+            total = total + 1
+            valid = valid and check_row(row, stub.rows[total])
+        end
+    end, 0, "", 0)
+    log_info("[mysql_stmt] cursor stream: ok:{} {} rows in {} batches, cost {} ms, valid: {}", sok, count, batches, lclock_ms() - sclock_ms,
+            valid and total == COUNT)
+    mysql_db:stmt_close(stmt_id)
+    thread_mgr:sleep(100)
+    log_info("[mysql_stmt] stmt close: {}", stub.stmts[stmt_id] == nil)
+    if not sok then
+        log_err("[mysql_stmt] cursor stream failed: {}", count)
+    end
+    mysql_db:close()
+    listener:close()
+end)
@@ -0,0 +1,240 @@
+--pb_cmd_test.lua
+--pb协议号测试: 按名字/按协议号/消息表池编解码典型网关消息的单条耗时, 以及luabus回环收发的单包开销
+local schar         = string.char
+local sformat       = string.format
+local tconcat       = table.concat
+local log_info      = logger.info
+local log_err       = logger.err
+local oclock        = os.clock
+
+local pb_encode     = protobuf.encode
+local pb_decode     = protobuf.decode
+local pb_encode_id  = protobuf.encode_cmd
+local pb_decode_id  = protobuf.decode_cmd
+local pb_bind_cmd   = protobuf.bind_cmd
+local pb_bind_pool  = protobuf.bind_pool
+local pb_recycle    = protobuf.recycle
+local eproto_type   = luabus.eproto_type
+
+local thread_mgr    = hive.get("thread_mgr")
+
+local PORT          = 8790
+local ROUND         = 20000
+local PACKETS       = 10000
+local BATCH         = 100
+local TIMEOUT       = 10000
+
+--手工构造FileDescriptorSet, 不依赖protoc
+local function varint(n)
+    local bytes = {}
+    repeat
+        local b = n & 0x7f
+        n = n >> 7
+        bytes[#bytes + 1] = schar(n > 0 and (b | 0x80) or b)
+    until n == 0
+    return tconcat(bytes)
+end
+
+local function tag_bytes(field, bytes)
+    return varint(field << 3 | 2) .. varint(#bytes) .. bytes
+end
+
+local function tag_varint(field, n)
+    return varint(field << 3) .. varint(n)
+end
+
+local TYPES = { float = 2, uint64 = 4, int32 = 5, bool = 8, string = 9, message = 11, uint32 = 13 }
+
+local function field(name, number, ftype, repeated)
+    local typ = TYPES[ftype] or TYPES.message
+    local data = tag_bytes(1, name) .. tag_varint(3, number) .. tag_varint(4, repeated and 3 or 1) .. tag_varint(5, typ)
+    if typ == TYPES.message then
+        data = data .. tag_bytes(6, ".gw." .. ftype)
+    end
+    return tag_bytes(2, data)
+end
+
+local function message(name, fields)
+    return tag_bytes(4, tag_bytes(1, name) .. tconcat(fields))
+end
+
+local DESCRIPTOR = tag_bytes(1, tag_bytes(1, "gw.proto") .. tag_bytes(2, "gw")
+        .. message("vec3", { field("x", 1, "float"), field("y", 2, "float"), field("z", 3, "float") })
+        .. message("move_req", { field("player_id", 1, "uint64"), field("pos", 2, "vec3"), field("path", 3, "vec3", true),
+                                 field("dir", 4, "int32"), field("speed", 5, "float"), field("ts", 6, "uint64") })
+        .. message("chat_req", { field("channel", 1, "uint32"), field("from", 2, "uint64"), field("text", 3, "string") })
+        .. message("item", { field("id", 1, "uint32"), field("uuid", 2, "uint64"), field("count", 3, "uint32"), field("bind", 4, "bool") })
+        .. message("login_res", { field("code", 1, "int32"), field("player_id", 2, "uint64"), field("name", 3, "string"),
+                                  field("items", 4, "item", true) })
+        .. tag_bytes(12, "proto3"))
+
+local function make_move()
+    return { player_id = 100001, pos = { x = 1024.5, y = 768.25, z = 0 }, dir = 90, speed = 3.5, ts = 1700000000033,
+             path = { { x = 1025, y = 769, z = 0 }, { x = 1030, y = 772, z = 0 }, { x = 1042, y = 780, z = 0 } } }
+end
+
+local function make_chat()
+    return { channel = 2, from = 100001, text = "组队打副本, 来个奶妈, 40级以上 ~" }
+end
+
+local function make_login()
+    local items = {}
+    for i = 1, 30 do
+        items[i] = { id = 1000 + i, uuid = 900000000 + i, count = i % 20 + 1, bind = (i % 2 == 0) }
+    end
+    return { code = 0, player_id = 100001, name = "player100001", items = items }
+end
+
+local MESSAGES = {
+    { 1001, "gw.move_req", make_move },
+    { 1002, "gw.chat_req", make_chat },
+    { 1003, "gw.login_res", make_login },
+}
+
+local function same(a, b)
+    if type(a) ~= "table" or type(b) ~= "table" then
+        return a == b
+    end
+    for k, v in pairs(a) do
+        if not same(v, b[k]) then
+            return false
+        end
+    end
+    return true
+end
+
+--取3轮最小值, 减少调度和gc抖动
+local function cost_ns(func)
+    local best
+    for _ = 1, 3 do
+        collectgarbage("collect")
+        local sclock = oclock()
+        for _ = 1, ROUND do
+            func()
+        end
+        local cost = (oclock() - sclock) * 1000000000 // ROUND
+        best = best and math.min(best, cost) or cost
+    end
+    return best
+end
+
+--单条编解码耗时: 按名字(原有方式) / 按协议号 / 按协议号+消息表池
+local function bench_codec()
+    for _, msg in ipairs(MESSAGES) do
+        local cmd_id, name, make = msg[1], msg[2], msg[3]
+        local body = make()
+        local data = pb_encode(name, body)
+        local enc_name = cost_ns(function() pb_encode(name, body) end)
+        local enc_cmd = cost_ns(function() pb_encode_id(cmd_id, body) end)
+        local dec_name = cost_ns(function() pb_decode(name, data) end)
+        local dec_cmd = cost_ns(function() pb_decode_id(cmd_id, data) end)
+        pb_bind_pool(cmd_id, 16)
+        local dec_pool = cost_ns(function() pb_recycle(cmd_id, pb_decode_id(cmd_id, data)) end)
+        --复用的表清空旧字段, 结果与新表一致
+        local first = pb_decode_id(cmd_id, data)
+        first.stale = true
+        pb_recycle(cmd_id, first)
+        local reuse = pb_decode_id(cmd_id, data)
+        local valid = pb_encode_id(cmd_id, body) == data and same(body, reuse) and reuse == first and reuse.stale == nil
+        --重复回收被拒绝
+        valid = valid and pb_recycle(cmd_id, reuse) and not pb_recycle(cmd_id, reuse)
+        pb_bind_pool(cmd_id, 0)
+        log_info("[pb_cmd] {}: {} bytes, encode name/cmd {}/{} ns, decode name/cmd/pool {}/{}/{} ns, valid: {}",
+                name, #data, enc_name, enc_cmd, dec_name, dec_cmd, dec_pool, valid)
+        if not valid then
+            log_err("[pb_cmd] {} roundtrip failed", name)
+        end
+    end
+end
+
+--网关回环: 客户端call_pb编码发送, 服务端pbcodec解码回调, 以进程cpu时间计算单包开销
+local function bench_loopback()
+    --codec和会话由lua持有, 测试期间不能被回收
+    local scodec, ccodec, sessions = protobuf.pbcodec(), protobuf.pbcodec(), {}
+    local listener = luabus.listen("127.0.0.1", PORT, eproto_type.pb)
+    listener.set_codec(scodec)
+    local received, target, block_id, valid = 0, 0, nil, 0
+    local expect = {}
+    listener.on_accept = function(session)
+        sessions[#sessions + 1] = session
+        session.on_call_pb = function(recv_len, cmd_id, flag, session_id, seq_id, data)
+            received = received + 1
+            if data.player_id == expect[cmd_id] or data.from == expect[cmd_id] then
+                valid = valid + 1
+            end
+            pb_recycle(cmd_id, data)
+            if block_id and received >= target then
+                local session_id = block_id
+                block_id = nil
+                thread_mgr:response(session_id, true)
+            end
+        end
+    end
+    local client = luabus.connect("127.0.0.1", PORT, 1000, eproto_type.pb)
+    client.set_codec(ccodec)
+    local connect_id = thread_mgr:build_session_id()
+    client.on_connect = function(res)
+        thread_mgr:response(connect_id, res == "ok")
+    end
+    thread_mgr:yield(connect_id, "pb_cmd", TIMEOUT)
+    for _, pool in ipairs({ 0, 64 }) do
+        for _, msg in ipairs(MESSAGES) do
+            local cmd_id, name, body = msg[1], msg[2], msg[3]()
+            expect[cmd_id] = 100001
+            pb_bind_pool(cmd_id, pool)
+            received, valid = 0, 0
+            collectgarbage("collect")
+            local sclock = oclock()
+            for i = 1, PACKETS, BATCH do
+                target, block_id = i + BATCH - 1, thread_mgr:build_session_id()
+                for _ = 1, BATCH do
+                    client.call_pb(cmd_id, 1, 0, body)
+                end
+                if received < target then
+                    thread_mgr:yield(block_id, "pb_cmd", TIMEOUT)
+                end
+                block_id = nil
+            end
+            local cost = oclock() - sclock
+            log_info("[pb_cmd] loopback {} pool {}: {} packets({} bytes) cpu {} us/packet, valid: {}", name, pool, received,
+                    #pb_encode(name, body), sformat("%.2f", cost * 1000000 / PACKETS), valid == PACKETS)
+            pb_bind_pool(cmd_id, 0)
+        end
+    end
+    client.close()
+    for _, session in ipairs(sessions) do
+        session.close()
+    end
+    listener.close()
+end
+
+local ok, pos = protobuf.load(DESCRIPTOR)
+if not ok then
+    log_err("[pb_cmd] load descriptor failed at {}", pos)
+    return
+end
+for _, msg in ipairs(MESSAGES) do
+    pb_bind_cmd(msg[1], msg[2])
+end
+--复用的表保留repeated字段的表, 旧元素需要清空
+pb_bind_pool(1003, 4)
+local login = make_login()
+local items = pb_decode_id(1003, pb_encode_id(1003, login))
+pb_recycle(1003, items)
+login.items = { login.items[1], login.items[2] }
+local fewer = pb_decode_id(1003, pb_encode_id(1003, login))
+log_info("[pb_cmd] pool repeated reused: {}, shrink: {}", fewer == items, #fewer.items == 2 and fewer.items[2].id == 1002)
+pb_bind_pool(1003, 0)
+--协议号超过64K走哈希表
+pb_bind_cmd(0x20001, "gw.chat_req")
+log_info("[pb_cmd] large cmd_id: {}", pb_decode_id(0x20001, pb_encode_id(0x20001, make_chat())).text == make_chat().text)
+--协议重新加载后类型缓存失效, 按名字重新解析
+protobuf.clear()
+log_info("[pb_cmd] cleared: {}", not pcall(pb_encode_id, 1001, make_move()))
+protobuf.load(DESCRIPTOR)
+log_info("[pb_cmd] reloaded: {}", pb_decode_id(1001, pb_encode_id(1001, make_move())).speed == 3.5)
+
+thread_mgr:fork(function()
+    bench_codec()
+    bench_loopback()
+end)
@@ -0,0 +1,127 @@
+--redis_pipeline_test.lua
+--redis pipeline压测: 本地模拟redis服务, 对比逐条执行和pipeline批量执行
+local sfind         = string.find
+local ssub          = string.sub
+local sformat       = string.format
+local supper        = string.upper
+local tconcat       = table.concat
+local log_info      = logger.info
+local log_err       = logger.err
+local lclock_ms     = timer.clock_ms
+
+local Socket        = import("driver/socket.lua")
+local RedisDB       = import("driver/redis.lua")
+local thread_mgr    = hive.get("thread_mgr")
+
+local PORT          = 8730
+local COUNT         = 10000
+local BATCH         = 1000
+
+--模拟redis服务: 解析RESP请求, 支持少量命令
+local RedisStub     = class()
+function RedisStub:__init()
+    self.kvs     = {}
+    self.clients = {}
+end
+
+function RedisStub:on_socket_accept(socket, token)
+    self.clients[token] = socket
+end
+
+function RedisStub:on_socket_error(socket, token, err)
+    self.clients[token] = nil
+end
+
+function RedisStub:read_command(buf, pos)
+    local _, e, n = sfind(buf, "^%*(%d+)\r\n", pos)
+    if not e then
+        return
+    end
+    local args = {}
+    pos = e + 1
+    for i = 1, tonumber(n) do
+        local _, e2, len = sfind(buf, "^%$(%d+)\r\n", pos)
+        if not e2 then
+            return
+        end
+        len = tonumber(len)
+        if e2 + len + 2 > #buf then
+            return
+        end
+        args[i] = ssub(buf, e2 + 1, e2 + len)
+        pos = e2 + len + 3
+    end
+    return args, pos
+end
+
+function RedisStub:execute(args)
+    local cmd = supper(args[1])
+    if cmd == "PING" then
+        return "+PONG\r\n"
+    elseif cmd == "SET" then
+        self.kvs[args[2]] = args[3]
+        return "+OK\r\n"
+    elseif cmd == "GET" then
+        local value = self.kvs[args[2]]
+        if not value then
+            return "$-1\r\n"
+        end
+        return sformat("$%d\r\n%s\r\n", #value, value)
+    elseif cmd == "EXISTS" then
+        return sformat(":%d\r\n", self.kvs[args[2]] and 1 or 0)
+    end
+    return sformat("-ERR unknown command '%s'\r\n", args[1])
+end
+
+function RedisStub:on_socket_recv(socket)
+    local buf, pos, replies = socket.recvbuf, 1, {}
+    while true do
+        local args, npos = self:read_command(buf, pos)
+        if not args then
+            break
+        end
+        replies[#replies + 1] = self:execute(args)
+        pos = npos
+    end
+    socket:pop(pos - 1)
+    if #replies > 0 then
+        socket:send(tconcat(replies))
+    end
+end
+
+local listener = Socket(RedisStub())
+listener:listen("127.0.0.1", PORT)
+
+thread_mgr:fork(function()
+    local redis_db = RedisDB({ hosts = { { "127.0.0.1", PORT } }, opts = {}, db = "bench" })
+    while not redis_db:available() do
+        thread_mgr:sleep(100)
+    end
+    --逐条执行
+    local sclock_ms = lclock_ms()
+    for i = 1, COUNT do
+        redis_db:execute("SET", "seq:" .. i, "value" .. i)
+    end
+    local seq_ms = lclock_ms() - sclock_ms
+    --pipeline执行
+    sclock_ms = lclock_ms()
+    for i = 1, COUNT, BATCH do
+        local cmds = {}
+        for j = i, i + BATCH - 1 do
+            cmds[#cmds + 1] = { "SET", "pipe:" .. j, "value" .. j }
+        end
+        local ok, res = redis_db:pipeline(cmds)
+        if not ok or #res ~= BATCH then
+            log_err("[redis_pipeline] pipeline set failed: {}", res)
+        end
+    end
+    local pipe_ms = lclock_ms() - sclock_ms
+    log_info("[redis_pipeline] {} SET: sequential {} ms, pipeline(batch {}) {} ms", COUNT, seq_ms, BATCH, pipe_ms)
+    --结果顺序和转换
+    local ok, res = redis_db:pipeline({ { "GET", "pipe:1" }, { "GET", "none" }, { "EXISTS", "pipe:2" }, { "GET", "seq:3" } })
+    log_info("[redis_pipeline] get: ok:{} res:{}, {}, {}, {}", ok, res[1], res[2], res[3], res[4])
+    ok, res = redis_db:pipeline({ { "SET", "k", "v" }, { "BADCMD" }, { "GET", "k" } })
+    log_info("[redis_pipeline] error: ok:{} res:{}, {}, {}", ok, res[1], res[2], res[3])
+    redis_db:close()
+    listener:close()
+end)
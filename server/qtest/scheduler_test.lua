@@ -0,0 +1,28 @@
+--scheduler_test.lua
+local lclock_ms  = timer.clock_ms
+local log_info   = logger.info
+
+local thread_mgr = hive.get("thread_mgr")
+local scheduler  = hive.get("scheduler")
+
+local COUNT      = 10000
+
+thread_mgr:fork(function()
+    thread_mgr:sleep(200)
+    local ok, code, data = scheduler:call("proxy", "rpc_thread_placement")
+    log_info("[scheduler_test] call proxy: {},{},{}", ok, code, data)
+    local done     = 0
+    local sclock_ms = lclock_ms()
+    for _ = 1, COUNT do
+        thread_mgr:fork(function()
+            scheduler:call("proxy", "rpc_thread_placement")
+            done = done + 1
+        end)
+    end
+    while done < COUNT do
+        thread_mgr:sleep(10)
+    end
+    log_info("[scheduler_test] {} calls cost {} ms", COUNT, lclock_ms() - sclock_ms)
+    log_info("[scheduler_test] master stats: {}", scheduler:stats())
+    log_info("[scheduler_test] proxy stats: {}", scheduler:collect("rpc_mailbox_stats"))
+end)
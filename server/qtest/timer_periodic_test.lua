@@ -0,0 +1,98 @@
+--timer_periodic_test.lua
+--周期/cron定时器测试: 轮内重新挂载的对齐和合并, TimerMgr的循环/次数/cron, 5万个1秒实体定时器的每帧开销
+local log_info      = logger.info
+local log_err       = logger.err
+local oclock        = os.clock
+local twheel        = timer.wheel
+
+local timer_mgr     = hive.get("timer_mgr")
+local thread_mgr    = hive.get("thread_mgr")
+
+local ENTITIES      = 50000
+local PERIOD        = 50        --1秒, 20ms一个tick
+local FRAMES        = 500
+
+--周期定时器按计划时间累加, 不随update步长漂移; 一次update内错过的周期只触发一次
+local function check_wheel()
+    local wheel, out, now, fires, aligned = twheel(), {}, 0, 0, true
+    wheel.insert(1, 3, 3)
+    for _, step in ipairs({ 1, 2, 1, 4, 2, 3, 1, 1, 5, 2 }) do
+        now = now + step
+        local count = wheel.update(step, out)
+        for i = 1, count do
+            fires = fires + 1
+            --本次update区间内存在3的倍数才会触发
+            if (now - step) // 3 == now // 3 and (now - step) % 3 ~= 0 then
+                aligned = false
+            end
+        end
+    end
+    --长时间卡顿后只补一次
+    local late = wheel.update(100, out)
+    local after = wheel.update(2, out) + wheel.update(1, out)
+    log_info("[timer_periodic] wheel: fires {}, aligned {}, stall fires {}, next period fires {}", fires, aligned, late, after)
+    if not aligned or late ~= 1 then
+        log_err("[timer_periodic] periodic rearm mismatch")
+    end
+end
+
+--按帧推进: 旧方式每次到期从lua重新插入, 新方式轮内自动重新挂载
+local function bench_entities()
+    local results = {}
+    for _, mode in ipairs({ "lua", "native" }) do
+        local wheel, out, handles, fired = twheel(), {}, {}, 0
+        for id = 1, ENTITIES do
+            local first = id % PERIOD + 1
+            handles[id] = mode == "lua" and wheel.insert(id, first) or wheel.insert(id, first, PERIOD)
+        end
+        collectgarbage("collect")
+        local sclock = oclock()
+        for _ = 1, FRAMES do
+            local count = wheel.update(1, out)
+            for i = 1, count do
+                local id = out[i]
+                if handles[id] then
+                    fired = fired + 1
+                    if mode == "lua" then
+                        handles[id] = wheel.insert(id, PERIOD)
+                    end
+                end
+            end
+        end
+        results[mode] = { (oclock() - sclock) * 1e6 / FRAMES, fired }
+    end
+    log_info("[timer_periodic] {} entity timers: lua rearm {} us/frame ({} fires), native rearm {} us/frame ({} fires)", ENTITIES,
+            results.lua[1] // 1, results.lua[2], results.native[1] // 1, results.native[2])
+end
+
+local function check_mgr()
+    local loops, limited, stopped, crons = 0, 0, 0, 0
+    timer_mgr:loop(100, function() loops = loops + 1 end)
+    timer_mgr:register(0, 100, 3, function() limited = limited + 1 end)
+    local stop_id
+    stop_id = timer_mgr:loop(100, function()
+        stopped = stopped + 1
+        if stopped == 2 then
+            timer_mgr:unregister(stop_id)
+        end
+    end)
+    local cron_id = timer_mgr:cron("* * * * * *", function() crons = crons + 1 end)
+    local slow = 0
+    local slow_id = timer_mgr:loop(100, function() slow = slow + 1 end)
+    timer_mgr:set_period(slow_id, 1000)
+    --回调中缩短周期, 下一次触发即按新周期(1000, 1300, 1600...)
+    local backoff, backoff_id = 0, nil
+    backoff_id = timer_mgr:loop(1000, function()
+        backoff = backoff + 1
+        timer_mgr:set_period(backoff_id, 300)
+    end)
+    thread_mgr:sleep(3050)
+    timer_mgr:unregister(cron_id)
+    timer_mgr:unregister(backoff_id)
+    log_info("[timer_periodic] mgr: loop {}, times(3) {}, self unregister {}, cron(1s) {}, set_period(1s) {}, backoff(1s->300ms) {}, bad cron {}",
+            loops, limited, stopped, crons, slow, backoff, timer_mgr:cron("bad cron", function() end) == nil)
+end
+
+check_wheel()
+bench_entities()
+thread_mgr:fork(check_mgr)
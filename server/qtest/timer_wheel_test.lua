@@ -0,0 +1,113 @@
+--timer_wheel_test.lua
+--时间轮测试: 跨层级到期/取消/重新调度的正确性, 100万挂起定时器下高频增删改的单次开销
+local log_info      = logger.info
+local log_err       = logger.err
+local oclock        = os.clock
+local twheel        = timer.wheel
+
+local PENDING       = 1000000
+local CHURN         = 10000
+local ROUNDS        = 100
+local MAX_ESCAPE    = 60000
+
+--伪随机, 保证每次运行一致
+local seed = 12345
+local function rand(n)
+    seed = (seed * 1103515245 + 12345) & 0x7fffffff
+    return seed % n + 1
+end
+
+--每个id记录期望触发的tick, 逐tick推进校验
+local function check_correct()
+    local wheel, expects, handles, now = twheel(), {}, {}, 0
+    for id = 1, 20000 do
+        local escape = id % 7 == 0 and rand(300000) or rand(2000)
+        handles[id] = wheel.insert(id, escape)
+        expects[id] = escape
+    end
+    --取消1/4, 重新调度1/4
+    local cancels = 0
+    for id = 1, 20000, 4 do
+        if wheel.cancel(handles[id]) then
+            cancels = cancels + 1
+        end
+        expects[id] = nil
+    end
+    for id = 2, 20000, 4 do
+        local escape = rand(5000)
+        wheel.reschedule(handles[id], escape)
+        expects[id] = escape
+    end
+    local out, fired, wrong, ticks = {}, 0, 0, 0
+    while wheel.size() > 0 and ticks < 400000 do
+        local step = rand(8)
+        local count = wheel.update(step, out)
+        now = now + step
+        ticks = ticks + step
+        for i = 1, count do
+            local id = out[i]
+            local expect = expects[id]
+            --update(step)触发[now-step, now]区间内到期的定时器
+            if not expect or expect > now or expect < now - step then
+                wrong = wrong + 1
+            end
+            expects[id] = nil
+            fired = fired + 1
+        end
+    end
+    --节点复用后旧句柄失效
+    local reused = wheel.insert(1, 10)
+    log_info("[timer_wheel] correct: fired {}, cancelled {}, wrong {}, left {}, stale handle: {}/{}", fired, cancels,
+            wrong, next(expects) and "yes" or "none", wheel.cancel(handles[1]), wheel.cancel(reused))
+    if wrong > 0 or next(expects) then
+        log_err("[timer_wheel] wheel result mismatch")
+    end
+end
+
+--100万挂起定时器: 每轮取消/新增/重新调度各CHURN个后推进一个tick
+local function bench_churn()
+    local wheel, out, handles = twheel(), {}, {}
+    collectgarbage("collect")
+    local sclock = oclock()
+    for id = 1, PENDING do
+        handles[id] = wheel.insert(id, rand(MAX_ESCAPE))
+    end
+    local insert_cost = oclock() - sclock
+    local next_id, cancel_cost, add_cost, move_cost, update_cost, fired = PENDING + 1, 0, 0, 0, 0, 0
+    for _ = 1, ROUNDS do
+        local clock = oclock()
+        for _ = 1, CHURN do
+            wheel.cancel(handles[rand(next_id - 1)])
+        end
+        cancel_cost = cancel_cost + oclock() - clock
+        clock = oclock()
+        for _ = 1, CHURN do
+            handles[next_id] = wheel.insert(next_id, rand(MAX_ESCAPE))
+            next_id = next_id + 1
+        end
+        add_cost = add_cost + oclock() - clock
+        clock = oclock()
+        for _ = 1, CHURN do
+            wheel.reschedule(handles[rand(next_id - 1)], rand(MAX_ESCAPE))
+        end
+        move_cost = move_cost + oclock() - clock
+        clock = oclock()
+        fired = fired + wheel.update(1, out)
+        update_cost = update_cost + oclock() - clock
+    end
+    local ops = CHURN * ROUNDS
+    log_info("[timer_wheel] {} pending: insert {} ns, churn cancel {} ns, insert {} ns, reschedule {} ns, update {} us/tick, fired {}, size {}",
+            PENDING, insert_cost * 1e9 // PENDING, cancel_cost * 1e9 // ops, add_cost * 1e9 // ops, move_cost * 1e9 // ops,
+            update_cost * 1e6 // ROUNDS, fired, wheel.size())
+    --推进整圈, 包含所有层级的级联
+    local clock = oclock()
+    local total = 0
+    for _ = 1, MAX_ESCAPE // 256 + 1 do
+        total = total + wheel.update(256, out)
+    end
+    log_info("[timer_wheel] drain {} timers in {} ms, {} ns/timer, size {}", total, (oclock() - clock) * 1000 // 1,
+            (oclock() - clock) * 1e9 // math.max(total, 1), wheel.size())
+end
+
+check_correct()
+bench_churn()
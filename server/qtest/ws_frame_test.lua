@@ -0,0 +1,297 @@
+--ws_frame_test.lua
+--websocket帧测试: 64B-64KB掩码帧解码吞吐, 分片消息重组, permessage-deflate协商/压缩比/上下文保留
+local srep          = string.rep
+local schar         = string.char
+local sbyte         = string.byte
+local sfind         = string.find
+local spack         = string.pack
+local sunpack       = string.unpack
+local sformat       = string.format
+local tconcat       = table.concat
+local log_info      = logger.info
+local log_err       = logger.err
+local lclock_ms     = timer.clock_ms
+local oclock        = os.clock
+
+local jsoncodec     = json.jsoncodec
+local wsscodec      = codec.wsscodec
+
+local Socket        = import("driver/socket.lua")
+local WSServer      = import("network/ws_server.lua")
+local thread_mgr    = hive.get("thread_mgr")
+
+local PORT          = 8780
+local TIMEOUT       = 10000
+local BATCH_BYTES   = 256 * 1024
+local MASK_KEY      = "\x3a\x5c\x7e\x91"
+
+local SIZES         = { { 64, 20000 }, { 512, 20000 }, { 4096, 8000 }, { 16384, 2000 }, { 65536, 500 } }
+
+local function wait(cond)
+    local sclock_ms = lclock_ms()
+    while not cond() and lclock_ms() - sclock_ms < TIMEOUT do
+        thread_mgr:sleep(5)
+    end
+    return cond()
+end
+
+--客户端帧必须带掩码
+local function mask_frame(opcode, payload, fin, key)
+    key = key or MASK_KEY
+    local keys, bytes = { sbyte(key, 1, 4) }, {}
+    for i = 1, #payload do
+        bytes[i] = schar(sbyte(payload, i) ~ keys[(i - 1) % 4 + 1])
+    end
+    local len, head = #payload, nil
+    local flag = (fin == false and 0 or 0x80) | opcode
+    if len < 0x7e then
+        head = spack("BB", flag, 0x80 | len)
+    elseif len <= 0xffff then
+        head = spack(">BBI2", flag, 0xfe, len)
+    else
+        head = spack(">BBI8", flag, 0xff, len)
+    end
+    return head .. key .. tconcat(bytes)
+end
+
+--解析服务端下发的帧头(不带掩码), 返回帧列表和消耗的字节数
+local function read_frames(buf)
+    local frames, pos = {}, 1
+    while pos + 1 <= #buf do
+        local flag, len = sunpack("BB", buf, pos)
+        local hlen = 2
+        if len == 0x7e then
+            if pos + 3 > #buf then break end
+            len, hlen = sunpack(">I2", buf, pos + 2), 4
+        elseif len == 0x7f then
+            if pos + 9 > #buf then break end
+            len, hlen = sunpack(">I8", buf, pos + 2), 10
+        end
+        if pos + hlen + len - 1 > #buf then
+            break
+        end
+        frames[#frames + 1] = { flag = flag, len = len, data = buf:sub(pos + hlen, pos + hlen + len - 1) }
+        pos = pos + hlen + len
+    end
+    return frames, pos - 1
+end
+
+local Client        = class()
+function Client:__init(port)
+    self.recvs    = {}
+    self.frames   = {}
+    self.messages = {}
+    self.socket   = Socket(self)
+    if not self.socket:connect("127.0.0.1", port) then
+        log_err("[ws_frame] connect {} failed", port)
+    end
+end
+
+function Client:on_socket_recv(socket, method, opcode, message)
+    if not self.wcodec then
+        self.recvs[#self.recvs + 1] = socket.recvbuf
+        socket:pop(#socket.recvbuf)
+        return
+    end
+    if method == "WSS" then
+        self.messages[#self.messages + 1] = message
+    end
+end
+
+function Client:on_socket_error(socket, token, err)
+    self.error = err
+end
+
+function Client:data()
+    return tconcat(self.recvs)
+end
+
+--握手, 返回响应头
+function Client:handshake(extensions)
+    local req = "GET /ws HTTP/1.1\r\nHost: 127.0.0.1\r\nUpgrade: websocket\r\nConnection: Upgrade\r\n"
+            .. "Sec-WebSocket-Version: 13\r\nSec-WebSocket-Key: dGhlIHNhbXBsZSBub25jZQ==\r\n"
+    if extensions then
+        req = req .. "Sec-WebSocket-Extensions: " .. extensions .. "\r\n"
+    end
+    self.socket:send(req .. "\r\n")
+    wait(function() return sfind(self:data(), "\r\n\r\n", 1, true) end)
+    local resp = self:data()
+    self.recvs = {}
+    --服务端下一帧才切换到wsscodec
+    thread_mgr:sleep(50)
+    return resp
+end
+
+--收齐count个服务端帧
+function Client:read_frames(count)
+    local bytes = 0
+    wait(function()
+        local frames, used = read_frames(self:data())
+        if used > 0 then
+            local rest = self:data():sub(used + 1)
+            self.recvs = { rest }
+            bytes = bytes + used
+            for _, frame in ipairs(frames) do
+                self.frames[#self.frames + 1] = frame
+            end
+        end
+        return #self.frames >= count
+    end)
+    return bytes
+end
+
+function Client:use_codec(send_takeover, recv_takeover)
+    self.wcodec = wsscodec(jsoncodec())
+    self.wcodec.deflate(send_takeover, recv_takeover)
+    self.socket:set_codec(self.wcodec)
+end
+
+function Client:close()
+    self.socket:close()
+end
+
+local function random_text(size)
+    local chars = {}
+    for i = 1, size do
+        chars[i] = schar(97 + (i * 7919 + i // 13) % 26)
+    end
+    return tconcat(chars)
+end
+
+--解掩码吞吐: 帧按批次发送, 服务端收齐一批后唤醒发送方, 以进程cpu时间计算单帧开销
+local function bench_mask()
+    local received, valid, expect, target, block_id = 0, 0, nil, 0, nil
+    local server = WSServer(sformat("127.0.0.1:%d", PORT))
+    server:register_handler(function(socket, message)
+        received = received + 1
+        if message == expect then
+            valid = valid + 1
+        end
+        if block_id and received >= target then
+            local session_id = block_id
+            block_id = nil
+            thread_mgr:response(session_id, true)
+        end
+    end)
+    local client = Client(PORT)
+    client:handshake()
+    for _, case in ipairs(SIZES) do
+        local size, count = case[1], case[2]
+        local payload = random_text(size)
+        local frame = mask_frame(0x1, payload)
+        local batch = math.max(1, BATCH_BYTES // #frame)
+        local data = srep(frame, batch)
+        received, valid, expect = 0, 0, payload
+        collectgarbage("collect")
+        local sclock = oclock()
+        for i = 1, count, batch do
+            local n = math.min(batch, count - i + 1)
+            target, block_id = i + n - 1, thread_mgr:build_session_id()
+            client.socket:send(n == batch and data or srep(frame, n))
+            if received < target then
+                thread_mgr:yield(block_id, "ws_frame", TIMEOUT)
+            end
+            block_id = nil
+        end
+        local cost = oclock() - sclock
+        log_info("[ws_frame] mask {}B: {} frames cpu {} us/frame, {} MB/s, valid: {}", size, received,
+                sformat("%.2f", cost * 1000000 / count), sformat("%.1f", size * count / cost / 1048576), valid == count)
+    end
+    client:close()
+    server.listener:close()
+end
+
+--分片消息中间插入ping, 控制帧立即处理, 数据帧重组成完整消息
+local function check_fragment()
+    local messages = {}
+    local server = WSServer(sformat("127.0.0.1:%d", PORT + 1))
+    server:register_handler(function(socket, message)
+        messages[#messages + 1] = message
+    end)
+    local client = Client(PORT + 1)
+    client:handshake()
+    local big = random_text(40000)
+    client.socket:send(mask_frame(0x1, "hello ", false, "\x01\x02\x03\x04") .. mask_frame(0x9, "ping")
+            .. mask_frame(0x0, "fragmented ", false, "\x05\x06\x07\x08") .. mask_frame(0x0, "world", true, "\x09\x0a\x0b\x0c")
+            .. mask_frame(0x1, big, false) .. mask_frame(0x0, big, false) .. mask_frame(0x0, big, true))
+    wait(function() return #messages >= 2 end)
+    client:read_frames(1)
+    local pong = client.frames[1]
+    log_info("[ws_frame] fragment: small {}, large {}, pong {}", messages[1] == "hello fragmented world",
+            messages[2] == big .. big .. big, pong and pong.flag == 0x8A)
+    client:close()
+    server.listener:close()
+end
+
+local function position(i)
+    return sformat('{"cmd":"move","id":%d,"x":%.2f,"y":%.2f,"z":0.00,"dir":%d,"speed":%.1f,"ts":%d}',
+            10000 + i % 50, 1000 + i * 0.37, 2000 - i * 0.21, i % 360, 3.5, 1700000000000 + i * 33)
+end
+
+--压缩协商, 双向往返校验, 统计同一批位置同步消息压缩前后的网络字节数
+local function check_deflate()
+    local burst = 2000
+    local server = WSServer(sformat("127.0.0.1:%d", PORT + 2), true)
+    server:register_handler(function(socket, message)
+        if message == "burst" then
+            for i = 1, burst do
+                socket:send_frame(position(i))
+            end
+            return
+        end
+        socket:send_frame(message)
+    end)
+    for _, case in ipairs({ { "takeover", "permessage-deflate; client_max_window_bits; server_max_window_bits=15", true },
+                            { "no_takeover", "permessage-deflate; server_no_context_takeover; client_no_context_takeover", false } }) do
+        local name, offer, takeover = case[1], case[2], case[3]
+        local client = Client(PORT + 2)
+        local resp = client:handshake(offer)
+        local negotiated = sfind(resp, "Sec-WebSocket-Extensions: permessage-deflate", 1, true) ~= nil
+        local echo_takeover = sfind(resp, "server_no_context_takeover", 1, true) == nil
+        --提出了server_max_window_bits时回应中必须带上
+        local echo_wbits = (sfind(resp, "server_max_window_bits=15", 1, true) ~= nil) == (sfind(offer, "server_max_window_bits", 1, true) ~= nil)
+        client:use_codec(takeover, takeover)
+        local count, match = 500, 0
+        for i = 1, count do
+            client.socket:send_data(0x1, position(i))
+        end
+        wait(function() return #client.messages >= count end)
+        for i = 1, count do
+            if client.messages[i] == position(i) then
+                match = match + 1
+            end
+        end
+        log_info("[ws_frame] deflate {}: negotiated {}, takeover {}, window bits {}, roundtrip {}/{}", name, negotiated,
+                echo_takeover == takeover, echo_wbits, match, count)
+        client:close()
+    end
+    --与未协商压缩的连接对比下行字节数
+    local results = {}
+    for _, offer in ipairs({ false, "permessage-deflate" }) do
+        local client = Client(PORT + 2)
+        client:handshake(offer or nil)
+        collectgarbage("collect")
+        local sclock = oclock()
+        client.socket:send(mask_frame(0x1, "burst"))
+        local bytes = client:read_frames(burst)
+        local compressed = 0
+        for _, frame in ipairs(client.frames) do
+            if frame.flag & 0x40 == 0x40 then
+                compressed = compressed + 1
+            end
+        end
+        results[#results + 1] = { bytes = bytes, compressed = compressed, cost = oclock() - sclock }
+        client:close()
+    end
+    local raw, zip = results[1], results[2]
+    log_info("[ws_frame] deflate burst {} msgs: raw {} bytes ({} us/msg), deflate {} bytes ({} us/msg, {} compressed), ratio {}%",
+            burst, raw.bytes, sformat("%.2f", raw.cost * 1000000 / burst), zip.bytes, sformat("%.2f", zip.cost * 1000000 / burst),
+            zip.compressed, zip.bytes * 100 // math.max(raw.bytes, 1))
+    server.listener:close()
+end
+
+thread_mgr:fork(function()
+    bench_mask()
+    check_fragment()
+    check_deflate()
+end)
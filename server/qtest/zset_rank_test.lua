@@ -0,0 +1,175 @@
+--zset_rank_test.lua
+--排行榜测试: B+树与原跳表在随机更新/删除下的排名和区间结果一致, 批量导入, 以及百万条目的更新/排名吞吐和内存对比
+local log_info      = logger.info
+local log_err       = logger.err
+local oclock        = os.clock
+local tconcat       = table.concat
+
+local lzset         = require("lzset")
+
+local KEYS          = 20000
+local COUNT         = 1000000
+local ROUND         = 200000
+
+--固定种子的线性同余
+local function lcg(seed)
+    local state = seed
+    return function(n)
+        state = (state * 1103515245 + 12345) % 2147483648
+        --低位周期很短, 取高位
+        return (state >> 8) % n
+    end
+end
+
+local function flatten(list)
+    local out = {}
+    for i, item in ipairs(list or {}) do
+        out[i] = tconcat(item, ":")
+    end
+    return tconcat(out, ",")
+end
+
+--分数区间的期望结果: 从完整排名里过滤
+local function brute_score(full, min, max, limit)
+    local out = {}
+    for _, item in ipairs(full) do
+        if item[3] >= min and item[3] <= max and #out < limit then
+            out[#out + 1] = item
+        end
+    end
+    return flatten(out)
+end
+
+local function compare(tree, skip, rand)
+    local full = skip:range(1, -1) or {}
+    local valid = tree:size() == skip:size() and flatten(tree:range(1, -1)) == flatten(full)
+    for _ = 1, 200 do
+        local key, rank = 1 + rand(KEYS), 1 + rand(#full + 1)
+        local r1, s1 = tree:rank(key)
+        local r2, s2 = skip:rank(key)
+        local k1, v1 = tree:key_by_rank(rank)
+        local k2, v2 = skip:key_by_rank(rank)
+        valid = valid and r1 == r2 and s1 == s2 and k1 == k2 and v1 == v2
+        local start = 1 + rand(#full + 1)
+        local stop = start + rand(100)
+        valid = valid and flatten(tree:range(start, stop)) == flatten(skip:range(start, stop))
+        local min = rand(5000)
+        local max, limit = min + rand(200), 1 + rand(50)
+        local expect = brute_score(full, min, max, limit)
+        valid = valid and flatten(tree:range_by_score(min, max, limit)) == expect
+        valid = valid and flatten(skip:range_by_score(min, max, limit)) == expect
+    end
+    return valid
+end
+
+--同样的随机操作序列, 分数重复较多, 时间戳和key决定先后
+local function check_same(max_count, reverse)
+    local tree, skip = lzset.new(max_count, reverse), lzset.new_skiplist(max_count, reverse)
+    local rand, check = lcg(7), lcg(9)
+    local valid = true
+    for _ = 1, 8 do
+        for _ = 1, 20000 do
+            local key = 1 + rand(KEYS)
+            if rand(10) == 0 then
+                valid = valid and tree:erase(key) == skip:erase(key)
+            else
+                local score, ts = rand(5000), rand(100)
+                tree:update(key, score, ts)
+                skip:update(key, score, ts)
+            end
+        end
+        valid = valid and compare(tree, skip, check)
+    end
+    --删掉大部分条目, 节点合并后仍然一致
+    for key = 1, KEYS do
+        if key % 16 ~= 0 then
+            tree:erase(key)
+            skip:erase(key)
+        end
+    end
+    valid = valid and compare(tree, skip, check)
+    log_info("[zset_rank] max_count {} reverse {}: same as skiplist: {}, size {}", max_count, reverse, valid, tree:size())
+    if not valid then
+        log_err("[zset_rank] rank tree differs from skiplist")
+    end
+end
+
+--批量导入与逐个更新结果一致, 导入后继续更新也一致
+local function check_load()
+    local rand, check = lcg(21), lcg(23)
+    local tree, skip, items = lzset.new(KEYS), lzset.new_skiplist(KEYS), {}
+    for _ = 1, 30000 do
+        local key, score, ts = 1 + rand(KEYS), rand(5000), rand(100)
+        items[#items + 1], items[#items + 2], items[#items + 3] = key, score, ts
+        skip:update(key, score, ts)
+    end
+    --分两次导入, 后面的覆盖前面的
+    local half = #items // 6 * 3
+    tree:load(table.move(items, 1, half, 1, {}))
+    tree:load(table.move(items, half + 1, #items, 1, {}))
+    local valid = compare(tree, skip, check)
+    for _ = 1, 20000 do
+        local key, score, ts = 1 + rand(KEYS), rand(5000), rand(100)
+        tree:update(key, score, ts)
+        skip:update(key, score, ts)
+    end
+    valid = valid and compare(tree, skip, check)
+    --超过上限只保留前max_count个
+    local top, ltop = lzset.new(1000), lzset.new_skiplist(1000)
+    top:load(items)
+    ltop:load(items)
+    valid = valid and top:size() == 1000 and compare(top, ltop, check)
+    log_info("[zset_rank] load same as updates: {}, size {}", valid, tree:size())
+    if not valid then
+        log_err("[zset_rank] bulk load differs from updates")
+    end
+end
+
+local function cost_ns(count, func)
+    collectgarbage("collect")
+    local sclock = oclock()
+    for i = 1, count do
+        func(i)
+    end
+    return (oclock() - sclock) * 1000000000 // count
+end
+
+local function bench()
+    for _, kind in ipairs({ "tree", "skiplist" }) do
+        local zset = kind == "tree" and lzset.new(COUNT) or lzset.new_skiplist(COUNT)
+        local rand = lcg(31)
+        local insert = cost_ns(COUNT, function(i) zset:update(i, rand(1000000), i) end)
+        local update = cost_ns(ROUND, function(i) zset:update(1 + rand(COUNT), rand(1000000), i) end)
+        --活跃玩家小幅加分, 名次变化不大
+        local small = cost_ns(ROUND, function(i)
+            local key = 1 + rand(COUNT)
+            local _, score = zset:rank(key)
+            zset:update(key, score + rand(100), i)
+        end)
+        local rank = cost_ns(ROUND, function() zset:rank(1 + rand(COUNT)) end)
+        local by_rank = cost_ns(ROUND, function() zset:key_by_rank(1 + rand(COUNT)) end)
+        local top = cost_ns(ROUND // 100, function() zset:range(1, 100) end)
+        local middle = cost_ns(ROUND // 100, function() zset:range(COUNT // 2, COUNT // 2 + 99) end)
+        local bytes, per_entry = zset:memory()
+        log_info("[zset_rank] {} {} entries: insert {} ns, update {} ns, small update {} ns, rank {} ns, key_by_rank {} ns",
+                kind, COUNT, insert, update, small, rank, by_rank)
+        log_info("[zset_rank] {} range top100 {} ns, middle100 {} ns, memory {} MB, {} bytes/entry",
+                kind, top, middle, bytes // 1048576, string.format("%.1f", per_entry))
+        zset:clear()
+    end
+    --同样的数据批量导入
+    local rand, items = lcg(31), {}
+    for i = 1, COUNT do
+        items[#items + 1], items[#items + 2], items[#items + 3] = i, rand(1000000), i
+    end
+    local zset = lzset.new(COUNT)
+    local load = cost_ns(1, function() zset:load(items) end)
+    local _, per_entry = zset:memory()
+    log_info("[zset_rank] tree load {} entries: {} ms, {} bytes/entry", COUNT, load // 1000000, string.format("%.1f", per_entry))
+end
+
+check_same(KEYS, false)
+check_same(15000, false)
+check_same(15000, true)
+check_load()
+bench()
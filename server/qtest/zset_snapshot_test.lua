@@ -0,0 +1,189 @@
+--zset_snapshot_test.lua
+--排行榜持久化测试: 快照+更新日志重启后与原排行榜一致, 异常快照被拒绝, 以及百万条目的存储/恢复耗时和日志开销
+local log_info      = logger.info
+local log_err       = logger.err
+local oclock        = os.clock
+local tconcat       = table.concat
+
+local lzset         = require("lzset")
+
+local KEYS          = 20000
+local COUNT         = 1000000
+local ROUND         = 200000
+
+--固定种子的线性同余
+local function lcg(seed)
+    local state = seed
+    return function(n)
+        state = (state * 1103515245 + 12345) % 2147483648
+        --低位周期很短, 取高位
+        return (state >> 8) % n
+    end
+end
+
+local function flatten(zset)
+    local out = {}
+    for i, item in ipairs(zset:range(1, -1) or {}) do
+        out[i] = tconcat(item, ":")
+    end
+    return tconcat(out, ",")
+end
+
+local function random_ops(zset, rand, count)
+    for _ = 1, count do
+        local key = 1 + rand(KEYS)
+        if rand(10) == 0 then
+            zset:erase(key)
+        else
+            zset:update(key, rand(5000), rand(100))
+        end
+    end
+end
+
+--快照之后的修改只在日志里, 重启后恢复快照再回放日志
+local function check_restart(reverse)
+    local snap, wal = os.tmpname(), os.tmpname()
+    os.remove(wal)
+    local rand = lcg(7)
+    local zset = lzset.new(15000, reverse)
+    local ok = zset:open_log(wal)
+    random_ops(zset, rand, 50000)
+    local _, saved = zset:save(snap)
+    random_ops(zset, rand, 20000)
+    local items = {}
+    for i = 1, 3000 do
+        items[#items + 1], items[#items + 2], items[#items + 3] = i * 7, rand(5000), rand(100)
+    end
+    zset:load(items)
+    random_ops(zset, rand, 5000)
+    --不关闭原来的日志, 模拟进程直接退出
+    local restart = lzset.new(15000, reverse)
+    local restored, count = restart:restore(snap)
+    local replayed, records = restart:open_log(wal)
+    local valid = ok and restored and count == saved and replayed and flatten(restart) == flatten(zset)
+    --重启后继续写日志, 再次重启仍一致
+    random_ops(restart, rand, 5000)
+    local again = lzset.new(15000, reverse)
+    again:restore(snap)
+    again:open_log(wal)
+    valid = valid and flatten(again) == flatten(restart)
+    log_info("[zset_snapshot] reverse {}: restart same: {}, snapshot {} entries, replayed {} records", reverse, valid, count, records)
+    if not valid then
+        log_err("[zset_snapshot] restarted zset differs")
+    end
+    zset:close_log()
+    restart:close_log()
+    again:close_log()
+    os.remove(snap)
+    os.remove(wal)
+end
+
+--不存在/排序方向不同/截断/内容损坏的快照都被拒绝, 原有数据不受影响
+local function check_invalid()
+    local snap = os.tmpname()
+    local zset = lzset.new(1000)
+    for key = 1, 100 do
+        zset:update(key, key, 0)
+    end
+    zset:save(snap)
+    local missing = not lzset.new(1000):restore(snap .. ".none")
+    local order = not lzset.new(1000, true):restore(snap)
+    local file = io.open(snap, "rb")
+    local data = file:read("a")
+    file:close()
+    local function broken(content)
+        local f = io.open(snap, "wb")
+        f:write(content)
+        f:close()
+        local other = lzset.new(1000)
+        other:update(1, 1, 0)
+        local res, err = other:restore(snap)
+        return not res and other:size() == 1, err
+    end
+    local truncated = broken(data:sub(1, #data - 10))
+    local corrupted, err = broken(data:sub(1, 100) .. "x" .. data:sub(102))
+    log_info("[zset_snapshot] rejects missing: {}, order: {}, truncated: {}, corrupted: {} ({})", missing, order, truncated, corrupted, err)
+    --校验和正确但内容非法(重复key/乱序)时同样拒绝, 不清空原有数据
+    local function resign(entries)
+        local hash = 0xcbf29ce484222325
+        for pos = 1, #entries, 8 do
+            hash = (hash ~ string.unpack("<i8", entries, pos)) * 1099511628211
+        end
+        return data:sub(1, 32) .. string.pack("<i8", hash) .. entries
+    end
+    local entries = data:sub(41)
+    local first, second = entries:sub(1, 24), entries:sub(25, 48)
+    local dup_key = broken(resign(first .. first:sub(1, 8) .. second:sub(9) .. entries:sub(49)))
+    local unordered = broken(resign(second .. first .. entries:sub(49)))
+    log_info("[zset_snapshot] signed snapshot rejects duplicate: {}, unordered: {}", dup_key, unordered)
+    --重复写入相同的分数和时间不追加日志
+    local wal = os.tmpname()
+    os.remove(wal)
+    local logged = lzset.new(1000)
+    logged:open_log(wal)
+    for _ = 1, 100 do
+        logged:update(1, 10, 5)
+    end
+    local _, records = lzset.new(1000):open_log(wal)
+    log_info("[zset_snapshot] repeated identical update logs {} record", records)
+    logged:close_log()
+    os.remove(wal)
+    os.remove(snap)
+end
+
+local function cost_ms(func)
+    collectgarbage("collect")
+    local sclock = oclock()
+    func()
+    return (oclock() - sclock) * 1000 // 1
+end
+
+--重建方式对比: 逐条update(相当于从数据库读出后重建), 批量load, 快照恢复
+local function bench()
+    local snap, wal = os.tmpname(), os.tmpname()
+    os.remove(wal)
+    local rand, items = lcg(31), {}
+    for i = 1, COUNT do
+        items[#items + 1], items[#items + 2], items[#items + 3] = i, rand(1000000), i
+    end
+    local zset = lzset.new(COUNT)
+    local rebuild = cost_ms(function()
+        for i = 1, #items, 3 do
+            zset:update(items[i], items[i + 1], items[i + 2])
+        end
+    end)
+    local load = cost_ms(function() lzset.new(COUNT):load(items) end)
+    local save = cost_ms(function() zset:save(snap) end)
+    local file = io.open(snap, "rb")
+    local size = file:seek("end")
+    file:close()
+    local restart = lzset.new(COUNT)
+    local restore = cost_ms(function() restart:restore(snap) end)
+    local same = restart:size() == zset:size() and tconcat(restart:range(1, 1000)[1000], ":") == tconcat(zset:range(1, 1000)[1000], ":")
+    log_info("[zset_snapshot] {} entries: rebuild by update {} ms, load {} ms, save {} ms ({} MB), restore {} ms, same: {}",
+            COUNT, rebuild, load, save, size // 1048576, restore, same)
+    --日志开销: 同样的随机更新, 打开日志前后对比
+    local plain = cost_ms(function()
+        for i = 1, ROUND do
+            zset:update(1 + rand(COUNT), rand(1000000), i)
+        end
+    end)
+    zset:open_log(wal)
+    local logged = cost_ms(function()
+        for i = 1, ROUND do
+            zset:update(1 + rand(COUNT), rand(1000000), i)
+        end
+    end)
+    zset:close_log()
+    local replay = cost_ms(function() restart:open_log(wal) end)
+    restart:close_log()
+    log_info("[zset_snapshot] update {} ns, with log {} ns, replay {} records {} ms", plain * 1000000 // ROUND,
+            logged * 1000000 // ROUND, ROUND, replay)
+    os.remove(snap)
+    os.remove(wal)
+end
+
+check_restart(false)
+check_restart(true)
+check_invalid()
+bench()
@@ -1,6 +1,7 @@
 --statis_mgr.lua
 local LinuxStatis          = import("feature/linux.lua")
 local InfluxDB             = import("driver/influx.lua")
+local GrayLog              = import("driver/graylog.lua")
 
 local tsort                = table.sort
 local tinsert              = table.insert
@@ -19,6 +20,7 @@ local MaxMessageLen<const> = 32 * 1024
 local StatisMgr            = singleton()
 local prop                 = property(StatisMgr)
 prop:reader("influx", nil)              --influx
+prop:reader("graylog", nil)             --graylog
 prop:reader("statis", {})               --statis
 prop:reader("statis_status", false)     --统计开关
 prop:reader("linux_statis", nil)
@@ -39,6 +41,7 @@ function StatisMgr:__init()
         event_mgr:add_listener(self, "on_proto_recv")
         event_mgr:add_listener(self, "on_proto_send")
         event_mgr:add_listener(self, "on_conn_update")
+        event_mgr:add_listener(self, "on_frame_perf")
         --定时处理
         update_mgr:attach_second(self)
         update_mgr:attach_minute(self)
@@ -49,6 +52,8 @@ function StatisMgr:__init()
         end
         --influx
         self:init_influx()
+        --graylog
+        self.graylog = GrayLog()
         --counter
         self.rpc_send_count = hive.make_sampling("rpc_send")
         self.rpc_recv_count = hive.make_sampling("rpc_recv")
@@ -178,6 +183,24 @@ function StatisMgr:on_perfeval(eval_name, fields)
     end
 end
 
+-- 统计线程帧耗时分布(us)
+function StatisMgr:on_frame_perf(thread, stats)
+    if self.statis_status then
+        for phase, fields in pairs(stats) do
+            if fields.count > 0 then
+                if self.influx then
+                    self:write("frame", thread, phase, fields)
+                end
+                local optional = { _thread = thread, _phase = phase }
+                for key, value in pairs(fields) do
+                    optional["_" .. key] = value
+                end
+                self.graylog:write("frame_perf", 6, optional)
+            end
+        end
+    end
+end
+
 function StatisMgr:on_second()
     self:flush()
 end